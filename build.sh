@@ -18,9 +18,40 @@ elif [[ `uname` = Darwin ]]; then
     echo "argp not found - but will try building anyway"
   fi
 else
+  LIBS="$LIBS -lpthread"
   DEFS="-D_GNU_SOURCE"
 fi
 
-gcc -Wall -Wextra -Wno-unused-parameter -Wno-missing-field-initializers -O3 $DEFS $INCS -o decode6502 src/main.c src/memory.c src/em_6502.c src/em_65816.c src/em_6800.c src/profiler.c src/profiler_instr.c src/profiler_block.c src/profiler_call.c src/tube_decode.c src/musl_tsearch.c src/symbols.c $LIBS
+# Optional support for compressed captures, if the libraries are installed
+has_header() {
+  echo "#include <$1>" | gcc $INCS -E - > /dev/null 2>&1
+}
+
+COMPRESSION_DEFS=""
+COMPRESSION_LIBS=""
+
+if has_header zlib.h; then
+  COMPRESSION_DEFS="$COMPRESSION_DEFS -DHAVE_ZLIB"
+  COMPRESSION_LIBS="$COMPRESSION_LIBS -lz"
+fi
+if has_header zstd.h; then
+  COMPRESSION_DEFS="$COMPRESSION_DEFS -DHAVE_ZSTD"
+  COMPRESSION_LIBS="$COMPRESSION_LIBS -lzstd"
+fi
+if has_header lz4frame.h; then
+  COMPRESSION_DEFS="$COMPRESSION_DEFS -DHAVE_LZ4"
+  COMPRESSION_LIBS="$COMPRESSION_LIBS -llz4"
+fi
+
+gcc -Wall -Wextra -Wno-unused-parameter -Wno-missing-field-initializers -O3 $DEFS $COMPRESSION_DEFS $INCS -o decode6502 src/main.c src/capture.c src/checkpoint.c src/cycles.c src/disasm.c src/edges.c src/output.c src/parallel.c src/spsc_queue.c src/stats.c src/trace.c src/memory.c src/memlog.c src/em_6502.c src/em_65816.c src/em_6800.c src/profiler.c src/profiler_instr.c src/profiler_block.c src/profiler_call.c src/profiler_mem.c src/tube_decode.c src/musl_tsearch.c src/symbols.c $LIBS $COMPRESSION_LIBS
 
 gcc -Wall -Wextra -Wno-unused-parameter -Wno-missing-field-initializers -O3 -o matcher src/matcher.c
+
+gcc -Wall -Wextra -Wno-unused-parameter -Wno-missing-field-initializers -O3 $DEFS $INCS -o gencapture src/gencapture.c $LIBS
+
+gcc -Wall -Wextra -Wno-unused-parameter -Wno-missing-field-initializers -O3 $DEFS $INCS -o memquery src/memquery.c src/memlog.c $LIBS
+
+# ./build.sh bench also runs the throughput benchmark
+if [ "$1" == "bench" ]; then
+  cd test && ./run_bench.sh
+fi
@@ -0,0 +1,743 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <signal.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define HAVE_MMAP
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#define HAVE_INOTIFY
+#endif
+
+#include "capture.h"
+#include "spsc_queue.h"
+#include "stats.h"
+
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif
+
+// Compressed captures are supported when the libraries are available
+// (build.sh defines HAVE_ZLIB, HAVE_ZSTD and HAVE_LZ4)
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD) || defined(HAVE_LZ4)
+#define HAVE_COMPRESSION
+#endif
+
+#ifdef _MSC_VER
+#define fseeko _fseeki64
+#endif
+
+// Samples returned by each capture_read() from a memory mapped file
+// (small enough for the reader thread to keep a few chunks ahead)
+#define MAP_CHUNK (1 << 20)
+
+// Samples returned by each capture_read() in stdio mode
+#define BUFSIZE 8192
+
+static uint16_t buffer[BUFSIZE];
+
+static FILE *stream = NULL;
+
+static int sample_size = 2;
+
+// Memory mapped capture state
+static uint8_t *map_base = NULL;
+static size_t   map_size = 0;
+static size_t   map_pos  = 0;
+
+// Raw input from the stream, used by the decompressors, and to hold
+// the first few bytes that were read to identify the format
+#define INBUF_SIZE (1 << 17)
+
+static uint8_t inbuf[INBUF_SIZE];
+static size_t  in_pos = 0;
+static size_t  in_num = 0;
+
+// Read n bytes of an uncompressed capture from the stream
+static size_t read_raw(uint8_t *data, size_t n) {
+   size_t num = 0;
+   if (in_pos < in_num) {
+      num = in_num - in_pos < n ? in_num - in_pos : n;
+      memcpy(data, inbuf + in_pos, num);
+      in_pos += num;
+   }
+   return num + fread(data + num, 1, n - num, stream);
+}
+
+// Reads up to n bytes of the (decompressed) capture, returning fewer
+// only at the end
+static size_t (*read_input)(uint8_t *data, size_t n) = read_raw;
+
+// ==================================================
+// Compressed captures
+// ==================================================
+
+typedef enum {
+   FORMAT_RAW,
+   FORMAT_GZIP,
+   FORMAT_ZSTD,
+   FORMAT_LZ4
+} capture_format_t;
+
+static const char *format_names[] = { "raw", "gzip", "zstd", "lz4" };
+
+static capture_format_t format = FORMAT_RAW;
+
+static capture_format_t identify_format(const uint8_t *magic, size_t n) {
+   // Check the method is deflate and the reserved flag bits are clear, as a
+   // raw capture can easily start with the sample 8B1F
+   if (n >= 4 && magic[0] == 0x1f && magic[1] == 0x8b && magic[2] == 0x08 && (magic[3] & 0xe0) == 0) {
+      return FORMAT_GZIP;
+   }
+   if (n >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+      return FORMAT_ZSTD;
+   }
+   if (n >= 4 && magic[0] == 0x04 && magic[1] == 0x22 && magic[2] == 0x4d && magic[3] == 0x18) {
+      return FORMAT_LZ4;
+   }
+   return FORMAT_RAW;
+}
+
+#ifdef HAVE_COMPRESSION
+
+static int fill_input() {
+   if (in_pos < in_num) {
+      return 1;
+   }
+   in_pos = 0;
+   in_num = fread(inbuf, 1, INBUF_SIZE, stream);
+   return in_num > 0;
+}
+
+static void corrupt(const char *msg) {
+   fprintf(stderr, "corrupt %s compressed capture: %s\n", format_names[format], msg);
+}
+
+#endif
+
+#ifdef HAVE_ZLIB
+
+static z_stream zs;
+
+static size_t read_gzip(uint8_t *data, size_t n) {
+   zs.next_out  = data;
+   zs.avail_out = n;
+   while (zs.avail_out > 0) {
+      if (zs.avail_in == 0) {
+         if (!fill_input()) {
+            break;
+         }
+         zs.next_in  = inbuf + in_pos;
+         zs.avail_in = in_num - in_pos;
+         in_pos = in_num;
+      }
+      int ret = inflate(&zs, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END) {
+         // Continue with any concatenated gzip members
+         inflateReset(&zs);
+      } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+         corrupt(zs.msg ? zs.msg : "inflate failed");
+         break;
+      }
+   }
+   return n - zs.avail_out;
+}
+
+#endif
+
+#ifdef HAVE_ZSTD
+
+static ZSTD_DCtx *zstd_ctx = NULL;
+static ZSTD_inBuffer zstd_in;
+
+static size_t read_zstd(uint8_t *data, size_t n) {
+   ZSTD_outBuffer out = { data, n, 0 };
+   while (out.pos < out.size) {
+      if (zstd_in.pos == zstd_in.size) {
+         if (!fill_input()) {
+            break;
+         }
+         zstd_in.src  = inbuf + in_pos;
+         zstd_in.size = in_num - in_pos;
+         zstd_in.pos  = 0;
+         in_pos = in_num;
+      }
+      size_t ret = ZSTD_decompressStream(zstd_ctx, &out, &zstd_in);
+      if (ZSTD_isError(ret)) {
+         corrupt(ZSTD_getErrorName(ret));
+         break;
+      }
+   }
+   return out.pos;
+}
+
+// The zstd seekable format ends with a seek table giving the compressed
+// and decompressed size of each frame:
+//
+//    entries: compressed size (32 bits), decompressed size (32 bits),
+//             optionally a checksum (32 bits)
+//    footer:  number of frames (32 bits), descriptor (8 bits, bit 7
+//             set if there are checksums), magic number (32 bits)
+//
+// This allows --skip to seek to the frame containing the first sample.
+//
+// Returns the number of bytes of the decompressed capture skipped.
+
+#define ZSTD_SEEKABLE_MAGIC 0x8F92EAB1
+#define ZSTD_SEEKABLE_FOOTER_SIZE 9
+
+static uint32_t get_le32(const uint8_t *bp) {
+   return bp[0] | (bp[1] << 8) | (bp[2] << 16) | ((uint32_t) bp[3] << 24);
+}
+
+static uint64_t seek_zstd(uint64_t skip) {
+   uint8_t footer[ZSTD_SEEKABLE_FOOTER_SIZE];
+   if (fseeko(stream, -ZSTD_SEEKABLE_FOOTER_SIZE, SEEK_END) < 0 || fread(footer, 1, sizeof(footer), stream) != sizeof(footer) || get_le32(footer + 5) != ZSTD_SEEKABLE_MAGIC) {
+      fseeko(stream, in_num, SEEK_SET);
+      return 0;
+   }
+   uint32_t num_frames = get_le32(footer);
+   int entry_size = (footer[4] & 0x80) ? 12 : 8;
+   fseeko(stream, -(ZSTD_SEEKABLE_FOOTER_SIZE + (int64_t) num_frames * entry_size), SEEK_END);
+   uint64_t compressed = 0;
+   uint64_t decompressed = 0;
+   for (uint32_t i = 0; i < num_frames; i++) {
+      uint8_t entry[12];
+      if (fread(entry, 1, entry_size, stream) != (size_t) entry_size || decompressed + get_le32(entry + 4) > skip) {
+         break;
+      }
+      compressed   += get_le32(entry);
+      decompressed += get_le32(entry + 4);
+   }
+   fseeko(stream, compressed, SEEK_SET);
+   in_pos = in_num = 0;
+   return decompressed;
+}
+
+#endif
+
+#ifdef HAVE_LZ4
+
+static LZ4F_dctx *lz4_ctx = NULL;
+
+static size_t read_lz4(uint8_t *data, size_t n) {
+   size_t num = 0;
+   while (num < n) {
+      if (!fill_input()) {
+         break;
+      }
+      size_t dst_size = n - num;
+      size_t src_size = in_num - in_pos;
+      size_t ret = LZ4F_decompress(lz4_ctx, data + num, &dst_size, inbuf + in_pos, &src_size, NULL);
+      if (LZ4F_isError(ret)) {
+         corrupt(LZ4F_getErrorName(ret));
+         break;
+      }
+      in_pos += src_size;
+      num += dst_size;
+   }
+   return num;
+}
+
+#endif
+
+// Returns 0 on success, or -1 if the format is not supported by this build
+static int open_decompressor() {
+   switch (format) {
+#ifdef HAVE_ZLIB
+   case FORMAT_GZIP:
+      memset(&zs, 0, sizeof(zs));
+      // Window size 15, plus 32 to detect the gzip header
+      if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+         return -1;
+      }
+      read_input = read_gzip;
+      return 0;
+#endif
+#ifdef HAVE_ZSTD
+   case FORMAT_ZSTD:
+      zstd_ctx = ZSTD_createDCtx();
+      memset(&zstd_in, 0, sizeof(zstd_in));
+      read_input = read_zstd;
+      return 0;
+#endif
+#ifdef HAVE_LZ4
+   case FORMAT_LZ4:
+      if (LZ4F_isError(LZ4F_createDecompressionContext(&lz4_ctx, LZ4F_VERSION))) {
+         return -1;
+      }
+      read_input = read_lz4;
+      return 0;
+#endif
+   default:
+      return -1;
+   }
+}
+
+static void close_decompressor() {
+#ifdef HAVE_ZLIB
+   if (format == FORMAT_GZIP) {
+      inflateEnd(&zs);
+   }
+#endif
+#ifdef HAVE_ZSTD
+   if (zstd_ctx) {
+      ZSTD_freeDCtx(zstd_ctx);
+      zstd_ctx = NULL;
+   }
+#endif
+#ifdef HAVE_LZ4
+   if (lz4_ctx) {
+      LZ4F_freeDecompressionContext(lz4_ctx);
+      lz4_ctx = NULL;
+   }
+#endif
+   read_input = read_raw;
+   format = FORMAT_RAW;
+}
+
+// Skip the start of the capture by reading and discarding it
+static void discard_input(uint64_t n) {
+   while (n > 0) {
+      size_t num = read_input((uint8_t *) buffer, n < sizeof(buffer) ? n : sizeof(buffer));
+      if (num == 0) {
+         break;
+      }
+      n -= num;
+   }
+}
+
+#ifdef HAVE_MMAP
+
+// Try to memory map the capture, which only works for regular files
+static int capture_map(int64_t skip) {
+   struct stat st;
+   int fd = fileno(stream);
+   if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+      return 0;
+   }
+   if ((uint64_t) st.st_size > (size_t) -1) {
+      // Too big for the address space (e.g. a 32-bit build)
+      return 0;
+   }
+   void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (base == MAP_FAILED) {
+      return 0;
+   }
+   map_base = (uint8_t *) base;
+   map_size = st.st_size;
+   // The capture is streamed through once from start to end
+#ifdef MADV_SEQUENTIAL
+   madvise(base, map_size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+   madvise(base, map_size, MADV_HUGEPAGE);
+#endif
+   // Skipping is just an offset into the mapping
+   uint64_t offset = skip * sample_size;
+   map_pos = offset < map_size ? offset : map_size;
+   return 1;
+}
+
+#endif
+
+// ==================================================
+// Following a growing capture
+// ==================================================
+
+// With capture_follow(), reaching the end of the capture waits (using
+// inotify) for the writer to append more, until the writer closes the
+// file or capture_stop_following() is called.
+
+static int follow = 0;
+
+#ifdef HAVE_INOTIFY
+
+static void (*follow_idle)() = NULL;
+
+static int inotify_fd = -1;
+
+// capture_stop_following() may be called from a signal handler, so it
+// just sets a flag, and wakes up any wait through a pipe
+static volatile sig_atomic_t stop_requested = 0;
+static int stop_pipe[2] = { -1, -1 };
+
+// Set once the writer has closed the capture
+static int writer_closed = 0;
+
+// Wait until the capture has grown, returning 0 if it never will
+static int wait_for_data() {
+   struct pollfd fds[2] = {
+      { inotify_fd,   POLLIN, 0 },
+      { stop_pipe[0], POLLIN, 0 }
+   };
+   while (!stop_requested) {
+      if (poll(fds, 2, -1) < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return 0;
+      }
+      if (fds[1].revents) {
+         return 0;
+      }
+      union {
+         struct inotify_event event;
+         char data[4096];
+      } events;
+      ssize_t n = read(inotify_fd, &events, sizeof(events));
+      int closed = n <= 0;
+      for (char *p = events.data; p < events.data + n; ) {
+         const struct inotify_event *event = (const struct inotify_event *) p;
+         if (event->mask & (IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)) {
+            closed = 1;
+         }
+         p += sizeof(struct inotify_event) + event->len;
+      }
+      return !closed;
+   }
+   return 0;
+}
+
+// Read n bytes of the capture, waiting for the writer when there are
+// none (any partial sample is kept back for the next read)
+static size_t read_follow(uint8_t *data, size_t n) {
+   while (!stop_requested) {
+      size_t num = read_raw(data, n);
+      clearerr(stream);
+      size_t partial = num % sample_size;
+      if (partial) {
+         num -= partial;
+         memcpy(inbuf, data + num, partial);
+         in_pos = 0;
+         in_num = partial;
+      }
+      if (num > 0 || writer_closed) {
+         return num;
+      }
+      if (follow_idle) {
+         follow_idle();
+      }
+      writer_closed = !wait_for_data();
+   }
+   return 0;
+}
+
+static int open_follow(const char *filename) {
+   inotify_fd = inotify_init();
+   if (inotify_fd < 0) {
+      return -1;
+   }
+   if (inotify_add_watch(inotify_fd, filename, IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+      close(inotify_fd);
+      inotify_fd = -1;
+      return -1;
+   }
+   writer_closed = 0;
+   read_input = read_follow;
+   return 0;
+}
+
+static void close_follow() {
+   if (inotify_fd >= 0) {
+      close(inotify_fd);
+      inotify_fd = -1;
+   }
+   read_input = read_raw;
+}
+
+int capture_follow(void (*idle)()) {
+   if (stop_pipe[0] < 0 && pipe(stop_pipe) < 0) {
+      return -1;
+   }
+   follow = 1;
+   follow_idle = idle;
+   return 0;
+}
+
+void capture_stop_following() {
+   stop_requested = 1;
+   if (stop_pipe[1] >= 0) {
+      char c = 0;
+      ssize_t n = write(stop_pipe[1], &c, 1);
+      (void) n;
+   }
+}
+
+int capture_writer_closed() {
+   return writer_closed && !stop_requested;
+}
+
+#else
+
+int capture_follow(void (*idle)()) {
+   return -1;
+}
+
+void capture_stop_following() {
+}
+
+int capture_writer_closed() {
+   return 0;
+}
+
+#endif
+
+int capture_open(const char *filename, int size, int64_t skip) {
+   sample_size = size;
+   if (!filename || !strcmp(filename, "-")) {
+      stream = stdin;
+   } else {
+      stream = fopen(filename, "rb");
+      if (stream == NULL) {
+         return -1;
+      }
+   }
+   // Identify the format from the first few bytes
+   in_pos = 0;
+   in_num = fread(inbuf, 1, 4, stream);
+   format = identify_format(inbuf, in_num);
+#ifdef HAVE_INOTIFY
+   if (follow) {
+      // Only a raw capture file can be followed, and it is read with
+      // stdio, as a mapping would not grow with the file
+      if (format != FORMAT_RAW || stream == stdin || open_follow(filename) < 0) {
+         format = FORMAT_RAW;
+         if (stream != stdin) {
+            fclose(stream);
+         }
+         stream = NULL;
+         errno = EINVAL;
+         return -1;
+      }
+      // (the file may not yet reach the first sample)
+      fseeko(stream, skip * sample_size, SEEK_SET);
+      in_num = 0;
+      return 0;
+   }
+#endif
+   if (format != FORMAT_RAW) {
+      if (open_decompressor() < 0) {
+         fprintf(stderr, "%s compressed captures are not supported by this build\n", format_names[format]);
+         format = FORMAT_RAW;
+         fclose(stream);
+         stream = NULL;
+         errno = EINVAL;
+         return -1;
+      }
+      uint64_t skip_bytes = skip * sample_size;
+#ifdef HAVE_ZSTD
+      if (format == FORMAT_ZSTD && skip_bytes > 0) {
+         skip_bytes -= seek_zstd(skip_bytes);
+      }
+#endif
+      discard_input(skip_bytes);
+#ifdef HAVE_THREADS
+      // Decompress on the reader thread, so it overlaps with decoding
+      capture_start_thread();
+#endif
+      return 0;
+   }
+#ifdef HAVE_MMAP
+   if (capture_map(skip)) {
+      in_num = 0;
+      return 0;
+   }
+#endif
+   // Fall back to stdio (e.g. for pipes)
+   if (skip) {
+      if (fseek(stream, skip * sample_size, SEEK_SET) == 0) {
+         in_num = 0;
+      } else {
+         // Not seekable, so read and discard the samples
+         discard_input(skip * sample_size);
+      }
+   } else if (fseek(stream, 0, SEEK_SET) == 0) {
+      in_num = 0;
+   }
+   return 0;
+}
+
+int capture_is_compressed(const char *filename) {
+   uint8_t magic[4];
+   FILE *f = fopen(filename, "rb");
+   if (!f) {
+      return 0;
+   }
+   size_t n = fread(magic, 1, sizeof(magic), f);
+   fclose(f);
+   return identify_format(magic, n) != FORMAT_RAW;
+}
+
+static int read_samples(const void **samples, uint16_t *buf) {
+   int num;
+   uint64_t t = stats_start();
+   if (map_base) {
+      size_t n = (map_size - map_pos) / sample_size;
+      num = n > MAP_CHUNK ? MAP_CHUNK : n;
+      *samples = map_base + map_pos;
+      map_pos += num * sample_size;
+   } else {
+      *samples = buf;
+      num = read_input((uint8_t *) buf, BUFSIZE * sizeof(uint16_t)) / sample_size;
+   }
+   stats_stop(TIMER_READ, t);
+   stats_add(STAT_BYTES_READ, num * sample_size);
+   return num;
+}
+
+#ifdef HAVE_THREADS
+
+// ==================================================
+// Reader thread
+// ==================================================
+
+// A pool of buffers circulates between the reader thread and the
+// consumer, so reading overlaps with decoding.
+
+#define NUM_READ_BUFFERS 8
+
+typedef struct {
+   const void *samples;
+   int num;
+   uint16_t data[BUFSIZE];
+} read_buffer_t;
+
+static read_buffer_t *read_pool = NULL;
+static read_buffer_t *current   = NULL;
+static spsc_queue_t *full_q;
+static spsc_queue_t *free_q;
+static pthread_t reader;
+
+static void *reader_thread(void *arg) {
+   read_buffer_t *rb;
+   do {
+      rb = spsc_queue_pop(free_q);
+      rb->num = read_samples(&rb->samples, rb->data);
+      if (map_base) {
+         // Fault in the pages here, rather than in the consumer
+         volatile const uint8_t *p = rb->samples;
+         for (size_t i = 0; i < (size_t) rb->num * sample_size; i += 4096) {
+            (void) p[i];
+         }
+      }
+      spsc_queue_push(full_q, rb);
+   } while (rb->num > 0);
+   return NULL;
+}
+
+int capture_start_thread() {
+   if (read_pool) {
+      // Already started (for a compressed capture)
+      return 0;
+   }
+   if (follow) {
+      // A followed capture is read on the extraction thread, which is
+      // where the idle function must be called
+      return 0;
+   }
+   read_pool = (read_buffer_t *)malloc(NUM_READ_BUFFERS * sizeof(read_buffer_t));
+   full_q = spsc_queue_create();
+   free_q = spsc_queue_create();
+   for (int i = 0; i < NUM_READ_BUFFERS; i++) {
+      spsc_queue_push(free_q, read_pool + i);
+   }
+   if (pthread_create(&reader, NULL, reader_thread, NULL)) {
+      spsc_queue_destroy(full_q);
+      spsc_queue_destroy(free_q);
+      free(read_pool);
+      read_pool = NULL;
+      return -1;
+   }
+   return 0;
+}
+
+static int read_from_thread(const void **samples) {
+   if (current) {
+      if (current->num == 0) {
+         // The reader thread has already finished
+         return 0;
+      }
+      spsc_queue_push(free_q, current);
+   }
+   current = spsc_queue_pop(full_q);
+   *samples = current->samples;
+   return current->num;
+}
+
+static void stop_thread() {
+   // Drain the reader, in case the consumer stopped early
+   while (!current || current->num > 0) {
+      const void *samples;
+      read_from_thread(&samples);
+   }
+   pthread_join(reader, NULL);
+   spsc_queue_destroy(full_q);
+   spsc_queue_destroy(free_q);
+   free(read_pool);
+   read_pool = NULL;
+   current = NULL;
+}
+
+#else
+
+int capture_start_thread() {
+   return -1;
+}
+
+#endif
+
+int capture_read(const void **samples) {
+#ifdef HAVE_THREADS
+   if (read_pool) {
+      return read_from_thread(samples);
+   }
+#endif
+   return read_samples(samples, buffer);
+}
+
+void capture_close() {
+#ifdef HAVE_THREADS
+   if (read_pool) {
+      stop_thread();
+   }
+#endif
+#ifdef HAVE_MMAP
+   if (map_base) {
+      munmap(map_base, map_size);
+      map_base = NULL;
+   }
+#endif
+#ifdef HAVE_INOTIFY
+   if (follow) {
+      close_follow();
+   }
+#endif
+   if (format != FORMAT_RAW) {
+      close_decompressor();
+   }
+   if (stream) {
+      fclose(stream);
+      stream = NULL;
+   }
+}
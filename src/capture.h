@@ -0,0 +1,53 @@
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <inttypes.h>
+
+// Open a capture file of sample_size byte samples (1 or 2), skipping
+// the first skip samples. If filename is NULL or "-" then stdin is used.
+//
+// Captures compressed with gzip, zstd or lz4 are recognised by their
+// magic number (where supported by the build), and decompressed on the
+// reader thread. With --skip, zstd captures in the seekable format are
+// read from the frame containing the first sample, otherwise the start
+// of a compressed capture is decompressed and discarded.
+//
+// Returns 0 on success, or -1 on failure (with errno set).
+int capture_open(const char *filename, int sample_size, int64_t skip);
+
+// Returns 1 if the file is a compressed capture
+int capture_is_compressed(const char *filename);
+
+// Return the number of samples available at *samples, or 0 at the end
+// of the capture. The samples remain valid until the next call.
+//
+// Where possible the file is memory mapped, and *samples points
+// directly into the mapping, so no copying takes place.
+int capture_read(const void **samples);
+
+// Move reading onto a separate thread, so it overlaps with decoding.
+//
+// Returns 0 on success, or -1 if threads are not available.
+int capture_start_thread();
+
+// Follow a capture that is still being written: at the end of the file,
+// wait for more to be appended rather than ending the capture, until
+// the writer closes the file or capture_stop_following() is called. The
+// idle function (if not NULL) is called before each wait. Must be called
+// before capture_open(), and is only supported for uncompressed capture
+// files.
+//
+// Returns 0 on success, or -1 if not supported on this platform.
+int capture_follow(void (*idle)());
+
+// Stop following the capture, so the next read ends it (this is safe to
+// call from a signal handler)
+void capture_stop_following();
+
+// Returns 1 if following ended because the writer closed the capture (so
+// it is complete), rather than because it was stopped
+int capture_writer_closed();
+
+void capture_close();
+
+#endif
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "checkpoint.h"
+#include "profiler.h"
+
+#ifdef _MSC_VER
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+// File format (all values little endian):
+//
+// The checkpoint file starts with a 24 byte header:
+//    0: "6502CKP" followed by the version number
+//    8: cpu type
+//    9: machine
+//   10: byte mode (1 if the capture is one byte per sample)
+//   11: options (bit 0 = profiler state present)
+//   16: --skip (64 bits)
+//
+// Each checkpoint is then:
+//    record size (32 bits), including the size itself
+//    start (64 bits)
+//    sample count (32 bits)
+//    flags (8 bits, bit 0 = triggered, bit 1 = reset in progress)
+//    number of emulator state values (8 bits)
+//    emulator state values (32 bits each)
+//    memory model state (see memory_save)
+//    profiler state (see profiler_save), if present
+//
+// The checkpoints are in increasing order of sample count. A resume file
+// has the same format, with just one checkpoint.
+
+#define CHECKPOINT_VERSION 2
+
+#define HEADER_SIZE 24
+#define RECORD_SIZE 18
+
+#define FLAG_TRIGGERED 0x01
+#define FLAG_RESET     0x02
+
+#define OPT_PROFILER   0x01
+
+#define IO_BUFFER_SIZE (1 << 20)
+
+static FILE *checkpoint_file = NULL;
+
+static int options;
+
+static void put_le(uint8_t *bp, uint64_t value, int n) {
+   for (int i = 0; i < n; i++) {
+      *bp++ = value & 0xff;
+      value >>= 8;
+   }
+}
+
+static uint64_t get_le(const uint8_t *bp, int n) {
+   uint64_t value = 0;
+   for (int i = n - 1; i >= 0; i--) {
+      value = (value << 8) | bp[i];
+   }
+   return value;
+}
+
+static char *checkpoint_filename(const char *capture, const char *ext) {
+   char *name = malloc(strlen(capture) + strlen(ext) + 1);
+   strcpy(name, capture);
+   strcat(name, ext);
+   return name;
+}
+
+static void make_header(uint8_t *header, cpu_t cpu_type, machine_t machine, int byte, int64_t skip, int opts) {
+   memset(header, 0, HEADER_SIZE);
+   memcpy(header, "6502CKP", 7);
+   header[7] = CHECKPOINT_VERSION;
+   header[8] = cpu_type;
+   header[9] = machine;
+   header[10] = byte;
+   header[11] = opts;
+   put_le(header + 16, skip, 8);
+}
+
+// ==================================================
+// Writing
+// ==================================================
+
+static int create(const char *capture, const char *ext, cpu_t cpu_type, machine_t machine, int byte, int64_t skip, int opts) {
+   char *filename = checkpoint_filename(capture, ext);
+   checkpoint_file = fopen(filename, "wb");
+   free(filename);
+   if (!checkpoint_file) {
+      return -1;
+   }
+   setvbuf(checkpoint_file, NULL, _IOFBF, IO_BUFFER_SIZE);
+   options = opts;
+   uint8_t header[HEADER_SIZE];
+   make_header(header, cpu_type, machine, byte, skip, options);
+   fwrite(header, 1, sizeof(header), checkpoint_file);
+   return 0;
+}
+
+int checkpoint_create(const char *capture, cpu_t cpu_type, machine_t machine, int byte, int64_t skip) {
+   return create(capture, ".ckpt", cpu_type, machine, byte, skip, 0);
+}
+
+void checkpoint_write(const checkpoint_t *checkpoint, cpu_emulator_t *em, void *cpu, memory_t *mem) {
+   int state[EM_MAX_STATE];
+   int n = em->save_state(cpu, state);
+   uint8_t record[RECORD_SIZE + EM_MAX_STATE * 4];
+   put_le(record + 4, checkpoint->start, 8);
+   put_le(record + 12, checkpoint->sample_count, 4);
+   record[16] = (checkpoint->triggered ? FLAG_TRIGGERED : 0) | (checkpoint->reset ? FLAG_RESET : 0);
+   record[17] = n;
+   for (int i = 0; i < n; i++) {
+      put_le(record + RECORD_SIZE + i * 4, (uint32_t) state[i], 4);
+   }
+   // The size of the memory model state is only known once written
+   int64_t offset = ftello(checkpoint_file);
+   fwrite(record, 1, RECORD_SIZE + n * 4, checkpoint_file);
+   memory_save(mem, checkpoint_file);
+   if (options & OPT_PROFILER) {
+      profiler_save(checkpoint_file);
+   }
+   int64_t end = ftello(checkpoint_file);
+   put_le(record, end - offset, 4);
+   fseeko(checkpoint_file, offset, SEEK_SET);
+   fwrite(record, 1, 4, checkpoint_file);
+   fseeko(checkpoint_file, end, SEEK_SET);
+}
+
+void checkpoint_close() {
+   if (checkpoint_file) {
+      fclose(checkpoint_file);
+      checkpoint_file = NULL;
+   }
+}
+
+int checkpoint_save_resume(const char *capture, cpu_t cpu_type, machine_t machine, int byte, int64_t skip,
+                           const checkpoint_t *checkpoint, cpu_emulator_t *em, void *cpu, memory_t *mem) {
+   if (create(capture, ".resume", cpu_type, machine, byte, skip, OPT_PROFILER) < 0) {
+      return -1;
+   }
+   checkpoint_write(checkpoint, em, cpu, mem);
+   int ret = ferror(checkpoint_file) ? -1 : 0;
+   checkpoint_close();
+   return ret;
+}
+
+// ==================================================
+// Restoring
+// ==================================================
+
+// Find the last checkpoint at or before sample_count, reading its
+// options and the start of its record.
+//
+// Returns 0 on success, or -1 on failure (with a message on stderr).
+static int find_checkpoint(FILE *f, const char *filename, cpu_t cpu_type, machine_t machine, int byte, int64_t skip,
+                           uint32_t sample_count, int *opts, uint8_t *record) {
+   uint8_t header[HEADER_SIZE];
+   uint8_t expected[HEADER_SIZE];
+   if (fread(header, 1, HEADER_SIZE, f) != HEADER_SIZE) {
+      fprintf(stderr, "%s is not a checkpoint file\n", filename);
+      return -1;
+   }
+   *opts = header[11];
+   make_header(expected, cpu_type, machine, byte, skip, *opts);
+   if (memcmp(header, expected, 8)) {
+      fprintf(stderr, "%s is not a checkpoint file\n", filename);
+      return -1;
+   }
+   if (memcmp(header, expected, HEADER_SIZE)) {
+      fprintf(stderr, "%s was made with a different --cpu, --machine, --byte or --skip\n", filename);
+      return -1;
+   }
+   int64_t offset = HEADER_SIZE;
+   int64_t found = -1;
+   while (fseeko(f, offset, SEEK_SET) == 0 && fread(record, 1, RECORD_SIZE, f) == RECORD_SIZE) {
+      if (get_le(record + 12, 4) > sample_count) {
+         break;
+      }
+      found = offset;
+      offset += get_le(record, 4);
+   }
+   if (found < 0) {
+      fprintf(stderr, "%s has no checkpoint at or before sample %08" PRIx32 "\n", filename, sample_count);
+      return -1;
+   }
+   if (fseeko(f, found, SEEK_SET) < 0 || fread(record, 1, RECORD_SIZE, f) != RECORD_SIZE) {
+      fprintf(stderr, "%s is corrupt\n", filename);
+      return -1;
+   }
+   return 0;
+}
+
+// Restore the rest of the record found by find_checkpoint
+static int restore_checkpoint(FILE *f, const char *filename, int opts, uint8_t *record,
+                              checkpoint_t *checkpoint, cpu_emulator_t *em, void *cpu, memory_t *mem) {
+   // The number of state values must match this emulator
+   int state[EM_MAX_STATE];
+   int n = em->save_state(cpu, state);
+   if (record[17] != n || fread(record + RECORD_SIZE, 1, n * 4, f) != (size_t) n * 4) {
+      fprintf(stderr, "%s is corrupt\n", filename);
+      return -1;
+   }
+   for (int i = 0; i < n; i++) {
+      state[i] = (int32_t) get_le(record + RECORD_SIZE + i * 4, 4);
+   }
+   if (memory_restore(mem, f) < 0) {
+      fprintf(stderr, "%s is truncated\n", filename);
+      return -1;
+   }
+   if ((opts & OPT_PROFILER) && profiler_restore(f) < 0) {
+      fprintf(stderr, "%s was made with different --profile options\n", filename);
+      return -1;
+   }
+   em->restore_state(cpu, state);
+   checkpoint->start        = get_le(record + 4, 8);
+   checkpoint->sample_count = get_le(record + 12, 4);
+   checkpoint->triggered    = (record[16] & FLAG_TRIGGERED) != 0;
+   checkpoint->reset        = (record[16] & FLAG_RESET) != 0;
+   return 0;
+}
+
+int checkpoint_restore(const char *capture, cpu_t cpu_type, machine_t machine, int byte, int64_t skip,
+                       uint32_t sample_count, checkpoint_t *checkpoint, cpu_emulator_t *em, void *cpu, memory_t *mem) {
+   char *filename = checkpoint_filename(capture, ".ckpt");
+   FILE *f = fopen(filename, "rb");
+   uint8_t record[RECORD_SIZE + EM_MAX_STATE * 4];
+   int opts;
+   int ret = -1;
+   if (!f) {
+      perror(filename);
+   } else {
+      if (find_checkpoint(f, filename, cpu_type, machine, byte, skip, sample_count, &opts, record) == 0) {
+         ret = restore_checkpoint(f, filename, opts, record, checkpoint, em, cpu, mem);
+      }
+      fclose(f);
+   }
+   free(filename);
+   return ret;
+}
+
+// A capture that is now shorter than the resume point has been replaced
+// since the state was saved
+static int capture_replaced(const char *capture, int64_t size) {
+   FILE *f = fopen(capture, "rb");
+   int replaced = 0;
+   if (f) {
+      replaced = fseeko(f, 0, SEEK_END) == 0 && ftello(f) < size;
+      fclose(f);
+   }
+   return replaced;
+}
+
+int checkpoint_resume(const char *capture, cpu_t cpu_type, machine_t machine, int byte, int64_t skip,
+                      checkpoint_t *checkpoint, cpu_emulator_t *em, void *cpu, memory_t *mem) {
+   char *filename = checkpoint_filename(capture, ".resume");
+   FILE *f = fopen(filename, "rb");
+   uint8_t record[RECORD_SIZE + EM_MAX_STATE * 4];
+   int opts;
+   int ret = 1;
+   if (f) {
+      ret = find_checkpoint(f, filename, cpu_type, machine, byte, skip, UINT32_MAX, &opts, record);
+      if (ret == 0 && capture_replaced(capture, (skip + (int64_t) get_le(record + 4, 8)) * (byte ? 1 : 2))) {
+         fprintf(stderr, "%s is for an earlier capture, ignoring it\n", filename);
+         ret = 1;
+      } else if (ret == 0) {
+         ret = restore_checkpoint(f, filename, opts, record, checkpoint, em, cpu, mem);
+      }
+      fclose(f);
+   }
+   free(filename);
+   return ret;
+}
+
+int checkpoint_remove_resume(const char *capture) {
+   char *filename = checkpoint_filename(capture, ".resume");
+   int ret = remove(filename);
+   free(filename);
+   return ret;
+}
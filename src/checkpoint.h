@@ -0,0 +1,64 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <inttypes.h>
+
+#include "defs.h"
+#include "memory.h"
+
+// A checkpoint file holds snapshots of the emulator state (the registers
+// and the modelled memory) taken every so often while decoding a capture,
+// so a later decode of the same capture can start from any point without
+// emulating everything that came before. It is written alongside the
+// capture, in <capture>.ckpt.
+//
+// When following a capture that is still being written (--follow), a
+// single checkpoint is written on exit, in <capture>.resume, which also
+// includes the profiler state, so the next run carries on from there.
+
+// The position of a checkpoint in the capture
+typedef struct {
+   int64_t  start;         // the sample to start extracting from (after --skip)
+   uint32_t sample_count;  // the sample number of the first instruction to decode
+   int      triggered;     // the state of --trigger at that instruction
+   int      reset;         // set if a reset was in progress
+} checkpoint_t;
+
+// Create a checkpoint file for a capture, recording what must match for
+// the checkpoints to be restored later.
+//
+// Returns 0 on success, or -1 on failure (with errno set).
+int checkpoint_create(const char *capture, cpu_t cpu_type, machine_t machine, int byte, int64_t skip);
+
+void checkpoint_write(const checkpoint_t *checkpoint, cpu_emulator_t *em, void *cpu, memory_t *mem);
+
+void checkpoint_close();
+
+// Write the state to resume from, replacing any previous state.
+//
+// Returns 0 on success, or -1 on failure (with errno set).
+int checkpoint_save_resume(const char *capture, cpu_t cpu_type, machine_t machine, int byte, int64_t skip,
+                           const checkpoint_t *checkpoint, cpu_emulator_t *em, void *cpu, memory_t *mem);
+
+// Restore the state saved by the previous run into the emulator, memory
+// model and profilers.
+//
+// Returns 0 on success, 1 if there is no saved state (or it is for an
+// earlier capture that has since been replaced), or -1 on failure (with a
+// message on stderr).
+int checkpoint_resume(const char *capture, cpu_t cpu_type, machine_t machine, int byte, int64_t skip,
+                      checkpoint_t *checkpoint, cpu_emulator_t *em, void *cpu, memory_t *mem);
+
+// Remove the state saved by the previous run, once it is no longer needed.
+//
+// Returns 0 on success, or -1 on failure (with errno set).
+int checkpoint_remove_resume(const char *capture);
+
+// Restore the last checkpoint taken at or before sample_count into the
+// emulator and memory model.
+//
+// Returns 0 on success, or -1 on failure (with a message on stderr).
+int checkpoint_restore(const char *capture, cpu_t cpu_type, machine_t machine, int byte, int64_t skip,
+                       uint32_t sample_count, checkpoint_t *checkpoint, cpu_emulator_t *em, void *cpu, memory_t *mem);
+
+#endif
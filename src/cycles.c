@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "cycles.h"
+
+// File format (all values little endian):
+//
+// The cycle file starts with a 16 byte header:
+//    0: "6502CYC" followed by the version number
+//    8: cpu type
+//    9: signals present (CYCLES_RNW etc)
+//   10: reserved
+//
+// Each bus cycle is then:
+//    flags (8 bits):
+//       bits 0-2: type
+//       bit 3:    rnw
+//       bit 4:    rst
+//       bit 5:    e
+//       bit 6:    user
+//       bit 7:    REC_DELTAS (the counter deltas follow)
+//    cycle count delta (varint), if REC_DELTAS
+//    sample count delta (varint), if REC_DELTAS
+//    data (8 bits)
+//    verify (8 bits), if CYCLES_VERIFY is present
+//
+// The cycle and sample counts are relative to the previous bus cycle,
+// and the deltas are only sent when they change. The file ends with
+// the LAST marker.
+
+#define CYCLES_VERSION 1
+
+#define REC_TYPE_MASK 0x07
+#define REC_RNW       0x08
+#define REC_RST       0x10
+#define REC_E         0x20
+#define REC_USER      0x40
+#define REC_DELTAS    0x80
+
+#define IO_BUFFER_SIZE (1 << 20)
+
+static FILE *cycles_file = NULL;
+
+static int signals;
+
+// Reference state for the delta encoding
+static uint32_t last_sample;
+static uint32_t last_cycle;
+static uint32_t last_sample_delta;
+static uint32_t last_cycle_delta;
+
+static void reset_deltas() {
+   last_sample = 0;
+   last_cycle = 0;
+   // Force the deltas to be sent in the first record
+   last_sample_delta = UINT32_MAX;
+   last_cycle_delta = UINT32_MAX;
+}
+
+// ==================================================
+// Writing
+// ==================================================
+
+static uint8_t *put_varint(uint8_t *bp, uint32_t value) {
+   while (value >= 0x80) {
+      *bp++ = (value & 0x7f) | 0x80;
+      value >>= 7;
+   }
+   *bp++ = value;
+   return bp;
+}
+
+int cycles_create(const char *filename, cpu_t cpu_type, int sigs) {
+   cycles_file = fopen(filename, "wb");
+   if (!cycles_file) {
+      return -1;
+   }
+   setvbuf(cycles_file, NULL, _IOFBF, IO_BUFFER_SIZE);
+   signals = sigs;
+   reset_deltas();
+   uint8_t header[CYCLES_HEADER_SIZE];
+   memset(header, 0, sizeof(header));
+   memcpy(header, "6502CYC", 7);
+   header[7] = CYCLES_VERSION;
+   header[8] = cpu_type;
+   header[9] = signals;
+   fwrite(header, 1, sizeof(header), cycles_file);
+   return 0;
+}
+
+void cycles_write(const sample_t *cycles, const bus_counts_t *counts, int n) {
+   uint8_t buffer[4096];
+   uint8_t *bp = buffer;
+   for (int i = 0; i < n; i++) {
+      const sample_t *s = cycles + i;
+      if (bp - buffer > (int) sizeof(buffer) - CYCLES_MAX_RECORD) {
+         fwrite(buffer, 1, bp - buffer, cycles_file);
+         bp = buffer;
+      }
+      uint32_t cycle_delta  = counts[i].cycle_count - last_cycle;
+      uint32_t sample_delta = counts[i].sample_count - last_sample;
+      int deltas = cycle_delta != last_cycle_delta || sample_delta != last_sample_delta;
+      *bp++ = s->type
+         | (s->rnw  > 0 ? REC_RNW  : 0)
+         | (s->rst  > 0 ? REC_RST  : 0)
+         | (s->e    > 0 ? REC_E    : 0)
+         | (s->user > 0 ? REC_USER : 0)
+         | (deltas ? REC_DELTAS : 0);
+      if (deltas) {
+         bp = put_varint(bp, cycle_delta);
+         bp = put_varint(bp, sample_delta);
+         last_cycle_delta  = cycle_delta;
+         last_sample_delta = sample_delta;
+      }
+      *bp++ = s->data;
+      if (signals & CYCLES_VERIFY) {
+         *bp++ = s->verify;
+      }
+      last_cycle  = counts[i].cycle_count;
+      last_sample = counts[i].sample_count;
+   }
+   fwrite(buffer, 1, bp - buffer, cycles_file);
+}
+
+void cycles_close() {
+   if (cycles_file) {
+      fclose(cycles_file);
+      cycles_file = NULL;
+   }
+}
+
+// ==================================================
+// Reading
+// ==================================================
+
+int cycles_read_header(const uint8_t *data, cpu_t *cpu_type, int *sigs) {
+   if (memcmp(data, "6502CYC", 7) || data[7] != CYCLES_VERSION) {
+      return -1;
+   }
+   *cpu_type = data[8];
+   *sigs = signals = data[9];
+   reset_deltas();
+   return 0;
+}
+
+// Returns the number of bytes used, or 0 if incomplete
+static int get_varint(const uint8_t *data, int n, uint32_t *value) {
+   uint32_t v = 0;
+   for (int i = 0; i < n && i < 5; i++) {
+      v |= (uint32_t) (data[i] & 0x7f) << (7 * i);
+      if (!(data[i] & 0x80)) {
+         *value = v;
+         return i + 1;
+      }
+   }
+   return 0;
+}
+
+int cycles_read(const uint8_t *data, int n, sample_t *cycle, bus_counts_t *counts) {
+   const uint8_t *bp = data;
+   const uint8_t *end = data + n;
+   if (bp >= end) {
+      return 0;
+   }
+   int flags = *bp++;
+   uint32_t cycle_delta  = last_cycle_delta;
+   uint32_t sample_delta = last_sample_delta;
+   if (flags & REC_DELTAS) {
+      int len = get_varint(bp, end - bp, &cycle_delta);
+      if (!len) {
+         return 0;
+      }
+      bp += len;
+      len = get_varint(bp, end - bp, &sample_delta);
+      if (!len) {
+         return 0;
+      }
+      bp += len;
+   }
+   if (end - bp < ((signals & CYCLES_VERIFY) ? 2 : 1)) {
+      return 0;
+   }
+   cycle->type = flags & REC_TYPE_MASK;
+   cycle->rnw  = (signals & CYCLES_RNW ) ? ((flags & REC_RNW ) != 0) : -1;
+   cycle->rst  = (signals & CYCLES_RST ) ? ((flags & REC_RST ) != 0) : -1;
+   cycle->e    = (signals & CYCLES_E   ) ? ((flags & REC_E   ) != 0) : -1;
+   cycle->user = (signals & CYCLES_USER) ? ((flags & REC_USER) != 0) : -1;
+   cycle->data = *bp++;
+   cycle->verify = (signals & CYCLES_VERIFY) ? (int8_t) *bp++ : -1;
+   // Only update the state once the whole record is available
+   last_cycle_delta  = cycle_delta;
+   last_sample_delta = sample_delta;
+   last_cycle  += cycle_delta;
+   last_sample += sample_delta;
+   counts->cycle_count  = last_cycle;
+   counts->sample_count = last_sample;
+   return bp - data;
+}
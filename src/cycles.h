@@ -0,0 +1,47 @@
+#ifndef _CYCLES_H
+#define _CYCLES_H
+
+#include <inttypes.h>
+
+#include "defs.h"
+
+// A cycle file holds the bus cycles extracted from a capture (after the
+// phi2 edge detection, skew and rdy handling), typically in two bytes
+// per cycle, so repeated analysis of an oversampled capture can skip
+// straight to decoding the instructions.
+
+#define CYCLES_HEADER_SIZE 16
+
+// The longest record
+#define CYCLES_MAX_RECORD 24
+
+// Signals present in the cycle file
+#define CYCLES_RNW    0x01
+#define CYCLES_RST    0x02
+#define CYCLES_E      0x04
+#define CYCLES_USER   0x08
+#define CYCLES_VERIFY 0x10
+#define CYCLES_RDY    0x20 // the stalled cycles have already been dropped
+
+// Create a cycle file for the given cpu, containing the given signals.
+//
+// Returns 0 on success, or -1 on failure (with errno set).
+int cycles_create(const char *filename, cpu_t cpu_type, int signals);
+
+// Write n bus cycles, the last of which may be the LAST marker
+void cycles_write(const sample_t *cycles, const bus_counts_t *counts, int n);
+
+void cycles_close();
+
+// Parse the header at the start of a cycle file, returning its cpu and
+// signals, and preparing to decode the records that follow.
+//
+// Returns 0 on success, or -1 if this is not a cycle file.
+int cycles_read_header(const uint8_t *data, cpu_t *cpu_type, int *signals);
+
+// Decode the record of one bus cycle from at most n bytes.
+//
+// Returns the number of bytes used, or 0 if the record is incomplete.
+int cycles_read(const uint8_t *data, int n, sample_t *cycle, bus_counts_t *counts);
+
+#endif
@@ -29,12 +29,25 @@ typedef enum {
    CPU_6800,
 } cpu_t;
 
+typedef enum {
+   OUTPUT_TEXT,
+   OUTPUT_BIN,
+} output_format_t;
+
+typedef enum {
+   INPUT_CAPTURE,
+   INPUT_CYCLES,
+} input_format_t;
+
 // Instruction set table size.
 #define INSTR_SET_SIZE 256
 
 // Sample Queue Depth - needs to fit the longest instruction
 #define DEPTH 13
 
+// The most values an emulator saves in a checkpoint (see save_state)
+#define EM_MAX_STATE 32
+
 // Sample_type_t is an abstraction of both the 6502 SYNC and the 65816 VDA/VPA
 
 typedef enum {     // 6502 Sync    65815 VDA/VPA
@@ -46,18 +59,25 @@ typedef enum {     // 6502 Sync    65815 VDA/VPA
    LAST            // a marker for the end of stream
 } sample_type_t;
 
+// A bus cycle, packed into 8 bytes, as the decoder looks ahead through a
+// queue of these. The sample and cycle counts are only needed for the
+// output, so they are kept in a parallel array (see bus_counts_t).
 typedef struct {
-   uint32_t      sample_count;
-   uint32_t      cycle_count;
-   sample_type_t type;
    uint8_t       data;
+   uint8_t       type; // sample_type_t
    int8_t         rnw; // -1 indicates unknown
    int8_t         rst; // -1 indicates unknown
    int8_t           e; // -1 indicates unknown (65816 e pin)
    int8_t        user; // -1 indicates unknown (user defined signal)
    int8_t      verify; // -1 indicates unknown (data bus bits to verify data bus).
+   uint8_t   reserved;
 } sample_t;
 
+typedef struct {
+   uint32_t      sample_count;
+   uint32_t      cycle_count;
+} bus_counts_t;
+
 
 typedef struct {
    int           pc;
@@ -123,23 +143,52 @@ typedef struct {
    char* roms_dir;
    int idx_verify;
    int verify_mask;
+   int threads;
+   int parallel;
+   output_format_t output_format;
+   char *output_file;
+   int direct_io;
+   int render;
+   int64_t render_first;
+   int64_t render_last;
+   int stats;
+   input_format_t input_format;
+   char *emit_cycles;
+   int fast;
+   int64_t checkpoint_every;
+   int64_t seek;
+   int follow;
+   char *mem_log;
 } arguments_t;
 
+// A memory model (see memory.h)
+typedef struct memory memory_t;
+
+// The methods of each emulator act on a context, created by create(), which
+// holds all the state of one emulated cpu, so several can be used at once
 typedef struct {
-   void (*init)(arguments_t *args);
-   int (*match_interrupt)(sample_t *sample_q, int num_samples);
-   int (*count_cycles)(sample_t *sample_q, int intr_seen);
-   void (*reset)(sample_t *sample_q, int num_cycles, instruction_t *instruction);
-   void (*interrupt)(sample_t *sample_q, int num_cycles, instruction_t *instruction);
-   void (*emulate)(sample_t *sample_q, int num_cycles, instruction_t *instruction);
-   int (*disassemble)(char *bp, instruction_t *instruction);
-   int (*get_PC)();
-   int (*get_PB)();
-   int (*read_memory)(int address);
-   char *(*get_state)();
-   int (*get_and_clear_fail)();
+   void *(*create)(arguments_t *args, memory_t *mem);
+   void (*destroy)(void *cpu);
+   int (*match_interrupt)(void *cpu, sample_t *sample_q, int num_samples);
+   int (*count_cycles)(void *cpu, sample_t *sample_q, int intr_seen);
+   void (*reset)(void *cpu, sample_t *sample_q, int num_cycles, instruction_t *instruction);
+   void (*interrupt)(void *cpu, sample_t *sample_q, int num_cycles, instruction_t *instruction);
+   void (*emulate)(void *cpu, sample_t *sample_q, int num_cycles, instruction_t *instruction);
+   int (*disassemble)(void *cpu, char *bp, instruction_t *instruction);
+   int (*get_PC)(void *cpu);
+   int (*get_PB)(void *cpu);
+   int (*read_memory)(void *cpu, int address);
+   char *(*get_state)(void *cpu, char *buffer);
+   int (*get_and_clear_fail)(void *cpu);
+   // Optional: any hidden state (not part of get_state) that affects decoding
+   int (*get_hidden_state)(void *cpu);
+   // Optional: count_cycles specialised for sync (or vda/vpa) being connected, or not
+   int (*count_cycles_with_sync)(void *cpu, sample_t *sample_q, int intr_seen);
+   int (*count_cycles_without_sync)(void *cpu, sample_t *sample_q, int intr_seen);
+   // The state carried from one instruction to the next, for checkpoints:
+   // save_state returns the number of values (at most EM_MAX_STATE)
+   int (*save_state)(void *cpu, int *state);
+   void (*restore_state)(void *cpu, const int *state);
 } cpu_emulator_t;
 
-extern int failflag;
-
 #endif
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "disasm.h"
+
+void disasm_compile(disasm_template_t *t, const char *fmt, const char *mnemonic, disasm_target_t target) {
+   char *bp  = t->text;
+   char *end = t->text + DISASM_TEXT_SIZE - 4;
+   int arg = 0;
+   t->op_pos[0] = -1;
+   t->op_pos[1] = -1;
+   t->op_pos[2] = -1;
+   t->target_pos = -1;
+   t->target = target;
+   while (*fmt && bp < end) {
+      if (*fmt != '%') {
+         *bp++ = *fmt++;
+         continue;
+      }
+      fmt++;
+      // Either a positional argument (n$) or a field width
+      int n = strtol(fmt, (char **) &fmt, 10);
+      if (*fmt == '$') {
+         arg = n;
+         fmt++;
+         strtol(fmt, (char **) &fmt, 10);
+      } else {
+         arg++;
+      }
+      if (*fmt == 's') {
+         if (arg == 1) {
+            bp += write_s(bp, mnemonic);
+         } else {
+            t->target_pos = bp - t->text;
+         }
+      } else if (*fmt == 'X' && arg >= 2 && arg <= 4) {
+         t->op_pos[arg - 2] = bp - t->text;
+         *bp++ = '?';
+         *bp++ = '?';
+      }
+      fmt++;
+   }
+   t->len = bp - t->text;
+   if (t->target_pos < 0) {
+      t->target_pos = t->len;
+      t->target = TARGET_NONE;
+   }
+}
+
+static int write_offset(char *buffer, int offset) {
+   char digits[8];
+   char *bp = buffer;
+   *bp++ = 'p';
+   *bp++ = 'c';
+   if (offset < 0) {
+      *bp++ = '-';
+      offset = -offset;
+   } else {
+      *bp++ = '+';
+   }
+   int n = 0;
+   do {
+      digits[n++] = '0' + offset % 10;
+      offset /= 10;
+   } while (offset);
+   while (n) {
+      *bp++ = digits[--n];
+   }
+   return bp - buffer;
+}
+
+int disasm_write(char *buffer, const disasm_template_t *t, const instruction_t *instruction) {
+   char *bp = buffer;
+   memcpy(bp, t->text, t->target_pos);
+   if (t->op_pos[0] >= 0) {
+      write_hex2(bp + t->op_pos[0], instruction->op1);
+   }
+   if (t->op_pos[1] >= 0) {
+      write_hex2(bp + t->op_pos[1], instruction->op2);
+   }
+   if (t->op_pos[2] >= 0) {
+      write_hex2(bp + t->op_pos[2], instruction->op3);
+   }
+   bp += t->target_pos;
+   if (t->target != TARGET_NONE) {
+      int offset;
+      int len;
+      switch (t->target) {
+      case TARGET_REL8_OP2:
+         offset = (int8_t) instruction->op2;
+         len = 3;
+         break;
+      case TARGET_REL16:
+         offset = (int16_t) ((instruction->op2 << 8) + instruction->op1);
+         len = 3;
+         break;
+      default:
+         offset = (int8_t) instruction->op1;
+         len = 2;
+         break;
+      }
+      if (instruction->pc < 0) {
+         bp += write_offset(bp, offset);
+      } else {
+         write_hex4(bp, (instruction->pc + len + offset) & 0xffff);
+         bp += 4;
+      }
+      memcpy(bp, t->text + t->target_pos, t->len - t->target_pos);
+      bp += t->len - t->target_pos;
+   }
+   // Terminate the string, without counting it
+   *bp = 0;
+   return bp - buffer;
+}
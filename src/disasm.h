@@ -0,0 +1,39 @@
+#ifndef _DISASM_H
+#define _DISASM_H
+
+#include <inttypes.h>
+
+#include "defs.h"
+
+// A disassembly template is compiled once per opcode from the printf
+// style format of its addressing mode, so that disassembling an
+// instruction is just a copy of the template with the operand bytes
+// (and any branch target) written into place.
+
+#define DISASM_TEXT_SIZE 32
+
+// How the branch target (the %s after the mnemonic) is calculated
+typedef enum {
+   TARGET_NONE,
+   TARGET_REL8,      // 8-bit offset in op1, relative to pc + 2
+   TARGET_REL8_OP2,  // 8-bit offset in op2, relative to pc + 3 (e.g. BBR/BBS)
+   TARGET_REL16,     // 16-bit offset in op1/op2, relative to pc + 3 (e.g. BRL)
+} disasm_target_t;
+
+typedef struct {
+   char    text[DISASM_TEXT_SIZE];
+   int8_t  len;
+   int8_t  target_pos;   // where the branch target is inserted
+   int8_t  op_pos[3];    // where the hex digits of op1..op3 are written, or -1
+   int8_t  target;
+} disasm_template_t;
+
+// The format may contain %s (the mnemonic, then the branch target) and
+// %02X (the operand bytes), optionally with positional arguments (%2$02X).
+// The operand bytes must come before the branch target.
+void disasm_compile(disasm_template_t *t, const char *fmt, const char *mnemonic, disasm_target_t target);
+
+// Returns the number of characters written (not including the terminator)
+int disasm_write(char *buffer, const disasm_template_t *t, const instruction_t *instruction);
+
+#endif
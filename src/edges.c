@@ -0,0 +1,74 @@
+#include <inttypes.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "edges.h"
+
+// Phi typically changes every 2-8 samples, so most blocks of samples
+// contain at least one edge. The vector kernels XOR each sample with
+// its predecessor, shift the phi bit up to bit 15 of each lane, and
+// then use movemask to collect these into a bitmask (the odd bits, one
+// per 16-bit lane).
+
+static inline int lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+   unsigned long index;
+   _BitScanForward(&index, mask);
+   return index;
+#else
+   return __builtin_ctz(mask);
+#endif
+}
+
+int find_edges(const uint16_t *samples, int n, int idx, uint32_t *edges) {
+   int num = 0;
+   int i = 0;
+
+#if defined(__AVX2__)
+
+   __m128i shift = _mm_cvtsi32_si128(15 - idx);
+   for (; i + 16 <= n; i += 16) {
+      __m256i cur  = _mm256_loadu_si256((const __m256i *)(samples + i));
+      __m256i prev = _mm256_loadu_si256((const __m256i *)(samples + i - 1));
+      __m256i diff = _mm256_sll_epi16(_mm256_xor_si256(cur, prev), shift);
+      uint32_t mask = _mm256_movemask_epi8(diff) & 0xAAAAAAAA;
+      while (mask) {
+         edges[num++] = i + (lowest_bit(mask) >> 1);
+         mask &= mask - 1;
+      }
+   }
+
+#elif defined(USE_SSE2)
+
+   __m128i shift = _mm_cvtsi32_si128(15 - idx);
+   for (; i + 8 <= n; i += 8) {
+      __m128i cur  = _mm_loadu_si128((const __m128i *)(samples + i));
+      __m128i prev = _mm_loadu_si128((const __m128i *)(samples + i - 1));
+      __m128i diff = _mm_sll_epi16(_mm_xor_si128(cur, prev), shift);
+      uint32_t mask = _mm_movemask_epi8(diff) & 0xAAAA;
+      while (mask) {
+         edges[num++] = i + (lowest_bit(mask) >> 1);
+         mask &= mask - 1;
+      }
+   }
+
+#endif
+
+   // Scalar fallback, also used for any remaining samples
+   for (; i < n; i++) {
+      if (((samples[i] ^ samples[i - 1]) >> idx) & 1) {
+         edges[num++] = i;
+      }
+   }
+
+   return num;
+}
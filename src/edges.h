@@ -0,0 +1,14 @@
+#ifndef _EDGES_H
+#define _EDGES_H
+
+#include <inttypes.h>
+
+// Find the indices i in [0, n) where bit idx of samples[i] differs from
+// bit idx of samples[i - 1], writing them in ascending order to edges[].
+//
+// samples[-1] must be readable.
+//
+// Returns the number of edges found.
+int find_edges(const uint16_t *samples, int n, int idx, uint32_t *edges);
+
+#endif
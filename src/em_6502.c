@@ -3,6 +3,9 @@
 #include <string.h>
 #include <inttypes.h>
 #include "memory.h"
+#include "disasm.h"
+#include "output.h"
+#include "stats.h"
 #include "tube_decode.h"
 #include "em_6502.h"
 
@@ -46,6 +49,8 @@ typedef int operand_t;
 
 typedef int ea_t;
 
+typedef struct cpu_state cpu_state_t;
+
 typedef struct {
    const char *mnemonic;
    int undocumented;
@@ -53,12 +58,78 @@ typedef struct {
    int cycles;
    int decimalcorrect;
    OpType optype;
-   int (*emulate)(operand_t, ea_t);
+   int (*emulate)(cpu_state_t *, operand_t, ea_t);
    int len;
-   const char *fmt;
+   disasm_template_t dis;
 } InstrType;
 
-int verify_mask = 0;
+// How em_6502_emulate finds the operand
+typedef enum {
+   OPERAND_LAST,        // the last bus cycle
+   OPERAND_RMW,         // the read of a read-modify-write
+   OPERAND_BRANCH,      // whether the branch was taken
+   OPERAND_JSR,         // the return address pushed to the stack
+   OPERAND_RTI,         // the flags and return address pulled from the stack
+   OPERAND_RTS,         // the return address pulled from the stack
+   OPERAND_IMM,         // the 2nd byte of the instruction
+   OPERAND_DECIMAL      // as OPERAND_LAST, except for the extra cycle in decimal mode
+} OperandKind;
+
+// The pointer reads of the indirect addressing modes
+typedef enum {
+   PTR_NONE,
+   PTR_IND,
+   PTR_IND_ARLET,
+   PTR_INDY,
+   PTR_INDX,
+   PTR_IND16,
+   PTR_IND16_NMOS,      // without the page crossing fix
+   PTR_IND1X
+} PointerKind;
+
+// How the effective address is formed
+typedef enum {
+   EA_NONE,
+   EA_ZP,
+   EA_ZPX,
+   EA_ZPY,
+   EA_INDY,
+   EA_INDX,
+   EA_IND,
+   EA_IND_ARLET,
+   EA_ABS,
+   EA_ABSX,
+   EA_ABSY
+} EaKind;
+
+// The data accesses to model
+#define ACCESS_READ  1
+#define ACCESS_WRITE 2
+
+// How the PC is updated
+typedef enum {
+   PC_NEXT,             // the next instruction
+   PC_INDIRECT,         // the last two bus cycles (RTI, JMP (ind), JMP (ind, X))
+   PC_ABSOLUTE,         // the operand (JSR abs, JMP abs)
+   PC_RTS,              // the return address pulled from the stack, plus one
+   PC_BRA,              // BRA
+   PC_BBX,              // BBR/BBS: relative to op2 if taken
+   PC_BXX               // Bxx: relative to op1 if taken
+} PcKind;
+
+// Everything em_6502_emulate needs to know about an opcode, resolved
+// for the variant when the context is created, so each instruction
+// takes a few table lookups rather than a chain of tests
+typedef struct {
+   int (*emulate)(cpu_state_t *, operand_t, ea_t);
+   uint8_t opcount;
+   uint8_t op2_index;   // the bus cycle with the 3rd byte of the instruction
+   uint8_t pointer;
+   uint8_t operand;
+   uint8_t ea;
+   uint8_t access;
+   uint8_t pc;
+} InstrPlan;
 
 // ====================================================================
 // Static variables
@@ -78,14 +149,52 @@ int verify_mask = 0;
 
 static const char default_state[] = "A=?? X=?? Y=?? SP=?? N=? V=? D=? I=? Z=? C=?";
 
-static int rockwell     = 0;
-static int arlet        = 0;
-static int aland        = 0;
-static int c02          = 0;
-static int bbctube      = 0;
-static int master_nordy = 0;
-
-static InstrType *instr_table;
+// The state of one emulated 6502
+struct cpu_state {
+   // Variant of the 6502
+   int rockwell;
+   int arlet;
+   int aland;
+   int c02;
+   int bbctube;
+   int master_nordy;
+   int verify_mask;
+
+   // Only the PC is followed (--fast)
+   int fast;
+
+   // The instruction set of the variant
+   InstrType instr_table[INSTR_SET_SIZE];
+   InstrPlan plan[INSTR_SET_SIZE];
+
+   // 6502 registers: -1 means unknown
+   int A;
+   int X;
+   int Y;
+   int S;
+   int PC;
+
+   // 6502 flags: -1 means unknown
+   int N;
+   int V;
+   int D;
+   int I;
+   int Z;
+   int C;
+
+   // JSR cycle positions
+   // <opcode> <op1> <read dummy> <write pch> <write pcl> <op2>
+   int jsr_pch;
+   int jsr_pcl;
+
+   // Phase of the 1MHz clock on the BBC Micro, relative to the CPU clock
+   int mhz1_phase;
+
+   // Set when the emulation disagrees with the bus
+   int failflag;
+
+   memory_t *mem;
+};
 
 static AddrModeType addr_mode_table[] = {
    {1,    "%s"},                    // IMP
@@ -106,31 +215,10 @@ static AddrModeType addr_mode_table[] = {
    {3,    "%s %02X,%s"}             // ZPR
 };
 
-// 6502 registers: -1 means unknown
-static int A = -1;
-static int X = -1;
-static int Y = -1;
-static int S = -1;
-static int PC = -1;
-
-// 6502 flags: -1 means unknown
-static int N = -1;
-static int V = -1;
-static int D = -1;
-static int I = -1;
-static int Z = -1;
-static int C = -1;
-
 static char ILLEGAL[] = "???";
 static char STP[]     = "STP";
 static char WAI[]     = "WAI";
 
-// JSR cycle positions
-// <opcode> <op1> <read dummy> <write pch> <write pcl> <op2>
-
-static int jsr_pch = 3;
-static int jsr_pcl = 4;
-
 // ====================================================================
 // Forward declarations
 // ====================================================================
@@ -138,105 +226,105 @@ static int jsr_pcl = 4;
 static InstrType instr_table_6502[INSTR_SET_SIZE];
 static InstrType instr_table_65c02[INSTR_SET_SIZE];
 
-static int op_STA(operand_t operand, ea_t ea);
-static int op_STX(operand_t operand, ea_t ea);
-static int op_STY(operand_t operand, ea_t ea);
+static int op_STA(cpu_state_t *cpu, operand_t operand, ea_t ea);
+static int op_STX(cpu_state_t *cpu, operand_t operand, ea_t ea);
+static int op_STY(cpu_state_t *cpu, operand_t operand, ea_t ea);
 
 // ====================================================================
 // Helper Methods
 // ====================================================================
 
-static int compare_FLAGS(int operand) {
-   if (N >= 0) {
-      if (N != ((operand >> 7) & 1)) {
+static int compare_FLAGS(cpu_state_t *cpu, int operand) {
+   if (cpu->N >= 0) {
+      if (cpu->N != ((operand >> 7) & 1)) {
          return 1;
       }
    }
-   if (V >= 0) {
-      if (V != ((operand >> 6) & 1)) {
+   if (cpu->V >= 0) {
+      if (cpu->V != ((operand >> 6) & 1)) {
          return 1;
       }
    }
-   if (D >= 0) {
-      if (D != ((operand >> 3) & 1)) {
+   if (cpu->D >= 0) {
+      if (cpu->D != ((operand >> 3) & 1)) {
          return 1;
       }
    }
-   if (I >= 0) {
-      if (I != ((operand >> 2) & 1)) {
+   if (cpu->I >= 0) {
+      if (cpu->I != ((operand >> 2) & 1)) {
          return 1;
       }
    }
-   if (Z >= 0) {
-      if (Z != ((operand >> 1) & 1)) {
+   if (cpu->Z >= 0) {
+      if (cpu->Z != ((operand >> 1) & 1)) {
          return 1;
       }
    }
-   if (C >= 0) {
-      if (C != ((operand >> 0) & 1)) {
+   if (cpu->C >= 0) {
+      if (cpu->C != ((operand >> 0) & 1)) {
          return 1;
       }
    }
    return 0;
 }
 
-static void check_FLAGS(int operand) {
-   failflag |= compare_FLAGS(operand);
+static void check_FLAGS(cpu_state_t *cpu, int operand) {
+   cpu->failflag |= compare_FLAGS(cpu, operand);
 }
 
-static void set_FLAGS(int operand) {
-   N = (operand >> 7) & 1;
-   V = (operand >> 6) & 1;
-   D = (operand >> 3) & 1;
-   I = (operand >> 2) & 1;
-   Z = (operand >> 1) & 1;
-   C = (operand >> 0) & 1;
+static void set_FLAGS(cpu_state_t *cpu, int operand) {
+   cpu->N = (operand >> 7) & 1;
+   cpu->V = (operand >> 6) & 1;
+   cpu->D = (operand >> 3) & 1;
+   cpu->I = (operand >> 2) & 1;
+   cpu->Z = (operand >> 1) & 1;
+   cpu->C = (operand >> 0) & 1;
 }
 
-static void set_NZ_unknown() {
-   N = -1;
-   Z = -1;
+static void set_NZ_unknown(cpu_state_t *cpu) {
+   cpu->N = -1;
+   cpu->Z = -1;
 }
 
-static void set_NZC_unknown() {
-   N = -1;
-   Z = -1;
-   C = -1;
+static void set_NZC_unknown(cpu_state_t *cpu) {
+   cpu->N = -1;
+   cpu->Z = -1;
+   cpu->C = -1;
 }
 
-static void set_NVZC_unknown() {
-   N = -1;
-   V = -1;
-   Z = -1;
-   C = -1;
+static void set_NVZC_unknown(cpu_state_t *cpu) {
+   cpu->N = -1;
+   cpu->V = -1;
+   cpu->Z = -1;
+   cpu->C = -1;
 }
 
-static void set_NZ(int value) {
-   N = (value & 128) > 0;
-   Z = value == 0;
+static void set_NZ(cpu_state_t *cpu, int value) {
+   cpu->N = (value & 128) > 0;
+   cpu->Z = value == 0;
 }
 
 
-static void pop8(int value) {
-   if (S >= 0) {
-      S = (S + 1) & 0xff;
-      memory_read(value & 0xff, 0x100 + S, MEM_STACK);
+static void pop8(cpu_state_t *cpu, int value) {
+   if (cpu->S >= 0) {
+      cpu->S = (cpu->S + 1) & 0xff;
+      memory_read(cpu->mem, value & 0xff, 0x100 + cpu->S, MEM_STACK);
    }
 }
 
-static void push8(int value) {
-   if (S >= 0) {
-      memory_write(value & 0xff, 0x100 + S, MEM_STACK);
-      S = (S - 1) & 0xff;
+static void push8(cpu_state_t *cpu, int value) {
+   if (cpu->S >= 0) {
+      memory_write(cpu->mem, value & 0xff, 0x100 + cpu->S, MEM_STACK);
+      cpu->S = (cpu->S - 1) & 0xff;
    }
 }
 
-static void push16(int value) {
-   push8(value >> 8);
-   push8(value);
+static void push16(cpu_state_t *cpu, int value) {
+   push8(cpu, value >> 8);
+   push8(cpu, value);
 }
 
-static void interrupt(sample_t *sample_q, int num_cycles, instruction_t *instruction, int pc_offset) {
+static void interrupt(cpu_state_t *cpu, sample_t *sample_q, int num_cycles, instruction_t *instruction, int pc_offset) {
    // Parse the bus cycles
    // <opcode> <op1> <write pch> <write pcl> <write p> <read rst> <read rsth>
    int pc     = (sample_q[2].data << 8) + sample_q[3].data;
@@ -244,27 +332,29 @@ static void interrupt(sample_t *sample_q, int num_cycles, instruction_t *instruc
    int vector = (sample_q[6].data << 8) + sample_q[5].data;
    // Update the address of the interruted instruction
    instruction->pc = (pc - pc_offset) & 0xffff;
-   // Stack the PB/PC/FLags (for memory modelling)
-   push16(pc);
-   push8(flags);
-   // Validate the flags
-   check_FLAGS(flags);
-   // And make them consistent
-   set_FLAGS(flags);
+   if (!cpu->fast) {
+      // Stack the PB/PC/FLags (for memory modelling)
+      push16(cpu, pc);
+      push8(cpu, flags);
+      // Validate the flags
+      check_FLAGS(cpu, flags);
+      // And make them consistent
+      set_FLAGS(cpu, flags);
+   }
    // Setup expected state for the ISR
-   I = 1;
-   if (c02) {
-      D = 0;
+   if (!cpu->fast) {
+      cpu->I = 1;
+      if (cpu->c02) {
+         cpu->D = 0;
+      }
    }
-   PC = vector;
+   cpu->PC = vector;
 }
 
-static int get_num_cycles(sample_t *sample_q, int intr_seen) {
-
-   static int mhz1_phase = 1;
+static int get_num_cycles(cpu_state_t *cpu, sample_t *sample_q, int intr_seen) {
 
    if (intr_seen) {
-      mhz1_phase ^= 1;
+      cpu->mhz1_phase ^= 1;
       return 7;
    }
 
@@ -272,30 +362,30 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
    int op1    = sample_q[1].data;
    int op2    = sample_q[opcode == 0x20 ? 5 : ((opcode & 0x0f) == 0x0f) ? 4 : 2].data;
 
-   InstrType *instr = &instr_table[opcode];
+   InstrType *instr = &cpu->instr_table[opcode];
 
    int cycle_count = instr->cycles;
 
    // Account for extra cycle in ADC/SBC in decimal mode in C02
-   if (c02 && instr->decimalcorrect && D == 1) {
+   if (cpu->c02 && instr->decimalcorrect && cpu->D == 1) {
       cycle_count++;
    }
 
    // Account for extra cycle in a page crossing in (indirect), Y (not stores)
    // <opcpde> <op1> <addrlo> <addrhi> [ <page crossing>] <<operand> [ <extra cycle in dec mode> ]
-   if ((instr->mode == INDY) && (instr->optype != WRITEOP) && Y >= 0) {
+   if ((instr->mode == INDY) && (instr->optype != WRITEOP) && cpu->Y >= 0) {
       int base = (sample_q[3].data << 8) + sample_q[2].data;
-      if ((base & 0xff00) != ((base + Y) & 0xff00)) {
+      if ((base & 0xff00) != ((base + cpu->Y) & 0xff00)) {
          cycle_count++;
       }
    }
 
    // Account for extra cycle in a page crossing in absolute indexed (not stores)
-   if ((((instr->mode == ABSX) || (instr->mode == ABSY)) && (instr->optype != WRITEOP)) || (arlet && instr->mode == IND1X)) {
+   if ((((instr->mode == ABSX) || (instr->mode == ABSY)) && (instr->optype != WRITEOP)) || (cpu->arlet && instr->mode == IND1X)) {
       // 6502:  Need to exclude ASL/ROL/LSR/ROR/DEC/INC, which are 7 cycles regardless
       // 65C02: Need to exclude DEC/INC, which are 7 cycles regardless
-      if ((opcode != 0xDE) && (opcode != 0xFE) && ((c02 && !arlet && !aland) || ((opcode != 0x1E) && (opcode != 0x3E) && (opcode != 0x5E) && (opcode != 0x7E)))) {
-         int index = (instr->mode == ABSY) ? Y : X;
+      if ((opcode != 0xDE) && (opcode != 0xFE) && ((cpu->c02 && !cpu->arlet && !cpu->aland) || ((opcode != 0x1E) && (opcode != 0x3E) && (opcode != 0x5E) && (opcode != 0x7E)))) {
+         int index = (instr->mode == ABSY) ? cpu->Y : cpu->X;
          if (index >= 0) {
             int base = op1 + (op2 << 8);
             if ((base & 0xff00) != ((base + index) & 0xff00)) {
@@ -317,7 +407,7 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
    // 6          (<page crossed penalty>)
    //
 
-   if (rockwell && (opcode & 0x0f) == 0x0f) {
+   if (cpu->rockwell && (opcode & 0x0f) == 0x0f) {
       int operand = sample_q[2].data;
       // invert operand for BBR
       if (opcode <= 0x80) {
@@ -329,9 +419,9 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
          // A taken bbr/bbs branch is 6 cycles, not 5
          cycle_count = 6;
          // A taken bbr/bbs branch that crosses a page boundary is 7 cycles
-         if (PC >= 0) {
-            int target =  (PC + 3) + ((int8_t)(op2));
-            if ((target & 0xFF00) != ((PC + 3) & 0xff00)) {
+         if (cpu->PC >= 0) {
+            int target =  (cpu->PC + 3) + ((int8_t)(op2));
+            if ((target & 0xFF00) != ((cpu->PC + 3) & 0xff00)) {
                cycle_count = 7;
             }
          }
@@ -339,51 +429,51 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
    }
 
    // Account for extra cycles in a branch
-   if (((opcode & 0x1f) == 0x10) || (c02 && opcode == 0x80)) {
+   if (((opcode & 0x1f) == 0x10) || (cpu->c02 && opcode == 0x80)) {
       // Default to backards branches taken, forward not taken
       int taken = ((int8_t)op1) < 0;
       switch (opcode) {
       case 0x10: // BPL
-         if (N >= 0) {
-            taken = !N;
+         if (cpu->N >= 0) {
+            taken = !cpu->N;
          }
          break;
       case 0x30: // BMI
-         if (N >= 0) {
-            taken = N;
+         if (cpu->N >= 0) {
+            taken = cpu->N;
          }
          break;
       case 0x50: // BVC
-         if (V >= 0) {
-            taken = !V;
+         if (cpu->V >= 0) {
+            taken = !cpu->V;
          }
          break;
       case 0x70: // BVS
-         if (V >= 0) {
-            taken = V;
+         if (cpu->V >= 0) {
+            taken = cpu->V;
          }
          break;
       case 0x80: // BRA
          taken = 1;
          break;
       case 0x90: // BCC
-         if (C >= 0) {
-            taken = !C;
+         if (cpu->C >= 0) {
+            taken = !cpu->C;
          }
          break;
       case 0xB0: // BCS
-         if (C >= 0) {
-            taken = C;
+         if (cpu->C >= 0) {
+            taken = cpu->C;
          }
          break;
       case 0xD0: // BNE
-         if (Z >= 0) {
-            taken = !Z;
+         if (cpu->Z >= 0) {
+            taken = !cpu->Z;
          }
          break;
       case 0xF0: // BEQ
-         if (Z >= 0) {
-            taken = Z;
+         if (cpu->Z >= 0) {
+            taken = cpu->Z;
          }
          break;
       }
@@ -391,9 +481,9 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
          // A taken branch is 3 cycles, not 2
          cycle_count = 3;
          // A taken branch that crosses a page boundary is 4 cycle
-         if (PC >= 0) {
-            int target =  (PC + 2) + ((int8_t)(op1));
-            if ((target & 0xFF00) != ((PC + 2) & 0xff00)) {
+         if (cpu->PC >= 0) {
+            int target =  (cpu->PC + 2) + ((int8_t)(op1));
+            if ((target & 0xFF00) != ((cpu->PC + 2) & 0xff00)) {
                cycle_count = 4;
             }
          }
@@ -401,7 +491,7 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
    }
 
    // Master specific behaviour to remain in sync if rdy is not available
-   if (master_nordy) {
+   if (cpu->master_nordy) {
       if (instr->len == 3) {
          if ((op2 == 0xfc) ||              // &FC00-&FCFF
              (op2 == 0xfd) ||              // &FD00-&FDFF
@@ -420,51 +510,54 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
                   } else {
                      new_phase = 0;
                   }
-                  if (mhz1_phase != new_phase) {
+                  if (cpu->mhz1_phase != new_phase) {
                      //printf("correcting 1MHz phase\n");
-                     mhz1_phase = new_phase;
+                     cpu->mhz1_phase = new_phase;
                   }
                } else {
-                  printf("fail: 1MHz access not extended as expected\n");
+                  output_printf("fail: 1MHz access not extended as expected\n");
                }
             }
             // Correct cycle count based on expected cycle stretching behaviour
             if (opcode == 0x9D) {
                // STA abs, X which has an unfortunate dummy cycle
-               cycle_count += 2 + mhz1_phase;
+               cycle_count += 2 + cpu->mhz1_phase;
             } else {
-               cycle_count += 1 + mhz1_phase;
+               cycle_count += 1 + cpu->mhz1_phase;
             }
          }
       }
       // Toggle the phase every cycle
-      mhz1_phase ^= (cycle_count & 1);
+      cpu->mhz1_phase ^= (cycle_count & 1);
    }
 
    return cycle_count;
 }
 
-static int count_cycles_without_sync(sample_t *sample_q, int intr_seen) {
-   int num_cycles = get_num_cycles(sample_q, intr_seen);
+static int count_cycles_without_sync(void *context, sample_t *sample_q, int intr_seen) {
+   cpu_state_t *cpu = context;
+   int num_cycles = get_num_cycles(cpu, sample_q, intr_seen);
    if (num_cycles >= 0) {
       return num_cycles;
    }
-   printf ("cycle prediction unknown\n");
+   output_printf("cycle prediction unknown\n");
    return 1;
 }
 
-static int count_cycles_with_sync(sample_t *sample_q, int intr_seen) {
+static int count_cycles_with_sync(void *context, sample_t *sample_q, int intr_seen) {
+   cpu_state_t *cpu = context;
    if (sample_q[0].type == OPCODE) {
       for (int i = 1; i < DEPTH; i++) {
          if (sample_q[i].type == LAST) {
             return 0;
          }
          if (sample_q[i].type == OPCODE) {
-            // Validate the num_cycles passed in
-            int expected = get_num_cycles(sample_q, intr_seen);
+            // Validate the num_cycles passed in (which needs the registers)
+            int expected = cpu->fast ? -1 : get_num_cycles(cpu, sample_q, intr_seen);
             if (expected >= 0) {
                if (i != expected) {
-                  printf ("opcode %02x: cycle prediction fail: expected %d actual %d\n", sample_q[0].data, expected, i);
+                  stats_add(STAT_CYCLE_PREDICTION_FAIL, 1);
+                  output_printf("opcode %02x: cycle prediction fail: expected %d actual %d\n", sample_q[0].data, expected, i);
                }
             }
             return i;
@@ -474,95 +567,198 @@ static int count_cycles_with_sync(sample_t *sample_q, int intr_seen) {
    return 1;
 }
 
+static void build_plan(cpu_state_t *cpu) {
+   for (int opcode = 0; opcode < INSTR_SET_SIZE; opcode++) {
+      InstrType *instr = &cpu->instr_table[opcode];
+      InstrPlan *plan = &cpu->plan[opcode];
+
+      plan->emulate = instr->emulate;
+      plan->opcount = instr->len - 1;
+      plan->op2_index = (opcode == 0x20) ? 5 : ((opcode & 0x0f) == 0x0f) ? 4 : 2;
+
+      switch (instr->mode) {
+      case IND:   plan->pointer = cpu->arlet ? PTR_IND_ARLET : PTR_IND; break;
+      case INDY:  plan->pointer = PTR_INDY;                              break;
+      case INDX:  plan->pointer = PTR_INDX;                              break;
+      case IND16: plan->pointer = cpu->c02 ? PTR_IND16 : PTR_IND16_NMOS; break;
+      case IND1X: plan->pointer = PTR_IND1X;                             break;
+      default:    plan->pointer = PTR_NONE;                              break;
+      }
+
+      // (BRK is passed to the interrupt handler before the operand is needed)
+      if (instr->optype == RMWOP) {
+         plan->operand = OPERAND_RMW;
+      } else if (instr->optype == BRANCHOP) {
+         plan->operand = OPERAND_BRANCH;
+      } else if (opcode == 0x20) {
+         plan->operand = OPERAND_JSR;
+      } else if (opcode == 0x40) {
+         plan->operand = OPERAND_RTI;
+      } else if (opcode == 0x60) {
+         plan->operand = OPERAND_RTS;
+      } else if (instr->mode == IMM) {
+         plan->operand = OPERAND_IMM;
+      } else if (instr->decimalcorrect) {
+         plan->operand = OPERAND_DECIMAL;
+      } else {
+         plan->operand = OPERAND_LAST;
+      }
+
+      switch (instr->mode) {
+      case ZP:
+      case ZPR:  plan->ea = EA_ZP;                                break;
+      case ZPX:  plan->ea = EA_ZPX;                               break;
+      case ZPY:  plan->ea = EA_ZPY;                               break;
+      case INDY: plan->ea = EA_INDY;                              break;
+      case INDX: plan->ea = EA_INDX;                              break;
+      case IND:  plan->ea = cpu->arlet ? EA_IND_ARLET : EA_IND;   break;
+      case ABS:  plan->ea = EA_ABS;                               break;
+      case ABSX: plan->ea = EA_ABSX;                              break;
+      case ABSY: plan->ea = EA_ABSY;                              break;
+      default:   plan->ea = EA_NONE;                              break;
+      }
+
+      plan->access = 0;
+      if (instr->optype == READOP || instr->optype == RMWOP) {
+         plan->access |= ACCESS_READ;
+      }
+      if (instr->optype == WRITEOP || instr->optype == RMWOP) {
+         plan->access |= ACCESS_WRITE;
+      }
+
+      if (opcode == 0x40 || opcode == 0x6c || opcode == 0x7c) {
+         plan->pc = PC_INDIRECT;
+      } else if (opcode == 0x20 || opcode == 0x4c) {
+         plan->pc = PC_ABSOLUTE;
+      } else if (opcode == 0x60) {
+         plan->pc = PC_RTS;
+      } else if (opcode == 0x80) {
+         plan->pc = PC_BRA;
+      } else if (cpu->rockwell && ((opcode & 0x0f) == 0x0f)) {
+         plan->pc = PC_BBX;
+      } else if ((opcode & 0x1f) == 0x10) {
+         plan->pc = PC_BXX;
+      } else {
+         plan->pc = PC_NEXT;
+      }
+
+      // In fast mode the PC is all that is followed, and that needs
+      // nothing more than the plan
+      if (cpu->fast) {
+         plan->emulate = NULL;
+         plan->pointer = PTR_NONE;
+      }
+   }
+}
+
 // ====================================================================
 // Public Methods
 // ====================================================================
 
-static void em_6502_init(arguments_t *args) {
-
+static void *em_6502_create(arguments_t *args, memory_t *mem) {
+   cpu_state_t *cpu = calloc(1, sizeof(cpu_state_t));
+   cpu->mem = mem;
+   cpu->A = -1;
+   cpu->X = -1;
+   cpu->Y = -1;
+   cpu->S = -1;
+   cpu->PC = -1;
+   cpu->N = -1;
+   cpu->V = -1;
+   cpu->D = -1;
+   cpu->I = -1;
+   cpu->Z = -1;
+   cpu->C = -1;
+   cpu->jsr_pch = 3;
+   cpu->jsr_pcl = 4;
+   cpu->mhz1_phase = 1;
+
+   InstrType *instr_table;
    switch (args->cpu_type) {
    case CPU_6502:
       instr_table = instr_table_6502;
       break;
    case CPU_6502_ARLET:
-      arlet = 1;
-      jsr_pch = 2;
-      jsr_pcl = 3;
+      cpu->arlet = 1;
+      cpu->jsr_pch = 2;
+      cpu->jsr_pcl = 3;
       instr_table = instr_table_6502;
       break;
    case CPU_65C02_WDC:
    case CPU_65C02_ROCKWELL:
-      rockwell = 1;
-      c02 = 1;
+      cpu->rockwell = 1;
+      cpu->c02 = 1;
       instr_table = instr_table_65c02;
       break;
    case CPU_65C02_ARLET:
-      arlet = 1;
-      c02 = 1;
-      jsr_pch = 2;
-      jsr_pcl = 3;
+      cpu->arlet = 1;
+      cpu->c02 = 1;
+      cpu->jsr_pch = 2;
+      cpu->jsr_pcl = 3;
       instr_table = instr_table_65c02;
       break;
    case CPU_65C02_ALAND:
-      aland = 1;
-      c02 = 1;
+      cpu->aland = 1;
+      cpu->c02 = 1;
       instr_table = instr_table_65c02;
       break;
    case CPU_65C02:
-      c02 = 1;
+      cpu->c02 = 1;
       instr_table = instr_table_65c02;
       break;
    default:
-      printf("em_6502_init called with unsupported cpu_type (%d)\n", args->cpu_type);
+      output_printf("em_6502_create called with unsupported cpu_type (%d)\n", args->cpu_type);
       exit(1);
    }
-   bbctube = args->bbctube;
+   // Each context has its own copy of the instruction table, as it is tweaked to suit the variant
+   memcpy(cpu->instr_table, instr_table, sizeof(cpu->instr_table));
+   cpu->bbctube = args->bbctube;
    // Initialize the SP
    if (args->sp_reg >= 0) {
-      S = args->sp_reg & 0xff;
+      cpu->S = args->sp_reg & 0xff;
    }
 
    // This flag tells the sync-less cycle count estimation to infer additional cycles on the master
    // It's needed when rdy is not being explicitely sampled
-   master_nordy = (args->machine == MACHINE_MASTER) && (args->idx_rdy < 0);
+   cpu->master_nordy = (args->machine == MACHINE_MASTER) && (args->idx_rdy < 0);
 
    if (args->cpu_type == CPU_65C02_ARLET) {
       // Arlet's 65C02 is really an NMOS 6502 with extra instructions
       // The NMOS instructions have NMOS cycle counts
-      instr_table[0x6c].cycles = 5; // JMP (ind)
-      instr_table[0x7c].cycles = 5; // JMP (ind, X)
-      instr_table[0x1e].cycles = 7; // ASL absx
-      instr_table[0x3e].cycles = 7; // ROL absx
-      instr_table[0x5e].cycles = 7; // LSR absx
-      instr_table[0x7e].cycles = 7; // ROR absx
+      cpu->instr_table[0x6c].cycles = 5; // JMP (ind)
+      cpu->instr_table[0x7c].cycles = 5; // JMP (ind, X)
+      cpu->instr_table[0x1e].cycles = 7; // ASL absx
+      cpu->instr_table[0x3e].cycles = 7; // ROL absx
+      cpu->instr_table[0x5e].cycles = 7; // LSR absx
+      cpu->instr_table[0x7e].cycles = 7; // ROR absx
       // CMOS instructions
-      instr_table[0x5c].cycles = 4; // NOP (should take 8 cycles)
+      cpu->instr_table[0x5c].cycles = 4; // NOP (should take 8 cycles)
       for (int i = 0x00; i <= 0xf0; i+= 0x10) {
-         instr_table[i + 0x03].cycles = 2; // NOP (should take 1 cycle)
-         instr_table[i + 0x0B].cycles = 2; // NOP (should take 1 cycle)
+         cpu->instr_table[i + 0x03].cycles = 2; // NOP (should take 1 cycle)
+         cpu->instr_table[i + 0x0B].cycles = 2; // NOP (should take 1 cycle)
       }
       for (int i = 0x00; i <= 0xff; i++) {
-         instr_table[i].decimalcorrect = 0; // Not cycle penalty for decimal correct
-         if (instr_table[i].mode == IND) {
-            instr_table[i].cycles = 6; // indirect addressing should take 5 cycles
+         cpu->instr_table[i].decimalcorrect = 0; // Not cycle penalty for decimal correct
+         if (cpu->instr_table[i].mode == IND) {
+            cpu->instr_table[i].cycles = 6; // indirect addressing should take 5 cycles
          }
       }
    }
 
    if (args->cpu_type == CPU_65C02_ALAND) {
       // Alan D's 65C02 is mostly cycle accurate, with a few exceptions
-      instr_table[0x40].cycles = 7; // RTI
-      instr_table[0x1e].cycles = 7; // ASL absx
-      instr_table[0x3e].cycles = 7; // ROL absx
-      instr_table[0x5e].cycles = 7; // LSR absx
-      instr_table[0x7e].cycles = 7; // ROR absx
-      instr_table[0x44].cycles = 2; // NOP (should take 3 cycles)
-      instr_table[0x54].cycles = 2; // NOP (should take 4 cycles)
-      instr_table[0x5c].cycles = 4; // NOP (should take 8 cycles)
-      instr_table[0xd4].cycles = 2; // NOP (should take 4 cycles)
-      instr_table[0xf4].cycles = 2; // NOP (should take 4 cycles)
+      cpu->instr_table[0x40].cycles = 7; // RTI
+      cpu->instr_table[0x1e].cycles = 7; // ASL absx
+      cpu->instr_table[0x3e].cycles = 7; // ROL absx
+      cpu->instr_table[0x5e].cycles = 7; // LSR absx
+      cpu->instr_table[0x7e].cycles = 7; // ROR absx
+      cpu->instr_table[0x44].cycles = 2; // NOP (should take 3 cycles)
+      cpu->instr_table[0x54].cycles = 2; // NOP (should take 4 cycles)
+      cpu->instr_table[0x5c].cycles = 4; // NOP (should take 8 cycles)
+      cpu->instr_table[0xd4].cycles = 2; // NOP (should take 4 cycles)
+      cpu->instr_table[0xf4].cycles = 2; // NOP (should take 4 cycles)
       for (int i = 0x00; i <= 0xff; i++) {
-         instr_table[i].decimalcorrect = 0; // Not cycle penalty for decimal correct
+         cpu->instr_table[i].decimalcorrect = 0; // Not cycle penalty for decimal correct
       }
    }
 
@@ -572,11 +768,11 @@ static void em_6502_init(arguments_t *args) {
       // xF (BBR/BBS): 5 cycles -> 1 cycles (2 on Arlet's core)
       int cycles = args->cpu_type == CPU_65C02_ARLET ? 2 : 1;
       for (int i = 0x07; i <= 0xff; i+= 0x08) {
-         instr_table[i].mnemonic = ILLEGAL;
-         instr_table[i].mode     = IMP;
-         instr_table[i].cycles   = cycles;
-         instr_table[i].optype   = READOP;
-         instr_table[i].len      = 1;
+         cpu->instr_table[i].mnemonic = ILLEGAL;
+         cpu->instr_table[i].mode     = IMP;
+         cpu->instr_table[i].cycles   = cycles;
+         cpu->instr_table[i].optype   = READOP;
+         cpu->instr_table[i].len      = 1;
       }
    }
 
@@ -584,13 +780,13 @@ static void em_6502_init(arguments_t *args) {
    // TODO: more work is needed to properly support WAI and STP
    // See https://github.com/hoglet67/6502Decoder/issues/10
    if (args->cpu_type == CPU_65C02_WDC) {
-      instr_table[0xcb].mnemonic = WAI;
-      instr_table[0xcb].cycles   = 3;
-      instr_table[0xdb].mnemonic = STP;
-      instr_table[0xdb].cycles   = 3;
+      cpu->instr_table[0xcb].mnemonic = WAI;
+      cpu->instr_table[0xcb].cycles   = 3;
+      cpu->instr_table[0xdb].mnemonic = STP;
+      cpu->instr_table[0xdb].cycles   = 3;
    }
 
-   InstrType *instr = instr_table;
+   InstrType *instr = cpu->instr_table;
    for (int i = 0; i < INSTR_SET_SIZE; i++) {
       // Remove the undocumented instructions, if not supported
       if (instr->undocumented && !args->undocumented) {
@@ -598,17 +794,27 @@ static void em_6502_init(arguments_t *args) {
          instr->mode     = IMP;
          instr->cycles   = 1;
       }
-      // Copy the length and format from the address mode, for efficiency
+      // Copy the length from the address mode, and compile the disassembly template, for efficiency
       instr->len = addr_mode_table[instr->mode].len;
-      instr->fmt = addr_mode_table[instr->mode].fmt;
+      disasm_compile(&instr->dis, addr_mode_table[instr->mode].fmt, instr->mnemonic,
+                     instr->mode == BRA ? TARGET_REL8 : instr->mode == ZPR ? TARGET_REL8_OP2 : TARGET_NONE);
       instr++;
    }
 
-   verify_mask = args->verify_mask;
+   cpu->fast = args->fast;
+   build_plan(cpu);
+
+   cpu->verify_mask = args->verify_mask;
+   return cpu;
+}
+
+static void em_6502_destroy(void *cpu) {
+   free(cpu);
 }
 
 
-static int em_6502_match_interrupt(sample_t *sample_q, int num_samples) {
+static int em_6502_match_interrupt(void *context, sample_t *sample_q, int num_samples) {
+   cpu_state_t *cpu = context;
    // Check we have enough valid samples
    if (num_samples < 7) {
       return 0;
@@ -626,11 +832,11 @@ static int em_6502_match_interrupt(sample_t *sample_q, int num_samples) {
    } else {
       // If not, then we use a heuristic, based on what we expect to see on the data
       // bus in cycles 2, 3 and 4, i.e. PCH, PCL, PSW
-      if (sample_q[2].data == ((PC >> 8) & 0xff) && sample_q[3].data == (PC & 0xff)) {
+      if (sample_q[2].data == ((cpu->PC >> 8) & 0xff) && sample_q[3].data == (cpu->PC & 0xff)) {
          // Now test unused flag is 1, B is 0
          if ((sample_q[4].data & 0x30) == 0x20) {
             // Finally test all other known flags match
-            if (!compare_FLAGS(sample_q[4].data)) {
+            if (!compare_FLAGS(cpu, sample_q[4].data)) {
                // Matched PSW = NV-BDIZC
                return 1;
             }
@@ -640,69 +846,70 @@ static int em_6502_match_interrupt(sample_t *sample_q, int num_samples) {
    return 0;
 }
 
-static int em_6502_count_cycles(sample_t *sample_q, int intr_seen) {
+static int em_6502_count_cycles(void *context, sample_t *sample_q, int intr_seen) {
+   cpu_state_t *cpu = context;
    if (sample_q[0].type == UNKNOWN) {
-      return count_cycles_without_sync(sample_q, intr_seen);
+      return count_cycles_without_sync(cpu, sample_q, intr_seen);
    } else {
-      return count_cycles_with_sync(sample_q, intr_seen);
+      return count_cycles_with_sync(cpu, sample_q, intr_seen);
    }
 }
 
-static void em_6502_reset(sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+static void em_6502_reset(void *context, sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
    instruction->pc = -1;
-   A = -1;
-   X = -1;
-   Y = -1;
-   S = -1;
-   N = -1;
-   V = -1;
-   D = -1;
-   Z = -1;
-   C = -1;
-   I = 1;
-   if (c02) {
-      D = 0;
-   }
-
-   PC = (sample_q[num_cycles - 1].data << 8) + sample_q[num_cycles - 2].data;
+   cpu->A = -1;
+   cpu->X = -1;
+   cpu->Y = -1;
+   cpu->S = -1;
+   cpu->N = -1;
+   cpu->V = -1;
+   cpu->D = -1;
+   cpu->Z = -1;
+   cpu->C = -1;
+   cpu->I = 1;
+   if (cpu->c02) {
+      cpu->D = 0;
+   }
+
+   cpu->PC = (sample_q[num_cycles - 1].data << 8) + sample_q[num_cycles - 2].data;
    
 }
 
-static void em_6502_interrupt(sample_t *sample_q, int num_cycles, instruction_t *instruction) {
-   interrupt(sample_q, num_cycles, instruction, 0);
+static void em_6502_interrupt(void *context, sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
+   interrupt(cpu, sample_q, num_cycles, instruction, 0);
 }
 
-static void em_6502_emulate(sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+static void em_6502_emulate(void *context, sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
    // Unpack the instruction bytes
    int opcode = sample_q[0].data;
 
    /* Useful for stopping at a known sample count from PulseView. 
    if (sample_q[0].sample_count == 0x00091b47) {
-      puts("Here.");
+      output_puts("Here.");
    }
    */
 
-   // lookup the entry for the instruction
-   InstrType *instr = &instr_table[opcode];
+   // lookup the plan for the instruction
+   const InstrPlan *plan = &cpu->plan[opcode];
 
-   int opcount = instr->len - 1;
+   int opcount = plan->opcount;
 
    int op1 = (opcount < 1) ? 0 : sample_q[1].data;
 
-   int op2 =
-      (opcount < 2)             ? 0 :
-      (opcode == 0x20)          ? sample_q[5].data :
-      ((opcode & 0x0f) == 0x0f) ? sample_q[4].data : sample_q[2].data;
+   int op2 = (opcount < 2) ? 0 : sample_q[plan->op2_index].data;
 
    // Memory Modelling: Instruction fetches
-   if (PC >= 0) {
-      int pc = PC;
-      memory_read(opcode, pc++, MEM_FETCH);
+   if (!cpu->fast && cpu->PC >= 0) {
+      int pc = cpu->PC;
+      memory_read(cpu->mem, opcode, pc++, MEM_FETCH);
       if (opcount >= 1) {
-         memory_read(op1, pc++, MEM_INSTR);
+         memory_read(cpu->mem, op1, pc++, MEM_INSTR);
       }
       if (opcount >= 2) {
-         memory_read(op2, pc++, MEM_INSTR);
+         memory_read(cpu->mem, op2, pc++, MEM_INSTR);
       }
    }
 
@@ -715,146 +922,167 @@ static void em_6502_emulate(sample_t *sample_q, int num_cycles, instruction_t *i
    // Determine the current PC value
    if (opcode == 0x00) {
       // Now just pass BRK onto the interrupt handler
-      interrupt(sample_q, num_cycles, instruction, 2);
+      interrupt(cpu, sample_q, num_cycles, instruction, 2);
       // And we are done
       return;
    } else if (opcode == 0x20) {
-      instruction->pc = (((sample_q[jsr_pch].data << 8) + sample_q[jsr_pcl].data) - 2) & 0xffff;
+      instruction->pc = (((sample_q[cpu->jsr_pch].data << 8) + sample_q[cpu->jsr_pcl].data) - 2) & 0xffff;
    } else {
-      instruction->pc = PC;
+      instruction->pc = cpu->PC;
    }
 
    // Memory Modelling: Pointer indirection
-   switch (instr->mode) {
-   case IND:
-      //        C02: <opcode> <op1> <addrlo> <addrhi> <operand>
+   switch (plan->pointer) {
+   case PTR_IND:
+      // C02: <opcode> <op1> <addrlo> <addrhi> <operand>
+      memory_read(cpu->mem, sample_q[2].data,   op1             , MEM_POINTER);
+      memory_read(cpu->mem, sample_q[3].data, ((op1 + 1) & 0xff), MEM_POINTER);
+      break;
+   case PTR_IND_ARLET:
       // Arlet  C02: <opcode> <op1> <addrlo> <addrlo> <addrhi> <operand>
-      memory_read(sample_q[arlet ? 3 : 2].data,   op1             , MEM_POINTER);
-      memory_read(sample_q[arlet ? 4 : 3].data, ((op1 + 1) & 0xff), MEM_POINTER);
+      memory_read(cpu->mem, sample_q[3].data,   op1             , MEM_POINTER);
+      memory_read(cpu->mem, sample_q[4].data, ((op1 + 1) & 0xff), MEM_POINTER);
       break;
-   case INDY:
+   case PTR_INDY:
       // <opcode> <op1> <addrlo> <addrhi> [ <page crossing>] <operand>
-      memory_read(sample_q[2].data,   op1             , MEM_POINTER);
-      memory_read(sample_q[3].data, ((op1 + 1) & 0xff), MEM_POINTER);
+      memory_read(cpu->mem, sample_q[2].data,   op1             , MEM_POINTER);
+      memory_read(cpu->mem, sample_q[3].data, ((op1 + 1) & 0xff), MEM_POINTER);
       break;
-   case INDX:
+   case PTR_INDX:
       // <opcode> <op1> <dummy> <addrlo> <addrhi> <operand>
-      if (X >= 0) {
-         memory_read(sample_q[3].data, ((op1 + X    ) & 0xff), MEM_POINTER);
-         memory_read(sample_q[4].data, ((op1 + X + 1) & 0xff), MEM_POINTER);
+      if (cpu->X >= 0) {
+         memory_read(cpu->mem, sample_q[3].data, ((op1 + cpu->X    ) & 0xff), MEM_POINTER);
+         memory_read(cpu->mem, sample_q[4].data, ((op1 + cpu->X + 1) & 0xff), MEM_POINTER);
       }
       break;
-   case IND16:
+   case PTR_IND16:
       // e.g. JMP (1234)
       // <opcode=6C> <op1> <op2> <read new pcl> <read new pch>
-      if (c02) {
-         memory_read(sample_q[num_cycles - 2].data,  (op2 << 8) + op1              , MEM_POINTER);
-         memory_read(sample_q[num_cycles - 1].data, ((op2 << 8) + op1 + 1) & 0xffff, MEM_POINTER);
-      } else {
-         memory_read(sample_q[num_cycles - 2].data, (op2 << 8) +   op1             , MEM_POINTER);
-         memory_read(sample_q[num_cycles - 1].data, (op2 << 8) + ((op1 + 1) & 0xff), MEM_POINTER);
-      }
+      memory_read(cpu->mem, sample_q[num_cycles - 2].data,  (op2 << 8) + op1              , MEM_POINTER);
+      memory_read(cpu->mem, sample_q[num_cycles - 1].data, ((op2 << 8) + op1 + 1) & 0xffff, MEM_POINTER);
+      break;
+   case PTR_IND16_NMOS:
+      // As above, but the pointer wraps within the page
+      memory_read(cpu->mem, sample_q[num_cycles - 2].data, (op2 << 8) +   op1             , MEM_POINTER);
+      memory_read(cpu->mem, sample_q[num_cycles - 1].data, (op2 << 8) + ((op1 + 1) & 0xff), MEM_POINTER);
       break;
-   case IND1X:
+   case PTR_IND1X:
       // JMP: <opcode=7C> <op1> <op2> <dummy> <read new pcl> <read new pch>
-      if (X >= 0) {
-         memory_read(sample_q[num_cycles - 2].data, ((op2 << 8) + op1 + X    ) & 0xffff, MEM_POINTER);
-         memory_read(sample_q[num_cycles - 1].data, ((op2 << 8) + op1 + X + 1) & 0xffff, MEM_POINTER);
+      if (cpu->X >= 0) {
+         memory_read(cpu->mem, sample_q[num_cycles - 2].data, ((op2 << 8) + op1 + cpu->X    ) & 0xffff, MEM_POINTER);
+         memory_read(cpu->mem, sample_q[num_cycles - 1].data, ((op2 << 8) + op1 + cpu->X + 1) & 0xffff, MEM_POINTER);
       }
       break;
    default:
       break;
    }
 
-   if (instr->emulate) {
+   if (plan->emulate) {
 
       int operand;
       int operand_verify = 0;
-      if (instr->optype == RMWOP) {
+      switch (plan->operand) {
+      case OPERAND_RMW:
          // e.g. <opcode> <op1> <op2> <read old> <write old> <write new>
          //      <opcode> <op1>       <read old> <write old> <write new>
          // Want to pick off the read
          operand = sample_q[num_cycles - 3].data;
          operand_verify = sample_q[num_cycles - 3].verify;
-      } else if (instr->optype == BRANCHOP) {
+         break;
+      case OPERAND_BRANCH:
          // the operand is true if branch taken
          operand = (num_cycles != 2);
-      } else if (opcode == 0x00) {
-         // BRK: the operand is the data pushed to the stack (PCH, PCL, P)
-         // <opcode> <op1> <write pch> <write pcl> <write p> <read rst> <read rsth>
-         operand = (sample_q[2].data << 16) +  (sample_q[3].data << 8) + sample_q[4].data;
-      } else if (opcode == 0x20) {
+         break;
+      case OPERAND_JSR:
          // JSR: the operand is the data pushed to the stack (PCH, PCL)
          // <opcode> <op1> <read dummy> <write pch> <write pcl> <op2>
-         operand = (sample_q[jsr_pch].data << 8) + sample_q[jsr_pcl].data;
-      } else if (opcode == 0x40) {
+         operand = (sample_q[cpu->jsr_pch].data << 8) + sample_q[cpu->jsr_pcl].data;
+         break;
+      case OPERAND_RTI:
          // RTI: the operand is the data pulled from the stack (P, PCL, PCH)
          // C02:      <opcode> <op1> <read dummy> <read p>            <read pcl> <read pch>
          // AlanDC02: <opcode> <op1> <read dummy> <read p> <read pcl> <read pcl> <read pch>
          operand = (sample_q[num_cycles - 1].data << 16) +  (sample_q[num_cycles - 2].data << 8) + sample_q[3].data;
-      } else if (opcode == 0x60) {
+         break;
+      case OPERAND_RTS:
          // RTS: the operand is the data pulled from the stack (PCL, PCH)
          // <opcode> <op1> <read dummy> <read pcl> <read pch>
          operand = (sample_q[4].data << 8) + sample_q[3].data;
-      } else if (instr->mode == IMM) {
+         break;
+      case OPERAND_IMM:
          // Immediate addressing mode: the operand is the 2nd byte of the instruction
          operand = op1;
-      } else if (instr->decimalcorrect && (D == 1)) {
-         // read operations on the C02 that have an extra cycle added
-         operand = sample_q[num_cycles - 2].data;
-      } else {
+         break;
+      case OPERAND_DECIMAL:
+         if (cpu->D == 1) {
+            // read operations on the C02 that have an extra cycle added
+            operand = sample_q[num_cycles - 2].data;
+         } else {
+            operand = sample_q[num_cycles - 1].data;
+            operand_verify = sample_q[num_cycles - 1].verify;
+         }
+         break;
+      default:
          // default to using the last bus cycle as the operand
          operand = sample_q[num_cycles - 1].data;
          operand_verify = sample_q[num_cycles - 1].verify;
+         break;
       }
 
       // Operand 2 is the value written back in a store or read-modify-write
       // See RMW comment above for bus cycles
       operand_t operand2 = operand;
-      if (instr->optype == RMWOP || instr->optype == WRITEOP) {
+      if (plan->access & ACCESS_WRITE) {
          operand2 = sample_q[num_cycles - 1].data;
       }
 
       // For instructions that read or write memory, we need to work out the effective address
       // Note: not needed for stack operations, as S is used directly
       int ea = -1;
-      int index;
-      switch (instr->mode) {
-      case ZP:
-      case ZPR:
+      switch (plan->ea) {
+      case EA_ZP:
          ea = op1;
          break;
-      case ZPX:
-      case ZPY:
-         index = instr->mode == ZPX ? X : Y;
-         if (index >= 0) {
-            ea = (op1 + index) & 0xff;
+      case EA_ZPX:
+         if (cpu->X >= 0) {
+            ea = (op1 + cpu->X) & 0xff;
          }
          break;
-      case INDY:
+      case EA_ZPY:
+         if (cpu->Y >= 0) {
+            ea = (op1 + cpu->Y) & 0xff;
+         }
+         break;
+      case EA_INDY:
          // <opcpde> <op1> <addrlo> <addrhi> [ <page crossing>] <<operand> [ <extra cycle in dec mode> ]
-         index = Y;
-         if (index >= 0) {
+         if (cpu->Y >= 0) {
             ea = (sample_q[3].data << 8) + sample_q[2].data;
-            ea = (ea + index) & 0xffff;
+            ea = (ea + cpu->Y) & 0xffff;
          }
          break;
-      case INDX:
+      case EA_INDX:
          // <opcpde> <op1> <dummy> <addrlo> <addrhi> <operand> [ <extra cycle in dec mode> ]
          ea = (sample_q[4].data << 8) + sample_q[3].data;
          break;
-      case IND:
+      case EA_IND:
          // <opcpde> <op1> <addrlo> <addrhi> <operand> [ <extra cycle in dec mode> ]
-         ea = (sample_q[arlet ? 4 : 3].data << 8) + sample_q[arlet ? 3 : 2].data;
+         ea = (sample_q[3].data << 8) + sample_q[2].data;
          break;
-      case ABS:
+      case EA_IND_ARLET:
+         // <opcpde> <op1> <addrlo> <addrlo> <addrhi> <operand>
+         ea = (sample_q[4].data << 8) + sample_q[3].data;
+         break;
+      case EA_ABS:
          ea = op2 << 8 | op1;
          break;
-      case ABSX:
-      case ABSY:
-         index = instr->mode == ABSX ? X : Y;
-         if (index >= 0) {
-            ea = ((op2 << 8 | op1) + index) & 0xffff;
+      case EA_ABSX:
+         if (cpu->X >= 0) {
+            ea = ((op2 << 8 | op1) + cpu->X) & 0xffff;
+         }
+         break;
+      case EA_ABSY:
+         if (cpu->Y >= 0) {
+            ea = ((op2 << 8 | op1) + cpu->Y) & 0xffff;
          }
          break;
       default:
@@ -863,18 +1091,18 @@ static void em_6502_emulate(sample_t *sample_q, int num_cycles, instruction_t *i
       }
 
       // Model memory reads
-      if (ea >= 0 && (instr->optype == READOP || instr->optype == RMWOP)) {
-         memory_read(operand, ea, MEM_DATA);
-         if (verify_mask) {
+      if (ea >= 0 && (plan->access & ACCESS_READ)) {
+         memory_read(cpu->mem, operand, ea, MEM_DATA);
+         if (cpu->verify_mask) {
             if (ea >= 0xe810 && ea <= 0xe82f ||
                ea >= 0xe840 && ea <= 0xe84f ||
                ea >= 0xe880 && ea <= 0xe88f ||
                ea >= 0xb000 && ea < 0xffff) {
             }
             else {
-               int bus_bits = operand & verify_mask;
+               int bus_bits = operand & cpu->verify_mask;
                if (bus_bits != operand_verify) {
-                  printf("Memory verify fail at %x: data bus: %x, ram bus: %x\n", ea, bus_bits, operand_verify);
+                  output_printf("Memory verify fail at %x: data bus: %x, ram bus: %x\n", ea, bus_bits, operand_verify);
                }
             }
          }
@@ -882,9 +1110,9 @@ static void em_6502_emulate(sample_t *sample_q, int num_cycles, instruction_t *i
 
       // Execute the instruction specific function
       // (This returns -1 if the result is unknown or invalid)
-      int result = instr->emulate(operand, ea);
+      int result = plan->emulate(cpu, operand, ea);
 
-      if (instr->optype == WRITEOP || instr->optype == RMWOP) {
+      if (plan->access & ACCESS_WRITE) {
 
          // STA STX STY STZ
          // INC DEX ASL LSR ROL ROR
@@ -892,169 +1120,150 @@ static void em_6502_emulate(sample_t *sample_q, int num_cycles, instruction_t *i
 
          // Check result of instruction against bye
          if (result >= 0 && result != operand2) {
-            failflag |= 1;
+            cpu->failflag |= 1;
          }
 
          // Model memory writes based on result seen on bus
          if (ea >= 0) {
-            memory_write(operand2,  ea, MEM_DATA);
+            memory_write(cpu->mem, operand2,  ea, MEM_DATA);
          }
       }
    }
 
    // Look for control flow changes and update the PC
-   if (opcode == 0x40 || opcode == 0x6c || opcode == 0x7c) {
+   switch (plan->pc) {
+   case PC_INDIRECT:
       // RTI, JMP (ind), JMP (ind, X)
-      PC = (sample_q[num_cycles - 1].data << 8) | sample_q[num_cycles - 2].data;
-   } else if (opcode == 0x20 || opcode == 0x4c) {
+      cpu->PC = (sample_q[num_cycles - 1].data << 8) | sample_q[num_cycles - 2].data;
+      break;
+   case PC_ABSOLUTE:
       // JSR abs, JMP abs
-      PC = op2 << 8 | op1;
-   } else if (PC < 0) {
-      // PC value is not known yet, everything below this point is relative
-      PC = -1;
-   } else if (opcode == 0x80) {
-      // BRA
-      PC = (PC + ((int8_t)(op1)) + 2) & 0xffff;
-   } else if (rockwell && ((opcode & 0x0f) == 0x0f) && (num_cycles != 5)) {
-      // BBR/BBS: op2 if taken
-      PC = (PC + ((int8_t)(op2)) + 3) & 0xffff;
-   } else if ((opcode & 0x1f) == 0x10 && num_cycles != 2) {
-      // BXX: op1 if taken
-      PC = (PC + ((int8_t)(op1)) + 2) & 0xffff;
-   } else {
-      // Otherwise, increment pc by length of instuction
-      PC = (PC + opcount + 1) & 0xffff;
-   }
-}
-
-static int em_6502_disassemble(char *buffer, instruction_t *instruction) {
-
-   int numchars;
-   int offset;
-   char target[16];
-
-   // Unpack the instruction bytes
-   int opcode = instruction->opcode;
-   int op1    = instruction->op1;
-   int op2    = instruction->op2;
-   int pc     = instruction->pc;
-
-   // lookup the entry for the instruction
-   InstrType *instr = &instr_table[opcode];
-
-   const char *mnemonic = instr->mnemonic;
-   const char *fmt = instr->fmt;
-   switch (instr->mode) {
-   case IMP:
-   case IMPA:
-      numchars = sprintf(buffer, fmt, mnemonic);
+      cpu->PC = op2 << 8 | op1;
       break;
-   case BRA:
-      // Calculate branch target using op1 for normal branches
-      offset = (int8_t) op1;
-      if (pc < 0) {
-         if (offset < 0) {
-            sprintf(target, "pc-%d", -offset);
-         } else {
-            sprintf(target,"pc+%d", offset);
-         }
-      } else {
-         sprintf(target, "%04X", (pc + 2 + offset) & 0xffff);
-      }
-      numchars = sprintf(buffer, fmt, mnemonic, target);
+   case PC_RTS:
+      // <opcode> <op1> <read dummy> <read pcl> <read pch> <read dummy>
+      cpu->PC = (((sample_q[4].data << 8) | sample_q[3].data) + 1) & 0xffff;
       break;
-   case ZPR:
-      // Calculate branch target using op2 for BBR/BBS
-      offset = (int8_t) op2;
-      if (pc < 0) {
-         if (offset < 0) {
-            sprintf(target, "pc-%d", -offset);
+   default:
+      // Everything else is relative, so the PC value must be known
+      if (cpu->PC >= 0) {
+         if (plan->pc == PC_BRA) {
+            // BRA
+            cpu->PC = (cpu->PC + ((int8_t)(op1)) + 2) & 0xffff;
+         } else if (plan->pc == PC_BBX && num_cycles != 5) {
+            // BBR/BBS: op2 if taken
+            cpu->PC = (cpu->PC + ((int8_t)(op2)) + 3) & 0xffff;
+         } else if (plan->pc == PC_BXX && num_cycles != 2) {
+            // BXX: op1 if taken
+            cpu->PC = (cpu->PC + ((int8_t)(op1)) + 2) & 0xffff;
          } else {
-            sprintf(target,"pc+%d", offset);
+            // Otherwise, increment pc by length of instuction
+            cpu->PC = (cpu->PC + opcount + 1) & 0xffff;
          }
-      } else {
-         sprintf(target, "%04X", (pc + 3 + offset) & 0xffff);
       }
-      numchars = sprintf(buffer, fmt, mnemonic, op1, target);
-      break;
-   case IMM:
-   case ZP:
-   case ZPX:
-   case ZPY:
-   case INDX:
-   case INDY:
-   case IND:
-      numchars = sprintf(buffer, fmt, mnemonic, op1);
       break;
-   case ABS:
-   case ABSX:
-   case ABSY:
-   case IND16:
-   case IND1X:
-      numchars = sprintf(buffer, fmt, mnemonic, op1, op2);
-      break;
-   default:
-      numchars = 0;
    }
+}
 
-   return numchars;
+static int em_6502_disassemble(void *context, char *buffer, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
+   return disasm_write(buffer, &cpu->instr_table[instruction->opcode].dis, instruction);
 }
 
-static int em_6502_get_PC() {
-   return PC;
+static int em_6502_get_PC(void *context) {
+   cpu_state_t *cpu = context;
+   return cpu->PC;
 }
 
-static int em_6502_get_PB() {
+static int em_6502_get_PB(void *context) {
    return 0;
 }
 
-static int em_6502_read_memory(int address) {
-   return memory_read_raw(address);
+static int em_6502_read_memory(void *context, int address) {
+   cpu_state_t *cpu = context;
+   return memory_read_raw(cpu->mem, address);
 }
 
-static char *em_6502_get_state(char *buffer) {
+static char *em_6502_get_state(void *context, char *buffer) {
+   cpu_state_t *cpu = context;
    strcpy(buffer, default_state);
-   if (A >= 0) {
-      write_hex2(buffer + OFFSET_A, A);
+   if (cpu->A >= 0) {
+      write_hex2(buffer + OFFSET_A, cpu->A);
    }
-   if (X >= 0) {
-      write_hex2(buffer + OFFSET_X, X);
+   if (cpu->X >= 0) {
+      write_hex2(buffer + OFFSET_X, cpu->X);
    }
-   if (Y >= 0) {
-      write_hex2(buffer + OFFSET_Y, Y);
+   if (cpu->Y >= 0) {
+      write_hex2(buffer + OFFSET_Y, cpu->Y);
    }
-   if (S >= 0) {
-      write_hex2(buffer + OFFSET_S, S);
+   if (cpu->S >= 0) {
+      write_hex2(buffer + OFFSET_S, cpu->S);
    }
-   if (N >= 0) {
-      buffer[OFFSET_N] = '0' + N;
+   if (cpu->N >= 0) {
+      buffer[OFFSET_N] = '0' + cpu->N;
    }
-   if (V >= 0) {
-      buffer[OFFSET_V] = '0' + V;
+   if (cpu->V >= 0) {
+      buffer[OFFSET_V] = '0' + cpu->V;
    }
-   if (D >= 0) {
-      buffer[OFFSET_D] = '0' + D;
+   if (cpu->D >= 0) {
+      buffer[OFFSET_D] = '0' + cpu->D;
    }
-   if (I >= 0) {
-      buffer[OFFSET_I] = '0' + I;
+   if (cpu->I >= 0) {
+      buffer[OFFSET_I] = '0' + cpu->I;
    }
-   if (Z >= 0) {
-      buffer[OFFSET_Z] = '0' + Z;
+   if (cpu->Z >= 0) {
+      buffer[OFFSET_Z] = '0' + cpu->Z;
    }
-   if (C >= 0) {
-      buffer[OFFSET_C] = '0' + C;
+   if (cpu->C >= 0) {
+      buffer[OFFSET_C] = '0' + cpu->C;
    }
    return buffer + OFFSET_END;
 }
 
-static int em_6502_get_and_clear_fail() {
-   int ret = failflag;
-   failflag = 0;
+static int em_6502_get_and_clear_fail(void *context) {
+   cpu_state_t *cpu = context;
+   int ret = cpu->failflag | memory_get_and_clear_fail(cpu->mem);
+   cpu->failflag = 0;
    return ret;
 }
 
+static int em_6502_get_hidden_state(void *context) {
+   cpu_state_t *cpu = context;
+   return cpu->mhz1_phase;
+}
+
+// The state saved in a checkpoint, i.e. everything carried from one
+// instruction to the next
+static int get_state_fields(cpu_state_t *cpu, int *fields[EM_MAX_STATE]) {
+   int *list[] = {
+      &cpu->A, &cpu->X, &cpu->Y, &cpu->S, &cpu->PC,
+      &cpu->N, &cpu->V, &cpu->D, &cpu->I, &cpu->Z, &cpu->C,
+      &cpu->mhz1_phase
+   };
+   memcpy(fields, list, sizeof(list));
+   return sizeof(list) / sizeof(list[0]);
+}
+
+static int em_6502_save_state(void *context, int *state) {
+   int *fields[EM_MAX_STATE];
+   int n = get_state_fields(context, fields);
+   for (int i = 0; i < n; i++) {
+      state[i] = *fields[i];
+   }
+   return n;
+}
+
+static void em_6502_restore_state(void *context, const int *state) {
+   int *fields[EM_MAX_STATE];
+   int n = get_state_fields(context, fields);
+   for (int i = 0; i < n; i++) {
+      *fields[i] = state[i];
+   }
+}
+
 cpu_emulator_t em_6502 = {
-   .init = em_6502_init,
+   .create = em_6502_create,
+   .destroy = em_6502_destroy,
    .match_interrupt = em_6502_match_interrupt,
    .count_cycles = em_6502_count_cycles,
    .reset = em_6502_reset,
@@ -1065,777 +1274,781 @@ cpu_emulator_t em_6502 = {
    .get_PB = em_6502_get_PB,
    .read_memory = em_6502_read_memory,
    .get_state = em_6502_get_state,
-   .get_and_clear_fail = em_6502_get_and_clear_fail
+   .get_and_clear_fail = em_6502_get_and_clear_fail,
+   .get_hidden_state = em_6502_get_hidden_state,
+   .count_cycles_with_sync = count_cycles_with_sync,
+   .count_cycles_without_sync = count_cycles_without_sync,
+   .save_state = em_6502_save_state,
+   .restore_state = em_6502_restore_state
 };
 
 // ====================================================================
 // Individual Instructions
 // ====================================================================
 
-static int op_ADC(operand_t operand, ea_t ea) {
-   if (A >= 0 && C >= 0) {
-      if (D == 1) {
+static int op_ADC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0 && cpu->C >= 0) {
+      if (cpu->D == 1) {
          // Decimal mode ADC
          int al;
          int ah;
          uint8_t tmp;
          ah = 0;
-         Z = N = 0;
-         tmp = A + operand + (C ? 1 : 0);
+         cpu->Z = cpu->N = 0;
+         tmp = cpu->A + operand + (cpu->C ? 1 : 0);
          if (!tmp) {
-            Z = 1;
+            cpu->Z = 1;
          }
-         al = (A & 0xF) + (operand & 0xF) + (C ? 1 : 0);
+         al = (cpu->A & 0xF) + (operand & 0xF) + (cpu->C ? 1 : 0);
          if (al > 9) {
             al -= 10;
             al &= 0xF;
             ah = 1;
          }
-         ah += ((A >> 4) + (operand >> 4));
+         ah += ((cpu->A >> 4) + (operand >> 4));
          if (ah & 8) {
-            N = 1;
+            cpu->N = 1;
          }
-         V = (((ah << 4) ^ A) & 128) && !((A ^ operand) & 128);
-         C = 0;
+         cpu->V = (((ah << 4) ^ cpu->A) & 128) && !((cpu->A ^ operand) & 128);
+         cpu->C = 0;
          if (ah > 9) {
-            C = 1;
+            cpu->C = 1;
             ah -= 10;
             ah &= 0xF;
          }
-         A = (al & 0xF) | (ah << 4);
+         cpu->A = (al & 0xF) | (ah << 4);
          // On 65C02 ADC, only the NZ flags are different to the 6502
-         if (c02) {
-            set_NZ(A);
+         if (cpu->c02) {
+            set_NZ(cpu, cpu->A);
          }
          // Arlet's core doesn't define the behaviour of the overflow flag in decimal mode
-         if (arlet) {
-            V = -1;
+         if (cpu->arlet) {
+            cpu->V = -1;
          }
       } else {
          // Normal mode ADC
-         int tmp = A + operand + C;
-         C = (tmp >> 8) & 1;
-         V = (((A ^ operand) & 0x80) == 0) && (((A ^ tmp) & 0x80) != 0);
-         A = tmp & 255;
-         set_NZ(A);
+         int tmp = cpu->A + operand + cpu->C;
+         cpu->C = (tmp >> 8) & 1;
+         cpu->V = (((cpu->A ^ operand) & 0x80) == 0) && (((cpu->A ^ tmp) & 0x80) != 0);
+         cpu->A = tmp & 255;
+         set_NZ(cpu, cpu->A);
       }
    } else {
-      A = -1;
-      set_NVZC_unknown();
+      cpu->A = -1;
+      set_NVZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_AND(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      A = A & operand;
-      set_NZ(A);
+static int op_AND(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->A = cpu->A & operand;
+      set_NZ(cpu, cpu->A);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_ASLA(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      C = (A >> 7) & 1;
-      A = (A << 1) & 255;
-      set_NZ(A);
+static int op_ASLA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->C = (cpu->A >> 7) & 1;
+      cpu->A = (cpu->A << 1) & 255;
+      set_NZ(cpu, cpu->A);
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_ASL(operand_t operand, ea_t ea) {
-   C = (operand >> 7) & 1;
+static int op_ASL(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->C = (operand >> 7) & 1;
    int tmp = (operand << 1) & 255;
-   set_NZ(tmp);
+   set_NZ(cpu, tmp);
    return tmp;
 }
 
-static int op_BCC(operand_t branch_taken, ea_t ea) {
-   if (C >= 0) {
-      if (C == branch_taken) {
-         failflag = 1;
+static int op_BCC(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->C >= 0) {
+      if (cpu->C == branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      C = 1 - branch_taken;
+      cpu->C = 1 - branch_taken;
    }
    return -1;
 }
 
-static int op_BCS(operand_t branch_taken, ea_t ea) {
-   if (C >= 0) {
-      if (C != branch_taken) {
-         failflag = 1;
+static int op_BCS(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->C >= 0) {
+      if (cpu->C != branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      C = branch_taken;
+      cpu->C = branch_taken;
    }
    return -1;
 }
 
-static int op_BNE(operand_t branch_taken, ea_t ea) {
-   if (Z >= 0) {
-      if (Z == branch_taken) {
-         failflag = 1;
+static int op_BNE(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->Z >= 0) {
+      if (cpu->Z == branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      Z = 1 - branch_taken;
+      cpu->Z = 1 - branch_taken;
    }
    return -1;
 }
 
-static int op_BEQ(operand_t branch_taken, ea_t ea) {
-   if (Z >= 0) {
-      if (Z != branch_taken) {
-         failflag = 1;
+static int op_BEQ(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->Z >= 0) {
+      if (cpu->Z != branch_taken) {
+         cpu->failflag = 1;
         }
    } else {
-      Z = branch_taken;
+      cpu->Z = branch_taken;
    }
    return -1;
 }
 
-static int op_BPL(operand_t branch_taken, ea_t ea) {
-   if (N >= 0) {
-      if (N == branch_taken) {
-         failflag = 1;
+static int op_BPL(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->N >= 0) {
+      if (cpu->N == branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      N = 1 - branch_taken;
+      cpu->N = 1 - branch_taken;
    }
    return -1;
 }
 
-static int op_BMI(operand_t branch_taken, ea_t ea) {
-   if (N >= 0) {
-      if (N != branch_taken) {
-         failflag = 1;
+static int op_BMI(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->N >= 0) {
+      if (cpu->N != branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      N = branch_taken;
+      cpu->N = branch_taken;
    }
    return -1;
 }
 
-static int op_BVC(operand_t branch_taken, ea_t ea) {
-   if (V >= 0) {
-      if (V == branch_taken) {
-         failflag = 1;
+static int op_BVC(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->V >= 0) {
+      if (cpu->V == branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      V = 1 - branch_taken;
+      cpu->V = 1 - branch_taken;
    }
    return -1;
 }
 
-static int op_BVS(operand_t branch_taken, ea_t ea) {
-   if (V >= 0) {
-      if (V != branch_taken) {
-         failflag = 1;
+static int op_BVS(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->V >= 0) {
+      if (cpu->V != branch_taken) {
+         cpu->failflag = 1;
         }
    } else {
-      V = branch_taken;
+      cpu->V = branch_taken;
    }
    return -1;
 }
 
-static int op_BIT_IMM(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      Z = (A & operand) == 0;
+static int op_BIT_IMM(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->Z = (cpu->A & operand) == 0;
    } else {
-      Z = -1;
+      cpu->Z = -1;
    }
    return -1;
 }
 
-static int op_BIT(operand_t operand, ea_t ea) {
-   N = (operand >> 7) & 1;
-   V = (operand >> 6) & 1;
-   if (A >= 0) {
-      Z = (A & operand) == 0;
+static int op_BIT(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->N = (operand >> 7) & 1;
+   cpu->V = (operand >> 6) & 1;
+   if (cpu->A >= 0) {
+      cpu->Z = (cpu->A & operand) == 0;
    } else {
-      Z = -1;
+      cpu->Z = -1;
    }
    return -1;
 }
 
-static int op_CLC(operand_t operand, ea_t ea) {
-   C = 0;
+static int op_CLC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->C = 0;
    return -1;
 }
 
-static int op_CLD(operand_t operand, ea_t ea) {
-   D = 0;
+static int op_CLD(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->D = 0;
    return -1;
 }
 
-static int op_CLI(operand_t operand, ea_t ea) {
-   I = 0;
+static int op_CLI(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->I = 0;
    return -1;
 }
 
-static int op_CLV(operand_t operand, ea_t ea) {
-   V = 0;
+static int op_CLV(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->V = 0;
    return -1;
 }
 
-static int op_CMP(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      int tmp = A - operand;
-      C = tmp >= 0;
-      set_NZ(tmp);
+static int op_CMP(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      int tmp = cpu->A - operand;
+      cpu->C = tmp >= 0;
+      set_NZ(cpu, tmp);
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_CPX(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      int tmp = X - operand;
-      C = tmp >= 0;
-      set_NZ(tmp);
+static int op_CPX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      int tmp = cpu->X - operand;
+      cpu->C = tmp >= 0;
+      set_NZ(cpu, tmp);
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_CPY(operand_t operand, ea_t ea) {
-   if (Y >= 0) {
-      int tmp = Y - operand;
-      C = tmp >= 0;
-      set_NZ(tmp);
+static int op_CPY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->Y >= 0) {
+      int tmp = cpu->Y - operand;
+      cpu->C = tmp >= 0;
+      set_NZ(cpu, tmp);
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_DECA(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      A = (A - 1) & 255;
-      set_NZ(A);
+static int op_DECA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->A = (cpu->A - 1) & 255;
+      set_NZ(cpu, cpu->A);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_DEC(operand_t operand, ea_t ea) {
+static int op_DEC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    int tmp = (operand - 1) & 255;
-   set_NZ(tmp);
+   set_NZ(cpu, tmp);
    return tmp;
 }
 
-static int op_DEX(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      X = (X - 1) & 255;
-      set_NZ(X);
+static int op_DEX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      cpu->X = (cpu->X - 1) & 255;
+      set_NZ(cpu, cpu->X);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_DEY(operand_t operand, ea_t ea) {
-   if (Y >= 0) {
-      Y = (Y - 1) & 255;
-      set_NZ(Y);
+static int op_DEY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->Y >= 0) {
+      cpu->Y = (cpu->Y - 1) & 255;
+      set_NZ(cpu, cpu->Y);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_EOR(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      A = A ^ operand;
-      set_NZ(A);
+static int op_EOR(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->A = cpu->A ^ operand;
+      set_NZ(cpu, cpu->A);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_INCA(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      A = (A + 1) & 255;
-      set_NZ(A);
+static int op_INCA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->A = (cpu->A + 1) & 255;
+      set_NZ(cpu, cpu->A);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_INC(operand_t operand, ea_t ea) {
+static int op_INC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    int tmp = (operand + 1) & 255;
-   set_NZ(tmp);
+   set_NZ(cpu, tmp);
    return tmp;
 }
 
-static int op_INX(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      X = (X + 1) & 255;
-      set_NZ(X);
+static int op_INX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      cpu->X = (cpu->X + 1) & 255;
+      set_NZ(cpu, cpu->X);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_INY(operand_t operand, ea_t ea) {
-   if (Y >= 0) {
-      Y = (Y + 1) & 255;
-      set_NZ(Y);
+static int op_INY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->Y >= 0) {
+      cpu->Y = (cpu->Y + 1) & 255;
+      set_NZ(cpu, cpu->Y);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_JSR(operand_t operand, ea_t ea) {
+static int op_JSR(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // JSR: the operand is the data pushed to the stack (PCH, PCL)
-   push16(operand);
+   push16(cpu, operand);
    return -1;
 }
 
-static int op_LDA(operand_t operand, ea_t ea) {
-   A = operand;
-   set_NZ(A);
+static int op_LDA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->A = operand;
+   set_NZ(cpu, cpu->A);
    return -1;
 }
 
-static int op_LDX(operand_t operand, ea_t ea) {
-   X = operand;
-   set_NZ(X);
+static int op_LDX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->X = operand;
+   set_NZ(cpu, cpu->X);
    return -1;
 }
 
-static int op_LDY(operand_t operand, ea_t ea) {
-   Y = operand;
-   set_NZ(Y);
+static int op_LDY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->Y = operand;
+   set_NZ(cpu, cpu->Y);
    return -1;
 }
 
-static int op_LSRA(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      C = A & 1;
-      A = A >> 1;
-      set_NZ(A);
+static int op_LSRA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->C = cpu->A & 1;
+      cpu->A = cpu->A >> 1;
+      set_NZ(cpu, cpu->A);
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_LSR(operand_t operand, ea_t ea) {
-   C = operand & 1;
+static int op_LSR(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->C = operand & 1;
    int tmp = operand >> 1;
-   set_NZ(tmp);
+   set_NZ(cpu, tmp);
    return tmp;
 }
 
-static int op_ORA(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      A = A | operand;
-      set_NZ(A);
+static int op_ORA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->A = cpu->A | operand;
+      set_NZ(cpu, cpu->A);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_PHA(operand_t operand, ea_t ea) {
-   push8(operand);
-   op_STA(operand, -1);
+static int op_PHA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   push8(cpu, operand);
+   op_STA(cpu, operand, -1);
    return -1;
 }
 
-static int op_PHP(operand_t operand, ea_t ea) {
-   push8(operand);
-   check_FLAGS(operand);
-   set_FLAGS(operand);
+static int op_PHP(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   push8(cpu, operand);
+   check_FLAGS(cpu, operand);
+   set_FLAGS(cpu, operand);
    return -1;
 }
 
-static int op_PHX(operand_t operand, ea_t ea) {
-   push8(operand);
-   op_STX(operand, -1);
+static int op_PHX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   push8(cpu, operand);
+   op_STX(cpu, operand, -1);
    return -1;
 }
 
-static int op_PHY(operand_t operand, ea_t ea) {
-   push8(operand);
-   op_STY(operand, -1);
+static int op_PHY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   push8(cpu, operand);
+   op_STY(cpu, operand, -1);
    return -1;
 }
 
-static int op_PLA(operand_t operand, ea_t ea) {
-   A = operand;
-   set_NZ(A);
-   pop8(operand);
+static int op_PLA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->A = operand;
+   set_NZ(cpu, cpu->A);
+   pop8(cpu, operand);
    return -1;
 }
 
-static int op_PLP(operand_t operand, ea_t ea) {
-   set_FLAGS(operand);
-   pop8(operand);
+static int op_PLP(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   set_FLAGS(cpu, operand);
+   pop8(cpu, operand);
    return -1;
 }
 
-static int op_PLX(operand_t operand, ea_t ea) {
-   X = operand;
-   set_NZ(X);
-   pop8(operand);
+static int op_PLX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->X = operand;
+   set_NZ(cpu, cpu->X);
+   pop8(cpu, operand);
    return -1;
 }
 
-static int op_PLY(operand_t operand, ea_t ea) {
-   Y = operand;
-   set_NZ(Y);
-   pop8(operand);
+static int op_PLY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->Y = operand;
+   set_NZ(cpu, cpu->Y);
+   pop8(cpu, operand);
    return -1;
 }
 
-static int op_ROLA(operand_t operand, ea_t ea) {
-   if (A >= 0 && C >= 0) {
-      int tmp = (A << 1) + C;
-      C = (tmp >> 8) & 1;
-      A = tmp & 255;
-      set_NZ(A);
+static int op_ROLA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0 && cpu->C >= 0) {
+      int tmp = (cpu->A << 1) + cpu->C;
+      cpu->C = (tmp >> 8) & 1;
+      cpu->A = tmp & 255;
+      set_NZ(cpu, cpu->A);
    } else {
-      A = -1;
-      set_NZC_unknown();
+      cpu->A = -1;
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_ROL(operand_t operand, ea_t ea) {
-   if (C >= 0) {
-      int tmp = (operand << 1) + C;
-      C = (tmp >> 8) & 1;
+static int op_ROL(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->C >= 0) {
+      int tmp = (operand << 1) + cpu->C;
+      cpu->C = (tmp >> 8) & 1;
       tmp = tmp & 255;
-      set_NZ(tmp);
+      set_NZ(cpu, tmp);
       return tmp;
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
       return -1;
    }
 }
 
-static int op_RORA(operand_t operand, ea_t ea) {
-   if (A >= 0 && C >= 0) {
-      int tmp = (A >> 1) + (C << 7);
-      C = A & 1;
-      A = tmp;
-      set_NZ(A);
+static int op_RORA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0 && cpu->C >= 0) {
+      int tmp = (cpu->A >> 1) + (cpu->C << 7);
+      cpu->C = cpu->A & 1;
+      cpu->A = tmp;
+      set_NZ(cpu, cpu->A);
    } else {
-      A = -1;
-      set_NZC_unknown();
+      cpu->A = -1;
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_ROR(operand_t operand, ea_t ea) {
-   if (C >= 0) {
-      int tmp = (operand >> 1) + (C << 7);
-      C = operand & 1;
-      set_NZ(tmp);
+static int op_ROR(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->C >= 0) {
+      int tmp = (operand >> 1) + (cpu->C << 7);
+      cpu->C = operand & 1;
+      set_NZ(cpu, tmp);
       return tmp;
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
       return -1;
    }
 }
 
-static int op_RTS(operand_t operand, ea_t ea) {
+static int op_RTS(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // RTS: the operand is the data pulled from the stack (PCL, PCH)
-   pop8(operand);
-   pop8(operand >> 8);
-   // The +1 is handled elsewhere
-   PC = operand & 0xffff;
+   pop8(cpu, operand);
+   pop8(cpu, operand >> 8);
+   // The PC is updated from the plan
    return -1;
 }
 
-static int op_RTI(operand_t operand, ea_t ea) {
+static int op_RTI(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // RTI: the operand is the data pulled from the stack (P, PCL, PCH, PBR)
-   set_FLAGS(operand);
-   pop8(operand);
-   pop8(operand >> 8);
-   pop8(operand >> 16);
+   set_FLAGS(cpu, operand);
+   pop8(cpu, operand);
+   pop8(cpu, operand >> 8);
+   pop8(cpu, operand >> 16);
    return -1;
 }
 
-static int op_SBC(operand_t operand, ea_t ea) {
-   if (A >= 0 && C >= 0) {
-      if (D == 1) {
+static int op_SBC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0 && cpu->C >= 0) {
+      if (cpu->D == 1) {
          // Decimal mode SBC
-         if (c02) {
+         if (cpu->c02) {
             int al;
             int tmp;
             // On 65C02 SBC, both flags and A can be different to the 6502
-            al = (A & 15) - (operand & 15) - ((C) ? 0 : 1);
-            tmp = A - operand - ((C) ? 0 : 1);
-            C = (tmp & 0x100) ? 0 : 1;
-            V = ((A ^ operand) & 0x80) && ((A ^ tmp) & 0x80);
+            al = (cpu->A & 15) - (operand & 15) - ((cpu->C) ? 0 : 1);
+            tmp = cpu->A - operand - ((cpu->C) ? 0 : 1);
+            cpu->C = (tmp & 0x100) ? 0 : 1;
+            cpu->V = ((cpu->A ^ operand) & 0x80) && ((cpu->A ^ tmp) & 0x80);
             if (tmp < 0) {
                tmp = tmp - 0x60;
             }
             if (al < 0) {
                tmp = tmp - 0x06;
             }
-            A = tmp & 255;
-            set_NZ(A);
+            cpu->A = tmp & 255;
+            set_NZ(cpu, cpu->A);
          } else {
             int al;
             int ah;
             int hc = 0;
-            uint8_t tmp = A - operand - ((C) ? 0 : 1);
-            Z = N = 0;
+            uint8_t tmp = cpu->A - operand - ((cpu->C) ? 0 : 1);
+            cpu->Z = cpu->N = 0;
             if (!(tmp)) {
-               Z = 1;
+               cpu->Z = 1;
             }
-            al = (A & 15) - (operand & 15) - ((C) ? 0 : 1);
+            al = (cpu->A & 15) - (operand & 15) - ((cpu->C) ? 0 : 1);
             if (al & 16) {
                al -= 6;
                al &= 0xF;
                hc = 1;
             }
-            ah = (A >> 4) - (operand >> 4);
+            ah = (cpu->A >> 4) - (operand >> 4);
             if (hc) {
                ah--;
             }
-            if ((A - (operand + ((C) ? 0 : 1))) & 0x80) {
-               N = 1;
+            if ((cpu->A - (operand + ((cpu->C) ? 0 : 1))) & 0x80) {
+               cpu->N = 1;
             }
-            V = ((A ^ operand) & 0x80) && ((A ^ tmp) & 0x80);
-            C = 1;
+            cpu->V = ((cpu->A ^ operand) & 0x80) && ((cpu->A ^ tmp) & 0x80);
+            cpu->C = 1;
             if (ah & 16) {
-               C = 0;
+               cpu->C = 0;
                ah -= 6;
                ah &= 0xF;
             }
-            A = (al & 0xF) | ((ah & 0xF) << 4);
+            cpu->A = (al & 0xF) | ((ah & 0xF) << 4);
          }
          // Arlet's core doesn't define the behaviour of the overflow flag in decimal mode
-         if (arlet) {
-            V = -1;
+         if (cpu->arlet) {
+            cpu->V = -1;
          }
       } else {
          // Normal mode SBC
-         int tmp = A - operand - (1 - C);
-         C = 1 - ((tmp >> 8) & 1);
-         V = (((A ^ operand) & 0x80) != 0) && (((A ^ tmp) & 0x80) != 0);
-         A = tmp & 255;
-         set_NZ(A);
+         int tmp = cpu->A - operand - (1 - cpu->C);
+         cpu->C = 1 - ((tmp >> 8) & 1);
+         cpu->V = (((cpu->A ^ operand) & 0x80) != 0) && (((cpu->A ^ tmp) & 0x80) != 0);
+         cpu->A = tmp & 255;
+         set_NZ(cpu, cpu->A);
       }
    } else {
-      A = -1;
-      set_NVZC_unknown();
+      cpu->A = -1;
+      set_NVZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_SEC(operand_t operand, ea_t ea) {
-   C = 1;
+static int op_SEC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->C = 1;
    return -1;
 }
 
-static int op_SED(operand_t operand, ea_t ea) {
-   D = 1;
+static int op_SED(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->D = 1;
    return -1;
 }
 
-static int op_SEI(operand_t operand, ea_t ea) {
-   I = 1;
+static int op_SEI(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->I = 1;
    return -1;
 }
 
-static int op_STA(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      if (operand != A) {
-         failflag = 1;
+static int op_STA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      if (operand != cpu->A) {
+         cpu->failflag = 1;
       }
    }
-   A = operand;
+   cpu->A = operand;
    return operand;
 }
 
-static int op_STX(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      if (operand != X) {
-         failflag = 1;
+static int op_STX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      if (operand != cpu->X) {
+         cpu->failflag = 1;
       }
    }
-   X = operand;
+   cpu->X = operand;
    return operand;
 }
 
-static int op_STY(operand_t operand, ea_t ea) {
-   if (Y >= 0) {
-      if (operand != Y) {
-         failflag = 1;
+static int op_STY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->Y >= 0) {
+      if (operand != cpu->Y) {
+         cpu->failflag = 1;
       }
    }
-   Y = operand;
+   cpu->Y = operand;
    return operand;
 }
 
-static int op_STZ(operand_t operand, ea_t ea) {
+static int op_STZ(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    if (operand != 0) {
-      failflag = 1;
+      cpu->failflag = 1;
    }
    return 0;
 }
 
-static int op_TAX(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      X = A;
-      set_NZ(X);
+static int op_TAX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->X = cpu->A;
+      set_NZ(cpu, cpu->X);
    } else {
-      X = -1;
-      set_NZ_unknown();
+      cpu->X = -1;
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_TAY(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      Y = A;
-      set_NZ(Y);
+static int op_TAY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->Y = cpu->A;
+      set_NZ(cpu, cpu->Y);
    } else {
-      Y = -1;
-      set_NZ_unknown();
+      cpu->Y = -1;
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_TSB(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      Z = (A & operand) == 0;
-      return operand | A;
+static int op_TSB(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->Z = (cpu->A & operand) == 0;
+      return operand | cpu->A;
    } else {
-      Z = -1;
+      cpu->Z = -1;
       return -1;
    }
 }
-static int op_TRB(operand_t operand, ea_t ea) {
-   if (A >= 0) {
-      Z = (A & operand) == 0;
-      return operand & ~A;
+static int op_TRB(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->A >= 0) {
+      cpu->Z = (cpu->A & operand) == 0;
+      return operand & ~cpu->A;
    } else {
-      Z = -1;
+      cpu->Z = -1;
       return -1;
    }
 }
 
-static int op_TSX(operand_t operand, ea_t ea) {
-   if (S >= 0) {
-      X = S;
-      set_NZ(X);
+static int op_TSX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->S >= 0) {
+      cpu->X = cpu->S;
+      set_NZ(cpu, cpu->X);
    } else {
-      X = -1;
-      set_NZ_unknown();
+      cpu->X = -1;
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_TXA(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      A = X;
-      set_NZ(A);
+static int op_TXA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      cpu->A = cpu->X;
+      set_NZ(cpu, cpu->A);
    } else {
-      A = -1;
-      set_NZ_unknown();
+      cpu->A = -1;
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_TXS(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      S = X;
+static int op_TXS(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      cpu->S = cpu->X;
    } else {
-      S = -1;
+      cpu->S = -1;
    }
    return -1;
 }
 
-static int op_TYA(operand_t operand, ea_t ea) {
-   if (Y >= 0) {
-      A = Y;
-      set_NZ(A);
+static int op_TYA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->Y >= 0) {
+      cpu->A = cpu->Y;
+      set_NZ(cpu, cpu->A);
    } else {
-      A = -1;
-      set_NZ_unknown();
+      cpu->A = -1;
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_RMB0(operand_t operand, ea_t ea) {
+static int op_RMB0(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand & ~0x01;
 }
 
-static int op_RMB1(operand_t operand, ea_t ea) {
+static int op_RMB1(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand & ~0x02;
 }
 
-static int op_RMB2(operand_t operand, ea_t ea) {
+static int op_RMB2(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand & ~0x04;
 }
 
-static int op_RMB3(operand_t operand, ea_t ea) {
+static int op_RMB3(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand & ~0x08;
 }
 
-static int op_RMB4(operand_t operand, ea_t ea) {
+static int op_RMB4(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand & ~0x10;
 }
 
-static int op_RMB5(operand_t operand, ea_t ea) {
+static int op_RMB5(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand & ~0x20;
 }
 
-static int op_RMB6(operand_t operand, ea_t ea) {
+static int op_RMB6(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand & ~0x40;
 }
 
-static int op_RMB7(operand_t operand, ea_t ea) {
+static int op_RMB7(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand & ~0x80;
 }
 
-static int op_SMB0(operand_t operand, ea_t ea) {
+static int op_SMB0(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand | 0x01;
 }
 
-static int op_SMB1(operand_t operand, ea_t ea) {
+static int op_SMB1(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand | 0x02;
 }
 
-static int op_SMB2(operand_t operand, ea_t ea) {
+static int op_SMB2(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand | 0x04;
 }
 
-static int op_SMB3(operand_t operand, ea_t ea) {
+static int op_SMB3(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand | 0x08;
 }
 
-static int op_SMB4(operand_t operand, ea_t ea) {
+static int op_SMB4(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand | 0x10;
 }
 
-static int op_SMB5(operand_t operand, ea_t ea) {
+static int op_SMB5(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand | 0x20;
 }
 
-static int op_SMB6(operand_t operand, ea_t ea) {
+static int op_SMB6(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand | 0x40;
 }
 
-static int op_SMB7(operand_t operand, ea_t ea) {
+static int op_SMB7(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    return operand | 0x80;
 }
 
@@ -4,7 +4,10 @@
 #include <inttypes.h>
 #include "em_65816.h"
 #include "defs.h"
+#include "disasm.h"
 #include "memory.h"
+#include "output.h"
+#include "stats.h"
 
 // ====================================================================
 // Type Defs
@@ -55,6 +58,8 @@ typedef int operand_t;
 
 typedef int ea_t;
 
+typedef struct cpu_state cpu_state_t;
+
 typedef struct {
    const char *mnemonic;
    int undocumented;
@@ -62,11 +67,12 @@ typedef struct {
    int cycles;
    int newop;
    OpType optype;
-   int (*emulate)(operand_t, ea_t);
+   int (*emulate)(cpu_state_t *, operand_t, ea_t);
    int len;
    int m_extra;
    int x_extra;
-   const char *fmt;
+   disasm_template_t dis;
+   disasm_template_t dis_imm16; // immediate mode with a 16-bit operand
 } InstrType;
 
 
@@ -96,8 +102,6 @@ typedef struct {
 
 static const char default_state[] = "A=???? X=???? Y=???? SP=???? N=? V=? M=? X=? D=? I=? Z=? C=? E=? PB=?? DB=?? DP=????";
 
-static InstrType *instr_table;
-
 AddrModeType addr_mode_table[] = {
    {2,    "%1$s (%2$02X,X)"},          // INDX
    {2,    "%1$s (%2$02X),Y"},          // INDY
@@ -127,34 +131,47 @@ AddrModeType addr_mode_table[] = {
 
 static const char *fmt_imm16 = "%1$s #%3$02X%2$02X";
 
-// 6502 registers: -1 means unknown
-static int A = -1;
-static int X = -1;
-static int Y = -1;
+// The state of one emulated 65C816
+struct cpu_state {
+   InstrType instr_table[INSTR_SET_SIZE];
+
+   // 6502 registers: -1 means unknown
+   int A;
+   int X;
+   int Y;
+
+   int SH;
+   int SL;
 
-static int SH = -1;
-static int SL = -1;
+   int PC;
 
-static int PC = -1;
+   // 65C816 additional registers: -1 means unknown
+   int B;  // Accumulator bits 15..8
+   int DP; // 16-bit Direct Page Register (default to zero, otherwise ZP addressing is broken)
+   int DB; // 8-bit Data Bank Register
+   int PB; // 8-bit Program Bank Register
 
-// 65C816 additional registers: -1 means unknown
-static int B  = -1; // Accumulator bits 15..8
-static int DP = -1; // 16-bit Direct Page Register (default to zero, otherwise ZP addressing is broken)
-static int DB = -1; // 8-bit Data Bank Register
-static int PB = -1; // 8-bit Program Bank Register
+   // 6502 flags: -1 means unknown
+   int N;
+   int V;
+   int D;
+   int I;
+   int Z;
+   int C;
 
-// 6502 flags: -1 means unknown
-static int N = -1;
-static int V = -1;
-static int D = -1;
-static int I = -1;
-static int Z = -1;
-static int C = -1;
+   // 65C816 additional flags: -1 means unknown
+   int MS; // Accumulator and Memeory Size Flag
+   int XS; // Index Register Size Flag
+   int E;  // Emulation Mode Flag, updated by XCE
 
-// 65C816 additional flags: -1 means unknown
-static int MS = -1; // Accumulator and Memeory Size Flag
-static int XS = -1; // Index Register Size Flag
-static int E =  -1; // Emulation Mode Flag, updated by XCE
+   // Only the PC, PB and E/M/X are followed (--fast)
+   int fast;
+
+   // Set when the emulation disagrees with the bus
+   int failflag;
+
+   memory_t *mem;
+};
 
 static char *x1_ops[] = {
    "CPX",
@@ -204,371 +221,371 @@ static char *m2_ops[] = {
 
 static InstrType instr_table_65c816[INSTR_SET_SIZE];
 
-static void emulation_mode_on();
-static void emulation_mode_off();
-static int op_STA(operand_t operand, ea_t ea);
-static int op_STX(operand_t operand, ea_t ea);
-static int op_STY(operand_t operand, ea_t ea);
+static void emulation_mode_on(cpu_state_t *cpu);
+static void emulation_mode_off(cpu_state_t *cpu);
+static int op_STA(cpu_state_t *cpu, operand_t operand, ea_t ea);
+static int op_STX(cpu_state_t *cpu, operand_t operand, ea_t ea);
+static int op_STY(cpu_state_t *cpu, operand_t operand, ea_t ea);
 
 // ====================================================================
 // Helper Methods
 // ====================================================================
 
-static int compare_FLAGS(int operand) {
-   if (N >= 0) {
-      if (N != ((operand >> 7) & 1)) {
+static int compare_FLAGS(cpu_state_t *cpu, int operand) {
+   if (cpu->N >= 0) {
+      if (cpu->N != ((operand >> 7) & 1)) {
          return 1;
       }
    }
-   if (V >= 0) {
-      if (V != ((operand >> 6) & 1)) {
+   if (cpu->V >= 0) {
+      if (cpu->V != ((operand >> 6) & 1)) {
          return 1;
       }
    }
-   if (E == 0 && MS >= 0) {
-      if (MS != ((operand >> 5) & 1)) {
+   if (cpu->E == 0 && cpu->MS >= 0) {
+      if (cpu->MS != ((operand >> 5) & 1)) {
          return 1;
       }
    }
-   if (E == 0 && XS >= 0) {
-      if (XS != ((operand >> 4) & 1)) {
+   if (cpu->E == 0 && cpu->XS >= 0) {
+      if (cpu->XS != ((operand >> 4) & 1)) {
          return 1;
       }
    }
-   if (D >= 0) {
-      if (D != ((operand >> 3) & 1)) {
+   if (cpu->D >= 0) {
+      if (cpu->D != ((operand >> 3) & 1)) {
          return 1;
       }
    }
-   if (I >= 0) {
-      if (I != ((operand >> 2) & 1)) {
+   if (cpu->I >= 0) {
+      if (cpu->I != ((operand >> 2) & 1)) {
          return 1;
       }
    }
-   if (Z >= 0) {
-      if (Z != ((operand >> 1) & 1)) {
+   if (cpu->Z >= 0) {
+      if (cpu->Z != ((operand >> 1) & 1)) {
          return 1;
       }
    }
-   if (C >= 0) {
-      if (C != ((operand >> 0) & 1)) {
+   if (cpu->C >= 0) {
+      if (cpu->C != ((operand >> 0) & 1)) {
          return 1;
       }
    }
    return 0;
 }
 
-static void check_FLAGS(int operand) {
-   failflag |= compare_FLAGS(operand);
+static void check_FLAGS(cpu_state_t *cpu, int operand) {
+   cpu->failflag |= compare_FLAGS(cpu, operand);
 }
 
-static void x_flag_updated() {
-   if (XS) {
-      if (X >= 0) {
-         X &= 0x00ff;
+static void x_flag_updated(cpu_state_t *cpu) {
+   if (cpu->XS) {
+      if (cpu->X >= 0) {
+         cpu->X &= 0x00ff;
       }
-      if (Y >= 0) {
-         Y &= 0x00ff;
+      if (cpu->Y >= 0) {
+         cpu->Y &= 0x00ff;
       }
    }
 }
 
-static void set_FLAGS(int operand) {
-   N = (operand >> 7) & 1;
-   V = (operand >> 6) & 1;
-   if (E == 0) {
-      MS = (operand >> 5) & 1;
-      XS = (operand >> 4) & 1;
+static void set_FLAGS(cpu_state_t *cpu, int operand) {
+   cpu->N = (operand >> 7) & 1;
+   cpu->V = (operand >> 6) & 1;
+   if (cpu->E == 0) {
+      cpu->MS = (operand >> 5) & 1;
+      cpu->XS = (operand >> 4) & 1;
    } else {
-      MS = 1;
-      XS = 1;
+      cpu->MS = 1;
+      cpu->XS = 1;
    }
-   x_flag_updated();
-   D = (operand >> 3) & 1;
-   I = (operand >> 2) & 1;
-   Z = (operand >> 1) & 1;
-   C = (operand >> 0) & 1;
+   x_flag_updated(cpu);
+   cpu->D = (operand >> 3) & 1;
+   cpu->I = (operand >> 2) & 1;
+   cpu->Z = (operand >> 1) & 1;
+   cpu->C = (operand >> 0) & 1;
 }
 
-static void set_NZ_unknown() {
-   N = -1;
-   Z = -1;
+static void set_NZ_unknown(cpu_state_t *cpu) {
+   cpu->N = -1;
+   cpu->Z = -1;
 }
 
-static void set_NZC_unknown() {
-   N = -1;
-   Z = -1;
-   C = -1;
+static void set_NZC_unknown(cpu_state_t *cpu) {
+   cpu->N = -1;
+   cpu->Z = -1;
+   cpu->C = -1;
 }
 
-static void set_NVZC_unknown() {
-   N = -1;
-   V = -1;
-   Z = -1;
-   C = -1;
+static void set_NVZC_unknown(cpu_state_t *cpu) {
+   cpu->N = -1;
+   cpu->V = -1;
+   cpu->Z = -1;
+   cpu->C = -1;
 }
 
-static void set_NZ8(int value) {
-   N = (value >> 7) & 1;
-   Z = (value & 0xff) == 0;
+static void set_NZ8(cpu_state_t *cpu, int value) {
+   cpu->N = (value >> 7) & 1;
+   cpu->Z = (value & 0xff) == 0;
 }
 
-static void set_NZ16(int value) {
-   N = (value >> 15) & 1;
-   Z = (value & 0xffff) == 0;
+static void set_NZ16(cpu_state_t *cpu, int value) {
+   cpu->N = (value >> 15) & 1;
+   cpu->Z = (value & 0xffff) == 0;
 }
 
-static void set_NZ_unknown_width(int value) {
+static void set_NZ_unknown_width(cpu_state_t *cpu, int value) {
    // Don't know which bit is the sign bit
    int s15 = (value >> 15) & 1;
    int s7 = (value >> 7) & 1;
    if (s7 == s15) {
       // both choices of sign bit are the same
-      N = s7;
+      cpu->N = s7;
    } else {
       // possible sign bits differ, so N must become undefined
-      N = -1;
+      cpu->N = -1;
    }
    // Don't know how many bits to check for any ones
    if ((value & 0xff00) == 0) {
       // no high bits set, so base Z on the low bits
-      Z = (value & 0xff) == 0;
+      cpu->Z = (value & 0xff) == 0;
    } else {
       // some high bits set, so Z must become undefined
-      Z = -1;
+      cpu->Z = -1;
    }
 }
 
-static void set_NZ_XS(int value) {
-   if (XS < 0) {
-      set_NZ_unknown_width(value);
-   } else if (XS == 0) {
-      set_NZ16(value);
+static void set_NZ_XS(cpu_state_t *cpu, int value) {
+   if (cpu->XS < 0) {
+      set_NZ_unknown_width(cpu, value);
+   } else if (cpu->XS == 0) {
+      set_NZ16(cpu, value);
    } else {
-      set_NZ8(value);
+      set_NZ8(cpu, value);
    }
 }
 
-static void set_NZ_MS(int value) {
-   if (MS < 0) {
-      set_NZ_unknown_width(value);
-   } else if (MS == 0) {
-      set_NZ16(value);
+static void set_NZ_MS(cpu_state_t *cpu, int value) {
+   if (cpu->MS < 0) {
+      set_NZ_unknown_width(cpu, value);
+   } else if (cpu->MS == 0) {
+      set_NZ16(cpu, value);
    } else {
-      set_NZ8(value);
+      set_NZ8(cpu, value);
    }
 }
 
-static void set_NZ_AB(int A, int B) {
-   if (MS > 0) {
+static void set_NZ_AB(cpu_state_t *cpu, int a, int b) {
+   if (cpu->MS > 0) {
       // 8-bit
-      if (A >= 0) {
-         set_NZ8(A);
+      if (a >= 0) {
+         set_NZ8(cpu, a);
       } else {
-         set_NZ_unknown();
+         set_NZ_unknown(cpu);
       }
-   } else if (MS == 0) {
+   } else if (cpu->MS == 0) {
       // 16-bit
-      if (A >= 0 && B >= 0) {
-         set_NZ16((B << 8) + A);
+      if (a >= 0 && b >= 0) {
+         set_NZ16(cpu, (b << 8) + a);
       } else {
          // TODO: the behaviour when A is known and B is unknown could be improved
-         set_NZ_unknown();
+         set_NZ_unknown(cpu);
       }
    } else {
       // width unknown
-      if (A >= 0 && B >= 0) {
-         set_NZ_unknown_width((B << 8) + A);
+      if (a >= 0 && b >= 0) {
+         set_NZ_unknown_width(cpu, (b << 8) + a);
       } else {
-         set_NZ_unknown();
+         set_NZ_unknown(cpu);
       }
    }
 }
 
 // Helper routine to handle incrementing the stack pointer
-static void incSP() {
+static void incSP(cpu_state_t *cpu) {
    // Increment the low byte of SP
-   if (SL >= 0) {
-      SL = (SL + 1) & 0xff;
+   if (cpu->SL >= 0) {
+      cpu->SL = (cpu->SL + 1) & 0xff;
    }
    // Increment the high byte of SP, in certain cases
-   if (E == 1) {
+   if (cpu->E == 1) {
       // In emulation mode, force SH to 1
-      SH = 1;
-   } else if (E == 0) {
+      cpu->SH = 1;
+   } else if (cpu->E == 0) {
       // In native mode, increment SH if SL has wrapped to 0
-      if (SH >= 0) {
-         if (SL < 0) {
-            SH = -1;
-         } else if (SL == 0) {
-            SH = (SH + 1) & 0xff;
+      if (cpu->SH >= 0) {
+         if (cpu->SL < 0) {
+            cpu->SH = -1;
+         } else if (cpu->SL == 0) {
+            cpu->SH = (cpu->SH + 1) & 0xff;
          }
       }
    } else {
-      SH = -1;
+      cpu->SH = -1;
    }
 }
 
 // Helper routine to handle decrementing the stack pointer
-static void decSP() {
+static void decSP(cpu_state_t *cpu) {
    // Decrement the low byte of SP
-   if (SL >= 0) {
-      SL = (SL - 1) & 0xff;
+   if (cpu->SL >= 0) {
+      cpu->SL = (cpu->SL - 1) & 0xff;
    }
    // Decrement the high byte of SP, in certain cases
-   if (E == 1) {
+   if (cpu->E == 1) {
       // In emulation mode, force SH to 1
-      SH = 1;
-   } else if (E == 0) {
+      cpu->SH = 1;
+   } else if (cpu->E == 0) {
       // In native mode, increment SH if SL has wrapped to 0
-      if (SH >= 0) {
-         if (SL < 0) {
-            SH = -1;
-         } else if (SL == 0xff) {
-            SH = (SH - 1) & 0xff;
+      if (cpu->SH >= 0) {
+         if (cpu->SL < 0) {
+            cpu->SH = -1;
+         } else if (cpu->SL == 0xff) {
+            cpu->SH = (cpu->SH - 1) & 0xff;
          }
       }
    } else {
-      SH = -1;
+      cpu->SH = -1;
    }
 }
 
 // pop one byte off the stack - used by "old" instructions
-static void pop8(int value) {
+static void pop8(cpu_state_t *cpu, int value) {
    // Increment/wrap the stack pointer
-   incSP();
+   incSP(cpu);
    // Handle the memory access
-   if (SL >= 0 && SH >= 0) {
-      memory_read(value & 0xff, (SH << 8) + SL, MEM_STACK);
+   if (cpu->SL >= 0 && cpu->SH >= 0) {
+      memory_read(cpu->mem, value & 0xff, (cpu->SH << 8) + cpu->SL, MEM_STACK);
    }
 }
 
 // pop one byte off the stack - used by "new" instructions
-static void pop8new(int value) {
+static void pop8new(cpu_state_t *cpu, int value) {
    // Handle the memory access
-   if (SL >= 0 && SH >= 0) {
-      memory_read(value & 0xff, ((SH << 8) + SL + 1) & 0xffff, MEM_STACK);
+   if (cpu->SL >= 0 && cpu->SH >= 0) {
+      memory_read(cpu->mem, value & 0xff, ((cpu->SH << 8) + cpu->SL + 1) & 0xffff, MEM_STACK);
    }
    // Increment/wrap the stack pointer
-   incSP();
+   incSP(cpu);
 }
 
 // pop two bytes off the stack - used by "old" instructions
-static void pop16(int value) {
-   pop8(value);
-   pop8(value >> 8);
+static void pop16(cpu_state_t *cpu, int value) {
+   pop8(cpu, value);
+   pop8(cpu, value >> 8);
 }
 
 
 // pop two bytes off the stack - used by "new" instructions (e.g. PLD)
-static void pop16new(int value) {
+static void pop16new(cpu_state_t *cpu, int value) {
    // Handle the memory access
-   if (SL >= 0 && SH >= 0) {
-      memory_read( value       & 0xff, ((SH << 8) + SL + 1) & 0xffff, MEM_STACK);
-      memory_read((value >> 8) & 0xff, ((SH << 8) + SL + 2) & 0xffff, MEM_STACK);
+   if (cpu->SL >= 0 && cpu->SH >= 0) {
+      memory_read(cpu->mem,  value       & 0xff, ((cpu->SH << 8) + cpu->SL + 1) & 0xffff, MEM_STACK);
+      memory_read(cpu->mem, (value >> 8) & 0xff, ((cpu->SH << 8) + cpu->SL + 2) & 0xffff, MEM_STACK);
    }
    // Increment/wrap the stack pointer
-   incSP();
-   incSP();
+   incSP(cpu);
+   incSP(cpu);
 }
 
 // pop three bytes off the stack - used by "new" instructions (e.g.RTL)
-static void pop24new(int value) {
+static void pop24new(cpu_state_t *cpu, int value) {
    // Handle the memory access
-   if (SL >= 0 && SH >= 0) {
-      memory_read( value        & 0xff, ((SH << 8) + SL + 1) & 0xffff, MEM_STACK); // PCL
-      memory_read((value >>  8) & 0xff, ((SH << 8) + SL + 2) & 0xffff, MEM_STACK); // PCH
-      memory_read((value >> 16) & 0xff, ((SH << 8) + SL + 3) & 0xffff, MEM_STACK); // PBR
+   if (cpu->SL >= 0 && cpu->SH >= 0) {
+      memory_read(cpu->mem,  value        & 0xff, ((cpu->SH << 8) + cpu->SL + 1) & 0xffff, MEM_STACK); // PCL
+      memory_read(cpu->mem, (value >>  8) & 0xff, ((cpu->SH << 8) + cpu->SL + 2) & 0xffff, MEM_STACK); // PCH
+      memory_read(cpu->mem, (value >> 16) & 0xff, ((cpu->SH << 8) + cpu->SL + 3) & 0xffff, MEM_STACK); // PBR
    }
    // Increment/wrap the stack pointer
-   incSP();
-   incSP();
-   incSP();
+   incSP(cpu);
+   incSP(cpu);
+   incSP(cpu);
 }
 
 // push one byte onto the stack - used by "old" instructions and "new" instructions
-static void push8(int value) {
+static void push8(cpu_state_t *cpu, int value) {
    // Handle the memory access
-   if (SL >= 0 && SH >= 0) {
-      memory_write(value & 0xff, (SH << 8) + SL, MEM_STACK);
+   if (cpu->SL >= 0 && cpu->SH >= 0) {
+      memory_write(cpu->mem, value & 0xff, (cpu->SH << 8) + cpu->SL, MEM_STACK);
    }
    // Decrement/wrap the stack pointer
-   decSP();
+   decSP(cpu);
 }
 
 // push two byte onto the stack - used by "old" instructions
-static void push16(int value) {
-   push8(value >> 8);
-   push8(value);
+static void push16(cpu_state_t *cpu, int value) {
+   push8(cpu, value >> 8);
+   push8(cpu, value);
 }
 
 // push two byte onto the stack - used by "new" instructions
-static void push16new(int value) {
+static void push16new(cpu_state_t *cpu, int value) {
    // Handle the memory access
-   if (SL >= 0 && SH >= 0) {
-      memory_write((value >> 8) & 0xff, (SH << 8) + SL, MEM_STACK);
-      memory_write(value & 0xff, ((SH << 8) + SL - 1) & 0xffff, MEM_STACK);
+   if (cpu->SL >= 0 && cpu->SH >= 0) {
+      memory_write(cpu->mem, (value >> 8) & 0xff, (cpu->SH << 8) + cpu->SL, MEM_STACK);
+      memory_write(cpu->mem, value & 0xff, ((cpu->SH << 8) + cpu->SL - 1) & 0xffff, MEM_STACK);
    }
    // Decrement/wrap the stack pointer
-   decSP();
-   decSP();
+   decSP(cpu);
+   decSP(cpu);
 }
 
-static void popXS(int value) {
-   if (XS < 0) {
-      SL = -1;
-      SH = -1;
-   } else if (XS == 0) {
-      pop16(value); // TODO: should be new?
+static void popXS(cpu_state_t *cpu, int value) {
+   if (cpu->XS < 0) {
+      cpu->SL = -1;
+      cpu->SH = -1;
+   } else if (cpu->XS == 0) {
+      pop16(cpu, value); // TODO: should be new?
    } else {
-      pop8(value);
+      pop8(cpu, value);
    }
 }
 
-static void popMS(int value) {
-   if (MS < 0) {
-      SL = -1;
-      SH = -1;
-   } else if (MS == 0) {
-      pop16(value); // TODO: should be new?
+static void popMS(cpu_state_t *cpu, int value) {
+   if (cpu->MS < 0) {
+      cpu->SL = -1;
+      cpu->SH = -1;
+   } else if (cpu->MS == 0) {
+      pop16(cpu, value); // TODO: should be new?
    } else {
-      pop8(value);
+      pop8(cpu, value);
    }
 }
 
-static void pushXS(int value) {
-   if (XS < 0) {
-      SL = -1;
-      SH = -1;
-   } else if (XS == 0) {
-      push16(value);
+static void pushXS(cpu_state_t *cpu, int value) {
+   if (cpu->XS < 0) {
+      cpu->SL = -1;
+      cpu->SH = -1;
+   } else if (cpu->XS == 0) {
+      push16(cpu, value);
    } else {
-      push8(value);
+      push8(cpu, value);
    }
 }
 
-static void pushMS(int value) {
-   if (MS < 0) {
-      SL = -1;
-      SH = -1;
-   } else if (MS == 0) {
-      push16(value);
+static void pushMS(cpu_state_t *cpu, int value) {
+   if (cpu->MS < 0) {
+      cpu->SL = -1;
+      cpu->SH = -1;
+   } else if (cpu->MS == 0) {
+      push16(cpu, value);
    } else {
-      push8(value);
+      push8(cpu, value);
    }
 }
 
-static void interrupt(sample_t *sample_q, int num_cycles, instruction_t *instruction, int pc_offset) {
+static void interrupt(cpu_state_t *cpu, sample_t *sample_q, int num_cycles, instruction_t *instruction, int pc_offset) {
    int i;
    int pb;
    if (num_cycles == 7) {
       // We must be in emulation mode
-      emulation_mode_on();
+      emulation_mode_on(cpu);
       i = 2;
-      pb = PB;
+      pb = cpu->PB;
    } else {
       // We must be in native mode
-      emulation_mode_off();
+      emulation_mode_off(cpu);
       i = 3;
       pb = sample_q[2].data;
    }
@@ -583,45 +600,47 @@ static void interrupt(sample_t *sample_q, int num_cycles, instruction_t *instruc
       instruction->pb = pb;
    }
    instruction->pc = (pc - pc_offset) & 0xffff;
-   // Stack the PB/PC/FLags (for memory modelling)
-   if (E == 0) {
-      push8(pb);
-   }
-   push16(pc);
-   push8(flags);
-   // Validate the flags
-   check_FLAGS(flags);
-   // And make them consistent
-   set_FLAGS(flags);
+   if (!cpu->fast) {
+      // Stack the PB/PC/FLags (for memory modelling)
+      if (cpu->E == 0) {
+         push8(cpu, pb);
+      }
+      push16(cpu, pc);
+      push8(cpu, flags);
+      // Validate the flags
+      check_FLAGS(cpu, flags);
+   }
+   // And make them consistent (in fast mode this is just for M/X)
+   set_FLAGS(cpu, flags);
    // Setup expected state for the ISR
-   I = 1;
-   D = 0;
-   PB = 0x00;
-   PC = vector;
+   cpu->I = 1;
+   cpu->D = 0;
+   cpu->PB = 0x00;
+   cpu->PC = vector;
 }
 
-static int get_8bit_cycles(sample_t *sample_q) {
+static int get_8bit_cycles(cpu_state_t *cpu, sample_t *sample_q) {
    int opcode = sample_q[0].data;
    int op1    = sample_q[1].data;
    int op2    = sample_q[2].data;
-   InstrType *instr = &instr_table[opcode];
+   InstrType *instr = &cpu->instr_table[opcode];
    int cycle_count = instr->cycles;
 
    // One cycle penalty if DP is not page aligned
-   int dpextra = (instr->mode <= ZP && DP >= 0 && (DP & 0xff)) ? 1 : 0;
+   int dpextra = (instr->mode <= ZP && cpu->DP >= 0 && (cpu->DP & 0xff)) ? 1 : 0;
 
    // Account for extra cycle in a page crossing in (indirect), Y (not stores)
    // <opcode> <op1> [ <dpextra> ] <addrlo> <addrhi> [ <page crossing>] <operand> [ <extra cycle in dec mode> ]
-   if ((instr->mode == INDY) && (instr->optype != WRITEOP) && Y >= 0) {
+   if ((instr->mode == INDY) && (instr->optype != WRITEOP) && cpu->Y >= 0) {
       int base = (sample_q[3 + dpextra].data << 8) + sample_q[2 + dpextra].data;
-      if ((base & 0x1ff00) != ((base + Y) & 0x1ff00)) {
+      if ((base & 0x1ff00) != ((base + cpu->Y) & 0x1ff00)) {
          cycle_count++;
       }
    }
 
    // Account for extra cycle in a page crossing in absolute indexed (not stores or rmw) in emulated mode
    if (((instr->mode == ABSX) || (instr->mode == ABSY)) && (instr->optype == READOP)) {
-      int index = (instr->mode == ABSX) ? X : Y;
+      int index = (instr->mode == ABSX) ? cpu->X : cpu->Y;
       if (index >= 0) {
          int base = op1 + (op2 << 8);
          if ((base & 0x1ff00) != ((base + index) & 0x1ff00)) {
@@ -633,16 +652,16 @@ static int get_8bit_cycles(sample_t *sample_q) {
    return cycle_count + dpextra;
 }
 
-static int get_num_cycles(sample_t *sample_q, int intr_seen) {
+static int get_num_cycles(cpu_state_t *cpu, sample_t *sample_q, int intr_seen) {
    int opcode = sample_q[0].data;
    int op1    = sample_q[1].data;
    int op2    = sample_q[2].data;
-   InstrType *instr = &instr_table[opcode];
+   InstrType *instr = &cpu->instr_table[opcode];
    int cycle_count = instr->cycles;
 
    // Interrupt, BRK, COP
    if (intr_seen || opcode == 0x00 || opcode == 0x02) {
-      return (E == 0) ? 8 : 7;
+      return (cpu->E == 0) ? 8 : 7;
    }
 
    // E MS    Correction:
@@ -657,40 +676,40 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
    // 1  1    0
 
    if (instr->m_extra) {
-      if (E == 0 && MS == 0) {
+      if (cpu->E == 0 && cpu->MS == 0) {
          cycle_count += instr->m_extra;
-      } else if (!(E > 0 || MS > 0)) {
+      } else if (!(cpu->E > 0 || cpu->MS > 0)) {
          return -1;
       }
    }
 
    if (instr->x_extra) {
-      if (E == 0 && XS == 0) {
+      if (cpu->E == 0 && cpu->XS == 0) {
          cycle_count += instr->x_extra;
-      } else if (!(E > 0 || XS > 0)) {
+      } else if (!(cpu->E > 0 || cpu->XS > 0)) {
          return -1;
       }
    }
 
 
    // One cycle penalty if DP is not page aligned
-   int dpextra = (instr->mode <= ZP && DP >= 0 && (DP & 0xff)) ? 1 : 0;
+   int dpextra = (instr->mode <= ZP && cpu->DP >= 0 && (cpu->DP & 0xff)) ? 1 : 0;
 
    // RTI takes one extra cycle in native mode
    if (opcode == 0x40) {
-      if (E == 0) {
+      if (cpu->E == 0) {
          cycle_count++;
-      } else if (E < 0) {
+      } else if (cpu->E < 0) {
          return -1;
       }
    }
 
    // Account for extra cycle in a page crossing in (indirect), Y (not stores)
    // <opcode> <op1> [ <dpextra> ] <addrlo> <addrhi> [ <page crossing>] <operand> [ <extra cycle in dec mode> ]
-   if ((instr->mode == INDY) && (instr->optype != WRITEOP) && Y >= 0) {
+   if ((instr->mode == INDY) && (instr->optype != WRITEOP) && cpu->Y >= 0) {
       int base = (sample_q[3 + dpextra].data << 8) + sample_q[2 + dpextra].data;
       // TODO: take account of page crossing with 16-bit Y
-      if ((base & 0x1ff00) != ((base + Y) & 0x1ff00)) {
+      if ((base & 0x1ff00) != ((base + cpu->Y) & 0x1ff00)) {
          cycle_count++;
       }
    }
@@ -698,7 +717,7 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
    // Account for extra cycle in a page crossing in absolute indexed (not stores or rmw)
    if (((instr->mode == ABSX) || (instr->mode == ABSY)) && (instr->optype == READOP)) {
       int correction = -1;
-      int index = (instr->mode == ABSX) ? X : Y;
+      int index = (instr->mode == ABSX) ? cpu->X : cpu->Y;
       if (index >= 0) {
          int base = op1 + (op2 << 8);
          if ((base & 0x1ff00) != ((base + index) & 0x1ff00)) {
@@ -717,9 +736,9 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
       //  1  ?    ?
       //  1  0    0
       //  1  1    1
-      if (XS == 0 || correction == 1) {
+      if (cpu->XS == 0 || correction == 1) {
          cycle_count++;
-      } else if (XS < 0 || correction < 0) {
+      } else if (cpu->XS < 0 || correction < 0) {
          return -1;
       }
    }
@@ -731,23 +750,23 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
       int taken = -1;
       switch (opcode) {
       case 0x10: // BPL
-         if (N >= 0) {
-            taken = !N;
+         if (cpu->N >= 0) {
+            taken = !cpu->N;
          }
          break;
       case 0x30: // BMI
-         if (N >= 0) {
-            taken = N;
+         if (cpu->N >= 0) {
+            taken = cpu->N;
          }
          break;
       case 0x50: // BVC
-         if (V >= 0) {
-            taken = !V;
+         if (cpu->V >= 0) {
+            taken = !cpu->V;
          }
          break;
       case 0x70: // BVS
-         if (V >= 0) {
-            taken = V;
+         if (cpu->V >= 0) {
+            taken = cpu->V;
          }
          break;
       case 0x80: // BRA
@@ -755,23 +774,23 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
          cycle_count--; // instr table contains 3 for cycle count
          break;
       case 0x90: // BCC
-         if (C >= 0) {
-            taken = !C;
+         if (cpu->C >= 0) {
+            taken = !cpu->C;
          }
          break;
       case 0xB0: // BCS
-         if (C >= 0) {
-            taken = C;
+         if (cpu->C >= 0) {
+            taken = cpu->C;
          }
          break;
       case 0xD0: // BNE
-         if (Z >= 0) {
-            taken = !Z;
+         if (cpu->Z >= 0) {
+            taken = !cpu->Z;
          }
          break;
       case 0xF0: // BEQ
-         if (Z >= 0) {
-            taken = Z;
+         if (cpu->Z >= 0) {
+            taken = cpu->Z;
          }
          break;
       }
@@ -782,14 +801,14 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
          cycle_count++;
          // In emulation node, a taken branch that crosses a page boundary is 4 cycle
          int page_cross = -1;
-         if (E > 0 && PC >= 0) {
-            int target =  (PC + 2) + ((int8_t)(op1));
-            if ((target & 0xFF00) != ((PC + 2) & 0xff00)) {
+         if (cpu->E > 0 && cpu->PC >= 0) {
+            int target =  (cpu->PC + 2) + ((int8_t)(op1));
+            if ((target & 0xFF00) != ((cpu->PC + 2) & 0xff00)) {
                page_cross = 1;
             } else {
                page_cross = 0;
             }
-         } else if (E == 0) {
+         } else if (cpu->E == 0) {
             page_cross = 0;
          }
          if (page_cross < 0) {
@@ -804,29 +823,32 @@ static int get_num_cycles(sample_t *sample_q, int intr_seen) {
 }
 
 
-static int count_cycles_without_sync(sample_t *sample_q, int intr_seen) {
+static int count_cycles_without_sync(void *context, sample_t *sample_q, int intr_seen) {
+   cpu_state_t *cpu = context;
    //printf("VPA/VDA must be connected in 65816 mode\n");
    //exit(1);
-   int num_cycles = get_num_cycles(sample_q, intr_seen);
+   int num_cycles = get_num_cycles(cpu, sample_q, intr_seen);
    if (num_cycles >= 0) {
       return num_cycles;
    }
-   printf ("cycle prediction unknown\n");
+   output_printf("cycle prediction unknown\n");
    return 1;
 }
 
-static int count_cycles_with_sync(sample_t *sample_q, int intr_seen) {
+static int count_cycles_with_sync(void *context, sample_t *sample_q, int intr_seen) {
+   cpu_state_t *cpu = context;
    if (sample_q[0].type == OPCODE) {
       for (int i = 1; i < DEPTH; i++) {
          if (sample_q[i].type == LAST) {
             return 0;
          }
          if (sample_q[i].type == OPCODE) {
-            // Validate the num_cycles passed in
-            int expected = get_num_cycles(sample_q, intr_seen);
+            // Validate the num_cycles passed in (which needs the registers)
+            int expected = cpu->fast ? -1 : get_num_cycles(cpu, sample_q, intr_seen);
             if (expected >= 0) {
                if (i != expected) {
-                  printf ("opcode %02x: cycle prediction fail: expected %d actual %d\n", sample_q[0].data, expected, i);
+                  stats_add(STAT_CYCLE_PREDICTION_FAIL, 1);
+                  output_printf("opcode %02x: cycle prediction fail: expected %d actual %d\n", sample_q[0].data, expected, i);
                }
             }
             return i;
@@ -837,56 +859,56 @@ static int count_cycles_with_sync(sample_t *sample_q, int intr_seen) {
 }
 
 // A set of actions to take if emulation mode enabled
-static void emulation_mode_on() {
-   if (E == 0) {
-      failflag = 1;
+static void emulation_mode_on(cpu_state_t *cpu) {
+   if (cpu->E == 0) {
+      cpu->failflag = 1;
    }
-   MS = 1;
-   XS = 1;
-   x_flag_updated();
-   SH = 0x01;
-   E = 1;
+   cpu->MS = 1;
+   cpu->XS = 1;
+   x_flag_updated(cpu);
+   cpu->SH = 0x01;
+   cpu->E = 1;
 }
 
 // A set of actions to take if emulation mode enabled
-static void emulation_mode_off() {
-   if (E == 1) {
-      failflag = 1;
+static void emulation_mode_off(cpu_state_t *cpu) {
+   if (cpu->E == 1) {
+      cpu->failflag = 1;
    }
-   E = 0;
+   cpu->E = 0;
 }
 
-static void check_and_set_ms(int val) {
-   if (MS >= 0 &&  MS != val) {
-      failflag = 1;
+static void check_and_set_ms(cpu_state_t *cpu, int val) {
+   if (cpu->MS >= 0 &&  cpu->MS != val) {
+      cpu->failflag = 1;
    }
-   MS = val;
+   cpu->MS = val;
    // Evidence of MS = 0 implies E = 0
-   if (MS == 0) {
-      emulation_mode_off();
+   if (cpu->MS == 0) {
+      emulation_mode_off(cpu);
    }
 }
 
-static void check_and_set_xs(int val) {
-   if (XS >= 0 &&  XS != val) {
-      failflag = 1;
+static void check_and_set_xs(cpu_state_t *cpu, int val) {
+   if (cpu->XS >= 0 &&  cpu->XS != val) {
+      cpu->failflag = 1;
    }
-   XS = val;
-   x_flag_updated();
+   cpu->XS = val;
+   x_flag_updated(cpu);
    // Evidence of XS = 0 implies E = 0
-   if (XS == 0) {
-      emulation_mode_off();
+   if (cpu->XS == 0) {
+      emulation_mode_off(cpu);
    }
 }
 
 // Helper to return the variable size accumulator
-static int get_accumulator() {
-   if (MS > 0 && A >= 0) {
+static int get_accumulator(cpu_state_t *cpu) {
+   if (cpu->MS > 0 && cpu->A >= 0) {
       // 8-bit mode
-      return A;
-   } else if (MS == 0 && A >= 0 && B >= 0) {
+      return cpu->A;
+   } else if (cpu->MS == 0 && cpu->A >= 0 && cpu->B >= 0) {
       // 16-bit mode
-      return (B << 8) + A;
+      return (cpu->B << 8) + cpu->A;
    } else {
       // unknown width
       return -1;
@@ -897,43 +919,66 @@ static int get_accumulator() {
 // Public Methods
 // ====================================================================
 
-static void em_65816_init(arguments_t *args) {
+static void *em_65816_create(arguments_t *args, memory_t *mem) {
+   cpu_state_t *cpu = calloc(1, sizeof(cpu_state_t));
+   cpu->mem = mem;
+   cpu->A = -1;
+   cpu->X = -1;
+   cpu->Y = -1;
+   cpu->SH = -1;
+   cpu->SL = -1;
+   cpu->PC = -1;
+   cpu->B = -1;
+   cpu->DP = -1;
+   cpu->DB = -1;
+   cpu->PB = -1;
+   cpu->N = -1;
+   cpu->V = -1;
+   cpu->D = -1;
+   cpu->I = -1;
+   cpu->Z = -1;
+   cpu->C = -1;
+   cpu->MS = -1;
+   cpu->XS = -1;
+   cpu->E = -1;
+
    switch (args->cpu_type) {
    case CPU_65C816:
-      instr_table = instr_table_65c816;
+      memcpy(cpu->instr_table, instr_table_65c816, sizeof(cpu->instr_table));
       break;
    default:
-      printf("em_65816_init called with unsupported cpu_type (%d)\n", args->cpu_type);
+      output_printf("em_65816_create called with unsupported cpu_type (%d)\n", args->cpu_type);
       exit(1);
    }
    if (args->e_flag >= 0) {
-      E  = args->e_flag & 1;
-      if (E) {
-         emulation_mode_on();
+      cpu->E  = args->e_flag & 1;
+      if (cpu->E) {
+         emulation_mode_on(cpu);
       } else {
-         emulation_mode_off();
+         emulation_mode_off(cpu);
       }
    }
    if (args->sp_reg >= 0) {
-      SL = args->sp_reg & 0xff;
-      SH = (args->sp_reg >> 8) & 0xff;
+      cpu->SL = args->sp_reg & 0xff;
+      cpu->SH = (args->sp_reg >> 8) & 0xff;
    }
    if (args->pb_reg >= 0) {
-      PB = args->pb_reg & 0xff;
+      cpu->PB = args->pb_reg & 0xff;
    }
    if (args->db_reg >= 0) {
-      DB = args->db_reg & 0xff;
+      cpu->DB = args->db_reg & 0xff;
    }
    if (args->dp_reg >= 0) {
-      DP = args->dp_reg & 0xffff;
+      cpu->DP = args->dp_reg & 0xffff;
    }
    if (args->ms_flag >= 0) {
-      MS = args->ms_flag & 1;
+      cpu->MS = args->ms_flag & 1;
    }
    if (args->xs_flag >= 0) {
-      XS = args->xs_flag & 1;
+      cpu->XS = args->xs_flag & 1;
    }
-   InstrType *instr = instr_table;
+   cpu->fast = args->fast;
+   InstrType *instr = cpu->instr_table;
    for (int i = 0; i < INSTR_SET_SIZE; i++) {
       // Compute the extra cycles for the 816 when M=0 and/or X=0
       instr->m_extra = 0;
@@ -961,15 +1006,44 @@ static void em_65816_init(arguments_t *args) {
             }
          }
       }
-      // Copy the length and format from the address mode, for efficiency
+      // Copy the length from the address mode, and compile the disassembly templates, for efficiency
       instr->len = addr_mode_table[instr->mode].len;
-      instr->fmt = addr_mode_table[instr->mode].fmt;
+      disasm_compile(&instr->dis, addr_mode_table[instr->mode].fmt, instr->mnemonic,
+                     instr->mode == BRA ? TARGET_REL8 : instr->mode == BRL ? TARGET_REL16 : TARGET_NONE);
+      disasm_compile(&instr->dis_imm16, fmt_imm16, instr->mnemonic, TARGET_NONE);
       //printf("%02x %d %d %d\n", i, instr->m_extra, instr->x_extra, instr->len);
+      // In fast mode only emulate the instructions that change the PC/PB
+      // (other than via the bus), or the E/M/X flags, as these determine
+      // the instruction lengths
+      if (cpu->fast) {
+         switch (i) {
+         case 0x18: // CLC (for XCE)
+         case 0x38: // SEC (for XCE)
+         case 0xFB: // XCE
+         case 0xC2: // REP
+         case 0xE2: // SEP
+         case 0x28: // PLP
+         case 0x2B: // PLD (for the DP cycle penalty)
+         case 0x40: // RTI
+         case 0x60: // RTS
+         case 0x6B: // RTL
+            break;
+         default:
+            instr->emulate = NULL;
+            break;
+         }
+      }
       instr++;
    }
+   return cpu;
+}
+
+static void em_65816_destroy(void *cpu) {
+   free(cpu);
 }
 
-static int em_65816_match_interrupt(sample_t *sample_q, int num_samples) {
+static int em_65816_match_interrupt(void *context, sample_t *sample_q, int num_samples) {
+   cpu_state_t *cpu = context;
    // Check we have enough valid samples
    if (num_samples < 7) {
       return 0;
@@ -996,11 +1070,11 @@ static int em_65816_match_interrupt(sample_t *sample_q, int num_samples) {
    } else {
       // If not, then we use a heuristic, based on what we expect to see on the data
       // bus in cycles 2, 3 and 4, i.e. PCH, PCL, PSW
-      if (sample_q[2].data == ((PC >> 8) & 0xff) && sample_q[3].data == (PC & 0xff)) {
+      if (sample_q[2].data == ((cpu->PC >> 8) & 0xff) && sample_q[3].data == (cpu->PC & 0xff)) {
          // Now test unused flag is 1, B is 0
          if ((sample_q[4].data & 0x30) == 0x20) {
             // Finally test all other known flags match
-            if (!compare_FLAGS(sample_q[4].data)) {
+            if (!compare_FLAGS(cpu, sample_q[4].data)) {
                // Matched PSW = NV-BDIZC
                return 1;
             }
@@ -1010,82 +1084,86 @@ static int em_65816_match_interrupt(sample_t *sample_q, int num_samples) {
    return 0;
 }
 
-static int em_65816_count_cycles(sample_t *sample_q, int intr_seen) {
+static int em_65816_count_cycles(void *context, sample_t *sample_q, int intr_seen) {
+   cpu_state_t *cpu = context;
    if (sample_q[0].type == UNKNOWN) {
-      return count_cycles_without_sync(sample_q, intr_seen);
+      return count_cycles_without_sync(cpu, sample_q, intr_seen);
    } else {
-      return count_cycles_with_sync(sample_q, intr_seen);
+      return count_cycles_with_sync(cpu, sample_q, intr_seen);
    }
 }
 
-static void em_65816_reset(sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+static void em_65816_reset(void *context, sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
    instruction->pc = -1;
-   A = -1;
-   X = -1;
-   Y = -1;
-   SH = -1;
-   SL = -1;
-   N = -1;
-   V = -1;
-   D = -1;
-   Z = -1;
-   C = -1;
-   I = 1;
-   D = 0;
+   cpu->A = -1;
+   cpu->X = -1;
+   cpu->Y = -1;
+   cpu->SH = -1;
+   cpu->SL = -1;
+   cpu->N = -1;
+   cpu->V = -1;
+   cpu->D = -1;
+   cpu->Z = -1;
+   cpu->C = -1;
+   cpu->I = 1;
+   cpu->D = 0;
    // Extra 816 regs
-   B = -1;
-   DP = 0;
-   PB = 0;
+   cpu->B = -1;
+   cpu->DP = 0;
+   cpu->PB = 0;
    // Extra 816 flags
-   E = 1;
-   emulation_mode_on();
+   cpu->E = 1;
+   emulation_mode_on(cpu);
    // Program Counter
-   PC = (sample_q[num_cycles - 1].data << 8) + sample_q[num_cycles - 2].data;
+   cpu->PC = (sample_q[num_cycles - 1].data << 8) + sample_q[num_cycles - 2].data;
 }
 
-static void em_65816_interrupt(sample_t *sample_q, int num_cycles, instruction_t *instruction) {
-   interrupt(sample_q, num_cycles, instruction, 0);
+static void em_65816_interrupt(void *context, sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
+   interrupt(cpu, sample_q, num_cycles, instruction, 0);
 }
 
-static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+static void em_65816_emulate(void *context, sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
 
    // Unpack the instruction bytes
    int opcode = sample_q[0].data;
 
    // Update the E flag if this e pin is being sampled
    int new_E = sample_q[0].e;
-   if (new_E >= 0 && E != new_E) {
-      if (E >= 0) {
-         printf("correcting e flag\n");
-         failflag |= 1;
-      }
-      E = new_E;
-      if (E) {
-         emulation_mode_on();
+   if (new_E >= 0 && cpu->E != new_E) {
+      if (cpu->E >= 0) {
+         output_printf("correcting e flag\n");
+         cpu->failflag |= 1;
+      }
+      cpu->E = new_E;
+      if (cpu->E) {
+         emulation_mode_on(cpu);
       } else {
-         emulation_mode_off();
+         emulation_mode_off(cpu);
       }
    }
 
    // lookup the entry for the instruction
-   InstrType *instr = &instr_table[opcode];
+   InstrType *instr = &cpu->instr_table[opcode];
 
    // Infer MS from instruction length
-   if (MS < 0 && instr->m_extra) {
-      int cycles = get_8bit_cycles(sample_q);
-      check_and_set_ms((num_cycles > cycles) ? 0 : 1);
+   if (cpu->MS < 0 && instr->m_extra) {
+      int cycles = get_8bit_cycles(cpu, sample_q);
+      check_and_set_ms(cpu, (num_cycles > cycles) ? 0 : 1);
    }
 
    // Infer XS from instruction length
-   if (XS < 0 && instr->x_extra) {
-      int cycles = get_8bit_cycles(sample_q);
-      check_and_set_xs((num_cycles > cycles) ? 0 : 1);
+   if (cpu->XS < 0 && instr->x_extra) {
+      int cycles = get_8bit_cycles(cpu, sample_q);
+      check_and_set_xs(cpu, (num_cycles > cycles) ? 0 : 1);
    }
 
    // Work out outcount, taking account of 8/16 bit immediates
    int opcount = 0;
    if (instr->mode == IMM) {
-      if ((instr->m_extra && MS == 0) || (instr->x_extra && XS == 0)) {
+      if ((instr->m_extra && cpu->MS == 0) || (instr->x_extra && cpu->XS == 0)) {
          opcount = 1;
       }
    }
@@ -1099,17 +1177,17 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
    int op3 = (opcount < 3) ? 0 : sample_q[(opcode == 0x22) ? 5 : 3].data;
 
    // Memory Modelling: Instruction fetches
-   if (PB >= 0 && PC >= 0) {
-      int pc = (PB << 16) + PC;
-      memory_read(opcode, pc++, MEM_FETCH);
+   if (!cpu->fast && cpu->PB >= 0 && cpu->PC >= 0) {
+      int pc = (cpu->PB << 16) + cpu->PC;
+      memory_read(cpu->mem, opcode, pc++, MEM_FETCH);
       if (opcount >= 1) {
-         memory_read(op1, pc++, MEM_INSTR);
+         memory_read(cpu->mem, op1, pc++, MEM_INSTR);
       }
       if (opcount >= 2) {
-         memory_read(op2, pc++, MEM_INSTR);
+         memory_read(cpu->mem, op2, pc++, MEM_INSTR);
       }
       if (opcount >= 3) {
-         memory_read(op3, pc++, MEM_INSTR);
+         memory_read(cpu->mem, op3, pc++, MEM_INSTR);
       }
    }
 
@@ -1125,42 +1203,42 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
    if (opcode == 0x00 || opcode == 0x02) {
       // BRK or COP - handle in the same way as an interrupt
       // Now just pass BRK onto the interrupt handler
-      interrupt(sample_q, num_cycles, instruction, 2);
+      interrupt(cpu, sample_q, num_cycles, instruction, 2);
       // And we are done
       return;
    } else if (opcode == 0x20) {
       // JSR: <opcode> <op1> <op2> <read dummy> <write pch> <write pcl>
       instruction->pc = (((sample_q[4].data << 8) + sample_q[5].data) - 2) & 0xffff;
-      instruction->pb = PB;
+      instruction->pb = cpu->PB;
    } else if (opcode == 0x22) {
       // JSL: <opcode> <op1> <op2> <write pbr> <read dummy> <op3> <write pch> <write pcl>
       instruction->pc = (((sample_q[6].data << 8) + sample_q[7].data) - 3) & 0xffff;
       instruction->pb = sample_q[3].data;
    } else {
-      instruction->pc = PC;
-      instruction->pb = PB;
+      instruction->pc = cpu->PC;
+      instruction->pb = cpu->PB;
    }
 
    // Take account for optional extra cycle for direct register low (DL) not equal 0.
-   int dpextra = (instr->mode <= ZP && DP >= 0 && (DP & 0xff)) ? 1 : 0;
+   int dpextra = (instr->mode <= ZP && cpu->DP >= 0 && (cpu->DP & 0xff)) ? 1 : 0;
 
    // DP page wrapping only happens:
    // - in Emulation Mode (E=1), and
    // - if DPL == 00, and
    // - only for old instructions
-   int wrap = E && !(DP & 0xff) && !(instr->newop);
+   int wrap = cpu->E && !(cpu->DP & 0xff) && !(instr->newop);
 
    // Memory Modelling: Pointer indirection
    switch (instr->mode) {
    case INDY:
       // <opcode> <op1> [ <dpextra> ] <addrlo> <addrhi> [ <page crossing>] <operand>
-      if (DP >= 0) {
+      if (cpu->DP >= 0) {
          if (wrap) {
-            memory_read(sample_q[2 + dpextra].data, (DP & 0xFF00) +                op1, MEM_POINTER);
-            memory_read(sample_q[3 + dpextra].data, (DP & 0xFF00) + ((op1 + 1) & 0xff), MEM_POINTER);
+            memory_read(cpu->mem, sample_q[2 + dpextra].data, (cpu->DP & 0xFF00) +                op1, MEM_POINTER);
+            memory_read(cpu->mem, sample_q[3 + dpextra].data, (cpu->DP & 0xFF00) + ((op1 + 1) & 0xff), MEM_POINTER);
          } else {
-            memory_read(sample_q[2 + dpextra].data, (DP + op1    ) & 0xffff, MEM_POINTER);
-            memory_read(sample_q[3 + dpextra].data, (DP + op1 + 1) & 0xffff, MEM_POINTER);
+            memory_read(cpu->mem, sample_q[2 + dpextra].data, (cpu->DP + op1    ) & 0xffff, MEM_POINTER);
+            memory_read(cpu->mem, sample_q[3 + dpextra].data, (cpu->DP + op1 + 1) & 0xffff, MEM_POINTER);
          }
       }
       break;
@@ -1182,78 +1260,78 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
       // not to other indirect modes.
 
       // <opcode> <op1> [ <dpextra> ] <dummy> <addrlo> <addrhi> <operand>
-      if (DP >= 0 && X >= 0) {
+      if (cpu->DP >= 0 && cpu->X >= 0) {
          if (wrap) {
-            memory_read(sample_q[3 + dpextra].data, (DP & 0xFF00) + ((op1 + X    ) & 0xff), MEM_POINTER);
-            memory_read(sample_q[4 + dpextra].data, (DP & 0xFF00) + ((op1 + X + 1) & 0xff), MEM_POINTER);
+            memory_read(cpu->mem, sample_q[3 + dpextra].data, (cpu->DP & 0xFF00) + ((op1 + cpu->X    ) & 0xff), MEM_POINTER);
+            memory_read(cpu->mem, sample_q[4 + dpextra].data, (cpu->DP & 0xFF00) + ((op1 + cpu->X + 1) & 0xff), MEM_POINTER);
          } else {
-            memory_read(sample_q[3 + dpextra].data, (DP + op1 + X) & 0xffff, MEM_POINTER);
-            if (E) {
+            memory_read(cpu->mem, sample_q[3 + dpextra].data, (cpu->DP + op1 + cpu->X) & 0xffff, MEM_POINTER);
+            if (cpu->E) {
                // This one is very strange, see above cooment
-               memory_read(sample_q[4 + dpextra].data, ((DP + op1 + X) & 0xff00) + ((DP + op1 + X + 1) & 0xff), MEM_POINTER);
+               memory_read(cpu->mem, sample_q[4 + dpextra].data, ((cpu->DP + op1 + cpu->X) & 0xff00) + ((cpu->DP + op1 + cpu->X + 1) & 0xff), MEM_POINTER);
             } else {
-               memory_read(sample_q[4 + dpextra].data, (DP + op1 + X + 1) & 0xffff, MEM_POINTER);
+               memory_read(cpu->mem, sample_q[4 + dpextra].data, (cpu->DP + op1 + cpu->X + 1) & 0xffff, MEM_POINTER);
             }
          }
       }
       break;
    case IND:
       // <opcode> <op1>  [ <dpextra> ] <addrlo> <addrhi> <operand>
-      if (DP >= 0) {
+      if (cpu->DP >= 0) {
          if (wrap) {
-            memory_read(sample_q[2 + dpextra].data, (DP & 0xFF00) + op1               , MEM_POINTER);
-            memory_read(sample_q[3 + dpextra].data, (DP & 0xFF00) + ((op1 + 1) & 0xff), MEM_POINTER);
+            memory_read(cpu->mem, sample_q[2 + dpextra].data, (cpu->DP & 0xFF00) + op1               , MEM_POINTER);
+            memory_read(cpu->mem, sample_q[3 + dpextra].data, (cpu->DP & 0xFF00) + ((op1 + 1) & 0xff), MEM_POINTER);
          } else {
-            memory_read(sample_q[2 + dpextra].data, (DP + op1    ) & 0xffff, MEM_POINTER);
-            memory_read(sample_q[3 + dpextra].data, (DP + op1 + 1) & 0xffff, MEM_POINTER);
+            memory_read(cpu->mem, sample_q[2 + dpextra].data, (cpu->DP + op1    ) & 0xffff, MEM_POINTER);
+            memory_read(cpu->mem, sample_q[3 + dpextra].data, (cpu->DP + op1 + 1) & 0xffff, MEM_POINTER);
          }
       }
       break;
    case ISY:
       // e.g. LDA (08, S),Y
       // <opcode> <op1> <internal> <addrlo> <addrhi> <internal> <operand>
-      if (SL >= 0 && SH >= 0) {
-         memory_read(sample_q[3].data, ((SH << 8) + SL + op1    ) & 0xffff, MEM_POINTER);
-         memory_read(sample_q[4].data, ((SH << 8) + SL + op1 + 1) & 0xffff, MEM_POINTER);
+      if (cpu->SL >= 0 && cpu->SH >= 0) {
+         memory_read(cpu->mem, sample_q[3].data, ((cpu->SH << 8) + cpu->SL + op1    ) & 0xffff, MEM_POINTER);
+         memory_read(cpu->mem, sample_q[4].data, ((cpu->SH << 8) + cpu->SL + op1 + 1) & 0xffff, MEM_POINTER);
       }
       break;
    case IDL:
       // e.g. LDA [80]
       // <opcode> <op1> [ <dpextra> ] <addrlo> <addrhi> <bank> <operand>
-      if (DP >= 0) {
-         memory_read(sample_q[2 + dpextra].data, (DP + op1    ) & 0xffff, MEM_POINTER);
-         memory_read(sample_q[3 + dpextra].data, (DP + op1 + 1) & 0xffff, MEM_POINTER);
-         memory_read(sample_q[4 + dpextra].data, (DP + op1 + 2) & 0xffff, MEM_POINTER);
+      if (cpu->DP >= 0) {
+         memory_read(cpu->mem, sample_q[2 + dpextra].data, (cpu->DP + op1    ) & 0xffff, MEM_POINTER);
+         memory_read(cpu->mem, sample_q[3 + dpextra].data, (cpu->DP + op1 + 1) & 0xffff, MEM_POINTER);
+         memory_read(cpu->mem, sample_q[4 + dpextra].data, (cpu->DP + op1 + 2) & 0xffff, MEM_POINTER);
       }
       break;
    case IDLY:
       // e.g. LDA [80],Y
       // <opcode> <op1> [ <dpextra> ] <addrlo> <addrhi> <bank> <operand>
-      if (DP >= 0) {
-         memory_read(sample_q[2 + dpextra].data, (DP + op1    ) & 0xffff, MEM_POINTER);
-         memory_read(sample_q[3 + dpextra].data, (DP + op1 + 1) & 0xffff, MEM_POINTER);
-         memory_read(sample_q[4 + dpextra].data, (DP + op1 + 2) & 0xffff, MEM_POINTER);
+      if (cpu->DP >= 0) {
+         memory_read(cpu->mem, sample_q[2 + dpextra].data, (cpu->DP + op1    ) & 0xffff, MEM_POINTER);
+         memory_read(cpu->mem, sample_q[3 + dpextra].data, (cpu->DP + op1 + 1) & 0xffff, MEM_POINTER);
+         memory_read(cpu->mem, sample_q[4 + dpextra].data, (cpu->DP + op1 + 2) & 0xffff, MEM_POINTER);
       }
       break;
    case IAL:
       // e.g. JMP [$1234] (this is the only one)
       // <opcode> <op1> <op2> <addrlo> <addrhi> <bank>
-      memory_read(sample_q[3].data,  (op2 << 8) + op1              , MEM_POINTER);
-      memory_read(sample_q[4].data, ((op2 << 8) + op1 + 1) & 0xffff, MEM_POINTER);
-      memory_read(sample_q[5].data, ((op2 << 8) + op1 + 2) & 0xffff, MEM_POINTER);
+      memory_read(cpu->mem, sample_q[3].data,  (op2 << 8) + op1              , MEM_POINTER);
+      memory_read(cpu->mem, sample_q[4].data, ((op2 << 8) + op1 + 1) & 0xffff, MEM_POINTER);
+      memory_read(cpu->mem, sample_q[5].data, ((op2 << 8) + op1 + 2) & 0xffff, MEM_POINTER);
       break;
    case IND16:
       // e.g. JMP (1234)
       // <opcode> <op1> <op2> <addrlo> <addrhi>
-      memory_read(sample_q[3].data,  (op2 << 8) + op1              , MEM_POINTER);
-      memory_read(sample_q[4].data, ((op2 << 8) + op1 + 1) & 0xffff, MEM_POINTER);
+      memory_read(cpu->mem, sample_q[3].data,  (op2 << 8) + op1              , MEM_POINTER);
+      memory_read(cpu->mem, sample_q[4].data, ((op2 << 8) + op1 + 1) & 0xffff, MEM_POINTER);
       break;
    case IND1X:
       // JMP: <opcode=6C> <op1> <op2> <read new pcl> <read new pch>
       // JSR: <opcode=FC> <op1> <write pch> <write pcl> <op2> <internal> <read new pcl> <read new pch>
-      if (PB >= 0 && X >= 0) {
-         memory_read(sample_q[num_cycles - 2].data, (PB << 16) + (((op2 << 8) + op1 + X    ) & 0xffff), MEM_POINTER);
-         memory_read(sample_q[num_cycles - 1].data, (PB << 16) + (((op2 << 8) + op1 + X + 1) & 0xffff), MEM_POINTER);
+      if (cpu->PB >= 0 && cpu->X >= 0) {
+         memory_read(cpu->mem, sample_q[num_cycles - 2].data, (cpu->PB << 16) + (((op2 << 8) + op1 + cpu->X    ) & 0xffff), MEM_POINTER);
+         memory_read(cpu->mem, sample_q[num_cycles - 1].data, (cpu->PB << 16) + (((op2 << 8) + op1 + cpu->X + 1) & 0xffff), MEM_POINTER);
       }
       break;
    default:
@@ -1269,9 +1347,9 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
       // E=0 - Dummy is an internal cycle (with VPA/VDA=00)
       // MS == 1:       <opcode> <op1> <op2> <read lo> <read hi> <dummy> <write hi> <write lo>
       // MS == 0:       <opcode> <op1> <op2> <read> <dummy> <write>
-      if (E == 1) {
+      if (cpu->E == 1) {
          operand = sample_q[num_cycles - 2].data;
-      } else if (MS == 0) {
+      } else if (cpu->MS == 0) {
          // 16-bit mode
          operand = (sample_q[num_cycles - 4].data << 8) + sample_q[num_cycles - 5].data;
       } else {
@@ -1299,9 +1377,9 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
       // E=1: <opcode> <op1> <read dummy> <read p> <read pcl> <read pch>
       operand = (sample_q[5].data << 16) +  (sample_q[4].data << 8) + sample_q[3].data;
       if (num_cycles == 6) {
-         emulation_mode_on();
+         emulation_mode_on(cpu);
       } else {
-         emulation_mode_off();
+         emulation_mode_off(cpu);
          operand |= (sample_q[6].data << 24);
       }
    } else if (opcode == 0x60) {
@@ -1321,7 +1399,7 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
    } else {
       // default to using the last bus cycle(s) as the operand
       // special case PHD (0B) / PLD (2B) / PEI (D4) as these are always 16-bit
-      if ((instr->m_extra && (MS == 0)) || (instr->x_extra && (XS == 0)) || opcode == 0x0B || opcode == 0x2B || opcode == 0xD4)  {
+      if ((instr->m_extra && (cpu->MS == 0)) || (instr->x_extra && (cpu->XS == 0)) || opcode == 0x0B || opcode == 0x2B || opcode == 0xD4)  {
          // 16-bit operation
          if (opcode == 0x48 || opcode == 0x5A || opcode == 0xDA || opcode == 0x0B || opcode == 0xD4) {
             // PHA/PHX/PHY/PHD push high byte followed by low byte
@@ -1340,7 +1418,7 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
    // See RMW comment above for bus cycles
    operand_t operand2 = operand;
    if (instr->optype == RMWOP) {
-      if (E == 0 && ((instr->m_extra && (MS == 0)) || (instr->x_extra && (XS == 0)))) {
+      if (cpu->E == 0 && ((instr->m_extra && (cpu->MS == 0)) || (instr->x_extra && (cpu->XS == 0)))) {
          // 16-bit - byte ordering is high then low
          operand2 = (sample_q[num_cycles - 2].data << 8) + sample_q[num_cycles - 1].data;
       } else {
@@ -1348,7 +1426,7 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
          operand2 = sample_q[num_cycles - 1].data;
       }
    } else if (instr->optype == WRITEOP) {
-      if (E == 0 && ((instr->m_extra && (MS == 0)) || (instr->x_extra && (XS == 0)))) {
+      if (cpu->E == 0 && ((instr->m_extra && (cpu->MS == 0)) || (instr->x_extra && (cpu->XS == 0)))) {
          // 16-bit - byte ordering is low then high
          operand2 = (sample_q[num_cycles - 1].data << 8) + sample_q[num_cycles - 2].data;
       } else {
@@ -1362,70 +1440,70 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
    int index;
    switch (instr->mode) {
    case ZP:
-      if (DP >= 0) {
-         ea = (DP + op1) & 0xffff; // always bank 0
+      if (cpu->DP >= 0) {
+         ea = (cpu->DP + op1) & 0xffff; // always bank 0
       }
       break;
    case ZPX:
    case ZPY:
-      index = instr->mode == ZPX ? X : Y;
-      if (index >= 0 && DP >= 0) {
+      index = instr->mode == ZPX ? cpu->X : cpu->Y;
+      if (index >= 0 && cpu->DP >= 0) {
          if (wrap) {
-            ea = (DP & 0xff00) + ((op1 + index) & 0xff);
+            ea = (cpu->DP & 0xff00) + ((op1 + index) & 0xff);
          } else {
-            ea = (DP + op1 + index) & 0xffff; // always bank 0
+            ea = (cpu->DP + op1 + index) & 0xffff; // always bank 0
          }
       }
       break;
    case INDY:
       // <opcode> <op1> [ <dpextra> ] <addrlo> <addrhi> [ <page crossing>] <operand>
-      index = Y;
-      if (index >= 0 && DB >= 0) {
+      index = cpu->Y;
+      if (index >= 0 && cpu->DB >= 0) {
          ea = (sample_q[3 + dpextra].data << 8) + sample_q[2 + dpextra].data;
-         ea = ((DB << 16) + ea + index) & 0xffffff;
+         ea = ((cpu->DB << 16) + ea + index) & 0xffffff;
       }
       break;
    case INDX:
       // <opcode> <op1> [ <dpextra> ] <dummy> <addrlo> <addrhi> <operand>
-      if (DB >= 0) {
-         ea = (DB << 16) + (sample_q[4 + dpextra].data << 8) + sample_q[3 + dpextra].data;
+      if (cpu->DB >= 0) {
+         ea = (cpu->DB << 16) + (sample_q[4 + dpextra].data << 8) + sample_q[3 + dpextra].data;
       }
       break;
    case IND:
       // <opcode> <op1>  [ <dpextra> ] <addrlo> <addrhi> <operand>
-      if (DB >= 0) {
-         ea = (DB << 16) + (sample_q[3 + dpextra].data << 8) + sample_q[2 + dpextra].data;
+      if (cpu->DB >= 0) {
+         ea = (cpu->DB << 16) + (sample_q[3 + dpextra].data << 8) + sample_q[2 + dpextra].data;
       }
       break;
    case ABS:
-      if (DB >= 0) {
-         ea = (DB << 16) + (op2 << 8) + op1;
+      if (cpu->DB >= 0) {
+         ea = (cpu->DB << 16) + (op2 << 8) + op1;
       }
       break;
    case ABSX:
    case ABSY:
-      index = instr->mode == ABSX ? X : Y;
-      if (index >= 0 && DB >= 0) {
-         ea = ((DB << 16) + (op2 << 8) + op1 + index) & 0xffffff;
+      index = instr->mode == ABSX ? cpu->X : cpu->Y;
+      if (index >= 0 && cpu->DB >= 0) {
+         ea = ((cpu->DB << 16) + (op2 << 8) + op1 + index) & 0xffffff;
       }
       break;
    case BRA:
-      if (PC > 0) {
-         ea = (PC + ((int8_t)(op1)) + 2) & 0xffff;
+      if (cpu->PC > 0) {
+         ea = (cpu->PC + ((int8_t)(op1)) + 2) & 0xffff;
       }
       break;
    case SR:
       // e.g. LDA 08,S
-      if (SL >= 0 && SH >= 0) {
-         ea = ((SH << 8) + SL + op1) & 0xffff;
+      if (cpu->SL >= 0 && cpu->SH >= 0) {
+         ea = ((cpu->SH << 8) + cpu->SL + op1) & 0xffff;
       }
       break;
    case ISY:
       // e.g. LDA (08, S),Y
       // <opcode> <op1> <internal> <addrlo> <addrhi> <internal> <operand>
-      index = Y;
-      if (index >= 0 && DB >= 0) {
-         ea = (DB << 16) + (sample_q[4].data << 8) + sample_q[3].data;
+      index = cpu->Y;
+      if (index >= 0 && cpu->DB >= 0) {
+         ea = (cpu->DB << 16) + (sample_q[4].data << 8) + sample_q[3].data;
          ea = (ea + index) & 0xffffff;
       }
       break;
@@ -1437,7 +1515,7 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
    case IDLY:
       // e.g. LDA [80],Y
       // <opcode> <op1> [ <dpextra> ] <addrlo> <addrhi> <bank> <operand>
-      index = Y;
+      index = cpu->Y;
       if (index >= 0) {
          ea = (sample_q[4 + dpextra].data << 16) + (sample_q[3 + dpextra].data << 8) + sample_q[2 + dpextra].data;
          ea = (ea + index) & 0xffffff;
@@ -1449,8 +1527,8 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
       break;
    case ALX:
       // e.g. LDA EE0080,X
-      if (X >= 0) {
-         ea = ((op3 << 16) + (op2 << 8) + op1 + X) & 0xffffff;
+      if (cpu->X >= 0) {
+         ea = ((op3 << 16) + (op2 << 8) + op1 + cpu->X) & 0xffffff;
       }
       break;
    case IAL:
@@ -1460,8 +1538,8 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
       break;
    case BRL:
       // e.g. PER 1234 or BRL 1234
-      if (PC > 0) {
-         ea = (PC + ((int16_t)((op2 << 8) + op1)) + 3) & 0xffff;
+      if (cpu->PC > 0) {
+         ea = (cpu->PC + ((int16_t)((op2 << 8) + op1)) + 3) & 0xffff;
       }
       break;
    case BM:
@@ -1479,27 +1557,27 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
       int isDP = instr->mode == ZP || instr->mode == ZPX || instr->mode == ZPY;
 
       // Determine memory access size
-      int size = instr->x_extra ? XS : instr->m_extra ? MS : 1;
+      int size = instr->x_extra ? cpu->XS : instr->m_extra ? cpu->MS : 1;
 
       // Model memory reads
       if (ea >= 0 && (instr->optype == READOP || instr->optype == RMWOP)) {
          int oplo = (operand & 0xff);
          int ophi = ((operand >> 8) & 0xff);
          if (size == 0) {
-            memory_read(oplo,  ea    , MEM_DATA);
+            memory_read(cpu->mem, oplo,  ea    , MEM_DATA);
             if (isDP) {
-               memory_read(ophi,  (ea + 1) & 0xffff, MEM_DATA);
+               memory_read(cpu->mem, ophi,  (ea + 1) & 0xffff, MEM_DATA);
             } else {
-               memory_read(ophi,  ea + 1, MEM_DATA);
+               memory_read(cpu->mem, ophi,  ea + 1, MEM_DATA);
             }
          } else if (size > 0) {
-            memory_read(oplo, ea, MEM_DATA);
+            memory_read(cpu->mem, oplo, ea, MEM_DATA);
          }
       }
 
       // Execute the instruction specific function
       // (This returns -1 if the result is unknown or invalid)
-      int result = instr->emulate(operand, ea);
+      int result = instr->emulate(cpu, operand, ea);
 
       if (instr->optype == WRITEOP || instr->optype == RMWOP) {
 
@@ -1509,17 +1587,17 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
 
          // Check result of instruction against bye
          if (result >= 0 && result != operand2) {
-            failflag |= 1;
+            cpu->failflag |= 1;
          }
 
          // Model memory writes based on result seen on bus
          if (ea >= 0) {
-            memory_write(operand2 & 0xff,  ea, MEM_DATA);
+            memory_write(cpu->mem, operand2 & 0xff,  ea, MEM_DATA);
             if (size == 0) {
                if (isDP) {
-                  memory_write((operand2 >> 8) & 0xff, (ea + 1) & 0xffff, MEM_DATA);
+                  memory_write(cpu->mem, (operand2 >> 8) & 0xff, (ea + 1) & 0xffff, MEM_DATA);
                } else {
-                  memory_write((operand2 >> 8) & 0xff, ea + 1, MEM_DATA);
+                  memory_write(cpu->mem, (operand2 >> 8) & 0xff, ea + 1, MEM_DATA);
                }
             }
          }
@@ -1530,205 +1608,160 @@ static void em_65816_emulate(sample_t *sample_q, int num_cycles, instruction_t *
    if (opcode == 0x40) {
       // E=0: <opcode> <op1> <read dummy> <read p> <read pcl> <read pch> <read pbr>
       // E=1: <opcode> <op1> <read dummy> <read p> <read pcl> <read pch>
-      PC = sample_q[4].data | (sample_q[5].data << 8);
-      if (E == 0) {
-         PB = sample_q[6].data;
+      cpu->PC = sample_q[4].data | (sample_q[5].data << 8);
+      if (cpu->E == 0) {
+         cpu->PB = sample_q[6].data;
       }
    } else if (opcode == 0x6c || opcode == 0x7c || opcode == 0xfc ) {
       // JMP (ind), JMP (ind, X), JSR (ind, X)
-      PC = (sample_q[num_cycles - 1].data << 8) | sample_q[num_cycles - 2].data;
+      cpu->PC = (sample_q[num_cycles - 1].data << 8) | sample_q[num_cycles - 2].data;
    } else if (opcode == 0x20 || opcode == 0x4c) {
       // JSR abs, JMP abs
       // Don't use ea here as it includes PB which may be unknown
-      PC = (op2 << 8) + op1;
+      cpu->PC = (op2 << 8) + op1;
    } else if (opcode == 0x22 || opcode == 0x5c || opcode == 0xdc) {
       // JSL long, JML long
-      PB = (ea >> 16) & 0xff;
-      PC = (ea & 0xffff);
-   } else if (PC < 0) {
+      cpu->PB = (ea >> 16) & 0xff;
+      cpu->PC = (ea & 0xffff);
+   } else if (cpu->PC < 0) {
       // PC value is not known yet, everything below this point is relative
-      PC = -1;
+      cpu->PC = -1;
    } else if (opcode == 0x80 || opcode == 0x82) {
       // BRA / BRL
-      PC = ea;
+      cpu->PC = ea;
    } else if ((opcode & 0x1f) == 0x10 && num_cycles != 2) {
       // BXX: if taken
-      PC = ea;
+      cpu->PC = ea;
    } else {
       // Otherwise, increment pc by length of instuction
-      PC = (PC + opcount + 1) & 0xffff;
+      cpu->PC = (cpu->PC + opcount + 1) & 0xffff;
    }
 }
 
-static int em_65816_disassemble(char *buffer, instruction_t *instruction) {
-
-   int numchars;
-   int offset;
-   char target[16];
-
-   // Unpack the instruction bytes
-   int opcode  = instruction->opcode;
-   int op1     = instruction->op1;
-   int op2     = instruction->op2;
-   int op3     = instruction->op3;
-   int pc      = instruction->pc;
-   int opcount = instruction->opcount;
-   // lookup the entry for the instruction
-   InstrType *instr = &instr_table[opcode];
-
-   const char *mnemonic = instr->mnemonic;
-   const char *fmt = instr->fmt;
-   switch (instr->mode) {
-   case IMP:
-   case IMPA:
-      numchars = sprintf(buffer, fmt, mnemonic);
-      break;
-   case BRA:
-      // Calculate branch target using op1 for normal branches
-      offset = (int8_t) op1;
-      if (pc < 0) {
-         if (offset < 0) {
-            sprintf(target, "pc-%d", -offset);
-         } else {
-            sprintf(target,"pc+%d", offset);
-         }
-      } else {
-         sprintf(target, "%04X", (pc + 2 + offset) & 0xffff);
-      }
-      numchars = sprintf(buffer, fmt, mnemonic, target);
-      break;
-   case BRL:
-      // Calculate branch target using op1 for normal branches
-      offset = (int16_t) ((op2 << 8) + op1);
-      if (pc < 0) {
-         if (offset < 0) {
-            sprintf(target, "pc-%d", -offset);
-         } else {
-            sprintf(target,"pc+%d", offset);
-         }
-      } else {
-         sprintf(target, "%04X", (pc + 3 + offset) & 0xffff);
-      }
-      numchars = sprintf(buffer, fmt, mnemonic, target);
-      break;
-   case IMM:
-      if (opcount == 2) {
-         numchars = sprintf(buffer, fmt_imm16, mnemonic, op1, op2);
-      } else {
-         numchars = sprintf(buffer, fmt, mnemonic, op1);
-      }
-      break;
-   case ZP:
-   case ZPX:
-   case ZPY:
-   case INDX:
-   case INDY:
-   case IND:
-   case SR:
-   case ISY:
-   case IDL:
-   case IDLY:
-      numchars = sprintf(buffer, fmt, mnemonic, op1);
-      break;
-   case ABS:
-   case ABSX:
-   case ABSY:
-   case IND16:
-   case IND1X:
-   case IAL:
-   case BM:
-      numchars = sprintf(buffer, fmt, mnemonic, op1, op2);
-      break;
-   case ABL:
-   case ALX:
-      numchars = sprintf(buffer, fmt, mnemonic, op1, op2, op3);
-      break;
-   default:
-      numchars = 0;
+static int em_65816_disassemble(void *context, char *buffer, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
+   InstrType *instr = &cpu->instr_table[instruction->opcode];
+   if (instr->mode == IMM && instruction->opcount == 2) {
+      return disasm_write(buffer, &instr->dis_imm16, instruction);
    }
-
-   return numchars;
+   return disasm_write(buffer, &instr->dis, instruction);
 }
 
-static int em_65816_get_PC() {
-   return PC;
+static int em_65816_get_PC(void *context) {
+   cpu_state_t *cpu = context;
+   return cpu->PC;
 }
 
-static int em_65816_get_PB() {
-   return PB;
+static int em_65816_get_PB(void *context) {
+   cpu_state_t *cpu = context;
+   return cpu->PB;
 }
 
-static int em_65816_read_memory(int address) {
-   return memory_read_raw(address);
+static int em_65816_read_memory(void *context, int address) {
+   cpu_state_t *cpu = context;
+   return memory_read_raw(cpu->mem, address);
 }
 
-static char *em_65816_get_state(char *buffer) {
+static char *em_65816_get_state(void *context, char *buffer) {
+   cpu_state_t *cpu = context;
    strcpy(buffer, default_state);
-   if (B >= 0) {
-      write_hex2(buffer + OFFSET_B, B);
+   if (cpu->B >= 0) {
+      write_hex2(buffer + OFFSET_B, cpu->B);
    }
-   if (A >= 0) {
-      write_hex2(buffer + OFFSET_A, A);
+   if (cpu->A >= 0) {
+      write_hex2(buffer + OFFSET_A, cpu->A);
    }
-   if (X >= 0) {
-      write_hex4(buffer + OFFSET_X, X);
+   if (cpu->X >= 0) {
+      write_hex4(buffer + OFFSET_X, cpu->X);
    }
-   if (Y >= 0) {
-      write_hex4(buffer + OFFSET_Y, Y);
+   if (cpu->Y >= 0) {
+      write_hex4(buffer + OFFSET_Y, cpu->Y);
    }
-   if (SH >= 0) {
-      write_hex2(buffer + OFFSET_SH, SH);
+   if (cpu->SH >= 0) {
+      write_hex2(buffer + OFFSET_SH, cpu->SH);
    }
-   if (SL >= 0) {
-      write_hex2(buffer + OFFSET_SL, SL);
+   if (cpu->SL >= 0) {
+      write_hex2(buffer + OFFSET_SL, cpu->SL);
    }
-   if (N >= 0) {
-      buffer[OFFSET_N] = '0' + N;
+   if (cpu->N >= 0) {
+      buffer[OFFSET_N] = '0' + cpu->N;
    }
-   if (V >= 0) {
-      buffer[OFFSET_V] = '0' + V;
+   if (cpu->V >= 0) {
+      buffer[OFFSET_V] = '0' + cpu->V;
    }
-   if (MS >= 0) {
-      buffer[OFFSET_MS] = '0' + MS;
+   if (cpu->MS >= 0) {
+      buffer[OFFSET_MS] = '0' + cpu->MS;
    }
-   if (XS >= 0) {
-      buffer[OFFSET_XS] = '0' + XS;
+   if (cpu->XS >= 0) {
+      buffer[OFFSET_XS] = '0' + cpu->XS;
    }
-   if (D >= 0) {
-      buffer[OFFSET_D] = '0' + D;
+   if (cpu->D >= 0) {
+      buffer[OFFSET_D] = '0' + cpu->D;
    }
-   if (I >= 0) {
-      buffer[OFFSET_I] = '0' + I;
+   if (cpu->I >= 0) {
+      buffer[OFFSET_I] = '0' + cpu->I;
    }
-   if (Z >= 0) {
-      buffer[OFFSET_Z] = '0' + Z;
+   if (cpu->Z >= 0) {
+      buffer[OFFSET_Z] = '0' + cpu->Z;
    }
-   if (C >= 0) {
-      buffer[OFFSET_C] = '0' + C;
+   if (cpu->C >= 0) {
+      buffer[OFFSET_C] = '0' + cpu->C;
    }
-   if (E >= 0) {
-      buffer[OFFSET_E] = '0' + E;
+   if (cpu->E >= 0) {
+      buffer[OFFSET_E] = '0' + cpu->E;
    }
-   if (PB >= 0) {
-      write_hex2(buffer + OFFSET_PB, PB);
+   if (cpu->PB >= 0) {
+      write_hex2(buffer + OFFSET_PB, cpu->PB);
    }
-   if (DB >= 0) {
-      write_hex2(buffer + OFFSET_DB, DB);
+   if (cpu->DB >= 0) {
+      write_hex2(buffer + OFFSET_DB, cpu->DB);
    }
-   if (DP >= 0) {
-      write_hex4(buffer + OFFSET_DP, DP);
+   if (cpu->DP >= 0) {
+      write_hex4(buffer + OFFSET_DP, cpu->DP);
    }
    return buffer + OFFSET_END;
 }
 
-static int em_65816_get_and_clear_fail() {
-   int ret = failflag;
-   failflag = 0;
+static int em_65816_get_and_clear_fail(void *context) {
+   cpu_state_t *cpu = context;
+   int ret = cpu->failflag | memory_get_and_clear_fail(cpu->mem);
+   cpu->failflag = 0;
    return ret;
 }
 
+// The state saved in a checkpoint, i.e. everything carried from one
+// instruction to the next
+static int get_state_fields(cpu_state_t *cpu, int *fields[EM_MAX_STATE]) {
+   int *list[] = {
+      &cpu->A, &cpu->X, &cpu->Y, &cpu->SH, &cpu->SL, &cpu->PC,
+      &cpu->B, &cpu->DP, &cpu->DB, &cpu->PB,
+      &cpu->N, &cpu->V, &cpu->D, &cpu->I, &cpu->Z, &cpu->C,
+      &cpu->MS, &cpu->XS, &cpu->E
+   };
+   memcpy(fields, list, sizeof(list));
+   return sizeof(list) / sizeof(list[0]);
+}
+
+static int em_65816_save_state(void *context, int *state) {
+   int *fields[EM_MAX_STATE];
+   int n = get_state_fields(context, fields);
+   for (int i = 0; i < n; i++) {
+      state[i] = *fields[i];
+   }
+   return n;
+}
+
+static void em_65816_restore_state(void *context, const int *state) {
+   int *fields[EM_MAX_STATE];
+   int n = get_state_fields(context, fields);
+   for (int i = 0; i < n; i++) {
+      *fields[i] = state[i];
+   }
+}
+
 cpu_emulator_t em_65816 = {
-   .init = em_65816_init,
+   .create = em_65816_create,
+   .destroy = em_65816_destroy,
    .match_interrupt = em_65816_match_interrupt,
    .count_cycles = em_65816_count_cycles,
    .reset = em_65816_reset,
@@ -1740,6 +1773,10 @@ cpu_emulator_t em_65816 = {
    .read_memory = em_65816_read_memory,
    .get_state = em_65816_get_state,
    .get_and_clear_fail = em_65816_get_and_clear_fail,
+   .count_cycles_with_sync = count_cycles_with_sync,
+   .count_cycles_without_sync = count_cycles_without_sync,
+   .save_state = em_65816_save_state,
+   .restore_state = em_65816_restore_state
 };
 
 // ====================================================================
@@ -1747,303 +1784,303 @@ cpu_emulator_t em_65816 = {
 // ====================================================================
 
 // Push Effective Absolute Address
-static int op_PEA(operand_t operand, ea_t ea) {
+static int op_PEA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // always pushes a 16-bit value
-   push16new(ea);
+   push16new(cpu, ea);
    return -1;
 }
 
 // Push Effective Relative Address
-static int op_PER(operand_t operand, ea_t ea) {
+static int op_PER(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // always pushes a 16-bit value
-   push16new(ea);
+   push16new(cpu, ea);
    return -1;
 }
 
 // Push Effective Indirect Address
-static int op_PEI(operand_t operand, ea_t ea) {
+static int op_PEI(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // always pushes a 16-bit value
-   push16new(operand);
+   push16new(cpu, operand);
    return -1;
 }
 
 // Push Data Bank Register
-static int op_PHB(operand_t operand, ea_t ea) {
-   push8(operand); // stack wrapping on push8 is same for old and new instructions
-   if (DB >= 0) {
-      if (operand != DB) {
-         failflag = 1;
+static int op_PHB(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   push8(cpu, operand); // stack wrapping on push8 is same for old and new instructions
+   if (cpu->DB >= 0) {
+      if (operand != cpu->DB) {
+         cpu->failflag = 1;
       }
    }
-   DB = operand;
+   cpu->DB = operand;
    return -1;
 }
 
 // Push Program Bank Register
-static int op_PHK(operand_t operand, ea_t ea) {
-   push8(operand); // stack wrapping on push8 is same for old and new instructions
-   if (PB >= 0) {
-      if (operand != PB) {
-         failflag = 1;
+static int op_PHK(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   push8(cpu, operand); // stack wrapping on push8 is same for old and new instructions
+   if (cpu->PB >= 0) {
+      if (operand != cpu->PB) {
+         cpu->failflag = 1;
       }
    }
-   PB = operand;
+   cpu->PB = operand;
    return -1;
 }
 
 // Push Direct Page Register
-static int op_PHD(operand_t operand, ea_t ea) {
-   push16new(operand);
-   if (DP >= 0) {
-      if (operand != DP) {
-         failflag = 1;
+static int op_PHD(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   push16new(cpu, operand);
+   if (cpu->DP >= 0) {
+      if (operand != cpu->DP) {
+         cpu->failflag = 1;
       }
    }
-   DP = operand;
+   cpu->DP = operand;
    return -1;
 }
 
 // Pull Data Bank Register
-static int op_PLB(operand_t operand, ea_t ea) {
-   DB = operand;
-   set_NZ8(DB);
-   pop8new(operand);
+static int op_PLB(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->DB = operand;
+   set_NZ8(cpu, cpu->DB);
+   pop8new(cpu, operand);
    return -1;
 }
 
 // Pull Direct Page Register
-static int op_PLD(operand_t operand, ea_t ea) {
-   DP = operand;
-   set_NZ16(DP);
-   pop16new(operand);
+static int op_PLD(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->DP = operand;
+   set_NZ16(cpu, cpu->DP);
+   pop16new(cpu, operand);
    return -1;
 }
 
-static int op_MV(int data, int sba, int dba, int dir) {
+static int op_MV(cpu_state_t *cpu, int data, int sba, int dba, int dir) {
    // operand is the data byte (from the bus read)
    // ea = (op2 << 8) + op1 == (srcbank << 8) + dstbank;
-   if (X >= 0) {
-      memory_read(data, (sba << 16) + X, MEM_DATA);
+   if (cpu->X >= 0) {
+      memory_read(cpu->mem, data, (sba << 16) + cpu->X, MEM_DATA);
    }
-   if (Y >= 0) {
-      memory_write(data, (dba << 16) + Y, MEM_DATA);
+   if (cpu->Y >= 0) {
+      memory_write(cpu->mem, data, (dba << 16) + cpu->Y, MEM_DATA);
    }
-   if (A >= 0 && B >= 0) {
-      int C = (((B << 8) | A) - 1) & 0xffff;
-      A = C & 0xff;
-      B = (C >> 8) & 0xff;
-      if (XS > 0) {
+   if (cpu->A >= 0 && cpu->B >= 0) {
+      int count = (((cpu->B << 8) | cpu->A) - 1) & 0xffff;
+      cpu->A = count & 0xff;
+      cpu->B = (count >> 8) & 0xff;
+      if (cpu->XS > 0) {
          // 8-bit mode
-         if (X >= 0) {
-            X = (X + dir) & 0xff;
+         if (cpu->X >= 0) {
+            cpu->X = (cpu->X + dir) & 0xff;
          }
-         if (Y >= 0) {
-            Y = (Y + dir) & 0xff;
+         if (cpu->Y >= 0) {
+            cpu->Y = (cpu->Y + dir) & 0xff;
          }
-      } else if (XS == 0) {
+      } else if (cpu->XS == 0) {
          // 16-bit mode
-         if (X >= 0) {
-            X = (X + dir) & 0xffff;
+         if (cpu->X >= 0) {
+            cpu->X = (cpu->X + dir) & 0xffff;
          }
-         if (Y >= 0) {
-            Y = (Y + dir) & 0xffff;
+         if (cpu->Y >= 0) {
+            cpu->Y = (cpu->Y + dir) & 0xffff;
          }
       } else {
          // mode undefined
          // TODO: we could be less pessimistic and only go to undefined
          // when a page boundary is crossed
-         X = -1;
-         Y = -1;
+         cpu->X = -1;
+         cpu->Y = -1;
       }
-      if (PC >= 0 && C != 0xffff) {
-         PC -= 3;
+      if (cpu->PC >= 0 && count != 0xffff) {
+         cpu->PC -= 3;
       }
    } else {
-      A = -1;
-      B = -1;
-      X = -1;
-      Y = -1;
-      PC = -1;
+      cpu->A = -1;
+      cpu->B = -1;
+      cpu->X = -1;
+      cpu->Y = -1;
+      cpu->PC = -1;
    }
    // Set the Data Bank to the destination bank
-   DB = dba;
+   cpu->DB = dba;
    return -1;
 }
 
 // Block Move (Decrementing)
-static int op_MVP(operand_t operand, ea_t ea) {
-   return op_MV(operand, (ea >> 8) & 0xff, ea & 0xff, -1);
+static int op_MVP(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   return op_MV(cpu, operand, (ea >> 8) & 0xff, ea & 0xff, -1);
 }
 
 // Block Move (Incrementing)
-static int op_MVN(operand_t operand, ea_t ea) {
-   return op_MV(operand, (ea >> 8) & 0xff, ea & 0xff, 1);
+static int op_MVN(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   return op_MV(cpu, operand, (ea >> 8) & 0xff, ea & 0xff, 1);
 }
 
 // Transfer Transfer C accumulator to Direct Page register
-static int op_TCD(operand_t operand, ea_t ea) {
+static int op_TCD(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Always a 16-bit transfer
-   if (B >= 0 && A >= 0) {
-      DP = (B << 8) + A;
-      set_NZ16(DP);
+   if (cpu->B >= 0 && cpu->A >= 0) {
+      cpu->DP = (cpu->B << 8) + cpu->A;
+      set_NZ16(cpu, cpu->DP);
    } else {
-      DP = -1;
-      set_NZ_unknown();
+      cpu->DP = -1;
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
 // Transfer Transfer C accumulator to Stack pointer
-static int op_TCS(operand_t operand, ea_t ea) {
-   SH = B;
-   SL = A;
+static int op_TCS(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->SH = cpu->B;
+   cpu->SL = cpu->A;
    // Force SH to be 1 in emulation mode
-   if (E == 1) {
-      SH = 1;
-   } else if (E < 0 && SH != 1) {
-      SH = -1;
+   if (cpu->E == 1) {
+      cpu->SH = 1;
+   } else if (cpu->E < 0 && cpu->SH != 1) {
+      cpu->SH = -1;
    }
    return -1;
 }
 
 // Transfer Transfer Direct Page register to C accumulator
-static int op_TDC(operand_t operand, ea_t ea) {
+static int op_TDC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Always a 16-bit transfer
-   if (DP >= 0) {
-      A = DP & 0xff;
-      B = (DP >> 8) & 0xff;
-      set_NZ16(DP);
+   if (cpu->DP >= 0) {
+      cpu->A = cpu->DP & 0xff;
+      cpu->B = (cpu->DP >> 8) & 0xff;
+      set_NZ16(cpu, cpu->DP);
    } else {
-      A = -1;
-      B = -1;
-      set_NZ_unknown();
+      cpu->A = -1;
+      cpu->B = -1;
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
 // Transfer Transfer Stack pointer to C accumulator
-static int op_TSC(operand_t operand, ea_t ea) {
+static int op_TSC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Always a 16-bit transfer
-   A = SL;
-   B = SH;
-   if (B >= 0 && A >= 0) {
-      set_NZ16((B << 8) + A);
+   cpu->A = cpu->SL;
+   cpu->B = cpu->SH;
+   if (cpu->B >= 0 && cpu->A >= 0) {
+      set_NZ16(cpu, (cpu->B << 8) + cpu->A);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_TXY(operand_t operand, ea_t ea) {
+static int op_TXY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Variable size transfer controlled by XS
-   if (X >= 0) {
-      Y = X;
-      set_NZ_XS(Y);
+   if (cpu->X >= 0) {
+      cpu->Y = cpu->X;
+      set_NZ_XS(cpu, cpu->Y);
    } else {
-      Y = -1;
-      set_NZ_unknown();
+      cpu->Y = -1;
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_TYX(operand_t operand, ea_t ea) {
+static int op_TYX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Variable size transfer controlled by XS
-   if (Y >= 0) {
-      X = Y;
-      set_NZ_XS(X);
+   if (cpu->Y >= 0) {
+      cpu->X = cpu->Y;
+      set_NZ_XS(cpu, cpu->X);
    } else {
-      X = -1;
-      set_NZ_unknown();
+      cpu->X = -1;
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
 // Exchange A and B
-static int op_XBA(operand_t operand, ea_t ea) {
-   int tmp = A;
-   A = B;
-   B = tmp;
-   if (A >= 0) {
+static int op_XBA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   int tmp = cpu->A;
+   cpu->A = cpu->B;
+   cpu->B = tmp;
+   if (cpu->A >= 0) {
       // Always based on the 8-bit result of A
-      set_NZ8(A);
+      set_NZ8(cpu, cpu->A);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_XCE(operand_t operand, ea_t ea) {
-   int tmp = C;
-   C = E;
-   E = tmp;
+static int op_XCE(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   int tmp = cpu->C;
+   cpu->C = cpu->E;
+   cpu->E = tmp;
    if (tmp < 0) {
-      MS = -1;
-      XS = -1;
-      E = -1;
+      cpu->MS = -1;
+      cpu->XS = -1;
+      cpu->E = -1;
    } else if (tmp > 0) {
-      emulation_mode_on();
+      emulation_mode_on(cpu);
    } else {
-      emulation_mode_off();
+      emulation_mode_off(cpu);
    }
    return -1;
 }
 
-static void repsep(int operand, int val) {
+static void repsep(cpu_state_t *cpu, int operand, int val) {
    if (operand & 0x80) {
-      N = val;
+      cpu->N = val;
    }
    if (operand & 0x40) {
-      V = val;
+      cpu->V = val;
    }
-   if (E == 0) {
+   if (cpu->E == 0) {
       if (operand & 0x20) {
-         MS = val;
+         cpu->MS = val;
       }
       if (operand & 0x10) {
-         XS = val;
-         x_flag_updated();
+         cpu->XS = val;
+         x_flag_updated(cpu);
       }
    }
    if (operand & 0x08) {
-      D = val;
+      cpu->D = val;
    }
    if (operand & 0x04) {
-      I = val;
+      cpu->I = val;
    }
    if (operand & 0x02) {
-      Z = val;
+      cpu->Z = val;
    }
    if (operand & 0x01) {
-      C = val;
+      cpu->C = val;
    }
 }
 
 // Reset/Set Processor Status Bits
-static int op_REP(operand_t operand, ea_t ea) {
-   repsep(operand, 0);
+static int op_REP(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   repsep(cpu, operand, 0);
    return -1;
 }
 
-static int op_SEP(operand_t operand, ea_t ea) {
-   repsep(operand, 1);
+static int op_SEP(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   repsep(cpu, operand, 1);
    return -1;
 }
 
 // Jump to Subroutine Long
-static int op_JSL(operand_t operand, ea_t ea) {
+static int op_JSL(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // JSR: the operand is the data pushed to the stack (PB, PCH, PCL)
-   push8(operand >> 16); // PB
-   push16(operand);      // PC
+   push8(cpu, operand >> 16); // PB
+   push16(cpu, operand);      // PC
    return -1;
 }
 
 // Return from Subroutine Long
-static int op_RTL(operand_t operand, ea_t ea) {
+static int op_RTL(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // RTL: the operand is the data pulled from the stack (PCL, PCH, PB)
-   pop24new(operand);
+   pop24new(cpu, operand);
    // The +1 is handled elsewhere
-   PC = operand & 0xffff;
-   PB = (operand >> 16) & 0xff;
+   cpu->PC = operand & 0xffff;
+   cpu->PB = (operand >> 16) & 0xff;
    return -1;
 }
 
@@ -2051,928 +2088,928 @@ static int op_RTL(operand_t operand, ea_t ea) {
 // 65816/6502 instructions
 // ====================================================================
 
-static int op_ADC(operand_t operand, ea_t ea) {
-   int acc = get_accumulator();
-   if (acc >= 0 && C >= 0) {
+static int op_ADC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   int acc = get_accumulator(cpu);
+   if (acc >= 0 && cpu->C >= 0) {
       int tmp = 0;
-      if (D == 1) {
+      if (cpu->D == 1) {
          // Decimal mode ADC - works like a 65C02
          // Working a nibble at a time, correct for both 8 and 18 bits
-         for (int bit = 0; bit < (MS ? 8 : 16); bit += 4) {
+         for (int bit = 0; bit < (cpu->MS ? 8 : 16); bit += 4) {
             int an = (acc >> bit) & 0xF;
             int bn = (operand >> bit) & 0xF;
-            int rn =  an + bn + C;
-            V = ((rn ^ an) & 8) && !((bn ^ an) & 8);
-            C = 0;
+            int rn =  an + bn + cpu->C;
+            cpu->V = ((rn ^ an) & 8) && !((bn ^ an) & 8);
+            cpu->C = 0;
             if (rn >= 10) {
                rn = (rn - 10) & 0xF;
-               C = 1;
+               cpu->C = 1;
             }
             tmp |= rn << bit;
          }
       } else {
          // Normal mode ADC
-         tmp = acc + operand + C;
-         if (MS > 0) {
+         tmp = acc + operand + cpu->C;
+         if (cpu->MS > 0) {
             // 8-bit mode
-            C = (tmp >> 8) & 1;
-            V = (((acc ^ operand) & 0x80) == 0) && (((acc ^ tmp) & 0x80) != 0);
+            cpu->C = (tmp >> 8) & 1;
+            cpu->V = (((acc ^ operand) & 0x80) == 0) && (((acc ^ tmp) & 0x80) != 0);
          } else {
             // 16-bit mode
-            C = (tmp >> 16) & 1;
-            V = (((acc ^ operand) & 0x8000) == 0) && (((acc ^ tmp) & 0x8000) != 0);
+            cpu->C = (tmp >> 16) & 1;
+            cpu->V = (((acc ^ operand) & 0x8000) == 0) && (((acc ^ tmp) & 0x8000) != 0);
          }
       }
-      if (MS > 0) {
+      if (cpu->MS > 0) {
          // 8-bit mode
-         A = tmp & 0xff;
+         cpu->A = tmp & 0xff;
       } else {
          // 16-bit mode
-         A = tmp & 0xff;
-         B = (tmp >> 8) & 0xff;
+         cpu->A = tmp & 0xff;
+         cpu->B = (tmp >> 8) & 0xff;
       }
-      set_NZ_AB(A, B);
+      set_NZ_AB(cpu, cpu->A, cpu->B);
    } else {
-      A = -1;
-      B = -1;
-      set_NVZC_unknown();
+      cpu->A = -1;
+      cpu->B = -1;
+      set_NVZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_AND(operand_t operand, ea_t ea) {
+static int op_AND(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // A is always updated, regardless of the size
-   if (A >= 0) {
-      A = A & (operand & 0xff);
+   if (cpu->A >= 0) {
+      cpu->A = cpu->A & (operand & 0xff);
    }
    // B is updated only of the size is 16
-   if (B >= 0) {
-      if (MS == 0) {
-         B = B & (operand >> 8);
-      } else if (MS < 0) {
-         B = -1;
+   if (cpu->B >= 0) {
+      if (cpu->MS == 0) {
+         cpu->B = cpu->B & (operand >> 8);
+      } else if (cpu->MS < 0) {
+         cpu->B = -1;
       }
    }
    // Updating NZ is complex, depending on the whether A and/or B are unknown
-   set_NZ_AB(A, B);
+   set_NZ_AB(cpu, cpu->A, cpu->B);
    return -1;
 }
 
-static int op_ASLA(operand_t operand, ea_t ea) {
+static int op_ASLA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Compute the new carry
-   if (MS > 0 && A >= 0) {
+   if (cpu->MS > 0 && cpu->A >= 0) {
       // 8-bit mode
-      C = (A >> 7) & 1;
-   } else if (MS == 0 && B >= 0) {
+      cpu->C = (cpu->A >> 7) & 1;
+   } else if (cpu->MS == 0 && cpu->B >= 0) {
       // 16-bit mode
-      C = (B >> 7) & 1;
+      cpu->C = (cpu->B >> 7) & 1;
    } else {
       // width unknown
-      C = -1;
+      cpu->C = -1;
    }
    // Compute the new B
-   if (MS == 0 && B >= 0) {
-      if (A >= 0) {
-         B = ((B << 1) & 0xfe) | ((A >> 7) & 1);
+   if (cpu->MS == 0 && cpu->B >= 0) {
+      if (cpu->A >= 0) {
+         cpu->B = ((cpu->B << 1) & 0xfe) | ((cpu->A >> 7) & 1);
       } else {
-         B = -1;
+         cpu->B = -1;
       }
-   } else if (MS < 0) {
-      B = -1;
+   } else if (cpu->MS < 0) {
+      cpu->B = -1;
    }
    // Compute the new A
-   if (A >= 0) {
-      A = (A << 1) & 0xff;
+   if (cpu->A >= 0) {
+      cpu->A = (cpu->A << 1) & 0xff;
    }
    // Updating NZ is complex, depending on the whether A and/or B are unknown
-   set_NZ_AB(A, B);
+   set_NZ_AB(cpu, cpu->A, cpu->B);
    return -1;
 }
 
-static int op_ASL(operand_t operand, ea_t ea) {
+static int op_ASL(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    int tmp;
-   if (MS > 0) {
+   if (cpu->MS > 0) {
       // 8-bit mode
-      C = (operand >> 7) & 1;
+      cpu->C = (operand >> 7) & 1;
       tmp = (operand << 1) & 0xff;
-      set_NZ8(tmp);
-   } else if (MS == 0) {
+      set_NZ8(cpu, tmp);
+   } else if (cpu->MS == 0) {
       // 16-bit mode
-      C = (operand >> 15) & 1;
+      cpu->C = (operand >> 15) & 1;
       tmp = (operand << 1) & 0xffff;
-      set_NZ16(tmp);
+      set_NZ16(cpu, tmp);
    } else {
       // mode unknown
-      C = -1;
+      cpu->C = -1;
       tmp = -1;
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return tmp;
 }
 
-static int op_BCC(operand_t branch_taken, ea_t ea) {
-   if (C >= 0) {
-      if (C == branch_taken) {
-         failflag = 1;
+static int op_BCC(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->C >= 0) {
+      if (cpu->C == branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      C = 1 - branch_taken;
+      cpu->C = 1 - branch_taken;
    }
    return -1;
 }
 
-static int op_BCS(operand_t branch_taken, ea_t ea) {
-   if (C >= 0) {
-      if (C != branch_taken) {
-         failflag = 1;
+static int op_BCS(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->C >= 0) {
+      if (cpu->C != branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      C = branch_taken;
+      cpu->C = branch_taken;
    }
    return -1;
 }
 
-static int op_BNE(operand_t branch_taken, ea_t ea) {
-   if (Z >= 0) {
-      if (Z == branch_taken) {
-         failflag = 1;
+static int op_BNE(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->Z >= 0) {
+      if (cpu->Z == branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      Z = 1 - branch_taken;
+      cpu->Z = 1 - branch_taken;
    }
    return -1;
 }
 
-static int op_BEQ(operand_t branch_taken, ea_t ea) {
-   if (Z >= 0) {
-      if (Z != branch_taken) {
-         failflag = 1;
+static int op_BEQ(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->Z >= 0) {
+      if (cpu->Z != branch_taken) {
+         cpu->failflag = 1;
         }
    } else {
-      Z = branch_taken;
+      cpu->Z = branch_taken;
    }
    return -1;
 }
 
-static int op_BPL(operand_t branch_taken, ea_t ea) {
-   if (N >= 0) {
-      if (N == branch_taken) {
-         failflag = 1;
+static int op_BPL(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->N >= 0) {
+      if (cpu->N == branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      N = 1 - branch_taken;
+      cpu->N = 1 - branch_taken;
    }
    return -1;
 }
 
-static int op_BMI(operand_t branch_taken, ea_t ea) {
-   if (N >= 0) {
-      if (N != branch_taken) {
-         failflag = 1;
+static int op_BMI(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->N >= 0) {
+      if (cpu->N != branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      N = branch_taken;
+      cpu->N = branch_taken;
    }
    return -1;
 }
 
-static int op_BVC(operand_t branch_taken, ea_t ea) {
-   if (V >= 0) {
-      if (V == branch_taken) {
-         failflag = 1;
+static int op_BVC(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->V >= 0) {
+      if (cpu->V == branch_taken) {
+         cpu->failflag = 1;
       }
    } else {
-      V = 1 - branch_taken;
+      cpu->V = 1 - branch_taken;
    }
    return -1;
 }
 
-static int op_BVS(operand_t branch_taken, ea_t ea) {
-   if (V >= 0) {
-      if (V != branch_taken) {
-         failflag = 1;
+static int op_BVS(cpu_state_t *cpu, operand_t branch_taken, ea_t ea) {
+   if (cpu->V >= 0) {
+      if (cpu->V != branch_taken) {
+         cpu->failflag = 1;
         }
    } else {
-      V = branch_taken;
+      cpu->V = branch_taken;
    }
    return -1;
 }
 
-static int op_BIT_IMM(operand_t operand, ea_t ea) {
-   int acc = get_accumulator();
+static int op_BIT_IMM(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   int acc = get_accumulator(cpu);
    if (operand == 0) {
       // This makes the remainder less pessimistic
-      Z = 1;
+      cpu->Z = 1;
    } else if (acc >= 0) {
       // both acc and operand will be the correct width
-      Z = (acc & operand) == 0;
+      cpu->Z = (acc & operand) == 0;
    } else {
-      Z = -1;
+      cpu->Z = -1;
    }
    return -1;
 }
 
-static int op_BIT(operand_t operand, ea_t ea) {
-   if (MS > 0) {
+static int op_BIT(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->MS > 0) {
       // 8-bit mode
-      N = (operand >> 7) & 1;
-      V = (operand >> 6) & 1;
-   } else if (MS == 0) {
+      cpu->N = (operand >> 7) & 1;
+      cpu->V = (operand >> 6) & 1;
+   } else if (cpu->MS == 0) {
       // 16-bit mode
-      N = (operand >> 15) & 1;
-      V = (operand >> 14) & 1;
+      cpu->N = (operand >> 15) & 1;
+      cpu->V = (operand >> 14) & 1;
    } else {
       // mode undefined
-      N = -1; // could be less pessimistic
-      V = -1; // could be less pessimistic
+      cpu->N = -1; // could be less pessimistic
+      cpu->V = -1; // could be less pessimistic
    }
    // the rest is the same as BIT immediate (i.e. setting the Z flag)
-   return op_BIT_IMM(operand, ea);
+   return op_BIT_IMM(cpu, operand, ea);
 }
 
-static int op_CLC(operand_t operand, ea_t ea) {
-   C = 0;
+static int op_CLC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->C = 0;
    return -1;
 }
 
-static int op_CLD(operand_t operand, ea_t ea) {
-   D = 0;
+static int op_CLD(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->D = 0;
    return -1;
 }
 
-static int op_CLI(operand_t operand, ea_t ea) {
-   I = 0;
+static int op_CLI(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->I = 0;
    return -1;
 }
 
-static int op_CLV(operand_t operand, ea_t ea) {
-   V = 0;
+static int op_CLV(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->V = 0;
    return -1;
 }
 
-static int op_CMP(operand_t operand, ea_t ea) {
-   int acc = get_accumulator();
+static int op_CMP(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   int acc = get_accumulator(cpu);
    if (acc >= 0) {
       int tmp = acc - operand;
-      C = tmp >= 0;
-      set_NZ_MS(tmp);
+      cpu->C = tmp >= 0;
+      set_NZ_MS(cpu, tmp);
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_CPX(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      int tmp = X - operand;
-      C = tmp >= 0;
-      set_NZ_XS(tmp);
+static int op_CPX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      int tmp = cpu->X - operand;
+      cpu->C = tmp >= 0;
+      set_NZ_XS(cpu, tmp);
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_CPY(operand_t operand, ea_t ea) {
-   if (Y >= 0) {
-      int tmp = Y - operand;
-      C = tmp >= 0;
-      set_NZ_XS(tmp);
+static int op_CPY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->Y >= 0) {
+      int tmp = cpu->Y - operand;
+      cpu->C = tmp >= 0;
+      set_NZ_XS(cpu, tmp);
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_DECA(operand_t operand, ea_t ea) {
+static int op_DECA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Compute the new A
-   if (A >= 0) {
-      A = (A - 1) & 0xff;
+   if (cpu->A >= 0) {
+      cpu->A = (cpu->A - 1) & 0xff;
    }
    // Compute the new B
-   if (MS == 0 && B >= 0) {
-      if (A == 0xff) {
-         B = (B - 1) & 0xff;
-      } else if (A < 0) {
-         B = -1;
+   if (cpu->MS == 0 && cpu->B >= 0) {
+      if (cpu->A == 0xff) {
+         cpu->B = (cpu->B - 1) & 0xff;
+      } else if (cpu->A < 0) {
+         cpu->B = -1;
       }
-   } else if (MS < 0) {
-      B = -1;
+   } else if (cpu->MS < 0) {
+      cpu->B = -1;
    }
    // Updating NZ is complex, depending on the whether A and/or B are unknown
-   set_NZ_AB(A, B);
+   set_NZ_AB(cpu, cpu->A, cpu->B);
    return -1;
 }
 
-static int op_DEC(operand_t operand, ea_t ea) {
+static int op_DEC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    int tmp = -1;
-   if (MS > 0) {
+   if (cpu->MS > 0) {
       // 8-bit mode
       tmp = (operand - 1) & 0xff;
-      set_NZ8(tmp);
-   } else if (MS == 0) {
+      set_NZ8(cpu, tmp);
+   } else if (cpu->MS == 0) {
       // 16-bit mode
       tmp = (operand - 1) & 0xffff;
-      set_NZ16(tmp);
+      set_NZ16(cpu, tmp);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return tmp;
 }
 
-static int op_DEX(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      if (XS > 0) {
+static int op_DEX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      if (cpu->XS > 0) {
          // 8-bit mode
-         X = (X - 1) & 0xff;
-         set_NZ8(X);
-      } else if (XS == 0) {
+         cpu->X = (cpu->X - 1) & 0xff;
+         set_NZ8(cpu, cpu->X);
+      } else if (cpu->XS == 0) {
          // 16-bit mode
-         X = (X - 1) & 0xffff;
-         set_NZ16(X);
+         cpu->X = (cpu->X - 1) & 0xffff;
+         set_NZ16(cpu, cpu->X);
       } else {
          // mode undefined
-         X = -1;
-         set_NZ_unknown();
+         cpu->X = -1;
+         set_NZ_unknown(cpu);
       }
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_DEY(operand_t operand, ea_t ea) {
-   if (Y >= 0) {
-      if (XS > 0) {
+static int op_DEY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->Y >= 0) {
+      if (cpu->XS > 0) {
          // 8-bit mode
-         Y = (Y - 1) & 0xff;
-         set_NZ8(Y);
-      } else if (XS == 0) {
+         cpu->Y = (cpu->Y - 1) & 0xff;
+         set_NZ8(cpu, cpu->Y);
+      } else if (cpu->XS == 0) {
          // 16-bit mode
-         Y = (Y - 1) & 0xffff;
-         set_NZ16(Y);
+         cpu->Y = (cpu->Y - 1) & 0xffff;
+         set_NZ16(cpu, cpu->Y);
       } else {
          // mode undefined
-         Y = -1;
-         set_NZ_unknown();
+         cpu->Y = -1;
+         set_NZ_unknown(cpu);
       }
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_EOR(operand_t operand, ea_t ea) {
+static int op_EOR(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // A is always updated, regardless of the size
-   if (A >= 0) {
-      A = A ^ (operand & 0xff);
+   if (cpu->A >= 0) {
+      cpu->A = cpu->A ^ (operand & 0xff);
    }
    // B is updated only of the size is 16
-   if (B >= 0) {
-      if (MS == 0) {
-         B = B ^ (operand >> 8);
-      } else if (MS < 0) {
-         B = -1;
+   if (cpu->B >= 0) {
+      if (cpu->MS == 0) {
+         cpu->B = cpu->B ^ (operand >> 8);
+      } else if (cpu->MS < 0) {
+         cpu->B = -1;
       }
    }
    // Updating NZ is complex, depending on the whether A and/or B are unknown
-   set_NZ_AB(A, B);
+   set_NZ_AB(cpu, cpu->A, cpu->B);
    return -1;
 }
 
-static int op_INCA(operand_t operand, ea_t ea) {
+static int op_INCA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Compute the new A
-   if (A >= 0) {
-      A = (A + 1) & 0xff;
+   if (cpu->A >= 0) {
+      cpu->A = (cpu->A + 1) & 0xff;
    }
    // Compute the new B
-   if (MS == 0 && B >= 0) {
-      if (A == 0x00) {
-         B = (B + 1) & 0xff;
-      } else if (A < 0) {
-         B = -1;
+   if (cpu->MS == 0 && cpu->B >= 0) {
+      if (cpu->A == 0x00) {
+         cpu->B = (cpu->B + 1) & 0xff;
+      } else if (cpu->A < 0) {
+         cpu->B = -1;
       }
-   } else if (MS < 0) {
-      B = -1;
+   } else if (cpu->MS < 0) {
+      cpu->B = -1;
    }
    // Updating NZ is complex, depending on the whether A and/or B are unknown
-   set_NZ_AB(A, B);
+   set_NZ_AB(cpu, cpu->A, cpu->B);
    return -1;
 }
 
-static int op_INC(operand_t operand, ea_t ea) {
+static int op_INC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    int tmp = -1;
-   if (MS > 0) {
+   if (cpu->MS > 0) {
       // 8-bit mode
       tmp = (operand + 1) & 0xff;
-      set_NZ8(tmp);
-   } else if (MS == 0) {
+      set_NZ8(cpu, tmp);
+   } else if (cpu->MS == 0) {
       // 16-bit mode
       tmp = (operand + 1) & 0xffff;
-      set_NZ16(tmp);
+      set_NZ16(cpu, tmp);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return tmp;
 }
 
-static int op_INX(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      if (XS > 0) {
+static int op_INX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      if (cpu->XS > 0) {
          // 8-bit mode
-         X = (X + 1) & 0xff;
-         set_NZ8(X);
-      } else if (XS == 0) {
+         cpu->X = (cpu->X + 1) & 0xff;
+         set_NZ8(cpu, cpu->X);
+      } else if (cpu->XS == 0) {
          // 16-bit mode
-         X = (X + 1) & 0xffff;
-         set_NZ16(X);
+         cpu->X = (cpu->X + 1) & 0xffff;
+         set_NZ16(cpu, cpu->X);
       } else {
          // mode undefined
-         X = -1;
-         set_NZ_unknown();
+         cpu->X = -1;
+         set_NZ_unknown(cpu);
       }
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_INY(operand_t operand, ea_t ea) {
-   if (Y >= 0) {
-      if (XS > 0) {
+static int op_INY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->Y >= 0) {
+      if (cpu->XS > 0) {
          // 8-bit mode
-         Y = (Y + 1) & 0xff;
-         set_NZ8(Y);
-      } else if (XS == 0) {
+         cpu->Y = (cpu->Y + 1) & 0xff;
+         set_NZ8(cpu, cpu->Y);
+      } else if (cpu->XS == 0) {
          // 16-bit mode
-         Y = (Y + 1) & 0xffff;
-         set_NZ16(Y);
+         cpu->Y = (cpu->Y + 1) & 0xffff;
+         set_NZ16(cpu, cpu->Y);
       } else {
          // mode undefined
-         Y = -1;
-         set_NZ_unknown();
+         cpu->Y = -1;
+         set_NZ_unknown(cpu);
       }
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return -1;
 }
 
-static int op_JSR(operand_t operand, ea_t ea) {
+static int op_JSR(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // JSR: the operand is the data pushed to the stack (PCH, PCL)
-   push16(operand);  // PC
+   push16(cpu, operand);  // PC
    return -1;
 }
 
-static int op_JSR_new(operand_t operand, ea_t ea) {
+static int op_JSR_new(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // JSR: the operand is the data pushed to the stack (PCH, PCL)
-   push16new(operand);  // PC
+   push16new(cpu, operand);  // PC
    return -1;
 }
 
-static int op_LDA(operand_t operand, ea_t ea) {
-   A = operand & 0xff;
-   if (MS == 0) {
-      B = (operand >> 8) & 0xff;
+static int op_LDA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->A = operand & 0xff;
+   if (cpu->MS == 0) {
+      cpu->B = (operand >> 8) & 0xff;
    }
-   set_NZ_AB(A, B);
+   set_NZ_AB(cpu, cpu->A, cpu->B);
    return -1;
 }
 
-static int op_LDX(operand_t operand, ea_t ea) {
-   X = operand;
-   set_NZ_XS(X);
+static int op_LDX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->X = operand;
+   set_NZ_XS(cpu, cpu->X);
    return -1;
 }
 
-static int op_LDY(operand_t operand, ea_t ea) {
-   Y = operand;
-   set_NZ_XS(Y);
+static int op_LDY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->Y = operand;
+   set_NZ_XS(cpu, cpu->Y);
    return -1;
 }
 
-static int op_LSRA(operand_t operand, ea_t ea) {
+static int op_LSRA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Compute the new carry
-   if (A >= 0) {
-      C = A & 1;
+   if (cpu->A >= 0) {
+      cpu->C = cpu->A & 1;
    } else {
-      C = -1;
+      cpu->C = -1;
    }
    // Compute the new A
-   if (MS > 0 && A >= 0) {
-      A = A >> 1;
-   } else if (MS == 0 && A >= 0 && B >= 0) {
-      A = ((A >> 1) | (B << 7)) & 0xff;
+   if (cpu->MS > 0 && cpu->A >= 0) {
+      cpu->A = cpu->A >> 1;
+   } else if (cpu->MS == 0 && cpu->A >= 0 && cpu->B >= 0) {
+      cpu->A = ((cpu->A >> 1) | (cpu->B << 7)) & 0xff;
    } else {
-      A = -1;
+      cpu->A = -1;
    }
    // Compute the new B
-   if (MS == 0 && B >= 0) {
-      B = (B >> 1) & 0xff;
-   } else if (MS < 0) {
-      B = -1;
+   if (cpu->MS == 0 && cpu->B >= 0) {
+      cpu->B = (cpu->B >> 1) & 0xff;
+   } else if (cpu->MS < 0) {
+      cpu->B = -1;
    }
    // Updating NZ is complex, depending on the whether A and/or B are unknown
-   set_NZ_AB(A, B);
+   set_NZ_AB(cpu, cpu->A, cpu->B);
    return -1;
 }
 
-static int op_LSR(operand_t operand, ea_t ea) {
+static int op_LSR(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    int tmp;
-   C = operand & 1;
-   if (MS > 0) {
+   cpu->C = operand & 1;
+   if (cpu->MS > 0) {
       // 8-bit mode
       tmp = (operand >> 1) & 0xff;
-      set_NZ8(tmp);
-   } else if (MS == 0) {
+      set_NZ8(cpu, tmp);
+   } else if (cpu->MS == 0) {
       // 16-bit mode
       tmp = (operand >> 1) & 0xffff;
-      set_NZ16(tmp);
+      set_NZ16(cpu, tmp);
    } else {
       // mode unknown
       tmp = -1;
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return tmp;
 }
 
-static int op_ORA(operand_t operand, ea_t ea) {
+static int op_ORA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // A is always updated, regardless of the size
-   if (A >= 0) {
-      A = A | (operand & 0xff);
+   if (cpu->A >= 0) {
+      cpu->A = cpu->A | (operand & 0xff);
    }
    // B is updated only of the size is 16
-   if (B >= 0) {
-      if (MS == 0) {
-         B = B | (operand >> 8);
-      } else if (MS < 0) {
-         B = -1;
+   if (cpu->B >= 0) {
+      if (cpu->MS == 0) {
+         cpu->B = cpu->B | (operand >> 8);
+      } else if (cpu->MS < 0) {
+         cpu->B = -1;
       }
    }
    // Updating NZ is complex, depending on the whether A and/or B are unknown
-   set_NZ_AB(A, B);
+   set_NZ_AB(cpu, cpu->A, cpu->B);
    return -1;
 }
 
-static int op_PHA(operand_t operand, ea_t ea) {
-   pushMS(operand);
-   op_STA(operand, -1);
+static int op_PHA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   pushMS(cpu, operand);
+   op_STA(cpu, operand, -1);
    return -1;
 }
 
-static int op_PHP(operand_t operand, ea_t ea) {
-   push8(operand);
-   check_FLAGS(operand);
-   set_FLAGS(operand);
+static int op_PHP(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   push8(cpu, operand);
+   check_FLAGS(cpu, operand);
+   set_FLAGS(cpu, operand);
    return -1;
 }
 
-static int op_PHX(operand_t operand, ea_t ea) {
-   pushXS(operand);
-   op_STX(operand, -1);
+static int op_PHX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   pushXS(cpu, operand);
+   op_STX(cpu, operand, -1);
    return -1;
 }
 
-static int op_PHY(operand_t operand, ea_t ea) {
-   pushXS(operand);
-   op_STY(operand, -1);
+static int op_PHY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   pushXS(cpu, operand);
+   op_STY(cpu, operand, -1);
    return -1;
 }
 
-static int op_PLA(operand_t operand, ea_t ea) {
-   A = operand & 0xff;
-   if (MS < 0) {
-      B = -1;
-   } else if (MS == 0) {
-      B = (operand >> 8);
+static int op_PLA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->A = operand & 0xff;
+   if (cpu->MS < 0) {
+      cpu->B = -1;
+   } else if (cpu->MS == 0) {
+      cpu->B = (operand >> 8);
    }
-   set_NZ_MS(operand);
-   popMS(operand);
+   set_NZ_MS(cpu, operand);
+   popMS(cpu, operand);
    return -1;
 }
 
-static int op_PLP(operand_t operand, ea_t ea) {
-   set_FLAGS(operand);
-   pop8(operand);
+static int op_PLP(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   set_FLAGS(cpu, operand);
+   pop8(cpu, operand);
    return -1;
 }
 
-static int op_PLX(operand_t operand, ea_t ea) {
-   X = operand;
-   set_NZ_XS(X);
-   popXS(operand);
+static int op_PLX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->X = operand;
+   set_NZ_XS(cpu, cpu->X);
+   popXS(cpu, operand);
    return -1;
 }
 
-static int op_PLY(operand_t operand, ea_t ea) {
-   Y = operand;
-   set_NZ_XS(Y);
-   popXS(operand);
+static int op_PLY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->Y = operand;
+   set_NZ_XS(cpu, cpu->Y);
+   popXS(cpu, operand);
    return -1;
 }
 
-static int op_ROLA(operand_t operand, ea_t ea) {
+static int op_ROLA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Save the old carry
-   int oldC = C;
+   int oldC = cpu->C;
    // Compute the new carry
-   if (MS > 0 && A >= 0) {
+   if (cpu->MS > 0 && cpu->A >= 0) {
       // 8-bit mode
-      C = (A >> 7) & 1;
-   } else if (MS == 0 && B >= 0) {
+      cpu->C = (cpu->A >> 7) & 1;
+   } else if (cpu->MS == 0 && cpu->B >= 0) {
       // 16-bit mode
-      C = (B >> 7) & 1;
+      cpu->C = (cpu->B >> 7) & 1;
    } else {
       // width unknown
-      C = -1;
+      cpu->C = -1;
    }
    // Compute the new B
-   if (MS == 0 && B >= 0) {
-      if (A >= 0) {
-         B = ((B << 1) & 0xfe) | ((A >> 7) & 1);
+   if (cpu->MS == 0 && cpu->B >= 0) {
+      if (cpu->A >= 0) {
+         cpu->B = ((cpu->B << 1) & 0xfe) | ((cpu->A >> 7) & 1);
       } else {
-         B = -1;
+         cpu->B = -1;
       }
-   } else if (MS < 0) {
-      B = -1;
+   } else if (cpu->MS < 0) {
+      cpu->B = -1;
    }
    // Compute the new A
-   if (A >= 0) {
+   if (cpu->A >= 0) {
       if (oldC >= 0) {
-         A = ((A << 1) | oldC) & 0xff;
+         cpu->A = ((cpu->A << 1) | oldC) & 0xff;
       } else {
-         A = -1;
+         cpu->A = -1;
       }
    }
    // Updating NZ is complex, depending on the whether A and/or B are unknown
-   set_NZ_AB(A, B);
+   set_NZ_AB(cpu, cpu->A, cpu->B);
    return -1;
 }
 
-static int op_ROL(operand_t operand, ea_t ea) {
-   int oldC = C;
+static int op_ROL(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   int oldC = cpu->C;
    int tmp;
-   if (MS > 0) {
+   if (cpu->MS > 0) {
       // 8-bit mode
-      C = (operand >> 7) & 1;
+      cpu->C = (operand >> 7) & 1;
       tmp = ((operand << 1) | oldC) & 0xff;
-      set_NZ8(tmp);
-   } else if (MS == 0) {
+      set_NZ8(cpu, tmp);
+   } else if (cpu->MS == 0) {
       // 16-bit mode
-      C = (operand >> 15) & 1;
+      cpu->C = (operand >> 15) & 1;
       tmp = ((operand << 1) | oldC) & 0xffff;
-      set_NZ16(tmp);
+      set_NZ16(cpu, tmp);
    } else {
-      C = -1;
+      cpu->C = -1;
       tmp = -1;
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return tmp;
 }
 
-static int op_RORA(operand_t operand, ea_t ea) {
+static int op_RORA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // Save the old carry
-   int oldC = C;
+   int oldC = cpu->C;
    // Compute the new carry
-   if (A >= 0) {
-      C = A & 1;
+   if (cpu->A >= 0) {
+      cpu->C = cpu->A & 1;
    } else {
-      C = -1;
+      cpu->C = -1;
    }
    // Compute the new A
-   if (MS > 0 && A >= 0) {
-      A = ((A >> 1) | (oldC << 7)) & 0xff;
-   } else if (MS == 0 && A >= 0 && B >= 0) {
-      A = ((A >> 1) | (B << 7)) & 0xff;
+   if (cpu->MS > 0 && cpu->A >= 0) {
+      cpu->A = ((cpu->A >> 1) | (oldC << 7)) & 0xff;
+   } else if (cpu->MS == 0 && cpu->A >= 0 && cpu->B >= 0) {
+      cpu->A = ((cpu->A >> 1) | (cpu->B << 7)) & 0xff;
    } else {
-      A = -1;
+      cpu->A = -1;
    }
    // Compute the new B
-   if (MS == 0 && B >= 0 && oldC >= 0) {
-      B = ((B >> 1) | (oldC << 7)) & 0xff;
-   } else if (MS < 0) {
-      B = -1;
+   if (cpu->MS == 0 && cpu->B >= 0 && oldC >= 0) {
+      cpu->B = ((cpu->B >> 1) | (oldC << 7)) & 0xff;
+   } else if (cpu->MS < 0) {
+      cpu->B = -1;
    }
    // Updating NZ is complex, depending on the whether A and/or B are unknown
-   set_NZ_AB(A, B);
+   set_NZ_AB(cpu, cpu->A, cpu->B);
    return -1;
 }
 
-static int op_ROR(operand_t operand, ea_t ea) {
-   int oldC = C;
+static int op_ROR(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   int oldC = cpu->C;
    int tmp;
-   C = operand & 1;
-   if (MS > 0) {
+   cpu->C = operand & 1;
+   if (cpu->MS > 0) {
       // 8-bit mode
       tmp = ((operand >> 1) | (oldC << 7)) & 0xff;
-      set_NZ8(tmp);
-   } else if (MS == 0) {
+      set_NZ8(cpu, tmp);
+   } else if (cpu->MS == 0) {
       // 16-bit mode
       tmp = ((operand >> 1) | (oldC << 15)) & 0xffff;
-      set_NZ16(tmp);
+      set_NZ16(cpu, tmp);
    } else {
-      C = -1;
+      cpu->C = -1;
       tmp = -1;
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return tmp;
 }
 
-static int op_RTS(operand_t operand, ea_t ea) {
+static int op_RTS(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // RTS: the operand is the data pulled from the stack (PCL, PCH)
-   pop8(operand);
-   pop8(operand >> 8);
+   pop8(cpu, operand);
+   pop8(cpu, operand >> 8);
    // The +1 is handled elsewhere
-   PC = operand & 0xffff;
+   cpu->PC = operand & 0xffff;
    return -1;
 }
 
-static int op_RTI(operand_t operand, ea_t ea) {
+static int op_RTI(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    // RTI: the operand is the data pulled from the stack (P, PCL, PCH, PBR)
-   set_FLAGS(operand);
-   pop8(operand);
-   pop8(operand >> 8);
-   pop8(operand >> 16);
-   if (E == 0) {
-      pop8(operand >> 24);
+   set_FLAGS(cpu, operand);
+   pop8(cpu, operand);
+   pop8(cpu, operand >> 8);
+   pop8(cpu, operand >> 16);
+   if (cpu->E == 0) {
+      pop8(cpu, operand >> 24);
    }
    return -1;
 }
 
-static int op_SBC(operand_t operand, ea_t ea) {
-   int acc = get_accumulator();
-   if (acc >= 0 && C >= 0) {
+static int op_SBC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   int acc = get_accumulator(cpu);
+   if (acc >= 0 && cpu->C >= 0) {
       int tmp = 0;
-      if (D == 1) {
+      if (cpu->D == 1) {
          // Decimal mode SBC - works like a 65C02
          // Working a nibble at a time, correct for both 8 and 18 bits
-         for (int bit = 0; bit < (MS ? 8 : 16); bit += 4) {
+         for (int bit = 0; bit < (cpu->MS ? 8 : 16); bit += 4) {
             int an = (acc >> bit) & 0xF;
             int bn = (operand >> bit) & 0xF;
-            int rn =  an - bn - (1 - C);
-            V = ((rn ^ an) & 8) && ((bn ^ an) & 8);
-            C = 1;
+            int rn =  an - bn - (1 - cpu->C);
+            cpu->V = ((rn ^ an) & 8) && ((bn ^ an) & 8);
+            cpu->C = 1;
             if (rn < 0) {
                rn = (rn + 10) & 0xF;
-               C = 0;
+               cpu->C = 0;
             }
             tmp |= rn << bit;
          }
       } else {
          // Normal mode SBC
-         tmp = acc - operand - (1 - C);
-         if (MS > 0) {
+         tmp = acc - operand - (1 - cpu->C);
+         if (cpu->MS > 0) {
             // 8-bit mode
-            C = 1 - ((tmp >> 8) & 1);
-            V = (((acc ^ operand) & 0x80) != 0) && (((acc ^ tmp) & 0x80) != 0);
+            cpu->C = 1 - ((tmp >> 8) & 1);
+            cpu->V = (((acc ^ operand) & 0x80) != 0) && (((acc ^ tmp) & 0x80) != 0);
          } else {
             // 16-bit mode
-            C = 1 - ((tmp >> 16) & 1);
-            V = (((acc ^ operand) & 0x8000) != 0) && (((acc ^ tmp) & 0x8000) != 0);
+            cpu->C = 1 - ((tmp >> 16) & 1);
+            cpu->V = (((acc ^ operand) & 0x8000) != 0) && (((acc ^ tmp) & 0x8000) != 0);
          }
       }
-      if (MS > 0) {
+      if (cpu->MS > 0) {
          // 8-bit mode
-         A = tmp & 0xff;
+         cpu->A = tmp & 0xff;
       } else {
          // 16-bit mode
-         A = tmp & 0xff;
-         B = (tmp >> 8) & 0xff;
+         cpu->A = tmp & 0xff;
+         cpu->B = (tmp >> 8) & 0xff;
       }
-      set_NZ_AB(A, B);
+      set_NZ_AB(cpu, cpu->A, cpu->B);
    } else {
-      A = -1;
-      B = -1;
-      set_NVZC_unknown();
+      cpu->A = -1;
+      cpu->B = -1;
+      set_NVZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_SEC(operand_t operand, ea_t ea) {
-   C = 1;
+static int op_SEC(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->C = 1;
    return -1;
 }
 
-static int op_SED(operand_t operand, ea_t ea) {
-   D = 1;
+static int op_SED(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->D = 1;
    return -1;
 }
 
-static int op_SEI(operand_t operand, ea_t ea) {
-   I = 1;
+static int op_SEI(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   cpu->I = 1;
    return -1;
 }
 
-static int op_STA(operand_t operand, ea_t ea) {
+static int op_STA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    int oplo = operand & 0xff;
    int ophi = (operand >> 8) & 0xff;
    // Always write A
-   if (A >= 0) {
-      if (oplo != A) {
-         failflag = 1;
+   if (cpu->A >= 0) {
+      if (oplo != cpu->A) {
+         cpu->failflag = 1;
       }
    }
-   A = oplo;
+   cpu->A = oplo;
    // Optionally write B, depending on the MS flag
-   if (MS < 0) {
-      B = -1;
-   } else if (MS == 0) {
-      if (B >= 0) {
-         if (ophi != B) {
-            failflag = 1;
+   if (cpu->MS < 0) {
+      cpu->B = -1;
+   } else if (cpu->MS == 0) {
+      if (cpu->B >= 0) {
+         if (ophi != cpu->B) {
+            cpu->failflag = 1;
          }
       }
-      B = ophi;
+      cpu->B = ophi;
    }
    return operand;
 }
 
-static int op_STX(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      if (operand != X) {
-         failflag = 1;
+static int op_STX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      if (operand != cpu->X) {
+         cpu->failflag = 1;
       }
    }
-   X = operand;
+   cpu->X = operand;
    return operand;
 }
 
-static int op_STY(operand_t operand, ea_t ea) {
-   if (Y >= 0) {
-      if (operand != Y) {
-         failflag = 1;
+static int op_STY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->Y >= 0) {
+      if (operand != cpu->Y) {
+         cpu->failflag = 1;
       }
    }
-   Y = operand;
+   cpu->Y = operand;
    return operand;
 }
 
-static int op_STZ(operand_t operand, ea_t ea) {
+static int op_STZ(cpu_state_t *cpu, operand_t operand, ea_t ea) {
    if (operand != 0) {
-      failflag = 1;
+      cpu->failflag = 1;
    }
    return operand;
 }
 
 
-static int op_TSB(operand_t operand, ea_t ea) {
-   int acc = get_accumulator();
+static int op_TSB(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   int acc = get_accumulator(cpu);
    if (acc >= 0) {
-      Z = ((acc & operand) == 0);
+      cpu->Z = ((acc & operand) == 0);
       return operand | acc;
    } else {
-      Z = -1;
+      cpu->Z = -1;
       return -1;
    }
 }
 
-static int op_TRB(operand_t operand, ea_t ea) {
-   int acc = get_accumulator();
+static int op_TRB(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   int acc = get_accumulator(cpu);
    if (acc >= 0) {
-      Z = ((acc & operand) == 0);
+      cpu->Z = ((acc & operand) == 0);
       return operand &~ acc;
    } else {
-      Z = -1;
+      cpu->Z = -1;
       return -1;
    }
 }
 
 // This is used to implement: TAX, TAY, TSX
-static void transfer_88_16(int srchi, int srclo, int *dst) {
-   if (srclo >= 0 && srchi >=0 && XS == 0) {
+static void transfer_88_16(cpu_state_t *cpu, int srchi, int srclo, int *dst) {
+   if (srclo >= 0 && srchi >=0 && cpu->XS == 0) {
       // 16-bit
       *dst = (srchi << 8) + srclo;
-      set_NZ16(*dst);
-   } else if (srclo >= 0 && XS == 1) {
+      set_NZ16(cpu, *dst);
+   } else if (srclo >= 0 && cpu->XS == 1) {
       // 8-bit
       *dst = srclo;
-      set_NZ8(*dst);
+      set_NZ8(cpu, *dst);
    } else {
       *dst = -1;
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
 }
 
 // This is used to implement: TXA, TYA
-static void transfer_16_88(int src, int *dsthi, int *dstlo) {
-   if (MS == 0) {
+static void transfer_16_88(cpu_state_t *cpu, int src, int *dsthi, int *dstlo) {
+   if (cpu->MS == 0) {
       // 16-bit
       if (src >= 0) {
          *dsthi = (src >> 8) & 0xff;
          *dstlo = src & 0xff;
-         set_NZ16(src);
+         set_NZ16(cpu, src);
       } else {
          *dsthi = -1;
          *dstlo = -1;
-         set_NZ_unknown();
+         set_NZ_unknown(cpu);
       }
-   } else if (MS == 1) {
+   } else if (cpu->MS == 1) {
       // 8-bit
       if (src >= 0) {
          *dstlo = src & 0xff;
-         set_NZ8(src);
+         set_NZ8(cpu, src);
       } else {
          *dstlo = -1;
-         set_NZ_unknown();
+         set_NZ_unknown(cpu);
       }
    } else {
       // MS undefined
@@ -2982,49 +3019,49 @@ static void transfer_16_88(int src, int *dsthi, int *dstlo) {
          *dstlo = -1;
       }
       *dsthi = -1;
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
 }
 
-static int op_TAX(operand_t operand, ea_t ea) {
-   transfer_88_16(B, A, &X);
+static int op_TAX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   transfer_88_16(cpu, cpu->B, cpu->A, &cpu->X);
    return -1;
 }
 
-static int op_TAY(operand_t operand, ea_t ea) {
-   transfer_88_16(B, A, &Y);
+static int op_TAY(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   transfer_88_16(cpu, cpu->B, cpu->A, &cpu->Y);
    return -1;
 }
 
-static int op_TSX(operand_t operand, ea_t ea) {
-   transfer_88_16(SH, SL, &X);
+static int op_TSX(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   transfer_88_16(cpu, cpu->SH, cpu->SL, &cpu->X);
    return -1;
 }
 
-static int op_TXA(operand_t operand, ea_t ea) {
-   transfer_16_88(X, &B, &A);
+static int op_TXA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   transfer_16_88(cpu, cpu->X, &cpu->B, &cpu->A);
    return -1;
 }
 
-static int op_TXS(operand_t operand, ea_t ea) {
-   if (X >= 0) {
-      SH = (X >> 8) & 0xff;
-      SL = (X     ) & 0xff;
+static int op_TXS(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   if (cpu->X >= 0) {
+      cpu->SH = (cpu->X >> 8) & 0xff;
+      cpu->SL = (cpu->X     ) & 0xff;
    } else {
-      SH = -1;
-      SL = -1;
+      cpu->SH = -1;
+      cpu->SL = -1;
    }
    // Force SH to be 1 in emulation mode
-   if (E == 1) {
-      SH = 1;
-   } else if (E < 0 && SH != 1) {
-      SH = -1;
+   if (cpu->E == 1) {
+      cpu->SH = 1;
+   } else if (cpu->E < 0 && cpu->SH != 1) {
+      cpu->SH = -1;
    }
    return -1;
 }
 
-static int op_TYA(operand_t operand, ea_t ea) {
-   transfer_16_88(Y, &B, &A);
+static int op_TYA(cpu_state_t *cpu, operand_t operand, ea_t ea) {
+   transfer_16_88(cpu, cpu->Y, &cpu->B, &cpu->A);
    return -1;
 }
 
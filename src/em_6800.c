@@ -3,6 +3,8 @@
 #include <string.h>
 #include <inttypes.h>
 #include "memory.h"
+#include "disasm.h"
+#include "output.h"
 #include "em_6800.h"
 
 // ====================================================================
@@ -50,17 +52,64 @@ typedef int operand_t;
 
 typedef int ea_t;
 
+typedef struct cpu_state cpu_state_t;
+
 typedef struct {
    const char *mnemonic;
    int undocumented;
    AddrMode mode;
    int cycles;
    OpType optype;
-   int (*emulate)(operand_t, ea_t, sample_t *);
+   int (*emulate)(cpu_state_t *, operand_t, ea_t, sample_t *);
    int len;
-   const char *fmt;
+   disasm_template_t dis;
 } InstrType;
 
+// How em_6800_emulate finds the address of the instruction
+typedef enum {
+   PC_CURRENT,          // the current PC
+   PC_INTERRUPT,        // WAI and SWI, which are passed to the interrupt handler
+   PC_BSR,              // the return address pushed to the stack by BSR
+   PC_JSR_IDX,          // ... by JSR IDX
+   PC_JSR_EXT           // ... by JSR EXT
+} PcKind;
+
+// How the effective address is formed
+typedef enum {
+   EA_NONE,
+   EA_DIR,
+   EA_EXT,
+   EA_IDX,
+   EA_REL
+} EaKind;
+
+// How the operand is found
+typedef enum {
+   OPERAND_BYTE,        // the last bus cycle
+   OPERAND_WORD,        // the last two bus cycles
+   OPERAND_RMW,         // the read of a read-modify-write
+   OPERAND_IMM8,        // the 2nd byte of the instruction
+   OPERAND_IMM16,       // the 2nd and 3rd bytes of the instruction
+   OPERAND_REL          // the 2nd byte of the instruction
+} OperandKind;
+
+// The data accesses to model
+#define ACCESS_READ  1
+#define ACCESS_WRITE 2
+
+// Everything em_6800_emulate needs to know about an opcode, resolved
+// when the context is created, so each instruction takes a few table
+// lookups rather than a chain of tests
+typedef struct {
+   int (*emulate)(cpu_state_t *, operand_t, ea_t, sample_t *);
+   uint8_t len;
+   uint8_t pc;
+   uint8_t ea;
+   uint8_t operand;
+   uint8_t access;
+   uint8_t word;        // the data accessed is 16 bits
+} InstrPlan;
+
 
 // ====================================================================
 // Static variables
@@ -80,8 +129,6 @@ typedef struct {
 
 static const char default_state[] = "A=?? B=?? X=???? SP=???? H=? I=? N=? Z=? V=? C=?";
 
-static InstrType *instr_table;
-
 static AddrModeType addr_mode_table[] = {
    {1,    "%1$s"},                  // IMP
    {1,    "%1$s"},                  // ACC
@@ -96,20 +143,31 @@ static AddrModeType addr_mode_table[] = {
    {2,    "%1$s %2$s"}              // REL
 };
 
-// 6800 registers: -1 means unknown
-static int A = -1;
-static int B = -1;
-static int X = -1;
-static int S = -1;
-static int PC = -1;
-
-// 6800 flags: -1 means unknown
-static int H = -1;
-static int I = -1;
-static int N = -1;
-static int Z = -1;
-static int V = -1;
-static int C = -1;
+// The state of one emulated 6800
+struct cpu_state {
+   InstrType instr_table[INSTR_SET_SIZE];
+   InstrPlan plan[INSTR_SET_SIZE];
+
+   // 6800 registers: -1 means unknown
+   int A;
+   int B;
+   int X;
+   int S;
+   int PC;
+
+   // 6800 flags: -1 means unknown
+   int H;
+   int I;
+   int N;
+   int Z;
+   int V;
+   int C;
+
+   // Set when the emulation disagrees with the bus
+   int failflag;
+
+   memory_t *mem;
+};
 
 static char ILLEGAL[] = "???  ";
 
@@ -131,124 +189,124 @@ static InstrType instr_table_6800[INSTR_SET_SIZE];
 // Helper Methods
 // ====================================================================
 
-static int compare_FLAGS(int operand) {
-   if (H >= 0) {
-      if (H != ((operand >> 5) & 1)) {
+static int compare_FLAGS(cpu_state_t *cpu, int operand) {
+   if (cpu->H >= 0) {
+      if (cpu->H != ((operand >> 5) & 1)) {
          return 1;
       }
    }
-   if (I >= 0) {
-      if (I != ((operand >> 4) & 1)) {
+   if (cpu->I >= 0) {
+      if (cpu->I != ((operand >> 4) & 1)) {
          return 1;
       }
    }
-   if (N >= 0) {
-      if (N != ((operand >> 3) & 1)) {
+   if (cpu->N >= 0) {
+      if (cpu->N != ((operand >> 3) & 1)) {
          return 1;
       }
    }
-   if (Z >= 0) {
-      if (Z != ((operand >> 2) & 1)) {
+   if (cpu->Z >= 0) {
+      if (cpu->Z != ((operand >> 2) & 1)) {
          return 1;
       }
    }
-   if (V >= 0) {
-      if (V != ((operand >> 1) & 1)) {
+   if (cpu->V >= 0) {
+      if (cpu->V != ((operand >> 1) & 1)) {
          return 1;
       }
    }
-   if (C >= 0) {
-      if (C != ((operand >> 0) & 1)) {
+   if (cpu->C >= 0) {
+      if (cpu->C != ((operand >> 0) & 1)) {
          return 1;
       }
    }
    return 0;
 }
 
-static void check_FLAGS(int operand) {
-   failflag |= compare_FLAGS(operand);
+static void check_FLAGS(cpu_state_t *cpu, int operand) {
+   cpu->failflag |= compare_FLAGS(cpu, operand);
 }
 
-static void set_FLAGS(int operand) {
+static void set_FLAGS(cpu_state_t *cpu, int operand) {
    if (operand >= 0) {
-      H = (operand >> 5) & 1;
-      I = (operand >> 4) & 1;
-      N = (operand >> 3) & 1;
-      Z = (operand >> 2) & 1;
-      V = (operand >> 1) & 1;
-      C = (operand >> 0) & 1;
+      cpu->H = (operand >> 5) & 1;
+      cpu->I = (operand >> 4) & 1;
+      cpu->N = (operand >> 3) & 1;
+      cpu->Z = (operand >> 2) & 1;
+      cpu->V = (operand >> 1) & 1;
+      cpu->C = (operand >> 0) & 1;
    } else {
-      H = -1;
-      I = -1;
-      N = -1;
-      Z = -1;
-      V = -1;
-      C = -1;
+      cpu->H = -1;
+      cpu->I = -1;
+      cpu->N = -1;
+      cpu->Z = -1;
+      cpu->V = -1;
+      cpu->C = -1;
    }
 }
 
-static int get_FLAGS() {
-   if (H >= 0 && I >= 0 && N >= 0 && Z >= 0 && V >= 0 && C >= 0) {
-      return 0xC0 | (H << 5) | (I << 4) | (N << 3) | (Z << 2) | (V << 1) | C;
+static int get_FLAGS(cpu_state_t *cpu) {
+   if (cpu->H >= 0 && cpu->I >= 0 && cpu->N >= 0 && cpu->Z >= 0 && cpu->V >= 0 && cpu->C >= 0) {
+      return 0xC0 | (cpu->H << 5) | (cpu->I << 4) | (cpu->N << 3) | (cpu->Z << 2) | (cpu->V << 1) | cpu->C;
    } else {
       return -1;
    }
 }
 
-static void set_NZ_unknown() {
-   N = -1;
-   Z = -1;
+static void set_NZ_unknown(cpu_state_t *cpu) {
+   cpu->N = -1;
+   cpu->Z = -1;
 }
 
-static void set_NZC_unknown() {
-   N = -1;
-   Z = -1;
-   C = -1;
+static void set_NZC_unknown(cpu_state_t *cpu) {
+   cpu->N = -1;
+   cpu->Z = -1;
+   cpu->C = -1;
 }
 
-static void set_NZV_unknown() {
-   N = -1;
-   Z = -1;
-   V = -1;
+static void set_NZV_unknown(cpu_state_t *cpu) {
+   cpu->N = -1;
+   cpu->Z = -1;
+   cpu->V = -1;
 }
 
-static void set_NZCV_unknown() {
-   N = -1;
-   V = -1;
-   Z = -1;
-   C = -1;
+static void set_NZCV_unknown(cpu_state_t *cpu) {
+   cpu->N = -1;
+   cpu->V = -1;
+   cpu->Z = -1;
+   cpu->C = -1;
 }
 
-static void set_NZ(int value) {
-   N = (value >> 7) & 1;
-   Z = value == 0;
+static void set_NZ(cpu_state_t *cpu, int value) {
+   cpu->N = (value >> 7) & 1;
+   cpu->Z = value == 0;
 }
 
-static void set_NZ16(int value) {
-   N = (value >> 15) & 1;
-   Z = value == 0;
+static void set_NZ16(cpu_state_t *cpu, int value) {
+   cpu->N = (value >> 15) & 1;
+   cpu->Z = value == 0;
 }
 
-static void pop8(int value) {
-   if (S >= 0) {
-      S = (S + 1) & 0xffff;
-      memory_read(value & 0xff, S, MEM_STACK);
+static void pop8(cpu_state_t *cpu, int value) {
+   if (cpu->S >= 0) {
+      cpu->S = (cpu->S + 1) & 0xffff;
+      memory_read(cpu->mem, value & 0xff, cpu->S, MEM_STACK);
    }
 }
 
-static void push8(int value) {
-   if (S >= 0) {
-      memory_write(value & 0xff, S, MEM_STACK);
-      S = (S - 1) & 0xffff;
+static void push8(cpu_state_t *cpu, int value) {
+   if (cpu->S >= 0) {
+      memory_write(cpu->mem, value & 0xff, cpu->S, MEM_STACK);
+      cpu->S = (cpu->S - 1) & 0xffff;
    }
 }
 
-static void push16(int value) {
-   push8(value);
-   push8(value >> 8);
+static void push16(cpu_state_t *cpu, int value) {
+   push8(cpu, value);
+   push8(cpu, value >> 8);
 }
 
-static void interrupt(sample_t *sample_q, int num_cycles, instruction_t *instruction, int pc_offset) {
+static void interrupt(cpu_state_t *cpu, sample_t *sample_q, int num_cycles, instruction_t *instruction, int pc_offset) {
    // Parse the bus cycles
    // <opcode> <op1> <write pch> <write pcl> <write p> <read rst> <read rsth>
    int pc     = sample_q[2].data + (sample_q[3].data << 8);
@@ -260,43 +318,112 @@ static void interrupt(sample_t *sample_q, int num_cycles, instruction_t *instruc
    // Update the address of the interruted instruction
    instruction->pc = (pc - pc_offset) & 0xffff;
    // Stack the PB/PC/FLags (for memory modelling)
-   push16(pc);
-   push16(x);
-   push8(a);
-   push8(b);
-   push8(flags);
+   push16(cpu, pc);
+   push16(cpu, x);
+   push8(cpu, a);
+   push8(cpu, b);
+   push8(cpu, flags);
    // Validate the flags
-   check_FLAGS(flags);
+   check_FLAGS(cpu, flags);
    // And make them consistent
-   set_FLAGS(flags);
+   set_FLAGS(cpu, flags);
    // Validate the registers
-   if ((A >= 0 && A != a) || (B >= 0 && B != b) || (X >= 0 && X != x)) {
-      failflag = 1;
+   if ((cpu->A >= 0 && cpu->A != a) || (cpu->B >= 0 && cpu->B != b) || (cpu->X >= 0 && cpu->X != x)) {
+      cpu->failflag = 1;
    }
    // And make them consistent
-   A = a;
-   B = b;
-   X = x;
+   cpu->A = a;
+   cpu->B = b;
+   cpu->X = x;
    // Setup expected state for the ISR
-   I = 1;
-   PC = vector;
-}
+   cpu->I = 1;
+   cpu->PC = vector;
+}
+
+static void build_plan(cpu_state_t *cpu) {
+   for (int opcode = 0; opcode < INSTR_SET_SIZE; opcode++) {
+      InstrType *instr = &cpu->instr_table[opcode];
+      InstrPlan *plan = &cpu->plan[opcode];
+
+      plan->emulate = instr->emulate;
+      plan->len = instr->len;
+
+      if (opcode == 0x3E || opcode == 0x3F) {
+         plan->pc = PC_INTERRUPT;
+      } else if (opcode == 0x8D) {
+         plan->pc = PC_BSR;
+      } else if (opcode == 0xAD) {
+         plan->pc = PC_JSR_IDX;
+      } else if (opcode == 0xBD) {
+         plan->pc = PC_JSR_EXT;
+      } else {
+         plan->pc = PC_CURRENT;
+      }
+
+      switch (instr->mode) {
+      case DIR8:
+      case DIR16: plan->ea = EA_DIR;  break;
+      case EXT8:
+      case EXT16: plan->ea = EA_EXT;  break;
+      case IDX8:
+      case IDX16: plan->ea = EA_IDX;  break;
+      case REL:   plan->ea = EA_REL;  break;
+      default:    plan->ea = EA_NONE; break;
+      }
+
+      plan->word = instr->mode == DIR16 || instr->mode == EXT16 || instr->mode == IDX16;
+
+      if (instr->optype == RMWOP) {
+         plan->operand = OPERAND_RMW;
+      } else if (instr->mode == IMM8) {
+         plan->operand = OPERAND_IMM8;
+      } else if (instr->mode == IMM16) {
+         plan->operand = OPERAND_IMM16;
+      } else if (instr->mode == REL) {
+         plan->operand = OPERAND_REL;
+      } else if (plan->word) {
+         plan->operand = OPERAND_WORD;
+      } else {
+         plan->operand = OPERAND_BYTE;
+      }
 
+      plan->access = 0;
+      if (instr->optype == READOP || instr->optype == RMWOP) {
+         plan->access |= ACCESS_READ;
+      }
+      if (instr->optype == WRITEOP || instr->optype == RMWOP) {
+         plan->access |= ACCESS_WRITE;
+      }
+   }
+}
 
 // ====================================================================
 // Public Methods
 // ====================================================================
 
-static void em_6800_init(arguments_t *args) {
-
-   instr_table = instr_table_6800;
+static void *em_6800_create(arguments_t *args, memory_t *mem) {
+   cpu_state_t *cpu = calloc(1, sizeof(cpu_state_t));
+   cpu->mem = mem;
+   cpu->A = -1;
+   cpu->B = -1;
+   cpu->X = -1;
+   cpu->S = -1;
+   cpu->PC = -1;
+   cpu->H = -1;
+   cpu->I = -1;
+   cpu->N = -1;
+   cpu->Z = -1;
+   cpu->V = -1;
+   cpu->C = -1;
+
+   memcpy(cpu->instr_table, instr_table_6800, sizeof(cpu->instr_table));
 
    // Initialize the SP
    if (args->sp_reg >= 0) {
-      S = args->sp_reg & 0xffff;
+      cpu->S = args->sp_reg & 0xffff;
    }
 
-   InstrType *instr = instr_table;
+   InstrType *instr = cpu->instr_table;
    for (int i = 0; i < INSTR_SET_SIZE; i++) {
       // Remove the undocumented instructions, if not supported
       if (instr->undocumented && !args->undocumented) {
@@ -304,16 +431,24 @@ static void em_6800_init(arguments_t *args) {
          instr->mode     = INH;
          instr->cycles   = 1;
       }
-      // Copy the length and format from the address mode, for efficiency
+      // Copy the length from the address mode, and compile the disassembly template, for efficiency
       instr->len = addr_mode_table[instr->mode].len;
-      instr->fmt = addr_mode_table[instr->mode].fmt;
+      disasm_compile(&instr->dis, addr_mode_table[instr->mode].fmt, instr->mnemonic, instr->mode == REL ? TARGET_REL8 : TARGET_NONE);
       instr++;
    }
 
+   build_plan(cpu);
+
+   return cpu;
+}
+
+static void em_6800_destroy(void *cpu) {
+   free(cpu);
 }
 
 
-static int em_6800_match_interrupt(sample_t *sample_q, int num_samples) {
+static int em_6800_match_interrupt(void *context, sample_t *sample_q, int num_samples) {
+   cpu_state_t *cpu = context;
    // Check we have enough valid samples
    if (num_samples < 12) {
       return 0;
@@ -335,11 +470,11 @@ static int em_6800_match_interrupt(sample_t *sample_q, int num_samples) {
       // If not, then we use a heuristic, based on what we expect to see on the data
       // bus in cycles 2, 3 and 8, i.e. PCL, PCH, PSW
       // (we could include X,A,B checks as well).
-      if (sample_q[2].data == (PC & 0xff) && sample_q[3].data == ((PC >> 8) & 0xff) ) {
+      if (sample_q[2].data == (cpu->PC & 0xff) && sample_q[3].data == ((cpu->PC >> 8) & 0xff) ) {
          // Now test unused flag is 1, B is 0
          if ((sample_q[8].data & 0xC0) == 0xC0) {
             // Finally test all other known flags match
-            if (!compare_FLAGS(sample_q[8].data & 0x3F)) {
+            if (!compare_FLAGS(cpu, sample_q[8].data & 0x3F)) {
                // Matched PSW = --HIVZVC
                return 1;
             }
@@ -349,53 +484,57 @@ static int em_6800_match_interrupt(sample_t *sample_q, int num_samples) {
    return 0;
 }
 
-static int em_6800_count_cycles(sample_t *sample_q, int intr_seen) {
+static int em_6800_count_cycles(void *context, sample_t *sample_q, int intr_seen) {
+   cpu_state_t *cpu = context;
    if (intr_seen) {
       return 12;
    }
    int opcode = sample_q[0].data;
-   return instr_table[opcode].cycles;
+   return cpu->instr_table[opcode].cycles;
 }
 
-static void em_6800_reset(sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+static void em_6800_reset(void *context, sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
    instruction->pc = -1;
-   A = -1;
-   B = -1;
-   X = -1;
-   S = -1;
-   H = -1;
-   I = 1;
-   N = -1;
-   Z = -1;
-   V = -1;
-   C = -1;
-   PC = (sample_q[num_cycles - 2].data << 8) + sample_q[num_cycles - 1].data;
+   cpu->A = -1;
+   cpu->B = -1;
+   cpu->X = -1;
+   cpu->S = -1;
+   cpu->H = -1;
+   cpu->I = 1;
+   cpu->N = -1;
+   cpu->Z = -1;
+   cpu->V = -1;
+   cpu->C = -1;
+   cpu->PC = (sample_q[num_cycles - 2].data << 8) + sample_q[num_cycles - 1].data;
 }
 
-static void em_6800_interrupt(sample_t *sample_q, int num_cycles, instruction_t *instruction) {
-   interrupt(sample_q, num_cycles, instruction, 0);
+static void em_6800_interrupt(void *context, sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
+   interrupt(cpu, sample_q, num_cycles, instruction, 0);
 }
 
-static void em_6800_emulate(sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+static void em_6800_emulate(void *context, sample_t *sample_q, int num_cycles, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
 
    // Unpack the instruction bytes
    int opcode = sample_q[0].data;
 
-   // lookup the entry for the instruction
-   InstrType *instr = &instr_table[opcode];
-   int opcount = instr->len - 1;
+   // lookup the plan for the instruction
+   const InstrPlan *plan = &cpu->plan[opcode];
+   int opcount = plan->len - 1;
    int op1 = (opcount < 1) ? 0 : sample_q[1].data;
    int op2 = (opcount < 2) ? 0 : sample_q[2].data;
 
    // Memory Modelling: Instruction fetches
-   if (PC >= 0) {
-      int pc = PC;
-      memory_read(opcode, pc++, MEM_FETCH);
+   if (cpu->PC >= 0) {
+      int pc = cpu->PC;
+      memory_read(cpu->mem, opcode, pc++, MEM_FETCH);
       if (opcount >= 1) {
-         memory_read(op1, pc++, MEM_INSTR);
+         memory_read(cpu->mem, op1, pc++, MEM_INSTR);
       }
       if (opcount >= 2) {
-         memory_read(op2, pc++, MEM_INSTR);
+         memory_read(cpu->mem, op2, pc++, MEM_INSTR);
       }
    }
 
@@ -406,88 +545,94 @@ static void em_6800_emulate(sample_t *sample_q, int num_cycles, instruction_t *i
    instruction->opcount = opcount;
 
    // Determine the current PC value
-   if (opcode == 0x3E || opcode == 0x3F) {
+   switch (plan->pc) {
+   case PC_INTERRUPT:
       // WAI and SWI
-      interrupt(sample_q, num_cycles, instruction, 1); // This handles everything
+      interrupt(cpu, sample_q, num_cycles, instruction, 1); // This handles everything
       return;
-   } else if (opcode == 0x8D) {
+   case PC_BSR:
       // BSR REL
       instruction->pc = (((sample_q[bsr_rel_pch].data << 8) + sample_q[bsr_rel_pcl].data) - 2) & 0xffff;
-   } else if (opcode == 0xAD) {
+      break;
+   case PC_JSR_IDX:
       // JSR IDX
       instruction->pc = (((sample_q[jsr_idx_pch].data << 8) + sample_q[jsr_idx_pcl].data) - 2) & 0xffff;
+      break;
+   case PC_JSR_EXT:
       // JSR EXT
-   } else if (opcode == 0xBD) {
       instruction->pc = (((sample_q[jsr_ext_pch].data << 8) + sample_q[jsr_ext_pcl].data) - 3) & 0xffff;
-   } else {
+      break;
+   default:
       // current PC value
-      instruction->pc = PC;
+      instruction->pc = cpu->PC;
+      break;
    }
 
    // Update PC to start of next instruction
-   if (PC >= 0) {
-      PC = (PC + instr->len) & 0xffff;
+   if (cpu->PC >= 0) {
+      cpu->PC = (cpu->PC + plan->len) & 0xffff;
    }
 
-   if (instr->emulate) {
+   if (plan->emulate) {
 
       // For instructions that read or write memory, we need to work out the effective address
       // Note: not needed for stack operations, as S is used directly
       int ea = -1;
-      switch (instr->mode) {
-      case DIR8:
-      case DIR16:
+      switch (plan->ea) {
+      case EA_DIR:
          ea = op1;
          break;
-      case EXT8:
-      case EXT16:
+      case EA_EXT:
          ea = (op1 << 8) | op2;
          break;
-      case IDX8:
-      case IDX16:
-         if (X >= 0) {
-            ea = (op1 + X) & 0xFFFF;
+      case EA_IDX:
+         if (cpu->X >= 0) {
+            ea = (op1 + cpu->X) & 0xFFFF;
          }
          break;
-      case REL:
-         if (PC >= 0) {
-            ea = (PC + (int8_t)op1) & 0xFFFF;
+      case EA_REL:
+         if (cpu->PC >= 0) {
+            ea = (cpu->PC + (int8_t)op1) & 0xFFFF;
          }
+         break;
       default:
          // covers INH, ACC, IMM8, IMM16
          break;
       }
 
-      int word = instr->mode == DIR16 || instr->mode == EXT16 || instr->mode == IDX16;
+      int word = plan->word;
 
       int operand;
-      if (instr->optype == RMWOP) {
+      switch (plan->operand) {
+      case OPERAND_RMW:
          // e.g. <opcode> <op1> <op2> <read old> <write old> <write new>
          //      <opcode> <op1>       <read old> <write old> <write new>
          // Want to pick off the read
          operand = sample_q[num_cycles - 3].data;
-      } else if (instr->mode == IMM8) {
-         // Immediate addressing mode: the operand is the 2nd byte of the instruction
+         break;
+      case OPERAND_IMM8:
+      case OPERAND_REL:
+         // Immediate and relative addressing modes: the operand is the 2nd byte of the instruction
          operand = op1;
-      } else if (instr->mode == IMM16) {
-         // Immediate addressing mode: the operand is the 2nd byte of the instruction
+         break;
+      case OPERAND_IMM16:
+         // Immediate addressing mode: the operand is the 2nd and 3rd bytes of the instruction
          operand = (op1 << 8) + op2;
-      } else if (instr->mode == REL) {
-         // Relative addressing mode: the operand is the 2nd byte of the instruction
-         operand = op1;
-      } else if (word) {
+         break;
+      case OPERAND_WORD:
          // 16 bit data (LDS/LDX/STS/STX/CPX), default top last two bus cycles as operand
          operand = (sample_q[num_cycles - 2].data << 8) + sample_q[num_cycles - 1].data;
-         word = 1;
-      } else {
+         break;
+      default:
          // 8 bit data, default to using the last bus cycle as the operand
          operand = sample_q[num_cycles - 1].data;
+         break;
       }
 
       // Operand 2 is the value written back in a store or read-modify-write
       // See RMW comment above for bus cycles
       operand_t operand2 = operand;
-      if (instr->optype == RMWOP || instr->optype == WRITEOP) {
+      if (plan->access & ACCESS_WRITE) {
          if (word) {
             operand2 = (sample_q[num_cycles - 2].data << 8) + sample_q[num_cycles - 1].data;
          } else {
@@ -496,148 +641,132 @@ static void em_6800_emulate(sample_t *sample_q, int num_cycles, instruction_t *i
       }
 
       // Model memory reads
-      if (ea >= 0 && (instr->optype == READOP || instr->optype == RMWOP)) {
+      if (ea >= 0 && (plan->access & ACCESS_READ)) {
          if (word) {
-            memory_read((operand >> 8) & 0xff,                ea, MEM_DATA);
-            memory_read( operand       & 0xff, (ea + 1) & 0xffff, MEM_DATA);
+            memory_read(cpu->mem, (operand >> 8) & 0xff,                ea, MEM_DATA);
+            memory_read(cpu->mem,  operand       & 0xff, (ea + 1) & 0xffff, MEM_DATA);
          } else {
-            memory_read(operand, ea, MEM_DATA);
+            memory_read(cpu->mem, operand, ea, MEM_DATA);
          }
       }
 
       // Execute the instruction specific function
       // (This returns -1 if the result is unknown or invalid
-      int result = instr->emulate(operand, ea, sample_q);
+      int result = plan->emulate(cpu, operand, ea, sample_q);
 
-      if (instr->optype == WRITEOP || instr->optype == RMWOP) {
+      if (plan->access & ACCESS_WRITE) {
 
          // Check result of instruction against bye
          if (result >= 0 && result != operand2) {
-            failflag |= 1;
+            cpu->failflag |= 1;
          }
 
          // Model memory writes based on result seen on bus
          if (ea >= 0) {
             if (word) {
-               memory_write((operand2 >> 8) & 0xff,                ea, MEM_DATA);
-               memory_write( operand2       & 0xff, (ea + 1) & 0xffff, MEM_DATA);
+               memory_write(cpu->mem, (operand2 >> 8) & 0xff,                ea, MEM_DATA);
+               memory_write(cpu->mem,  operand2       & 0xff, (ea + 1) & 0xffff, MEM_DATA);
             } else {
-               memory_write(operand2,  ea, MEM_DATA);
+               memory_write(cpu->mem, operand2,  ea, MEM_DATA);
             }
          }
       }
    }
 }
 
-static int em_6800_disassemble(char *buffer, instruction_t *instruction) {
-
-   int numchars;
-   int offset;
-   char target[16];
-
-   // Unpack the instruction bytes
-   int opcode = instruction->opcode;
-   int op1    = instruction->op1;
-   int op2    = instruction->op2;
-   int pc     = instruction->pc;
-
-   // lookup the entry for the instruction
-   InstrType *instr = &instr_table[opcode];
-
-   const char *mnemonic = instr->mnemonic;
-   const char *fmt = instr->fmt;
-   switch (instr->mode) {
-   case INH:
-   case ACC:
-      numchars = sprintf(buffer, fmt, mnemonic);
-      break;
-   case IMM8:
-   case DIR8:
-   case DIR16:
-   case IDX8:
-   case IDX16:
-      numchars = sprintf(buffer, fmt, mnemonic, op1);
-      break;
-   case IMM16:
-   case EXT8:
-   case EXT16:
-      numchars = sprintf(buffer, fmt, mnemonic, op1, op2);
-      break;
-   case REL:
-      // Calculate branch target using op1 for normal branches
-      offset = (int8_t) op1;
-      if (pc < 0) {
-         if (offset < 0) {
-            sprintf(target, "pc-%d", -offset);
-         } else {
-            sprintf(target,"pc+%d", offset);
-         }
-      } else {
-         sprintf(target, "%04X", (pc + 2 + offset) & 0xffff);
-      }
-      numchars = sprintf(buffer, fmt, mnemonic, target);
-      break;
-   default:
-      numchars = 0;
-   }
-   return numchars;
+static int em_6800_disassemble(void *context, char *buffer, instruction_t *instruction) {
+   cpu_state_t *cpu = context;
+   return disasm_write(buffer, &cpu->instr_table[instruction->opcode].dis, instruction);
 }
 
-static int em_6800_get_PC() {
-   return PC;
+static int em_6800_get_PC(void *context) {
+   cpu_state_t *cpu = context;
+   return cpu->PC;
 }
 
-static int em_6800_get_PB() {
+static int em_6800_get_PB(void *context) {
    return 0;
 }
 
-static int em_6800_read_memory(int address) {
-   return memory_read_raw(address);
+static int em_6800_read_memory(void *context, int address) {
+   cpu_state_t *cpu = context;
+   return memory_read_raw(cpu->mem, address);
 }
 
-static char *em_6800_get_state(char *buffer) {
+static char *em_6800_get_state(void *context, char *buffer) {
+   cpu_state_t *cpu = context;
    strcpy(buffer, default_state);
-   if (A >= 0) {
-      write_hex2(buffer + OFFSET_A, A);
+   if (cpu->A >= 0) {
+      write_hex2(buffer + OFFSET_A, cpu->A);
    }
-   if (B >= 0) {
-      write_hex2(buffer + OFFSET_B, B);
+   if (cpu->B >= 0) {
+      write_hex2(buffer + OFFSET_B, cpu->B);
    }
-   if (X >= 0) {
-      write_hex4(buffer + OFFSET_X, X);
+   if (cpu->X >= 0) {
+      write_hex4(buffer + OFFSET_X, cpu->X);
    }
-   if (S >= 0) {
-      write_hex4(buffer + OFFSET_S, S);
+   if (cpu->S >= 0) {
+      write_hex4(buffer + OFFSET_S, cpu->S);
    }
-   if (H >= 0) {
-      buffer[OFFSET_H] = '0' + H;
+   if (cpu->H >= 0) {
+      buffer[OFFSET_H] = '0' + cpu->H;
    }
-   if (I >= 0) {
-      buffer[OFFSET_I] = '0' + I;
+   if (cpu->I >= 0) {
+      buffer[OFFSET_I] = '0' + cpu->I;
    }
-   if (N >= 0) {
-      buffer[OFFSET_N] = '0' + N;
+   if (cpu->N >= 0) {
+      buffer[OFFSET_N] = '0' + cpu->N;
    }
-   if (Z >= 0) {
-      buffer[OFFSET_Z] = '0' + Z;
+   if (cpu->Z >= 0) {
+      buffer[OFFSET_Z] = '0' + cpu->Z;
    }
-   if (V >= 0) {
-      buffer[OFFSET_V] = '0' + V;
+   if (cpu->V >= 0) {
+      buffer[OFFSET_V] = '0' + cpu->V;
    }
-   if (C >= 0) {
-      buffer[OFFSET_C] = '0' + C;
+   if (cpu->C >= 0) {
+      buffer[OFFSET_C] = '0' + cpu->C;
    }
    return buffer + OFFSET_END;
 }
 
-static int em_6800_get_and_clear_fail() {
-   int ret = failflag;
-   failflag = 0;
+static int em_6800_get_and_clear_fail(void *context) {
+   cpu_state_t *cpu = context;
+   int ret = cpu->failflag | memory_get_and_clear_fail(cpu->mem);
+   cpu->failflag = 0;
    return ret;
 }
 
+// The state saved in a checkpoint, i.e. everything carried from one
+// instruction to the next
+static int get_state_fields(cpu_state_t *cpu, int *fields[EM_MAX_STATE]) {
+   int *list[] = {
+      &cpu->A, &cpu->B, &cpu->X, &cpu->S, &cpu->PC,
+      &cpu->H, &cpu->I, &cpu->N, &cpu->Z, &cpu->V, &cpu->C
+   };
+   memcpy(fields, list, sizeof(list));
+   return sizeof(list) / sizeof(list[0]);
+}
+
+static int em_6800_save_state(void *context, int *state) {
+   int *fields[EM_MAX_STATE];
+   int n = get_state_fields(context, fields);
+   for (int i = 0; i < n; i++) {
+      state[i] = *fields[i];
+   }
+   return n;
+}
+
+static void em_6800_restore_state(void *context, const int *state) {
+   int *fields[EM_MAX_STATE];
+   int n = get_state_fields(context, fields);
+   for (int i = 0; i < n; i++) {
+      *fields[i] = state[i];
+   }
+}
+
 cpu_emulator_t em_6800 = {
-   .init = em_6800_init,
+   .create = em_6800_create,
+   .destroy = em_6800_destroy,
    .match_interrupt = em_6800_match_interrupt,
    .count_cycles = em_6800_count_cycles,
    .reset = em_6800_reset,
@@ -648,234 +777,236 @@ cpu_emulator_t em_6800 = {
    .get_PB = em_6800_get_PB,
    .read_memory = em_6800_read_memory,
    .get_state = em_6800_get_state,
-   .get_and_clear_fail = em_6800_get_and_clear_fail
+   .get_and_clear_fail = em_6800_get_and_clear_fail,
+   .save_state = em_6800_save_state,
+   .restore_state = em_6800_restore_state
 };
 
 // ====================================================================
 // Instruction helpers
 // ====================================================================
 
-static int add_helper(int val, int operand, int carry) {
+static int add_helper(cpu_state_t *cpu, int val, int operand, int carry) {
    if (val >= 0 && operand >= 0 && carry >= 0) {
       int tmp = val + operand + carry;
-      C = (tmp >> 8) & 1;
-      V = (((val ^ operand) & 0x80) == 0) && (((val ^ tmp) & 0x80) != 0);
+      cpu->C = (tmp >> 8) & 1;
+      cpu->V = (((val ^ operand) & 0x80) == 0) && (((val ^ tmp) & 0x80) != 0);
       // Taken from the 6809 decoder
-      H =  ((val ^ operand ^ tmp) >> 4) & 1;
+      cpu->H =  ((val ^ operand ^ tmp) >> 4) & 1;
       val = tmp & 0xff;
-      set_NZ(val);
+      set_NZ(cpu, val);
    } else {
       val = -1;
-      set_NZCV_unknown();
+      set_NZCV_unknown(cpu);
    }
    return val;
 }
 
-static int and_helper(int val, operand_t operand) {
+static int and_helper(cpu_state_t *cpu, int val, operand_t operand) {
    if (val >= 0 || operand == 0) {
       val = val & operand;
-      set_NZ(val);
+      set_NZ(cpu, val);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
-   V = 0;
+   cpu->V = 0;
    return val;
 }
 
-static int asl_helper(int val) {
+static int asl_helper(cpu_state_t *cpu, int val) {
    if (val >= 0) {
-      C = (val >> 7) & 1;
+      cpu->C = (val >> 7) & 1;
       val = (val << 1) & 0xff;
-      set_NZ(val);
-      V = C ^ N;
+      set_NZ(cpu, val);
+      cpu->V = cpu->C ^ cpu->N;
    } else {
-      set_NZCV_unknown();
+      set_NZCV_unknown(cpu);
    }
    return val;
 }
 
-static int asr_helper(int val) {
+static int asr_helper(cpu_state_t *cpu, int val) {
    if (val >= 0) {
-      C = val & 1;
+      cpu->C = val & 1;
       val = (val & 0x80) | (val >> 1);
-      set_NZ(val);
-      V = C ^ N;
+      set_NZ(cpu, val);
+      cpu->V = cpu->C ^ cpu->N;
    } else {
-      set_NZCV_unknown();
+      set_NZCV_unknown(cpu);
    }
    return val;
 }
 
-static int clr_helper() {
-   C = 0;
-   V = 0;
-   N = 0;
-   Z = 1;
+static int clr_helper(cpu_state_t *cpu) {
+   cpu->C = 0;
+   cpu->V = 0;
+   cpu->N = 0;
+   cpu->Z = 1;
    return 0;
 }
 
-static int com_helper(int val) {
-   C = 1;
-   V = 0;
+static int com_helper(cpu_state_t *cpu, int val) {
+   cpu->C = 1;
+   cpu->V = 0;
    if (val >= 0) {
       val = 0xFF - val;
-      set_NZ(val);
+      set_NZ(cpu, val);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
    return val;
 }
 
-static int dec_helper(int val) {
+static int dec_helper(cpu_state_t *cpu, int val) {
    if (val >= 0) {
       val = (val - 1) & 0xff;
-      set_NZ(val);
-      V = (val == 0x7F);
+      set_NZ(cpu, val);
+      cpu->V = (val == 0x7F);
    } else {
-      set_NZV_unknown();
+      set_NZV_unknown(cpu);
    }
    return val;
 }
 
-static int eor_helper(int val, operand_t operand) {
+static int eor_helper(cpu_state_t *cpu, int val, operand_t operand) {
    if (val >= 0) {
       val = val ^ operand;
-      set_NZ(val);
+      set_NZ(cpu, val);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
-   V = 0;
+   cpu->V = 0;
    return val;
 }
 
-static int inc_helper(int val) {
+static int inc_helper(cpu_state_t *cpu, int val) {
    if (val >= 0) {
       val = (val + 1) & 0xff;
-      set_NZ(val);
-      V = (val == 0x80);
+      set_NZ(cpu, val);
+      cpu->V = (val == 0x80);
    } else {
-      set_NZV_unknown();
+      set_NZV_unknown(cpu);
    }
    return val;
 }
 
-static int lda_helper(int val) {
-   set_NZ(val);
-   V = 0;
+static int lda_helper(cpu_state_t *cpu, int val) {
+   set_NZ(cpu, val);
+   cpu->V = 0;
    return val;
 }
 
-static int lsr_helper(int val) {
+static int lsr_helper(cpu_state_t *cpu, int val) {
    if (val >= 0) {
-      C = val & 1;
+      cpu->C = val & 1;
       val = val >> 1;
-      set_NZ(val);
-      V = C ^ N;
+      set_NZ(cpu, val);
+      cpu->V = cpu->C ^ cpu->N;
    } else {
-      set_NZCV_unknown();
+      set_NZCV_unknown(cpu);
    }
    return val;
 }
 
-static int neg_helper(int val) {
+static int neg_helper(cpu_state_t *cpu, int val) {
    if (val >= 0) {
       val = (0x00 - val) & 0xff;
-      set_NZ(val);
-      V = (val == 0x80);
-      C = (val == 0x00);
+      set_NZ(cpu, val);
+      cpu->V = (val == 0x80);
+      cpu->C = (val == 0x00);
       val = 0xFF - val;
-      set_NZ(val);
+      set_NZ(cpu, val);
    } else {
-      set_NZCV_unknown();
+      set_NZCV_unknown(cpu);
    }
    return val;
 }
 
-static int ora_helper(int val, operand_t operand) {
+static int ora_helper(cpu_state_t *cpu, int val, operand_t operand) {
    if (val >= 0) {
       val = val | operand;
-      set_NZ(val);
+      set_NZ(cpu, val);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
-   V = 0;
+   cpu->V = 0;
    return val;
 }
 
-static int psh_helper(int val, operand_t operand) {
-   push8(operand);
+static int psh_helper(cpu_state_t *cpu, int val, operand_t operand) {
+   push8(cpu, operand);
    if (val >= 0) {
       if (operand != val) {
-         failflag = 1;
+         cpu->failflag = 1;
       }
    }
    return operand;
 }
 
-static int pul_helper(operand_t operand) {
-   pop8(operand);
+static int pul_helper(cpu_state_t *cpu, operand_t operand) {
+   pop8(cpu, operand);
    return operand;
 }
 
-static int rol_helper(int val) {
+static int rol_helper(cpu_state_t *cpu, int val) {
    if (val >= 0) {
-      int oldC = C;
-      C = (val >> 7) & 1;
+      int oldC = cpu->C;
+      cpu->C = (val >> 7) & 1;
       val = ((val << 1) | oldC) & 0xff;
-      set_NZ(val);
-      V = C ^ N;
+      set_NZ(cpu, val);
+      cpu->V = cpu->C ^ cpu->N;
    } else {
-      set_NZCV_unknown();
+      set_NZCV_unknown(cpu);
    }
    return val;
 }
 
-static int ror_helper(int val) {
+static int ror_helper(cpu_state_t *cpu, int val) {
    if (val >= 0) {
-      int oldC = C;
-      C = val & 1;
+      int oldC = cpu->C;
+      cpu->C = val & 1;
       val = (val >> 1) | (oldC << 7);
-      set_NZ(val);
-      V = C ^ N;
+      set_NZ(cpu, val);
+      cpu->V = cpu->C ^ cpu->N;
    } else {
-      set_NZCV_unknown();
+      set_NZCV_unknown(cpu);
    }
    return val;
 }
 
-static int sta_helper(int val, operand_t operand) {
+static int sta_helper(cpu_state_t *cpu, int val, operand_t operand) {
    if (val >= 0) {
       if (operand != val) {
-         failflag = 1;
+         cpu->failflag = 1;
       }
    }
-   set_NZ(val);
-   V = 0;
+   set_NZ(cpu, val);
+   cpu->V = 0;
    return val;
 }
 
-static int sub_helper(int val, int operand, int carry) {
+static int sub_helper(cpu_state_t *cpu, int val, int operand, int carry) {
    if (val >= 0 && operand >= 0 && carry >= 0) {
       int tmp = val - operand - carry;
-      C = (tmp >> 8) & 1;
-      V = (((val ^ operand) & 0x80) != 0) && (((val ^ tmp) & 0x80) != 0);
+      cpu->C = (tmp >> 8) & 1;
+      cpu->V = (((val ^ operand) & 0x80) != 0) && (((val ^ tmp) & 0x80) != 0);
       val = tmp & 0xff;
-      set_NZ(val);
+      set_NZ(cpu, val);
    } else {
       val = -1;
-      set_NZCV_unknown();
+      set_NZCV_unknown(cpu);
    }
    return val;
 }
 
-static int tst_helper(int val) {
+static int tst_helper(cpu_state_t *cpu, int val) {
    if (val >= 0) {
-      set_NZ(val);
+      set_NZ(cpu, val);
    } else {
-      set_NZ_unknown();
+      set_NZ_unknown(cpu);
    }
-   V = 0;
-   C = 0;
+   cpu->V = 0;
+   cpu->C = 0;
    return val;
 }
 
@@ -883,123 +1014,123 @@ static int tst_helper(int val) {
 // Individual Instructions
 // ====================================================================
 
-static int op_ABA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = add_helper(A, B, 0);
+static int op_ABA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = add_helper(cpu, cpu->A, cpu->B, 0);
    return -1;
 }
 
-static int op_ADCA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = add_helper(A, operand, C);
+static int op_ADCA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = add_helper(cpu, cpu->A, operand, cpu->C);
    return -1;
 }
-static int op_ADCB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = add_helper(B, operand, C);
+static int op_ADCB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = add_helper(cpu, cpu->B, operand, cpu->C);
    return -1;
 }
 
-static int op_ADDA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = add_helper(A, operand, 0);
+static int op_ADDA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = add_helper(cpu, cpu->A, operand, 0);
    return -1;
 }
 
-static int op_ADDB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = add_helper(A, operand, 0);
+static int op_ADDB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = add_helper(cpu, cpu->A, operand, 0);
    return -1;
 }
 
-static int op_ANDA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = and_helper(A, operand);
+static int op_ANDA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = and_helper(cpu, cpu->A, operand);
    return -1;
 }
 
-static int op_ANDB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = and_helper(B, operand);
+static int op_ANDB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = and_helper(cpu, cpu->B, operand);
    return -1;
 }
 
-static int op_ASL(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return asl_helper(operand);
+static int op_ASL(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return asl_helper(cpu, operand);
 }
 
-static int op_ASLA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = asl_helper(A);
+static int op_ASLA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = asl_helper(cpu, cpu->A);
    return -1;
 }
 
-static int op_ASLB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = asl_helper(B);
+static int op_ASLB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = asl_helper(cpu, cpu->B);
    return -1;
 }
 
-static int op_ASR(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return asr_helper(operand);
+static int op_ASR(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return asr_helper(cpu, operand);
 }
 
-static int op_ASRA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = asr_helper(A);
+static int op_ASRA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = asr_helper(cpu, cpu->A);
    return -1;
 }
 
-static int op_ASRB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = asr_helper(B);
+static int op_ASRB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = asr_helper(cpu, cpu->B);
    return -1;
 }
 
-static int op_BCC(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BCC(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if !C
-   if (C == 0) {
-      PC = ea;
-   } else if (C < 0) {
-      PC = -1;
+   if (cpu->C == 0) {
+      cpu->PC = ea;
+   } else if (cpu->C < 0) {
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BCS(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (C == 1) {
-      PC = ea;
-   } else if (C < 0) {
-      PC = -1;
+static int op_BCS(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->C == 1) {
+      cpu->PC = ea;
+   } else if (cpu->C < 0) {
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BEQ(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BEQ(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Brach if Z=1
-   if (Z == 1) {
-      PC = ea;
-   } else if (Z < 0) {
-      PC = -1;
+   if (cpu->Z == 1) {
+      cpu->PC = ea;
+   } else if (cpu->Z < 0) {
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BGE(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BGE(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if N = V
-   if (N >= 0 && V >= 0) {
-      if (N == V) {
-         PC = ea;
+   if (cpu->N >= 0 && cpu->V >= 0) {
+      if (cpu->N == cpu->V) {
+         cpu->PC = ea;
       }
    } else {
-      PC = -1;
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BGT(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BGT(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if !Z and N = V
    // TODO: narrow the scope of this test
-   if (Z >= 0 && N >= 0 && V >= 0) {
-      if (!Z && (N == V)) {
-         PC = ea;
+   if (cpu->Z >= 0 && cpu->N >= 0 && cpu->V >= 0) {
+      if (!cpu->Z && (cpu->N == cpu->V)) {
+         cpu->PC = ea;
       }
    } else {
-      PC = -1;
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BHI(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BHI(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if !C and !Z
    //  C  Z    taken
    // -1 -1 => -1
@@ -1011,38 +1142,38 @@ static int op_BHI(operand_t operand, ea_t ea, sample_t *sample_q) {
    //  1 -1 =>  0
    //  1  0 =>  0
    //  1  1 =>  0
-   if (C == 0 && Z == 0) {
-      PC = ea;
-   } else if ((C < 0 && Z != 1) || (Z < 0 && C != 1)) {
-      PC = -1;
+   if (cpu->C == 0 && cpu->Z == 0) {
+      cpu->PC = ea;
+   } else if ((cpu->C < 0 && cpu->Z != 1) || (cpu->Z < 0 && cpu->C != 1)) {
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BITA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   and_helper(A, operand);
+static int op_BITA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   and_helper(cpu, cpu->A, operand);
    return -1;
 }
 
-static int op_BITB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   and_helper(B, operand);
+static int op_BITB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   and_helper(cpu, cpu->B, operand);
    return -1;
 }
 
-static int op_BLE(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BLE(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if Z OR N != V
    // TODO: narrow the scope of this test
-   if (Z >= 0 && N >= 0 && V >= 0) {
-      if (Z || (N != V)) {
-         PC = ea;
+   if (cpu->Z >= 0 && cpu->N >= 0 && cpu->V >= 0) {
+      if (cpu->Z || (cpu->N != cpu->V)) {
+         cpu->PC = ea;
       }
    } else {
-      PC = -1;
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BLS(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BLS(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if C or Z
    //  C  Z    taken
    // -1 -1 => -1
@@ -1054,379 +1185,379 @@ static int op_BLS(operand_t operand, ea_t ea, sample_t *sample_q) {
    //  1 -1 =>  1
    //  1  0 =>  1
    //  1  1 =>  1
-   if (C == 1 || Z == 1) {
-      PC = ea;
-   } else if (C != 0 && Z != 0) {
-      PC = -1;
+   if (cpu->C == 1 || cpu->Z == 1) {
+      cpu->PC = ea;
+   } else if (cpu->C != 0 && cpu->Z != 0) {
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BLT(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BLT(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if N != V
-   if (N >= 0 && V >= 0) {
-      if (N != V) {
-         PC = ea;
+   if (cpu->N >= 0 && cpu->V >= 0) {
+      if (cpu->N != cpu->V) {
+         cpu->PC = ea;
       }
    } else {
-      PC = -1;
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BMI(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BMI(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if N=1
-   if (N == 1) {
-      PC = ea;
-   } else if (N < 0) {
-      PC = -1;
+   if (cpu->N == 1) {
+      cpu->PC = ea;
+   } else if (cpu->N < 0) {
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BNE(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BNE(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if Z=0
-   if (Z == 0) {
-      PC = ea;
-   } else if (Z < 0) {
-      PC = -1;
+   if (cpu->Z == 0) {
+      cpu->PC = ea;
+   } else if (cpu->Z < 0) {
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BPL(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BPL(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if N=0
-   if (N == 0) {
-      PC = ea;
-   } else if (N < 0) {
-      PC = -1;
+   if (cpu->N == 0) {
+      cpu->PC = ea;
+   } else if (cpu->N < 0) {
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BRA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   PC = ea;
+static int op_BRA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->PC = ea;
    return -1;
 }
 
-static int op_BSR(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BSR(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    int idx = bsr_rel_pcl;
-   push8(sample_q[idx].data);
-   push8(sample_q[idx + 1].data);
-   PC = ea;
+   push8(cpu, sample_q[idx].data);
+   push8(cpu, sample_q[idx + 1].data);
+   cpu->PC = ea;
    return -1;
 }
 
-static int op_BVC(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BVC(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if V=0
-   if (V == 0) {
-      PC = ea;
-   } else if (V < 0) {
-      PC = -1;
+   if (cpu->V == 0) {
+      cpu->PC = ea;
+   } else if (cpu->V < 0) {
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_BVS(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_BVS(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // Branch if V=1
-   if (V == 1) {
-      PC = ea;
-   } else if (V < 0) {
-      PC = -1;
+   if (cpu->V == 1) {
+      cpu->PC = ea;
+   } else if (cpu->V < 0) {
+      cpu->PC = -1;
    }
    return -1;
 }
 
-static int op_CBA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   sub_helper(A, B, 0);
+static int op_CBA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   sub_helper(cpu, cpu->A, cpu->B, 0);
    return -1;
 }
 
-static int op_CLC(operand_t operand, ea_t ea, sample_t *sample_q) {
-   C = 0;
+static int op_CLC(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->C = 0;
    return -1;
 }
 
-static int op_CLI(operand_t operand, ea_t ea, sample_t *sample_q) {
-   I = 0;
+static int op_CLI(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->I = 0;
    return -1;
 }
 
-static int op_CLR(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return clr_helper();
+static int op_CLR(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return clr_helper(cpu);
 }
 
-static int op_CLRA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return A = clr_helper();
+static int op_CLRA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return cpu->A = clr_helper(cpu);
 }
 
-static int op_CLRB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return B = clr_helper();
+static int op_CLRB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return cpu->B = clr_helper(cpu);
 }
 
-static int op_CLV(operand_t operand, ea_t ea, sample_t *sample_q) {
-   V = 0;
+static int op_CLV(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->V = 0;
    return -1;
 }
 
-static int op_CMPA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   sub_helper(A, operand, 0);
+static int op_CMPA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   sub_helper(cpu, cpu->A, operand, 0);
    return -1;
 }
 
-static int op_CMPB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   sub_helper(B, operand, 0);
+static int op_CMPB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   sub_helper(cpu, cpu->B, operand, 0);
    return -1;
 }
 
-static int op_COM(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return com_helper(operand);
+static int op_COM(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return com_helper(cpu, operand);
 }
 
-static int op_COMA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = com_helper(A);
+static int op_COMA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = com_helper(cpu, cpu->A);
    return -1;
 }
 
-static int op_COMB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = com_helper(B);
+static int op_COMB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = com_helper(cpu, cpu->B);
    return -1;
 }
 
-static int op_CPX(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (X >= 0) {
-      int xl = X & 0xff;
-      int xh = (X >> 8) & 0xff;
+static int op_CPX(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->X >= 0) {
+      int xl = cpu->X & 0xff;
+      int xh = (cpu->X >> 8) & 0xff;
       int opl = operand & 0xff;
       int oph = (operand >> 8) & 0xff;
       int resl = xl - opl;
       int resh = xh - oph;
-      Z = !resl && !resh;
-      N = (resh & 128) > 0;
-      V = (((xh ^ oph) & 0x80) != 0) && (((xh ^ resh) & 0x80) != 0);
+      cpu->Z = !resl && !resh;
+      cpu->N = (resh & 128) > 0;
+      cpu->V = (((xh ^ oph) & 0x80) != 0) && (((xh ^ resh) & 0x80) != 0);
    } else {
-      set_NZC_unknown();
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
 // Taken from the 6809 decoder
-static int op_DAA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (A >= 0 && H >= 0 && C >= 0) {
+static int op_DAA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->A >= 0 && cpu->H >= 0 && cpu->C >= 0) {
       int correction = 0x00;
-      if (H == 1 || (A & 0x0f) > 0x09) {
+      if (cpu->H == 1 || (cpu->A & 0x0f) > 0x09) {
          correction |= 0x06;
       }
-      if (C == 1 || (A & 0xf0) > 0x90 || ((A & 0xf0) > 0x80 && (A & 0x0f) > 0x09)) {
+      if (cpu->C == 1 || (cpu->A & 0xf0) > 0x90 || ((cpu->A & 0xf0) > 0x80 && (cpu->A & 0x0f) > 0x09)) {
          correction |= 0x60;
       }
-      int tmp = A + correction;
+      int tmp = cpu->A + correction;
       // TODO: On the 6809 C is apparently only ever set by DAA, never cleared
-      C = (tmp >> 8) & 1;
+      cpu->C = (tmp >> 8) & 1;
       // V is is calculated as follows on both the 6809 and the 6309
-      V = ((tmp >> 7) & 1) ^ C;
+      cpu->V = ((tmp >> 7) & 1) ^ cpu->C;
       tmp &= 0xff;
-      set_NZ(tmp);
-      A = tmp;
+      set_NZ(cpu, tmp);
+      cpu->A = tmp;
    } else {
-      A = -1;
-      set_NZC_unknown();
+      cpu->A = -1;
+      set_NZC_unknown(cpu);
    }
    return -1;
 }
 
-static int op_DEC(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return dec_helper(operand);
+static int op_DEC(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return dec_helper(cpu, operand);
 }
 
-static int op_DECA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = dec_helper(A);
+static int op_DECA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = dec_helper(cpu, cpu->A);
    return -1;
 }
 
-static int op_DECB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = dec_helper(B);
+static int op_DECB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = dec_helper(cpu, cpu->B);
    return -1;
 }
 
-static int op_DES(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (S >= 0) {
-      S = (S - 1) & 0xFFFF;
+static int op_DES(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->S >= 0) {
+      cpu->S = (cpu->S - 1) & 0xFFFF;
    }
    return -1;
 }
 
-static int op_DEX(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (X >= 0) {
-      X = (X - 1) & 0xFFFF;
-      Z = (X == 0);
+static int op_DEX(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->X >= 0) {
+      cpu->X = (cpu->X - 1) & 0xFFFF;
+      cpu->Z = (cpu->X == 0);
    }
    return -1;
 }
 
-static int op_EORA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = eor_helper(A, operand);
+static int op_EORA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = eor_helper(cpu, cpu->A, operand);
    return -1;
 }
 
-static int op_EORB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = eor_helper(B, operand);
+static int op_EORB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = eor_helper(cpu, cpu->B, operand);
    return -1;
 }
 
-static int op_INC(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return inc_helper(operand);
+static int op_INC(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return inc_helper(cpu, operand);
 }
 
-static int op_INCA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = inc_helper(A);
+static int op_INCA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = inc_helper(cpu, cpu->A);
    return -1;
 }
 
-static int op_INCB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = inc_helper(B);
+static int op_INCB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = inc_helper(cpu, cpu->B);
    return -1;
 }
 
-static int op_INS(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (S >= 0) {
-      S = (S + 1) & 0xFFFF;
+static int op_INS(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->S >= 0) {
+      cpu->S = (cpu->S + 1) & 0xFFFF;
    }
    return -1;
 }
 
-static int op_INX(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (X >= 0) {
-      X = (X + 1) & 0xFFFF;
-      Z = (X == 0);
+static int op_INX(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->X >= 0) {
+      cpu->X = (cpu->X + 1) & 0xFFFF;
+      cpu->Z = (cpu->X == 0);
    }
    return -1;
 }
 
-static int op_JMP(operand_t operand, ea_t ea, sample_t *sample_q) {
-   PC = ea;
+static int op_JMP(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->PC = ea;
    return -1;
 }
 
-static int op_JSR(operand_t operand, ea_t ea, sample_t *sample_q) {
-   PC = ea;
+static int op_JSR(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->PC = ea;
    int idx = sample_q[0].data == 0xAD ? jsr_idx_pcl : jsr_ext_pcl;
-   push8(sample_q[idx].data);
-   push8(sample_q[idx + 1].data);
+   push8(cpu, sample_q[idx].data);
+   push8(cpu, sample_q[idx + 1].data);
    return -1;
 }
 
-static int op_LDAA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = lda_helper(operand);
+static int op_LDAA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = lda_helper(cpu, operand);
    return -1;
 }
 
-static int op_LDAB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = lda_helper(operand);
+static int op_LDAB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = lda_helper(cpu, operand);
    return -1;
 }
 
-static int op_LDS(operand_t operand, ea_t ea, sample_t *sample_q) {
-   S = operand;
-   set_NZ16(S);
-   V = 0;
+static int op_LDS(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->S = operand;
+   set_NZ16(cpu, cpu->S);
+   cpu->V = 0;
    return -1;
 }
 
-static int op_LDX(operand_t operand, ea_t ea, sample_t *sample_q) {
-   X = operand;
-   set_NZ16(X);
-   V = 0;
+static int op_LDX(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->X = operand;
+   set_NZ16(cpu, cpu->X);
+   cpu->V = 0;
    return -1;
 }
 
-static int op_LSR(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return lsr_helper(operand);
+static int op_LSR(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return lsr_helper(cpu, operand);
 }
 
-static int op_LSRA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = lsr_helper(A);
+static int op_LSRA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = lsr_helper(cpu, cpu->A);
    return -1;
 }
 
-static int op_LSRB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = lsr_helper(B);
+static int op_LSRB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = lsr_helper(cpu, cpu->B);
    return -1;
 }
 
-static int op_NEG(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return neg_helper(operand);
+static int op_NEG(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return neg_helper(cpu, operand);
 }
 
-static int op_NEGA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = neg_helper(A);
+static int op_NEGA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = neg_helper(cpu, cpu->A);
    return -1;
 }
 
-static int op_NEGB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = neg_helper(B);
+static int op_NEGB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = neg_helper(cpu, cpu->B);
    return -1;
 }
 
-static int op_ORAA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = ora_helper(A, operand);
+static int op_ORAA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = ora_helper(cpu, cpu->A, operand);
    return -1;
 }
 
-static int op_ORAB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = ora_helper(B, operand);
+static int op_ORAB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = ora_helper(cpu, cpu->B, operand);
    return -1;
 }
 
-static int op_PSHA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = psh_helper(A, operand);
+static int op_PSHA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = psh_helper(cpu, cpu->A, operand);
    return -1;
 }
 
-static int op_PSHB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = psh_helper(B, operand);
+static int op_PSHB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = psh_helper(cpu, cpu->B, operand);
    return -1;
 }
 
-static int op_PULA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = pul_helper(operand);
+static int op_PULA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = pul_helper(cpu, operand);
    return -1;
 }
 
-static int op_PULB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = pul_helper(operand);
+static int op_PULB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = pul_helper(cpu, operand);
    return -1;
 }
 
-static int op_ROL(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return rol_helper(operand);
+static int op_ROL(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return rol_helper(cpu, operand);
 }
 
-static int op_ROLA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = rol_helper(A);
+static int op_ROLA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = rol_helper(cpu, cpu->A);
    return -1;
 }
 
-static int op_ROLB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = rol_helper(B);
+static int op_ROLB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = rol_helper(cpu, cpu->B);
    return -1;
 }
 
-static int op_ROR(operand_t operand, ea_t ea, sample_t *sample_q) {
-   return ror_helper(operand);
+static int op_ROR(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   return ror_helper(cpu, operand);
 }
 
-static int op_RORA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = ror_helper(A);
+static int op_RORA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = ror_helper(cpu, cpu->A);
    return -1;
 }
 
-static int op_RORB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = ror_helper(B);
+static int op_RORB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = ror_helper(cpu, cpu->B);
    return -1;
 }
 
-static int op_RTI(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_RTI(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // 0 = opcode
    // 1 = dead
    // 2 = dead
@@ -1438,171 +1569,171 @@ static int op_RTI(operand_t operand, ea_t ea, sample_t *sample_q) {
    // 8 = PCH
    // 9 = PCL
    for (int i = 3; i <= 9; i++) {
-      pop8(sample_q[i].data);
+      pop8(cpu, sample_q[i].data);
    }
-   set_FLAGS(sample_q[3].data);
-   B = sample_q[4].data;
-   A = sample_q[5].data;
-   X = (sample_q[6].data << 8) + sample_q[7].data;
-   PC = (sample_q[8].data << 8) + sample_q[9].data;
+   set_FLAGS(cpu, sample_q[3].data);
+   cpu->B = sample_q[4].data;
+   cpu->A = sample_q[5].data;
+   cpu->X = (sample_q[6].data << 8) + sample_q[7].data;
+   cpu->PC = (sample_q[8].data << 8) + sample_q[9].data;
    return -1;
 }
 
-static int op_RTS(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_RTS(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // 0 = opcode
    // 1 = dead
    // 2 = dead
    // 3 = PCH
    // 4 = PCL
    for (int i = 3; i <= 4; i++) {
-      pop8(sample_q[i].data);
+      pop8(cpu, sample_q[i].data);
    }
-   PC = (sample_q[3].data << 8) + sample_q[4].data;
+   cpu->PC = (sample_q[3].data << 8) + sample_q[4].data;
    return -1;
 }
 
-static int op_SBA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = sub_helper(A, B, 0);
+static int op_SBA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = sub_helper(cpu, cpu->A, cpu->B, 0);
    return -1;
 }
 
-static int op_SBCA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = sub_helper(A, operand, C);
+static int op_SBCA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = sub_helper(cpu, cpu->A, operand, cpu->C);
    return -1;
 }
 
-static int op_SBCB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = sub_helper(B, operand, C);
+static int op_SBCB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = sub_helper(cpu, cpu->B, operand, cpu->C);
    return -1;
 }
 
-static int op_SEC(operand_t operand, ea_t ea, sample_t *sample_q) {
-   C = 1;
+static int op_SEC(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->C = 1;
    return -1;
 }
 
-static int op_SEI(operand_t operand, ea_t ea, sample_t *sample_q) {
-   I = 1;
+static int op_SEI(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->I = 1;
    return -1;
 }
 
-static int op_SEV(operand_t operand, ea_t ea, sample_t *sample_q) {
-   V = 1;
+static int op_SEV(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->V = 1;
    return -1;
 }
 
-static int op_STAA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = sta_helper(A, operand);
+static int op_STAA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = sta_helper(cpu, cpu->A, operand);
    return operand;
 }
 
-static int op_STAB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = sta_helper(B, operand);
+static int op_STAB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = sta_helper(cpu, cpu->B, operand);
    return operand;
 }
 
-static int op_STS(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (S >= 0) {
-      if (operand != S) {
-         failflag = 1;
+static int op_STS(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->S >= 0) {
+      if (operand != cpu->S) {
+         cpu->failflag = 1;
       }
    }
-   S = operand;
-   set_NZ16(S);
-   V = 0;
+   cpu->S = operand;
+   set_NZ16(cpu, cpu->S);
+   cpu->V = 0;
    return operand;
 }
 
-static int op_STX(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (X >= 0) {
-      if (operand != X) {
-         failflag = 1;
+static int op_STX(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->X >= 0) {
+      if (operand != cpu->X) {
+         cpu->failflag = 1;
       }
    }
-   X = operand;
-   set_NZ16(X);
-   V = 0;
+   cpu->X = operand;
+   set_NZ16(cpu, cpu->X);
+   cpu->V = 0;
    return operand;
 }
 
-static int op_SUBA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = sub_helper(A, operand, 0);
+static int op_SUBA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = sub_helper(cpu, cpu->A, operand, 0);
    return -1;
 }
 
-static int op_SUBB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   B = sub_helper(B, operand, 0);
+static int op_SUBB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->B = sub_helper(cpu, cpu->B, operand, 0);
    return -1;
 }
 
-static int op_TAB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (A >= 0) {
-      B = A;
-      set_NZ(B);
+static int op_TAB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->A >= 0) {
+      cpu->B = cpu->A;
+      set_NZ(cpu, cpu->B);
    } else {
-      B = -1;
-      set_NZ_unknown();
+      cpu->B = -1;
+      set_NZ_unknown(cpu);
    }
-   V = 0;
+   cpu->V = 0;
    return -1;
 }
 
-static int op_TAP(operand_t operand, ea_t ea, sample_t *sample_q) {
-   set_FLAGS(A);
+static int op_TAP(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   set_FLAGS(cpu, cpu->A);
    return -1;
 }
 
-static int op_TBA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (B >= 0) {
-      A = B;
-      set_NZ(A);
+static int op_TBA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->B >= 0) {
+      cpu->A = cpu->B;
+      set_NZ(cpu, cpu->A);
    } else {
-      A = -1;
-      set_NZ_unknown();
+      cpu->A = -1;
+      set_NZ_unknown(cpu);
    }
-   V = 0;
+   cpu->V = 0;
    return -1;
 }
 
-static int op_TPA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   A = get_FLAGS();
+static int op_TPA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   cpu->A = get_FLAGS(cpu);
    return -1;
 }
 
-static int op_TST(operand_t operand, ea_t ea, sample_t *sample_q) {
-   tst_helper(operand);
+static int op_TST(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   tst_helper(cpu, operand);
    return -1;
 }
 
-static int op_TSTA(operand_t operand, ea_t ea, sample_t *sample_q) {
-   tst_helper(A);
+static int op_TSTA(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   tst_helper(cpu, cpu->A);
    return -1;
 }
 
-static int op_TSTB(operand_t operand, ea_t ea, sample_t *sample_q) {
-   tst_helper(B);
+static int op_TSTB(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   tst_helper(cpu, cpu->B);
    return -1;
 }
 
-static int op_TSX(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (S >= 0) {
-      X = (S + 1) & 0xffff;
+static int op_TSX(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->S >= 0) {
+      cpu->X = (cpu->S + 1) & 0xffff;
    } else {
-      X = -1;
+      cpu->X = -1;
    }
    return -1;
 }
 
-static int op_TXS(operand_t operand, ea_t ea, sample_t *sample_q) {
-   if (X >= 0) {
-      S = (X - 1) & 0xffff;
+static int op_TXS(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
+   if (cpu->X >= 0) {
+      cpu->S = (cpu->X - 1) & 0xffff;
    } else {
-      S = -1;
+      cpu->S = -1;
    }
    return -1;
 }
 
-static int op_WAI(operand_t operand, ea_t ea, sample_t *sample_q) {
+static int op_WAI(cpu_state_t *cpu, operand_t operand, ea_t ea, sample_t *sample_q) {
    // TODO
    return -1;
 }
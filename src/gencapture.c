@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <argp.h>
+
+// ====================================================================
+// Synthetic capture generator
+// ====================================================================
+
+// Generates deterministic capture files for benchmarking the decoder.
+//
+// A small reference program (a loop that stores and reloads an
+// incrementing index register) is run for each CPU, and every bus cycle
+// is written out exactly as the decoder expects to see it from a logic
+// analyzer, using the default decode6502 pin assignments.
+//
+// The capture starts with RST asserted, followed by the CPU's reset
+// sequence, so it can be decoded with or without the rst/sync pins.
+//
+// The program is at 0400, which is also the reset vector:
+//
+// 6502/65C816:                 6800:
+//   0400 LDX #00                 0400 LDX #0000
+//   0402 TXA                     0403 INX
+//   0403 STA 80                  0404 STX 80
+//   0405 LDA 80                  0406 LDA A 81
+//   0407 INX                     0408 STA A 82
+//   0408 JMP 0402                040A JMP 0403
+
+const char *argp_program_version = "gencapture 0.1";
+
+static char doc[] = "\n\
+Generates synthetic logic analyzer capture files for benchmarking decode6502.\n\
+\n\
+The capture is written to FILENAME, or stdout if FILENAME is omitted. The\n\
+number of bus cycles, instructions and samples written is reported on stderr.\n\
+\n\
+Modes:\n\
+ - byte: 8-bit samples of the data bus only (decode with --byte)\n\
+ - sync: 16-bit samples, one per bus cycle (decode with --phi2=)\n\
+ - async: 16-bit samples, oversampled with phi2 on bit 15\n\
+\n\
+For the 6800, neither sync nor BA are in the capture (decode with --sync= --rdy=).\n\
+\n\
+In byte mode the reset can be found with --vecrst=A20400 (6502/65C816)\n\
+or --vecrst=CE0004 (6800).\n";
+
+static char args_doc[] = "[FILENAME]";
+
+enum {
+   KEY_CPU = 'c',
+   KEY_MODE = 'm',
+   KEY_CYCLES = 'n',
+   KEY_SPC = 's'
+};
+
+static struct argp_option options[] = {
+   { "cpu",               KEY_CPU,    "CPU",     0, "Sets CPU type (6502, 65c816 or 6800)"},
+   { "mode",              KEY_MODE,   "MODE",    0, "Sets sampling mode (byte, sync or async)"},
+   { "cycles",            KEY_CYCLES, "CYCLES",  0, "Number of bus cycles to generate (default 10000000)"},
+   { "samples-per-cycle", KEY_SPC,    "SAMPLES", 0, "Samples per bus cycle in async mode (default 4)"},
+   { 0 }
+};
+
+typedef enum {
+   GEN_6502,
+   GEN_65816,
+   GEN_6800
+} gen_cpu_t;
+
+typedef enum {
+   MODE_BYTE,
+   MODE_SYNC,
+   MODE_ASYNC
+} gen_mode_t;
+
+typedef struct {
+   gen_cpu_t cpu;
+   gen_mode_t mode;
+   int64_t cycles;
+   int samples_per_cycle;
+   char *filename;
+} gen_arguments_t;
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+   gen_arguments_t *arguments = state->input;
+   switch (key) {
+   case KEY_CPU:
+      if (!strcmp(arg, "6502")) {
+         arguments->cpu = GEN_6502;
+      } else if (!strcmp(arg, "65c816") || !strcmp(arg, "65C816") || !strcmp(arg, "65816")) {
+         arguments->cpu = GEN_65816;
+      } else if (!strcmp(arg, "6800")) {
+         arguments->cpu = GEN_6800;
+      } else {
+         argp_error(state, "unsupported cpu type");
+      }
+      break;
+   case KEY_MODE:
+      if (!strcmp(arg, "byte")) {
+         arguments->mode = MODE_BYTE;
+      } else if (!strcmp(arg, "sync")) {
+         arguments->mode = MODE_SYNC;
+      } else if (!strcmp(arg, "async")) {
+         arguments->mode = MODE_ASYNC;
+      } else {
+         argp_error(state, "unsupported sampling mode");
+      }
+      break;
+   case KEY_CYCLES:
+      arguments->cycles = strtoll(arg, NULL, 10);
+      break;
+   case KEY_SPC:
+      arguments->samples_per_cycle = atoi(arg);
+      if (arguments->samples_per_cycle < 2) {
+         argp_error(state, "there must be at least two samples per cycle");
+      }
+      break;
+   case ARGP_KEY_ARG:
+      if (state->arg_num > 0) {
+         argp_usage(state);
+      }
+      arguments->filename = arg;
+      break;
+   default:
+      return ARGP_ERR_UNKNOWN;
+   }
+   return 0;
+}
+
+static struct argp argp = {options, parse_opt, args_doc, doc, 0, 0, 0};
+
+static gen_arguments_t arguments;
+
+// ====================================================================
+// Bus cycle output
+// ====================================================================
+
+// The default decode6502 pin assignments
+#define PIN_RNW   8
+#define PIN_SYNC  9   // vpa on the 65C816
+#define PIN_RDY  10   // ba on the 6800, so inverted
+#define PIN_VDA  11
+#define PIN_E    12
+#define PIN_RST  14
+#define PIN_PHI2 15
+
+#define BUFFER_SIZE (1 << 20)
+
+// The bus cycle types, in terms of the 65C816 vpa/vda signals
+typedef enum {
+   OPCODE,    // vpa=1 vda=1 (sync on the 6502)
+   PROGRAM,   // vpa=1 vda=0
+   DATA,      // vpa=0 vda=1
+   INTERNAL   // vpa=0 vda=0
+} cycle_type_t;
+
+static FILE *out;
+static uint8_t buffer[BUFFER_SIZE];
+static int buffer_num = 0;
+
+static int rst = 0;
+static int64_t num_cycles = 0;
+static int64_t num_instructions = 0;
+static int64_t num_samples = 0;
+
+static void put_sample(uint16_t sample) {
+   if (buffer_num > BUFFER_SIZE - 2) {
+      fwrite(buffer, 1, buffer_num, out);
+      buffer_num = 0;
+   }
+   if (arguments.mode == MODE_BYTE) {
+      buffer[buffer_num++] = sample & 0xff;
+   } else {
+      buffer[buffer_num++] = sample & 0xff;
+      buffer[buffer_num++] = sample >> 8;
+   }
+   num_samples++;
+}
+
+static void bus_cycle(int data, int rnw, cycle_type_t type) {
+   uint16_t sample = (data & 0xff) | (rnw << PIN_RNW) | (rst << PIN_RST);
+   switch (arguments.cpu) {
+   case GEN_6502:
+      sample |= (type == OPCODE) << PIN_SYNC;
+      sample |= 1 << PIN_RDY;
+      break;
+   case GEN_65816:
+      sample |= (type == OPCODE || type == PROGRAM) << PIN_SYNC;
+      sample |= (type == OPCODE || type == DATA) << PIN_VDA;
+      sample |= (1 << PIN_RDY) | (1 << PIN_E);
+      break;
+   case GEN_6800:
+      // No sync, and BA is low
+      break;
+   }
+   if (arguments.mode == MODE_ASYNC) {
+      // Phi2 low for the first half of the cycle, and high for the second
+      // half; the data is valid throughout
+      int half = arguments.samples_per_cycle / 2;
+      for (int i = 0; i < half; i++) {
+         put_sample(sample);
+      }
+      for (int i = half; i < arguments.samples_per_cycle; i++) {
+         put_sample(sample | (1 << PIN_PHI2));
+      }
+   } else {
+      put_sample(sample);
+   }
+   num_cycles++;
+}
+
+static void flush_cycles() {
+   if (arguments.mode == MODE_ASYNC) {
+      // A final falling edge of phi2 to complete the last cycle
+      put_sample(1 << PIN_RST);
+   }
+   fwrite(buffer, 1, buffer_num, out);
+   buffer_num = 0;
+}
+
+// ====================================================================
+// Reference programs
+// ====================================================================
+
+#define RESET_CYCLES 8
+
+static void reset_6502() {
+   for (int i = 0; i < RESET_CYCLES; i++) {
+      bus_cycle(0xff, 1, INTERNAL);
+   }
+   rst = 1;
+   // Two cycles before the reset sequence, which starts with an opcode
+   // fetch, three dummy stack reads, and the reset vector reads
+   bus_cycle(0xff, 1, INTERNAL);
+   bus_cycle(0xff, 1, INTERNAL);
+   bus_cycle(0x00, 1, OPCODE);
+   bus_cycle(0x00, 1, INTERNAL);
+   bus_cycle(0xff, 1, DATA);
+   bus_cycle(0xff, 1, DATA);
+   bus_cycle(0xff, 1, DATA);
+   bus_cycle(0x00, 1, DATA);
+   bus_cycle(0x04, 1, DATA);
+}
+
+static void run_6502() {
+   int x = 0;
+   // In emulation mode, the 65C816 bus cycles match the 6502, except
+   // that the dummy reads are internal cycles
+   cycle_type_t dummy = (arguments.cpu == GEN_65816) ? INTERNAL : DATA;
+   reset_6502();
+   // LDX #00
+   bus_cycle(0xA2, 1, OPCODE);
+   bus_cycle(0x00, 1, PROGRAM);
+   num_instructions++;
+   while (num_cycles < arguments.cycles) {
+      // TXA
+      bus_cycle(0x8A, 1, OPCODE);
+      bus_cycle(0x85, 1, dummy);
+      // STA 80
+      bus_cycle(0x85, 1, OPCODE);
+      bus_cycle(0x80, 1, PROGRAM);
+      bus_cycle(x,    0, DATA);
+      // LDA 80
+      bus_cycle(0xA5, 1, OPCODE);
+      bus_cycle(0x80, 1, PROGRAM);
+      bus_cycle(x,    1, DATA);
+      // INX
+      bus_cycle(0xE8, 1, OPCODE);
+      bus_cycle(0x4C, 1, dummy);
+      x = (x + 1) & 0xff;
+      // JMP 0402
+      bus_cycle(0x4C, 1, OPCODE);
+      bus_cycle(0x02, 1, PROGRAM);
+      bus_cycle(0x04, 1, PROGRAM);
+      num_instructions += 5;
+   }
+}
+
+static void run_6800() {
+   int x = 0;
+   for (int i = 0; i < RESET_CYCLES; i++) {
+      bus_cycle(0xff, 1, INTERNAL);
+   }
+   rst = 1;
+   // One cycle before the reset vector reads (high byte first)
+   bus_cycle(0xff, 1, INTERNAL);
+   bus_cycle(0x04, 1, DATA);
+   bus_cycle(0x00, 1, DATA);
+   // LDX #0000
+   bus_cycle(0xCE, 1, OPCODE);
+   bus_cycle(0x00, 1, PROGRAM);
+   bus_cycle(0x00, 1, PROGRAM);
+   num_instructions++;
+   while (num_cycles < arguments.cycles) {
+      // INX
+      bus_cycle(0x08, 1, OPCODE);
+      bus_cycle(0xff, 1, INTERNAL);
+      bus_cycle(0xff, 1, INTERNAL);
+      bus_cycle(0xff, 1, INTERNAL);
+      x = (x + 1) & 0xffff;
+      // STX 80
+      bus_cycle(0xDF,   1, OPCODE);
+      bus_cycle(0x80,   1, PROGRAM);
+      bus_cycle(0xff,   1, INTERNAL);
+      bus_cycle(x >> 8, 0, DATA);
+      bus_cycle(x,      0, DATA);
+      // LDA A 81
+      bus_cycle(0x96, 1, OPCODE);
+      bus_cycle(0x81, 1, PROGRAM);
+      bus_cycle(x,    1, DATA);
+      // STA A 82
+      bus_cycle(0x97, 1, OPCODE);
+      bus_cycle(0x82, 1, PROGRAM);
+      bus_cycle(0xff, 1, INTERNAL);
+      bus_cycle(x,    0, DATA);
+      // JMP 0403
+      bus_cycle(0x7E, 1, OPCODE);
+      bus_cycle(0x04, 1, PROGRAM);
+      bus_cycle(0x03, 1, PROGRAM);
+      num_instructions += 5;
+   }
+}
+
+int main(int argc, char *argv[]) {
+   arguments.cpu               = GEN_6502;
+   arguments.mode              = MODE_SYNC;
+   arguments.cycles            = 10000000;
+   arguments.samples_per_cycle = 4;
+   arguments.filename          = NULL;
+
+   argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+   if (arguments.filename) {
+      out = fopen(arguments.filename, "wb");
+      if (!out) {
+         perror("failed to create capture file");
+         return 1;
+      }
+   } else {
+      out = stdout;
+   }
+
+   if (arguments.cpu == GEN_6800) {
+      run_6800();
+   } else {
+      run_6502();
+   }
+   flush_cycles();
+
+   if (out != stdout) {
+      fclose(out);
+   }
+
+   fprintf(stderr, "%"PRId64" cycles, %"PRId64" instructions, %"PRId64" samples\n", num_cycles, num_instructions, num_samples);
+   return 0;
+}
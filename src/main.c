@@ -3,19 +3,41 @@
 #include <inttypes.h>
 #include <argp.h>
 #include <string.h>
+#include <signal.h>
 #include <math.h>
 
 #include "defs.h"
+#include "capture.h"
+#include "checkpoint.h"
+#include "cycles.h"
+#include "edges.h"
+#include "parallel.h"
+#include "output.h"
+#include "trace.h"
 #include "em_6502.h"
 #include "em_65816.h"
 #include "em_6800.h"
 #include "memory.h"
+#include "memlog.h"
 #include "profiler.h"
+#include "spsc_queue.h"
+#include "stats.h"
 #include "symbols.h"
 
-// Small skew buffer to allow the data bus samples to be taken early or late
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif
 
-#define SKEW_BUFFER_SIZE  32 // Must be a power of 2
+#ifdef HAVE_FORK
+#include <sys/stat.h>
+#endif
+
+// Small history of samples to allow the data bus samples to be taken early or late
+
+#define SKEW_BUFFER_SIZE  32
+
+// Number of samples scanned for phi edges at a time
+#define EDGE_BLOCK_SIZE 4096
 
 #define MAX_SKEW_VALUE ((SKEW_BUFFER_SIZE / 2) - 1)
 
@@ -28,12 +50,6 @@
 // to a value of undefined (?).
 #define UNDEFINED -1
 
-#define BUFSIZE 8192
-
-uint8_t buffer8[BUFSIZE];
-
-uint16_t buffer[BUFSIZE];
-
 const char *machine_names[] = {
    "default",
    "beeb",
@@ -59,22 +75,40 @@ const char default_fwa[] = "\?\?-\?\?:\?\?\?\?\?\?\?\?:\?\?:\?\? = \?\?\?\?\?\?\
 #define OFFSET_VALUE    23
 
 static char fwabuf[80];
-static char disbuf[256];
+// Longest line of instruction output
+#define DISBUF_SIZE 256
 
 static cpu_emulator_t *em;
 
+// The emulator context, and the memory model it uses
+static void *cpu;
+static memory_t *mem;
+
+// The decoder variants for the signals present (see select_decoder)
+static int (*decode_cycles)(sample_t *sample_q, int num, int last) = NULL;
+static int (*count_cycles)(void *cpu, sample_t *sample_q, int intr_seen) = NULL;
+
+// The cycles and counts of the batch being decoded
+static sample_t *batch_cycles;
+static bus_counts_t *batch_counts;
+
+// The counts of a bus cycle in the batch being decoded
+static inline const bus_counts_t *get_counts(const sample_t *sample) {
+   return batch_counts + (sample - batch_cycles);
+}
+
 static int c816;
 static int arlet;
 
+// The counters of the profiler that counts memory accesses, if any
+static mem_counters_t *profile_counters;
+
 // This is a global, so it's visible to the emulator functions
 arguments_t arguments;
 
 // This is a global, so it's visible to the emulator functions
 int triggered = 0;
 
-// indicate state prediction failed
-int failflag = 0;
-
 char* source[65536] = { 0 };
 
 
@@ -95,6 +129,36 @@ FILENAME must be a binary capture file containing:\n\
 \n\
 If FILENAME is omitted, stdin is read instead.\n\
 \n\
+The capture file may be compressed with gzip, zstd or lz4 (where supported\n\
+by the build).\n\
+\n\
+The bus cycles extracted from a capture can be saved with --emit-cycles=FILE,\n\
+and later decoded (much faster) with --input-format=cycles. The cycle file\n\
+records the cpu and which signals were connected, so the signal definition\n\
+options are not needed when it is decoded.\n\
+\n\
+With --fast only the PC (and on the 65C816 the E/M/X flags and the program\n\
+bank) is followed, which is enough to show the address and disassembly of\n\
+each instruction. The registers, flags, stack and memory are not modelled,\n\
+so they are not validated against the bus, and the cycle count of each\n\
+instruction is not checked. It requires sync (or vda/vpa), and is not\n\
+supported on the 6800.\n\
+\n\
+With --checkpoint-every=N the emulator state (the registers and the modelled\n\
+memory) is saved every N samples to FILENAME.ckpt. A later decode of the same\n\
+capture (with the same options) can then use --seek=SAMPLE to restore the\n\
+checkpoint at or before SAMPLE (in hex, as shown by --samplenum), and start\n\
+decoding from there.\n\
+\n\
+With --follow a capture that is still being written is decoded as it grows,\n\
+until the writer closes it or the decoder is interrupted. The state (the\n\
+emulator, memory model and profilers) is then saved to FILENAME.resume, and\n\
+the next --follow of the same capture carries on from where it stopped.\n\
+Decoding the capture without --follow also carries on from there, but\n\
+decodes to the end of the capture as it stands and then removes\n\
+FILENAME.resume, which finishes off a decode that was interrupted after the\n\
+writer closed the capture.\n\
+\n\
 The default sample bit assignments for the 6502/65C02 signals are:\n\
  - data: bit  0 (assumes 8 consecutive bits)\n\
  -  rnw: bit  8\n\
@@ -142,6 +206,17 @@ Each of the three nibbles has the same semantics:\n\
 Examples:\n\
  --mem=00F models (and verifies) all accesses, but with minimal extra logging\n\
  --mem=F0F would additional log all writes\n\
+\n\
+With --mem-log=FILE the logged accesses are written to FILE as fixed size\n\
+binary records, rather than as Rd:/Wr: lines in the output. These can be\n\
+filtered by address range, access type and bus cycle with memquery, which\n\
+prints the matching accesses in the usual format.\n\
+\n\
+With --profile=mem[,MIN[,MAX[,TOP]]] the reads and writes of each address\n\
+from MIN to MAX (in hex) are counted by access type. The TOP (default 20)\n\
+hottest addresses, pages, and data outside of zero page are reported, along\n\
+with the use of each zero page location. Only one memory profiler can be\n\
+used at a time.\n\
 \n";
 
 static char args_doc[] = "[FILENAME]";
@@ -202,6 +277,22 @@ enum {
    KEY_ROMSDIR,
    KEY_VERIFY,
    KEY_VERIFY_MASK,
+   // Long-only options added later start above the ASCII range so argp
+   // never registers them as short options
+   KEY_THREADS = 256,
+   KEY_PARALLEL,
+   KEY_OUTPUT_FORMAT,
+   KEY_OUTPUT,
+   KEY_RENDER,
+   KEY_DIRECT_IO,
+   KEY_STATS,
+   KEY_INPUT_FORMAT,
+   KEY_EMIT_CYCLES,
+   KEY_FAST,
+   KEY_CHECKPOINT_EVERY,
+   KEY_SEEK,
+   KEY_FOLLOW,
+   KEY_MEM_LOG,
 };
 
 
@@ -279,6 +370,8 @@ static struct argp_option options[] = {
    { "trigger",    KEY_TRIGGER, "ADDRESS",                   0, "Trigger on address",                                GROUP_GENERAL},
    { "bbctube",    KEY_BBCTUBE,         0,                   0, "BBC tube protocol decoding",                        GROUP_GENERAL},
    { "mem",            KEY_MEM,     "HEX", OPTION_ARG_OPTIONAL, "Memory modelling (see above)",                      GROUP_GENERAL},
+   { "mem-log",    KEY_MEM_LOG,     "FILE",                  0, "Write the memory access logging to FILE in binary (see above)",
+                                                                                                                     GROUP_GENERAL},
    { "skip",          KEY_SKIP,     "HEX", OPTION_ARG_OPTIONAL, "Skip the first n samples",                          GROUP_GENERAL},
    { "skew",          KEY_SKEW,    "SKEW", OPTION_ARG_OPTIONAL, "Skew the data bus by +/- n samples",                GROUP_GENERAL},
    { "skew_rd",    KEY_SKEW_RD,    "SKEW", OPTION_ARG_OPTIONAL, "Skew the data bus by +/- n samples for read data",  GROUP_GENERAL},
@@ -286,6 +379,24 @@ static struct argp_option options[] = {
    { "labels",      KEY_LABELS,   "FILE",                    0, "Swift format label/symbols file e.g. from beebasm", GROUP_GENERAL},
    { "verify",      KEY_VERIFY, "BITNUM",  OPTION_ARG_OPTIONAL, "Bit number for data verify bits (default 12)",      GROUP_GENERAL},
    { "verify-mask", KEY_VERIFY_MASK, "HEX", OPTION_ARG_OPTIONAL, "Bit mask of data bus bits to verify.",             GROUP_GENERAL},
+   { "threads",    KEY_THREADS,         0,                   0, "Pipeline reading, bus cycle extraction and emulation on separate threads",
+                                                                                                                     GROUP_GENERAL},
+   { "parallel",  KEY_PARALLEL,      "N",                   0, "Decode the capture file in N chunks on separate processes",
+                                                                                                                     GROUP_GENERAL},
+   { "render",      KEY_RENDER, "FIRST,LAST", OPTION_ARG_OPTIONAL, "Render a binary instruction trace as text (see above)",
+                                                                                                                     GROUP_GENERAL},
+   { "stats",        KEY_STATS,         0,                   0, "Report counts and time spent per stage on stderr",  GROUP_GENERAL},
+   { "input-format", KEY_INPUT_FORMAT, "FORMAT",            0, "Input format, capture (default) or cycles",         GROUP_GENERAL},
+   { "emit-cycles", KEY_EMIT_CYCLES, "FILE",                0, "Write the extracted bus cycles to FILE, instead of decoding",
+                                                                                                                     GROUP_GENERAL},
+   { "fast",          KEY_FAST,         0,                   0, "Only follow the PC, skipping the register modelling (see above)",
+                                                                                                                     GROUP_GENERAL},
+   { "checkpoint-every", KEY_CHECKPOINT_EVERY, "N",         0, "Save the emulator state every N samples (see above)",
+                                                                                                                     GROUP_GENERAL},
+   { "seek",          KEY_SEEK,    "SAMPLE",                 0, "Start decoding from the checkpoint at or before SAMPLE",
+                                                                                                                     GROUP_GENERAL},
+   { "follow",      KEY_FOLLOW,         0,                   0, "Decode a capture as it is written, resuming any previous run (see above)",
+                                                                                                                     GROUP_GENERAL},
 
    { 0, 0, 0, 0, "Output options:", GROUP_OUTPUT},
 
@@ -298,6 +409,9 @@ static struct argp_option options[] = {
    { "samplenum",  KEY_SAMPLES,         0,                   0, "Show bus cycle numbers",                            GROUP_OUTPUT},
    { "bbcfwa",      KEY_BBCFWA,         0,                   0, "Show BBC floating-point work areas",                GROUP_OUTPUT},
    { "showromno",   KEY_SHOWROM,        0,                   0, "Show BBC rom no for address 8000..BFFF",            GROUP_OUTPUT},
+   { "output-format", KEY_OUTPUT_FORMAT, "FORMAT",          0, "Output format, text (default) or bin",              GROUP_OUTPUT},
+   { "output",      KEY_OUTPUT,     "FILE",                  0, "Write the binary instruction trace to FILE",        GROUP_OUTPUT},
+   { "direct-io",   KEY_DIRECT_IO,      0,                   0, "Bypass the page cache when the output is a file",   GROUP_OUTPUT},
 
    { 0, 0, 0, 0, "Signal defintion options:", GROUP_SIGDEFS},
 
@@ -595,9 +709,84 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
    case KEY_UNDOC:
       arguments->undocumented = 1;
       break;
+   case KEY_THREADS:
+#ifdef HAVE_THREADS
+      arguments->threads = 1;
+#else
+      argp_error(state, "--threads is not supported on this platform");
+#endif
+      break;
+   case KEY_PARALLEL:
+#ifdef HAVE_FORK
+      arguments->parallel = atoi(arg);
+#else
+      argp_error(state, "--parallel is not supported on this platform");
+#endif
+      break;
+   case KEY_OUTPUT_FORMAT:
+      if (!strcmp(arg, "text")) {
+         arguments->output_format = OUTPUT_TEXT;
+      } else if (!strcmp(arg, "bin")) {
+         arguments->output_format = OUTPUT_BIN;
+      } else {
+         argp_error(state, "unsupported output format");
+      }
+      break;
+   case KEY_OUTPUT:
+      arguments->output_file = arg;
+      break;
+   case KEY_DIRECT_IO:
+      arguments->direct_io = 1;
+      break;
+   case KEY_STATS:
+      arguments->stats = 1;
+      break;
+   case KEY_INPUT_FORMAT:
+      if (!strcmp(arg, "capture")) {
+         arguments->input_format = INPUT_CAPTURE;
+      } else if (!strcmp(arg, "cycles")) {
+         arguments->input_format = INPUT_CYCLES;
+      } else {
+         argp_error(state, "unsupported input format");
+      }
+      break;
+   case KEY_EMIT_CYCLES:
+      arguments->emit_cycles = arg;
+      break;
+   case KEY_FAST:
+      arguments->fast = 1;
+      break;
+   case KEY_CHECKPOINT_EVERY:
+      arguments->checkpoint_every = strtoll(arg, (char **)NULL, 10);
+      if (arguments->checkpoint_every <= 0) {
+         argp_error(state, "--checkpoint-every must be a positive number of samples");
+      }
+      break;
+   case KEY_SEEK:
+      arguments->seek = strtoll(arg, (char **)NULL, 16);
+      break;
+   case KEY_FOLLOW:
+      arguments->follow = 1;
+      break;
+   case KEY_MEM_LOG:
+      arguments->mem_log = arg;
+      break;
+   case KEY_RENDER:
+      arguments->render = 1;
+      if (arg && strlen(arg) > 0) {
+         char *first = strtok(arg, ",");
+         char *last  = strtok(NULL, ",");
+         if (first && strlen(first) > 0) {
+            arguments->render_first = strtoll(first, (char **)NULL, 10);
+         }
+         if (last && strlen(last) > 0) {
+            arguments->render_last = strtoll(last, (char **)NULL, 10);
+         }
+      }
+      break;
    case KEY_ROMSDIR:
        arguments->roms_dir = arg;
-       printf("Roms dir: %s\n", arguments->roms_dir);
+       output_printf("Roms dir: %s\n", arguments->roms_dir);
        break;
    case KEY_VERIFY:
       if (arg && strlen(arg) > 0) {
@@ -637,6 +826,10 @@ static struct argp argp = { options, parse_opt, args_doc, doc, 0, 0, 0 };
 void loadSource() {
    const char* sourceFileName = "source.txt";
 
+   if (!arguments.roms_dir) {
+      return;
+   }
+
    char sourceFilePathName[255];
    strcpy(sourceFilePathName, arguments.roms_dir);
    if (sourceFilePathName[strlen(sourceFilePathName) - 1] != '\\')
@@ -645,7 +838,7 @@ void loadSource() {
 
    FILE* sourceFile = fopen(sourceFilePathName, "r");
    if (!sourceFile) {
-      printf("Warning: Failed to open rom source file: %s\n", sourceFilePathName);
+      output_printf("Warning: Failed to open rom source file: %s\n", sourceFilePathName);
       return;
    }
 
@@ -672,36 +865,37 @@ void loadSource() {
 static void dump_samples(sample_t *sample_q, int n) {
       for (int i = 0; i < n; i++) {
          sample_t *sample = sample_q + i;
-         printf("%08x %2d %02x ", sample->sample_count, i, sample->data);
+         char type;
          switch(sample->type) {
          case INTERNAL:
-            putchar('I');
+            type = 'I';
             break;
          case PROGRAM:
-            putchar('P');
+            type = 'P';
             break;
          case DATA:
-            putchar('D');
+            type = 'D';
             break;
          case OPCODE:
-            putchar('O');
+            type = 'O';
             break;
          case LAST:
-            putchar('L');
+            type = 'L';
             break;
          default:
-            putchar('?');
+            type = '?';
             break;
          }
-         putchar(' ');
-         putchar(sample->rnw >= 0 ? '0' + sample->rnw : '?');
-         putchar(' ');
-         putchar(sample->rst >= 0 ? '0' + sample->rst : '?');
+         char *bp = output_reserve(64);
+         bp += sprintf(bp, "%08x %2d %02x %c %c %c", get_counts(sample)->sample_count, i, sample->data, type,
+                       sample->rnw >= 0 ? '0' + sample->rnw : '?',
+                       sample->rst >= 0 ? '0' + sample->rst : '?');
          if (sample->user >= 0) {
-            putchar(' ');
-            putchar('0' + sample->user);
+            *bp++ = ' ';
+            *bp++ = '0' + sample->user;
          }
-         putchar('\n');
+         *bp++ = '\n';
+         output_commit(bp);
       }
 }
 
@@ -752,14 +946,14 @@ int write_s(char *buffer, const char *s) {
 
 static char *get_fwa(int a_sign, int a_exp, int a_mantissa, int a_round, int a_overflow) {
    strcpy(fwabuf, default_fwa);
-   int sign     = em->read_memory(a_sign);
-   int exp      = em->read_memory(a_exp);
-   int man1     = em->read_memory(a_mantissa);
-   int man2     = em->read_memory(a_mantissa + 1);
-   int man3     = em->read_memory(a_mantissa + 2);
-   int man4     = em->read_memory(a_mantissa + 3);
-   int round    = em->read_memory(a_round);
-   int overflow = a_overflow >= 0 ? em->read_memory(a_overflow) : -1;
+   int sign     = em->read_memory(cpu, a_sign);
+   int exp      = em->read_memory(cpu, a_exp);
+   int man1     = em->read_memory(cpu, a_mantissa);
+   int man2     = em->read_memory(cpu, a_mantissa + 1);
+   int man3     = em->read_memory(cpu, a_mantissa + 2);
+   int man4     = em->read_memory(cpu, a_mantissa + 3);
+   int round    = em->read_memory(cpu, a_round);
+   int overflow = a_overflow >= 0 ? em->read_memory(cpu, a_overflow) : -1;
    if (sign >= 0) {
       write_hex2(fwabuf + OFFSET_SIGN, sign);
    }
@@ -817,12 +1011,154 @@ static char *get_fwa(int a_sign, int a_exp, int a_mantissa, int a_round, int a_o
 }
 
 
+// Format an instruction as a line of text. If state is NULL the current
+// state of the emulator is shown.
+static void print_instruction(instruction_t *instruction, uint32_t sample_count, int real_cycles, int user, int flags, const char *state) {
+   int fail      = flags & TRACE_FAIL;
+   int rst_seen  = flags & TRACE_RESET;
+   int intr_seen = flags & TRACE_INTERRUPT;
+   int opcode    = instruction->opcode;
+   int pb        = instruction->pb;
+   int pc        = instruction->pc;
+
+   // Try to minimise the calls to printf as these are quite expensive,
+   // by writing straight into the output buffer
+
+   char *bp = output_reserve(DISBUF_SIZE);
+   int numchars = 0;
+   // Show sample count
+   if (arguments.show_samplenums) {
+      write_hex8(bp, sample_count);
+      bp += 8;
+      *bp++ = ' ';
+      *bp++ = ':';
+      *bp++ = ' ';
+   }
+   // Show address
+   if (fail || arguments.show_address) {
+      if (c816) {
+         if (pb < 0) {
+            *bp++ = '?';
+            *bp++ = '?';
+         } else {
+            write_hex2(bp, pb);
+            bp += 2;
+         }
+      }
+      if (arguments.show_romno) {
+         bp += write_bankid(mem, bp, pc);
+      }
+      if (pc < 0) {
+         *bp++ = '?';
+         *bp++ = '?';
+         *bp++ = '?';
+         *bp++ = '?';
+      } else {
+         write_hex4(bp, pc);
+         bp += 4;
+      }
+      *bp++ = ' ';
+      *bp++ = ':';
+      *bp++ = ' ';
+   }
+   // Show hex bytes
+   if (fail || arguments.show_hex) {
+      for (int i = 0; i < (c816 ? 4 : 3); i++) {
+         if (rst_seen || intr_seen || i > instruction->opcount) {
+            *bp++ = ' ';
+            *bp++ = ' ';
+         } else {
+            switch (i) {
+            case 0: write_hex2(bp, opcode         ); break;
+            case 1: write_hex2(bp, instruction->op1); break;
+            case 2: write_hex2(bp, instruction->op2); break;
+            case 3: write_hex2(bp, instruction->op3); break;
+            }
+            bp += 2;
+         }
+         *bp++ = ' ';
+      }
+      *bp++ = ':';
+      *bp++ = ' ';
+   }
+
+   // Show instruction disassembly
+   if (fail || arguments.show_something) {
+      if (rst_seen) {
+         numchars = write_s(bp, "RESET !!");
+      } else if (intr_seen) {
+         numchars = write_s(bp, "INTERRUPT !!");
+      } else {
+         numchars = em->disassemble(cpu, bp, instruction);
+      }
+      bp += numchars;
+   }
+
+   // Pad if there is more to come
+   if (fail || arguments.show_cycles || arguments.show_state || arguments.show_bbcfwa) {
+      // Pad opcode to 14 characters, to match python
+      while (numchars++ < 14) {
+         *bp++ = ' ';
+      }
+   }
+   // Show cycles (don't include with fail as it is inconsistent depending on whether rdy is present)
+   if (arguments.show_cycles) {
+      *bp++ = ' ';
+      *bp++ = ':';
+      *bp++ = ' ';
+      // No instruction is more then 8 cycles
+      write_hex1(bp++, real_cycles);
+   }
+   // Show register state
+   if (fail || arguments.show_state) {
+      *bp++ = ' ';
+      *bp++ = ':';
+      *bp++ = ' ';
+      if (state) {
+         bp += write_s(bp, state);
+      } else {
+         bp = em->get_state(cpu, bp);
+      }
+   }
+   // Show BBC floating point work area FWA, FWB
+   if (arguments.show_bbcfwa) {
+      bp += write_s(bp, " : FWA ");
+      bp += write_s(bp, get_fwa(0x2e, 0x30, 0x31, 0x35, 0x2f));
+      bp += write_s(bp, " : FWB ");
+      bp += write_s(bp, get_fwa(0x3b, 0x3c, 0x3d, 0x41,   -1));
+   }
+   // Show the user defined signal value
+   if (arguments.idx_user >= 0) {
+      *bp++ = ' ';
+      *bp++ = ':';
+      *bp++ = ' ';
+      if (user >= 0) {
+         *bp++ = '0' + user;
+      } else {
+         *bp++ = '?';
+      }
+   }
+   // Show any errors
+   if (fail) {
+      bp += write_s(bp, " prediction failed");
+   }
+
+   // Show source
+   if (pc > 0 && source[pc] != NULL) {
+      bp += write_s(bp, source[pc]);
+   }
+
+   // End the line
+   *bp++ = '\n';
+   output_commit(bp);
+}
+
 static int analyze_instruction(sample_t *sample_q, int num_samples, int rst_seen) {
    static int total_cycles = 0;
    static int interrupt_depth = 0;
    static int skipping_interrupted = 0;
 
-   int intr_seen = em->match_interrupt(sample_q, num_samples);
+   int intr_seen = em->match_interrupt(cpu, sample_q, num_samples);
 
    int num_cycles;
    int real_cycles;
@@ -871,7 +1207,7 @@ static int analyze_instruction(sample_t *sample_q, int num_samples, int rst_seen
    if (rst_seen > 0) {
       num_cycles = rst_seen;
    } else {
-      num_cycles = em->count_cycles(sample_q, intr_seen);
+      num_cycles = count_cycles(cpu, sample_q, intr_seen);
    }
 
    // Deal with partial final instruction
@@ -885,21 +1221,34 @@ static int analyze_instruction(sample_t *sample_q, int num_samples, int rst_seen
 
    instruction_t instruction;
 
-   int oldpc = em->get_PC();
-   int oldpb = em->get_PB();
+   int oldpc = em->get_PC(cpu);
+   int oldpb = em->get_PB(cpu);
+
+   // Stamp any binary memory access log records with the first bus cycle
+   memory_set_cycle(mem, get_counts(sample_q)->cycle_count);
+
+   // Count the memory accesses of the instructions that are profiled
+   if (profile_counters) {
+      memory_set_profiling(mem, (triggered && !skipping_interrupted && !intr_seen) ? profile_counters : NULL);
+   }
 
+   uint64_t t = stats_start();
    if (rst_seen) {
       // Handle a reset
-      em->reset(sample_q, num_cycles, &instruction);
+      em->reset(cpu, sample_q, num_cycles, &instruction);
+      stats_add(STAT_RESETS, 1);
    } else if (intr_seen) {
       // Handle an interrupt
-      em->interrupt(sample_q, num_cycles, &instruction);
+      em->interrupt(cpu, sample_q, num_cycles, &instruction);
+      stats_add(STAT_INTERRUPTS, 1);
    } else {
       // Handle a normal instruction
-      em->emulate(sample_q, num_cycles, &instruction);
+      em->emulate(cpu, sample_q, num_cycles, &instruction);
+      stats_add(STAT_INSTRUCTIONS, 1);
    }
+   stats_stop(TIMER_EMULATE, t);
 
-   real_cycles = sample_q[num_cycles].cycle_count - sample_q[0].cycle_count;
+   real_cycles = get_counts(sample_q + num_cycles)->cycle_count - get_counts(sample_q)->cycle_count;
 
    // Sanity check the pc prediction has not gone awry
    // (e.g. in JSR the emulation can use the stacked PC)
@@ -911,23 +1260,25 @@ static int analyze_instruction(sample_t *sample_q, int num_samples, int rst_seen
    if (c816) {
       if (pb >= 0) {
          if (oldpb >= 0 && oldpb != pb) {
-            printf("pb: prediction failed at %02X old pb was %02X\n", pb, oldpb);
+            stats_add(STAT_PC_PREDICTION_FAIL, 1);
+            output_printf("pb: prediction failed at %02X old pb was %02X\n", pb, oldpb);
          }
       }
    }
 
    if (pc >= 0) {
       if (oldpc >= 0 && oldpc != pc) {
-         printf("pc: prediction failed at %04X old pc was %04X\n", pc, oldpc);
+         stats_add(STAT_PC_PREDICTION_FAIL, 1);
+         output_printf("pc: prediction failed at %04X old pc was %04X\n", pc, oldpc);
       }
    }
 
    if (pc >= 0 && pc == arguments.trigger_start) {
       triggered = 1;
-      printf("start trigger hit at cycle %d\n", total_cycles);
+      output_printf("start trigger hit at cycle %d\n", total_cycles);
    } else if (pc >= 0 && pc == arguments.trigger_stop) {
       triggered = 0;
-      printf("stop trigger hit at cycle %d\n", total_cycles);
+      output_printf("stop trigger hit at cycle %d\n", total_cycles);
    }
 
    // Exclude interrupts from profiling
@@ -948,136 +1299,30 @@ static int analyze_instruction(sample_t *sample_q, int num_samples, int rst_seen
       profiler_profile_instruction(instruction.pc, instruction.opcode, instruction.op1, instruction.op2, real_cycles);
    }
 
-   int fail = em->get_and_clear_fail();
-
-   // Try to minimise the calls to printf as these are quite expensive
-
-   char *bp = disbuf;
-
-   if ((fail | arguments.show_something) && triggered && !skipping_interrupted) {
-      int numchars = 0;
-      // Show sample count
-      if (arguments.show_samplenums) {
-         write_hex8(bp, sample_q->sample_count);
-         bp += 8;
-         *bp++ = ' ';
-         *bp++ = ':';
-         *bp++ = ' ';
-      }
-      // Show address
-      if (fail || arguments.show_address) {
-         if (c816) {
-            if (pb < 0) {
-               *bp++ = '?';
-               *bp++ = '?';
-            } else {
-               write_hex2(bp, pb);
-               bp += 2;
-            }
-         }
-         if (arguments.show_romno) {
-            bp += write_bankid(bp, pc);
-         }
-         if (pc < 0) {
-            *bp++ = '?';
-            *bp++ = '?';
-            *bp++ = '?';
-            *bp++ = '?';
-         } else {
-            write_hex4(bp, pc);
-            bp += 4;
-         }
-         *bp++ = ' ';
-         *bp++ = ':';
-         *bp++ = ' ';
-      }
-      // Show hex bytes
-      if (fail || arguments.show_hex) {
-         for (int i = 0; i < (c816 ? 4 : 3); i++) {
-            if (rst_seen || intr_seen || i > instruction.opcount) {
-               *bp++ = ' ';
-               *bp++ = ' ';
-            } else {
-               switch (i) {
-               case 0: write_hex2(bp, opcode         ); break;
-               case 1: write_hex2(bp, instruction.op1); break;
-               case 2: write_hex2(bp, instruction.op2); break;
-               case 3: write_hex2(bp, instruction.op3); break;
-               }
-               bp += 2;
-            }
-            *bp++ = ' ';
-         }
-         *bp++ = ':';
-         *bp++ = ' ';
-      }
-
-      // Show instruction disassembly
-      if (fail || arguments.show_something) {
-         if (rst_seen) {
-            numchars = write_s(bp, "RESET !!");
-         } else if (intr_seen) {
-            numchars = write_s(bp, "INTERRUPT !!");
-         } else {
-            numchars = em->disassemble(bp, &instruction);
-         }
-         bp += numchars;
-      }
-
-      // Pad if there is more to come
-      if (fail || arguments.show_cycles || arguments.show_state || arguments.show_bbcfwa) {
-         // Pad opcode to 14 characters, to match python
-         while (numchars++ < 14) {
-            *bp++ = ' ';
-         }
-      }
-      // Show cycles (don't include with fail as it is inconsistent depending on whether rdy is present)
-      if (arguments.show_cycles) {
-         *bp++ = ' ';
-         *bp++ = ':';
-         *bp++ = ' ';
-         // No instruction is more then 8 cycles
-         write_hex1(bp++, real_cycles);
-      }
-      // Show register state
-      if (fail || arguments.show_state) {
-         *bp++ = ' ';
-         *bp++ = ':';
-         *bp++ = ' ';
-         bp = em->get_state(bp);
-      }
-      // Show BBC floating point work area FWA, FWB
-      if (arguments.show_bbcfwa) {
-         bp += sprintf(bp, " : FWA %s", get_fwa(0x2e, 0x30, 0x31, 0x35, 0x2f));
-         bp += sprintf(bp, " : FWB %s", get_fwa(0x3b, 0x3c, 0x3d, 0x41,   -1));
-      }
-      // Show the user defined signal value
-      if (arguments.idx_user >= 0) {
-         *bp++ = ' ';
-         *bp++ = ':';
-         *bp++ = ' ';
-         int user = sample_q[num_cycles - 1].user;
-         if (user >= 0) {
-            *bp++ = '0' + user;
-         } else {
-            *bp++ = '?';
-         }
-      }
-      // Show any errors
-      if (fail) {
-         bp += write_s(bp, " prediction failed");
-      }
-
-      // Show source
-      if (pc > 0 && source[pc] != NULL) {
-         bp += write_s(bp, source[pc]);
-      }
-
-      // End the line
-      *bp++ = 0;
-      puts(disbuf);
+   int fail = em->get_and_clear_fail(cpu);
+   if (fail) {
+      stats_add(STAT_PREDICTION_FAIL, 1);
+   }
 
+   t = stats_start();
+   if (arguments.output_format == OUTPUT_BIN) {
+      // Record everything, the output options are applied when rendering
+      if (triggered && !skipping_interrupted) {
+         trace_record_t record;
+         record.sample_count = get_counts(sample_q)->sample_count;
+         record.cycles       = real_cycles;
+         record.flags        = (rst_seen ? TRACE_RESET : 0) | (intr_seen ? TRACE_INTERRUPT : 0) | (fail ? TRACE_FAIL : 0);
+         record.user         = (arguments.idx_user >= 0) ? sample_q[num_cycles - 1].user : -1;
+         record.instruction  = instruction;
+         *em->get_state(cpu, record.state) = 0;
+         trace_write(&record);
+      }
+   } else if ((fail | arguments.show_something) && triggered && !skipping_interrupted) {
+      int flags = (rst_seen ? TRACE_RESET : 0) | (intr_seen ? TRACE_INTERRUPT : 0) | (fail ? TRACE_FAIL : 0);
+      int user = (arguments.idx_user >= 0) ? sample_q[num_cycles - 1].user : -1;
+      print_instruction(&instruction, get_counts(sample_q)->sample_count, real_cycles, user, flags, NULL);
    }
+   stats_stop(TIMER_OUTPUT, t);
 
    total_cycles += real_cycles;
    return num_cycles;
@@ -1096,25 +1341,71 @@ static int analyze_instruction(sample_t *sample_q, int num_samples, int rst_seen
 // Case 3: 01   ?  : dead reconning; 8 or 9 depending on the cpu type
 // Case 4: 01  01  : mark first instruction after rst stable
 //
+// Whether rst and sync (or vda/vpa) are connected is the same for every
+// bus cycle, so there is a variant of the decoder for each combination,
+// with has_rst and has_type as constants.
+
+static int rst_seen = 0;
+
+// Set when a decode without --follow carries on from the state saved by
+// --follow, which is removed once the capture is decoded to the end
+static int finishing = 0;
+
+// Set when the state is saved, by --checkpoint-every or --follow
+static int checkpointing = 0;
+
+// The sample number of the last bus cycle of the previous instruction, and
+// of the instruction at or after which the next checkpoint is saved
+static uint32_t prev_sample_count = 0;
+static int64_t next_checkpoint = 0;
+
+// Describe the position of a checkpoint taken before the bus cycle at sample_count
+static void make_checkpoint(checkpoint_t *checkpoint, uint32_t sample_count) {
+   // Extraction must restart early enough to see the whole of the bus
+   // cycle before the instruction, allowing for the skew
+   int delay = arguments.skew_rd > arguments.skew_wr ? arguments.skew_rd : arguments.skew_wr;
+   int64_t start = (int64_t) prev_sample_count - 1 - (delay > 0 ? delay : 0) - SKEW_BUFFER_SIZE;
+   checkpoint->start        = start > 0 ? start : 0;
+   checkpoint->sample_count = sample_count;
+   checkpoint->triggered    = triggered;
+   checkpoint->reset        = rst_seen != 0;
+}
 
-int decode_instruction(sample_t *sample_q, int num_samples) {
-   static int rst_seen = 0;
+static void save_checkpoint(uint32_t sample_count) {
+   checkpoint_t checkpoint;
+   make_checkpoint(&checkpoint, sample_count);
+   checkpoint_write(&checkpoint, em, cpu, mem);
+   next_checkpoint = sample_count + arguments.checkpoint_every;
+}
+
+static inline int decode_instruction_body(sample_t *sample_q, int num_samples, const int has_rst, const int has_type) {
 
    // Skip any samples where RST is asserted (active low)
-   if (sample_q[0].rst == 0) {
+   if (has_rst && sample_q[0].rst == 0) {
       rst_seen = 1;
       return 1;
    }
 
    // If the first sample is not an SYNC, then drop the sample
-   if (sample_q->type != OPCODE && sample_q->type != UNKNOWN) {
+   if (has_type && sample_q->type != OPCODE) {
       return 1;
    }
 
+#ifdef HAVE_FORK
+   // Compare state with the neighbouring chunks when decoding in parallel
+   if (arguments.parallel > 1 && !rst_seen) {
+      parallel_sync_point(cpu, mem, get_counts(sample_q)->sample_count);
+   }
+#endif
+
+   if (arguments.checkpoint_every && !rst_seen && prev_sample_count && get_counts(sample_q)->sample_count >= next_checkpoint) {
+      save_checkpoint(get_counts(sample_q)->sample_count);
+   }
+
    // Flag to indicate the sample type is missing (sync/vda/vpa unconnected)
-   int notype = sample_q[0].type == UNKNOWN;
+   int notype = !has_type;
 
-   if (sample_q[0].rst < 0) {
+   if (!has_rst) {
       // We use a heuristic, based on what we expect to see on the data
       // bus in cycles 5, 6 and 7, i.e. RSTVECL, RSTVECH, RSTOPCODE
       int veclo  = (arguments.vec_rst      ) & 0xff;
@@ -1150,7 +1441,7 @@ int decode_instruction(sample_t *sample_q, int num_samples) {
          if (sample_q[7].type == OPCODE) {
             rst_seen = 7;
          } else {
-            printf("Instruction after rst /= 7 cycles\n");
+            output_printf("Instruction after rst /= 7 cycles\n");
             rst_seen = 0;
          }
       }
@@ -1164,6 +1455,10 @@ int decode_instruction(sample_t *sample_q, int num_samples) {
    // Decode the instruction
    int num_cycles = analyze_instruction(sample_q, num_samples, rst_seen);
 
+   if (checkpointing) {
+      prev_sample_count = get_counts(sample_q + num_cycles - 1)->sample_count;
+   }
+
    // And reset rst_seen for the next reset
    if (rst_seen) {
       rst_seen = 0;
@@ -1172,45 +1467,234 @@ int decode_instruction(sample_t *sample_q, int num_samples) {
    return num_cycles;
 }
 
+// Decode the bus cycles in sample_q, returning the number consumed
+static inline int decode_cycles_body(sample_t *sample_q, int num, int last, const int has_rst, const int has_type) {
+   int index = 0;
+
+   // Decode while there is a full lookahead window available
+   while (num - index >= DEPTH) {
+      index += decode_instruction_body(sample_q + index, DEPTH, has_rst, has_type);
+   }
+
+   if (last) {
+      // Drain the batch when the LAST marker is seen
+      // (to prevent edge condition, the marker is not advertised)
+      while (num - index > 1) {
+         index += decode_instruction_body(sample_q + index, num - index, has_rst, has_type);
+      }
+   }
+   return index;
+}
+
+static int decode_cycles_rst_type(sample_t *sample_q, int num, int last) {
+   return decode_cycles_body(sample_q, num, last, 1, 1);
+}
+
+static int decode_cycles_rst(sample_t *sample_q, int num, int last) {
+   return decode_cycles_body(sample_q, num, last, 1, 0);
+}
+
+static int decode_cycles_type(sample_t *sample_q, int num, int last) {
+   return decode_cycles_body(sample_q, num, last, 0, 1);
+}
+
+static int decode_cycles_none(sample_t *sample_q, int num, int last) {
+   return decode_cycles_body(sample_q, num, last, 0, 0);
+}
+
+// Select the decoder variants for the signals present in the first bus cycle
+static void select_decoder(const sample_t *sample) {
+   int has_rst  = sample->rst >= 0;
+   int has_type = sample->type != UNKNOWN;
+   // Without sync the cycle counts are predicted from the registers
+   if (arguments.fast && !has_type) {
+      fprintf(stderr, "--fast requires sync (or vda/vpa) to be connected\n");
+      exit(1);
+   }
+   if (has_rst) {
+      decode_cycles = has_type ? decode_cycles_rst_type : decode_cycles_rst;
+   } else {
+      decode_cycles = has_type ? decode_cycles_type : decode_cycles_none;
+   }
+   if (has_type && em->count_cycles_with_sync) {
+      count_cycles = em->count_cycles_with_sync;
+   } else if (!has_type && em->count_cycles_without_sync) {
+      count_cycles = em->count_cycles_without_sync;
+   } else {
+      count_cycles = em->count_cycles;
+   }
+}
+
 // ====================================================================
-// Queue a small number of samples so the decoders can lookahead
+// Batch bus cycles into a large buffer so the decoders can lookahead
 // ====================================================================
 
-void queue_sample(sample_t *sample) {
-   static sample_t sample_q[DEPTH];
-   static int index = 0;
+// The instruction decoder consumes cycles by index, and the few cycles
+// left over at the end of a batch (fewer than DEPTH) are carried over
+// into the space reserved at the start of the next batch. This avoids
+// shifting the whole queue after every instruction.
+
+#define CYCLE_BATCH_SIZE 65536
+
+// Number of batches in circulation when using threads
+#define NUM_CYCLE_BATCHES 8
+
+typedef struct {
+   int num;   // number of cycles in the batch
+   int last;  // set when the cycles are followed by the LAST marker
+   int flush; // set to flush the output once the batch is decoded
+   sample_t cycles[DEPTH + CYCLE_BATCH_SIZE + 1];
+   bus_counts_t counts[DEPTH + CYCLE_BATCH_SIZE + 1];
+} cycle_batch_t;
+
+// The batch currently being filled
+static cycle_batch_t *batch;
+
+#ifdef HAVE_THREADS
+static spsc_queue_t *batch_full_q;
+static spsc_queue_t *batch_free_q;
+#endif
+
+// After --seek, the sample number of the instruction the checkpoint was
+// taken at (extraction starts a little before it)
+static uint32_t resume_sample = 0;
+
+static void decode_batch(cycle_batch_t *b) {
+   static sample_t carry[DEPTH];
+   static bus_counts_t carry_counts[DEPTH];
+   static int carry_num = 0;
+
+   uint64_t t = stats_start();
+
+   // Drop the bus cycles before the instruction the checkpoint was taken at
+   if (resume_sample) {
+      sample_t *cycles = b->cycles + DEPTH;
+      bus_counts_t *counts = b->counts + DEPTH;
+      int n = 0;
+      while (n < b->num && counts[n].sample_count < resume_sample) {
+         n++;
+      }
+      // (including the LAST marker)
+      memmove(cycles, cycles + n, (b->num - n + b->last) * sizeof(sample_t));
+      memmove(counts, counts + n, (b->num - n + b->last) * sizeof(bus_counts_t));
+      b->num -= n;
+      if (!b->num && !b->last) {
+         stats_stop(TIMER_DECODE, t);
+         return;
+      }
+      if (b->num && counts[0].sample_count != resume_sample) {
+         fprintf(stderr, "--seek: no bus cycle at sample %08x, the checkpoint does not match the capture\n", resume_sample);
+      }
+      resume_sample = 0;
+   }
+   stats_add(STAT_CYCLES, b->num);
+
+   // Just save the bus cycles, without decoding them
+   if (arguments.emit_cycles) {
+      cycles_write(b->cycles + DEPTH, b->counts + DEPTH, b->num + b->last);
+      stats_stop(TIMER_DECODE, t);
+      return;
+   }
+
+   if (!decode_cycles) {
+      select_decoder(b->cycles + DEPTH);
+   }
+
+   // Prepend the cycles left over from the previous batch
+   sample_t *sample_q = b->cycles + DEPTH - carry_num;
+   memcpy(sample_q, carry, carry_num * sizeof(sample_t));
+   memcpy(b->counts + DEPTH - carry_num, carry_counts, carry_num * sizeof(bus_counts_t));
+   batch_cycles = b->cycles;
+   batch_counts = b->counts;
+
+   // A followed capture that was interrupted is not drained, as the last
+   // few bus cycles are decoded by the next run, once the rest of the
+   // instruction is known. Once the writer has closed it, it is complete.
+   int num = carry_num + b->num;
+   int drain = b->last && (!arguments.follow || capture_writer_closed());
+   int index = decode_cycles(sample_q, num, drain);
+
+   // Save the partial window for the next batch
+   carry_num = num - index;
+   memcpy(carry, sample_q + index, carry_num * sizeof(sample_t));
+   memcpy(carry_counts, get_counts(sample_q + index), carry_num * sizeof(bus_counts_t));
+
+   // Save the state to resume from (the next run extracts the bus cycles
+   // that are left over again, if any)
+   if (b->last && arguments.follow) {
+      checkpoint_t checkpoint;
+      make_checkpoint(&checkpoint, get_counts(sample_q + index)->sample_count);
+      if (checkpoint_save_resume(arguments.filename, arguments.cpu_type, arguments.machine, arguments.byte, arguments.skip,
+                                 &checkpoint, em, cpu, mem) < 0) {
+         perror("failed to save the state to resume from");
+      }
+   }
+   if (b->last && finishing && checkpoint_remove_resume(arguments.filename) < 0) {
+      perror("failed to remove the state to resume from");
+   }
+
+   if (b->flush) {
+      output_flush();
+   }
+
+   stats_stop(TIMER_DECODE, t);
+}
+
+static void emit_batch() {
+#ifdef HAVE_THREADS
+   if (arguments.threads) {
+      // Pass the batch to the emulation thread
+      spsc_queue_push(batch_full_q, batch);
+      batch = spsc_queue_pop(batch_free_q);
+      batch->num = 0;
+      batch->last = 0;
+      batch->flush = 0;
+      return;
+   }
+#endif
+   decode_batch(batch);
+   batch->num = 0;
+   batch->flush = 0;
+}
+
+// Called while waiting for a followed capture to grow, so everything
+// extracted so far is decoded and output
+static void follow_idle() {
+   if (batch->num > 0) {
+      batch->flush = 1;
+      emit_batch();
+   }
+}
+
+static void stop_following(int sig) {
+   capture_stop_following();
+}
+
+// Whether the options allow the state to be saved to resume from (with
+// --follow), and restored by the next run
+static int resume_options_ok() {
+   return !(arguments.checkpoint_every || arguments.seek >= 0 || arguments.parallel > 1 || arguments.input_format == INPUT_CYCLES ||
+            arguments.emit_cycles || arguments.render || arguments.bbctube || arguments.output_format == OUTPUT_BIN);
+}
+
+static inline void queue_sample(const sample_t *sample, const bus_counts_t *counts) {
 
    // This helped when clock noise affected Arlet's core
    // (a better fix was to add 100pF cap to the clock)
    //
-   // if (index > 0 && sample_q[index - 1].type == OPCODE && sample->type == OPCODE) {
+   // if (batch->num > 0 && batch->cycles[DEPTH + batch->num - 1].type == OPCODE && sample->type == OPCODE) {
    //    printf("Skipping duplicate SYNC\n");
    //    return;
    // }
 
-   sample_q[index++] = *sample;
+   batch->cycles[DEPTH + batch->num] = *sample;
+   batch->counts[DEPTH + batch->num] = *counts;
 
    if (sample->type == LAST) {
-      // To prevent edge condition, don't advertise the LAST marker
-      index--;
-      // Drain the queue when the LAST marker is seen
-      while (index > 1) {
-         int consumed = decode_instruction(sample_q, index);
-         for (int i = 0; i < DEPTH - consumed; i++) {
-            sample_q[i] = sample_q[i + consumed];
-         }
-         index -= consumed;
-      }
-   } else {
-      // Else queue the samples
-      // If the queue is full, then pass on to the decoder
-      if (index == DEPTH) {
-         int consumed = decode_instruction(sample_q, index);
-         for (int i = 0; i < DEPTH - consumed; i++) {
-            sample_q[i] = sample_q[i + consumed];
-         }
-         index -= consumed;
-      }
+      batch->last = 1;
+      emit_batch();
+   } else if (++batch->num == CYCLE_BATCH_SIZE) {
+      emit_batch();
    }
 }
 
@@ -1254,20 +1738,273 @@ static inline sample_type_t build_sample_type(uint16_t sample, int idx_vpa, int
    }
 }
 
-void decode(FILE *stream) {
+// The pin mapping is fixed once the arguments have been parsed, so each
+// possible sample word is mapped in advance to a packed descriptor of its
+// control signals. Extracting a bus cycle is then one table lookup, plus
+// extracting the data byte.
+//
+// The rnw, rst, e and user signals are stored as their value + 1, so
+// that zero means the signal is not connected.
 
-   // Pin mappings into the 16 bit words
-   int idx_data  = arguments.idx_data;
-   int idx_rnw   = arguments.idx_rnw ;
-   int idx_sync  = arguments.idx_sync;
-   int idx_rdy   = arguments.idx_rdy ;
-   int idx_user  = arguments.idx_user;
-   int idx_rst   = arguments.idx_rst;
-   int idx_vda   = arguments.idx_vda;
-   int idx_vpa   = arguments.idx_vpa;
-   int idx_e     = arguments.idx_e;
-   int idx_verify = arguments.idx_verify;
+#define DESC_TYPE_MASK  0x0007
+#define DESC_RNW_SHIFT  3
+#define DESC_RST_SHIFT  5
+#define DESC_E_SHIFT    7
+#define DESC_USER_SHIFT 9
+#define DESC_RDY        0x0800 // not a wait state (or rdy not connected)
+#define DESC_PHI        0x1000 // phi2 high (after any phi1 inversion)
+
+static uint16_t sample_desc[0x10000];
+
+static inline uint16_t desc_signal(uint16_t sample, int idx, int shift) {
+   return (idx < 0) ? 0 : (((sample >> idx) & 1) + 1) << shift;
+}
 
+static void build_sample_desc(int idx_phi, int clk_pol, int rdy_pol) {
+   for (int i = 0; i < 0x10000; i++) {
+      uint16_t sample = i;
+      uint16_t desc = build_sample_type(sample, arguments.idx_vpa, arguments.idx_vda, arguments.idx_sync);
+      desc |= desc_signal(sample, arguments.idx_rnw,  DESC_RNW_SHIFT);
+      desc |= desc_signal(sample, arguments.idx_rst,  DESC_RST_SHIFT);
+      desc |= desc_signal(sample, arguments.idx_e,    DESC_E_SHIFT);
+      desc |= desc_signal(sample, arguments.idx_user, DESC_USER_SHIFT);
+      if (arguments.idx_rdy < 0 || (((sample >> arguments.idx_rdy) & 1) == rdy_pol)) {
+         desc |= DESC_RDY;
+      }
+      if (idx_phi >= 0 && (clk_pol ^ ((sample >> idx_phi) & 1))) {
+         desc |= DESC_PHI;
+      }
+      sample_desc[i] = desc;
+   }
+}
+
+// Set the control signals of a bus cycle from its descriptor
+static inline void unpack_sample_desc(sample_t *s, uint16_t desc) {
+   s->type = desc & DESC_TYPE_MASK;
+   s->rnw  = ((desc >> DESC_RNW_SHIFT ) & 3) - 1;
+   s->rst  = ((desc >> DESC_RST_SHIFT ) & 3) - 1;
+   s->e    = ((desc >> DESC_E_SHIFT   ) & 3) - 1;
+   s->user = ((desc >> DESC_USER_SHIFT) & 3) - 1;
+}
+
+// State of the asynchronous bus cycle extraction
+typedef struct {
+   int idx_phi;
+   int delay;      // the head lags the samples read by this many samples
+   int last_phi2;  // the previous value of phi, to detect the rising/falling edge
+   uint32_t base;  // the sample count of the first sample in the current buffer
+} async_state_t;
+
+static inline void async_edge(async_state_t *as, sample_t *s, bus_counts_t *c, const uint16_t *head, int i) {
+   uint16_t sample = head[i];
+   uint16_t desc = sample_desc[sample];
+   int pin_phi2 = (desc & DESC_PHI) != 0;
+   if (pin_phi2) {
+      // Sample control signals after rising edge of PHI2
+      // Note: this is a change for the 65816, but should be fine timing wise
+      unpack_sample_desc(s, desc);
+   } else {
+      if (as->last_phi2 != -1 && (desc & DESC_RDY)) {
+         if (arguments.idx_verify >= 0 && arguments.verify_mask > 0) {
+            s->verify = (sample >> arguments.idx_verify) & arguments.verify_mask;
+         }
+         // Sample the data skewed (--skew=) relative to the falling edge of PHI2
+         s->data = (head[i + (s->rnw == 0 ? arguments.skew_wr : arguments.skew_rd)] >> arguments.idx_data) & 255;
+         c->sample_count = as->base + i;
+         queue_sample(s, c);
+      } else if (as->last_phi2 != -1) {
+         stats_add(STAT_RDY_DROPPED, 1);
+      }
+      c->cycle_count++;
+   }
+   as->last_phi2 = pin_phi2;
+}
+
+// Process samples [first, end) of a buffer, acting only on the edges of phi.
+// The samples up to SKEW_BUFFER_SIZE before the start must be readable.
+static void extract_async(async_state_t *as, sample_t *s, bus_counts_t *c, const uint16_t *samples, int first, int end) {
+   uint32_t edges[EDGE_BLOCK_SIZE];
+   const uint16_t *head = samples - as->delay;
+   int i = first;
+   // The very first sample always counts as an edge
+   if (as->last_phi2 < 0 && i < end) {
+      async_edge(as, s, c, head, i++);
+   }
+   while (i < end) {
+      int n = imin(end - i, EDGE_BLOCK_SIZE);
+      int num_edges = find_edges(head + i, n, as->idx_phi, edges);
+      stats_add(STAT_EDGES, num_edges);
+      for (int e = 0; e < num_edges; e++) {
+         async_edge(as, s, c, head, i + edges[e]);
+      }
+      i += n;
+   }
+}
+
+// Process a buffer of samples in the synchronous word sampling mode.
+//
+// Like the decoder, there is a variant for each combination of rdy and
+// the verify bits being connected, with has_rdy and has_verify as
+// constants.
+static inline void extract_sync_body(sample_t *s, bus_counts_t *c, const uint16_t *samples, int num, const int has_rdy, const int has_verify) {
+   int idx_data    = arguments.idx_data;
+   int idx_verify  = arguments.idx_verify;
+   int verify_mask = arguments.verify_mask;
+   for (int i = 0; i < num; i++) {
+      uint16_t sample = samples[i];
+      uint16_t desc = sample_desc[sample];
+      // Drop samples where RDY=0 (or BA=1 for 6800)
+      if (!has_rdy || (desc & DESC_RDY)) {
+         unpack_sample_desc(s, desc);
+         if (has_verify) {
+            s->verify = (sample >> idx_verify) & verify_mask;
+         }
+         s->data = (sample >> idx_data) & 255;
+         queue_sample(s, c);
+      } else {
+         stats_add(STAT_RDY_DROPPED, 1);
+      }
+      c->sample_count++;
+      c->cycle_count++;
+   }
+}
+
+static void extract_sync_rdy_verify(sample_t *s, bus_counts_t *c, const uint16_t *samples, int num) {
+   extract_sync_body(s, c, samples, num, 1, 1);
+}
+
+static void extract_sync_rdy(sample_t *s, bus_counts_t *c, const uint16_t *samples, int num) {
+   extract_sync_body(s, c, samples, num, 1, 0);
+}
+
+static void extract_sync_verify(sample_t *s, bus_counts_t *c, const uint16_t *samples, int num) {
+   extract_sync_body(s, c, samples, num, 0, 1);
+}
+
+static void extract_sync_none(sample_t *s, bus_counts_t *c, const uint16_t *samples, int num) {
+   extract_sync_body(s, c, samples, num, 0, 0);
+}
+
+typedef void (*extract_sync_fn)(sample_t *s, bus_counts_t *c, const uint16_t *samples, int num);
+
+static extract_sync_fn select_extract_sync() {
+   int has_rdy    = arguments.idx_rdy >= 0;
+   int has_verify = arguments.idx_verify >= 0 && arguments.verify_mask > 0;
+   if (has_rdy) {
+      return has_verify ? extract_sync_rdy_verify : extract_sync_rdy;
+   } else {
+      return has_verify ? extract_sync_verify : extract_sync_none;
+   }
+}
+
+// The offset of the first sample decoded (after --skip), which is
+// non-zero for all but the first chunk of a parallel decode
+static int64_t first_sample = 0;
+
+// ====================================================================
+// Cycle file input
+// ====================================================================
+
+// The signals present in the cycle file
+static int cycles_signals;
+
+// The rest of the first buffer, following the header
+static const uint8_t *cycles_data;
+static int cycles_num;
+
+// The header is read before the emulator is initialised, as it
+// determines the cpu and which signals were connected
+static int open_cycles() {
+   if (capture_open(arguments.filename, 1, 0) < 0) {
+      perror("failed to open cycle file");
+      return -1;
+   }
+   const void *data;
+   int num = capture_read(&data);
+   cpu_t cpu_type;
+   if (num < CYCLES_HEADER_SIZE || cycles_read_header(data, &cpu_type, &cycles_signals) < 0) {
+      fprintf(stderr, "%s is not a cycle file\n", arguments.filename ? arguments.filename : "stdin");
+      return -1;
+   }
+   if (arguments.cpu_type == CPU_UNKNOWN) {
+      arguments.cpu_type = cpu_type;
+   } else if (arguments.cpu_type != cpu_type) {
+      fprintf(stderr, "--cpu does not match the cpu in the cycle file\n");
+      return -1;
+   }
+   cycles_data = (const uint8_t *)data + CYCLES_HEADER_SIZE;
+   cycles_num = num - CYCLES_HEADER_SIZE;
+   return 0;
+}
+
+static void read_cycles() {
+   sample_t s;
+   bus_counts_t c;
+   memset(&s, 0, sizeof(s));
+   memset(&c, 0, sizeof(c));
+
+   // A record split between buffers is reassembled here
+   uint8_t split[2 * CYCLES_MAX_RECORD];
+   int split_num = 0;
+
+   const uint8_t *data = cycles_data;
+   int num = cycles_num;
+   int last = 0;
+   do {
+      uint64_t t = stats_start();
+      if (split_num > 0) {
+         int n = imin(num, CYCLES_MAX_RECORD);
+         memcpy(split + split_num, data, n);
+         int len = cycles_read(split, split_num + n, &s, &c);
+         if (len) {
+            data += len - split_num;
+            num  -= len - split_num;
+            split_num = 0;
+            last = s.type == LAST;
+            queue_sample(&s, &c);
+         } else {
+            // Still incomplete, which is only possible with a tiny buffer
+            split_num += n;
+            data += n;
+            num  -= n;
+         }
+      }
+      int len;
+      while (!last && (len = cycles_read(data, num, &s, &c)) > 0) {
+         data += len;
+         num  -= len;
+         last = s.type == LAST;
+         queue_sample(&s, &c);
+      }
+      if (!last && num > 0) {
+         memcpy(split + split_num, data, num);
+         split_num += num;
+      }
+      stats_stop(TIMER_EXTRACT, t);
+      if (last) {
+         break;
+      }
+      const void *next;
+      num = capture_read(&next);
+      data = next;
+   } while (num > 0);
+
+   if (!last) {
+      fprintf(stderr, "cycle file is truncated\n");
+      // Flush the sample queue
+      s.type = LAST;
+      queue_sample(&s, &c);
+   }
+}
+
+static void extract_cycles() {
+
+   if (arguments.input_format == INPUT_CYCLES) {
+      read_cycles();
+      return;
+   }
+
+   // Pin mappings into the 16 bit words
    // Invert RDY polarity on the 6800 to allow it to be driven from BA
    int rdy_pol = (arguments.cpu_type == CPU_6800) ? 0 : 1;
 
@@ -1283,16 +2020,14 @@ void decode(FILE *stream) {
 
    // The structured bus sample we will pass on to the next level of processing
    sample_t s;
+   bus_counts_t c;
 
-   // Skip the start of the file, if required
-   if (arguments.skip) {
-      fseek(stream, arguments.skip * (arguments.byte ? 1 : 2), SEEK_SET);
-   }
+   // Note: --skip is handled when the capture is opened
 
    // Common to all sampling modes
    s.type = UNKNOWN;
-   s.sample_count = 1;
-   s.cycle_count = 1;
+   c.sample_count = 1 + first_sample;
+   c.cycle_count = 1;
    s.rnw  = -1;
    s.rst  = -1;
    s.e    = -1;
@@ -1311,14 +2046,18 @@ void decode(FILE *stream) {
 
       // Read the capture file, and queue structured sampled for the decoder
       int num;
-      while ((num = fread(buffer8, sizeof(uint8_t), BUFSIZE, stream)) > 0) {
-         uint8_t *sampleptr = &buffer8[0];
+      const void *samples;
+      while ((num = capture_read(&samples)) > 0) {
+         const uint8_t *sampleptr = samples;
+         uint64_t t = stats_start();
+         stats_add(STAT_SAMPLES, num);
          while (num-- > 0) {
             s.data = *sampleptr++;
-            queue_sample(&s);
-            s.sample_count++;
-            s.cycle_count++;
+            queue_sample(&s, &c);
+            c.sample_count++;
+            c.cycle_count++;
          }
+         stats_stop(TIMER_EXTRACT, t);
       }
 
    } else if (idx_phi < 0 ) {
@@ -1336,35 +2075,15 @@ void decode(FILE *stream) {
 
       // Read the capture file, and queue structured sampled for the decoder
       int num;
-      while ((num = fread(buffer, sizeof(uint16_t), BUFSIZE, stream)) > 0) {
-         uint16_t *sampleptr = &buffer[0];
-         while (num-- > 0) {
-            uint16_t sample = *sampleptr++;
-            // Drop samples where RDY=0 (or BA=1 for 6800)
-            if (idx_rdy < 0 || (((sample >> idx_rdy) & 1) == rdy_pol)) {
-               s.type = build_sample_type(sample, idx_vpa, idx_vda, idx_sync);
-               if (idx_rnw >= 0) {
-                  s.rnw = (sample >> idx_rnw ) & 1;
-               }
-               if (idx_rst >= 0) {
-                  s.rst = (sample >> idx_rst) & 1;
-               }
-               if (idx_e >= 0) {
-                  s.e = (sample >> idx_e) & 1;
-               }
-               if (idx_user >= 0) {
-                  s.user = (sample >> idx_user) & 1;
-               }
-               if (idx_verify >= 0 && arguments.verify_mask > 0) {
-                  s.verify = (sample >> idx_verify) & arguments.verify_mask;
-               }
-               s.data = (sample >> idx_data) & 255;
-               
-               queue_sample(&s);
-            }
-            s.sample_count++;
-            s.cycle_count++;
-         }
+      const void *samples;
+      build_sample_desc(idx_phi, clk_pol, rdy_pol);
+      extract_sync_fn extract_sync = select_extract_sync();
+
+      while ((num = capture_read(&samples)) > 0) {
+         uint64_t t = stats_start();
+         stats_add(STAT_SAMPLES, num);
+         extract_sync(&s, &c, samples, num);
+         stats_stop(TIMER_EXTRACT, t);
       }
 
    } else {
@@ -1379,93 +2098,204 @@ void decode(FILE *stream) {
       // In asynchronous word sampling mode clke is connected, and
       // the capture file contans multple samples per bus cycle.
 
-      // The previous value of clke, to detect the rising/falling edge
-      int last_phi2 = -1;
+      // (rdy has never been inverted for the 6800 in this mode)
+      build_sample_desc(idx_phi, clk_pol, 1);
 
-      // A small circular buffer for skewing the sampling of the data bus
-      uint16_t skew_buffer  [SKEW_BUFFER_SIZE];
+      async_state_t as;
+      as.idx_phi   = idx_phi;
+      as.last_phi2 = -1;
+      as.base      = c.sample_count;
 
-      // Minimize the amount of buffering to avoid unnecessary garbage
-      int min_skew = imin(arguments.skew_rd, arguments.skew_wr);
-      int max_skew = imax(arguments.skew_rd, arguments.skew_wr);
+      // Bus cycles are extracted from a delayed copy of the sample
+      // stream (the head), which allows the data bus to be sampled
+      // early or late (--skew=) by indexing either side of the head.
+      as.delay = imax(0, imax(arguments.skew_rd, arguments.skew_wr));
 
-      int tail        = imax(0, max_skew);
-      int head        = 0;
-      int rddata_head = arguments.skew_rd;
-      int wrdata_head = arguments.skew_wr;
-
-      // If any of the skews are negative, then increase all by this amount so they are all positive
-      if (min_skew < 0) {
-         tail        = (       tail - min_skew) & (SKEW_BUFFER_SIZE - 1);
-         head        = (       head - min_skew) & (SKEW_BUFFER_SIZE - 1);
-         rddata_head = (rddata_head - min_skew) & (SKEW_BUFFER_SIZE - 1);
-         wrdata_head = (wrdata_head - min_skew) & (SKEW_BUFFER_SIZE - 1);
-      }
-
-      // Clear the buffer, so the first few samples are ignored
-      for (int i = 0; i < SKEW_BUFFER_SIZE; i++) {
-         skew_buffer[i] = 0;
-      }
+      // The previous SKEW_BUFFER_SIZE samples are kept, so the skew can
+      // reach back into the previous buffer. These start off as zero,
+      // so the first few samples are ignored.
+      uint16_t seam[2 * SKEW_BUFFER_SIZE];
+      memset(seam, 0, sizeof(seam));
 
       // Read the capture file, and queue structured sampled for the decoder
       int num;
-      while ((num = fread(buffer, sizeof(uint16_t), BUFSIZE, stream)) > 0) {
-         uint16_t *sampleptr = &buffer[0];
-         while (num-- > 0) {
-            skew_buffer[tail] = *sampleptr++;
-            uint16_t sample   = skew_buffer[head];
-            // Only act on edges of phi
-            int pin_phi2 = clk_pol ^ ((sample >> idx_phi) & 1);
-            if (pin_phi2 != last_phi2) {
-               if (pin_phi2) {
-                  // Sample control signals after rising edge of PHI2
-                  // Note: this is a change for the 65816, but should be fine timing wise
-                  s.type = build_sample_type(sample, idx_vpa, idx_vda, idx_sync);
-                  if (idx_rnw >= 0) {
-                     s.rnw = (sample >> idx_rnw ) & 1;
-                  }
-                  if (idx_rst >= 0) {
-                     s.rst = (sample >> idx_rst) & 1;
-                     }
-                  if (idx_e >= 0) {
-                     s.e = (sample >> idx_e) & 1;
-                  }
-                  if (idx_user >= 0) {
-                     s.user = (sample >> idx_user) & 1;
-                  }
-               } else {
-                  if (last_phi2 != -1 && (idx_rdy < 0 || ((sample >> idx_rdy) & 1)) ) {
-                     if (idx_verify >= 0 && arguments.verify_mask > 0) {
-                        s.verify = (sample >> idx_verify) & arguments.verify_mask;
-                     }
-                     // Sample the data skewed (--skew=) relative to the falling edge of PHI2
-                     s.data = (skew_buffer[s.rnw == 0 ? wrdata_head : rddata_head] >> idx_data) & 255;
-                     queue_sample(&s);
-                  }
-                  s.cycle_count++;
-               }
-               last_phi2 = pin_phi2;
-            }
-            s.sample_count++;
-            // Increment the circular buffer pointers in lock-step to keey the skew constant
-            tail        = (tail        + 1) & (SKEW_BUFFER_SIZE - 1);
-            head        = (head        + 1) & (SKEW_BUFFER_SIZE - 1);
-            rddata_head = (rddata_head + 1) & (SKEW_BUFFER_SIZE - 1);
-            wrdata_head = (wrdata_head + 1) & (SKEW_BUFFER_SIZE - 1);
+      const void *samples;
+      while ((num = capture_read(&samples)) > 0) {
+         const uint16_t *sampleptr = samples;
+         uint64_t t = stats_start();
+         stats_add(STAT_SAMPLES, num);
+         // The start of the buffer is processed from a copy appended to the history
+         int num_seam = imin(num, SKEW_BUFFER_SIZE);
+         memcpy(seam + SKEW_BUFFER_SIZE, sampleptr, num_seam * sizeof(uint16_t));
+         extract_async(&as, &s, &c, seam + SKEW_BUFFER_SIZE, 0, num_seam);
+         // The rest is processed in place
+         if (num > SKEW_BUFFER_SIZE) {
+            extract_async(&as, &s, &c, sampleptr, SKEW_BUFFER_SIZE, num);
+         }
+         // Update the history
+         if (num >= SKEW_BUFFER_SIZE) {
+            memcpy(seam, sampleptr + num - SKEW_BUFFER_SIZE, SKEW_BUFFER_SIZE * sizeof(uint16_t));
+         } else {
+            memmove(seam, seam + num, SKEW_BUFFER_SIZE * sizeof(uint16_t));
          }
+         as.base += num;
+         stats_stop(TIMER_EXTRACT, t);
       }
+      c.sample_count = as.base;
    }
 
    // Flush the sample queue
    s.type = LAST;
-   queue_sample(&s);
+   queue_sample(&s, &c);
+}
+
+#ifdef HAVE_THREADS
+
+static void *extract_thread(void *arg) {
+   extract_cycles();
+   return NULL;
+}
+
+// Pipelined decode: the capture is read on one thread, bus cycles are
+// extracted on another, and passed in batches to this thread for
+// emulation and output.
+static int decode_threaded() {
+   cycle_batch_t *pool = (cycle_batch_t *)malloc(NUM_CYCLE_BATCHES * sizeof(cycle_batch_t));
+   batch_full_q = spsc_queue_create();
+   batch_free_q = spsc_queue_create();
+   for (int i = 1; i < NUM_CYCLE_BATCHES; i++) {
+      spsc_queue_push(batch_free_q, pool + i);
+   }
+   batch = pool;
+   batch->num = 0;
+   batch->last = 0;
+   batch->flush = 0;
+
+   if (capture_start_thread() < 0) {
+      fprintf(stderr, "failed to start reader thread\n");
+   }
+   if (output_start_thread() < 0) {
+      fprintf(stderr, "failed to start writer thread\n");
+   }
+
+   pthread_t extractor;
+   if (pthread_create(&extractor, NULL, extract_thread, NULL)) {
+      return -1;
+   }
+
+   int last;
+   do {
+      cycle_batch_t *b = spsc_queue_pop(batch_full_q);
+      decode_batch(b);
+      last = b->last;
+      spsc_queue_push(batch_free_q, b);
+   } while (!last);
+
+   pthread_join(extractor, NULL);
+   output_close();
+   spsc_queue_destroy(batch_full_q);
+   spsc_queue_destroy(batch_free_q);
+   free(pool);
+   return 0;
 }
 
+#endif
+
+void decode() {
+#ifdef HAVE_THREADS
+   if (arguments.threads) {
+      if (decode_threaded() == 0) {
+         return;
+      }
+      fprintf(stderr, "failed to start threads, falling back to a single thread\n");
+      arguments.threads = 0;
+   }
+#endif
+   batch = (cycle_batch_t *)malloc(sizeof(cycle_batch_t));
+   batch->num = 0;
+   batch->last = 0;
+   batch->flush = 0;
+   extract_cycles();
+   free(batch);
+}
+
+#ifdef HAVE_FORK
+
+// ====================================================================
+// Parallel decode
+// ====================================================================
+
+// Each chunk of the capture is decoded by a separate worker process,
+// and parallel.c stitches together their output once the decoders of
+// neighbouring chunks agree on the register and memory model state.
+
+static void decode_chunk(int64_t first, int sp, int quiet) {
+   first_sample = first;
+   arguments.sp_reg = sp;
+   cpu = em->create(&arguments, mem);
+   if (quiet) {
+      arguments.show_something = 0;
+      memory_set_rd_logging(mem, 0);
+      memory_set_wr_logging(mem, 0);
+   }
+   if (capture_open(arguments.filename, arguments.byte ? 1 : 2, arguments.skip + first) < 0) {
+      perror("failed to open capture file");
+      exit(2);
+   }
+   decode();
+   capture_close();
+}
+
+static int decode_parallel() {
+   struct stat st;
+   if (!arguments.filename || !strcmp(arguments.filename, "-") || stat(arguments.filename, &st) < 0 || !S_ISREG(st.st_mode)) {
+      fprintf(stderr, "--parallel requires a capture file\n");
+      return 1;
+   }
+   if (capture_is_compressed(arguments.filename)) {
+      fprintf(stderr, "--parallel requires an uncompressed capture file\n");
+      return 1;
+   }
+   int64_t num_samples = st.st_size / (arguments.byte ? 1 : 2) - arguments.skip;
+   if (num_samples < 0) {
+      num_samples = 0;
+   }
+   if (parallel_decode(arguments.parallel, num_samples, arguments.sp_reg, em, mem, decode_chunk) < 0) {
+      return 2;
+   }
+   return 0;
+}
+
+#endif
+
 
 // ====================================================================
 // Main program entry point
 // ====================================================================
 
+// ====================================================================
+// Binary instruction trace rendering
+// ====================================================================
+
+static int render_trace() {
+   trace_record_t record;
+   if (trace_seek(arguments.render_first) < 0) {
+      fprintf(stderr, "binary instruction trace has fewer than %" PRId64 " instructions\n", arguments.render_first + 1);
+      trace_close();
+      return 1;
+   }
+   for (int64_t i = arguments.render_first; arguments.render_last < 0 || i <= arguments.render_last; i++) {
+      if (!trace_read(&record)) {
+         break;
+      }
+      if ((record.flags & TRACE_FAIL) || arguments.show_something) {
+         print_instruction(&record.instruction, record.sample_count, record.cycles, record.user, record.flags, record.state);
+      }
+   }
+   trace_close();
+   return 0;
+}
+
 int main(int argc, char *argv[]) {
    // General options
    arguments.cpu_type         = CPU_UNKNOWN;
@@ -1484,6 +2314,19 @@ int main(int argc, char *argv[]) {
    arguments.trigger_stop     = UNSPECIFIED;
    arguments.trigger_skipint  = 0;
    arguments.filename         = NULL;
+   arguments.threads          = 0;
+   arguments.parallel         = 0;
+   arguments.render           = 0;
+   arguments.render_first     = 0;
+   arguments.render_last      = -1;
+   arguments.stats            = 0;
+   arguments.input_format     = INPUT_CAPTURE;
+   arguments.emit_cycles      = NULL;
+   arguments.mem_log          = NULL;
+   arguments.fast             = 0;
+   arguments.checkpoint_every = 0;
+   arguments.seek             = -1;
+   arguments.follow           = 0;
 
    // Output options
    arguments.show_address     = 1;
@@ -1493,6 +2336,9 @@ int main(int argc, char *argv[]) {
    arguments.show_bbcfwa      = 0;
    arguments.show_cycles      = 0;
    arguments.show_samplenums  = 0;
+   arguments.output_format    = OUTPUT_TEXT;
+   arguments.output_file      = NULL;
+   arguments.direct_io        = 0;
 
    // Signal definition options
    arguments.idx_data         = UNSPECIFIED;
@@ -1518,14 +2364,45 @@ int main(int argc, char *argv[]) {
    arguments.ms_flag          = UNSPECIFIED;
    arguments.xs_flag          = UNSPECIFIED;
 
+   // Make sure any buffered output is written, however the program exits
+   atexit(output_close);
+
    argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
+   if (arguments.direct_io && output_set_direct() < 0) {
+      fprintf(stderr, "--direct-io is not supported for this output, ignoring\n");
+   }
+
    if (arguments.trigger_start < 0) {
       triggered = 1;
    }
 
    arguments.show_something = arguments.show_samplenums | arguments.show_address | arguments.show_hex | arguments.show_instruction | arguments.show_state | arguments.show_bbcfwa | arguments.show_cycles;
 
+   // When rendering a binary instruction trace, the cpu comes from the trace
+   if (arguments.render) {
+      int user;
+      if (!arguments.filename) {
+         fprintf(stderr, "--render requires a binary instruction trace FILENAME\n");
+         return 1;
+      }
+      if (trace_open(arguments.filename, &arguments.cpu_type, &arguments.undocumented, &user) < 0) {
+         return 2;
+      }
+      arguments.idx_user = user ? 0 : UNDEFINED;
+   }
+
+   // When decoding a cycle file, the cpu comes from the file
+   if (arguments.input_format == INPUT_CYCLES) {
+      if (arguments.byte || arguments.skip || arguments.parallel > 1 || arguments.emit_cycles) {
+         fprintf(stderr, "--input-format=cycles cannot be used with --byte, --skip, --parallel or --emit-cycles\n");
+         return 1;
+      }
+      if (open_cycles() < 0) {
+         return 2;
+      }
+   }
+
    // Normally the data file should be 16 bit samples. In byte mode
    // the data file is 8 bit samples, and all the control signals are
    // assumed to be don't care.
@@ -1606,7 +2483,6 @@ int main(int argc, char *argv[]) {
 
    int memory_size;
    // Initialize memory modelling
-   // (em->init actually mallocs the memory)
    if (arguments.cpu_type == CPU_65C816) {
       // 16MB
       memory_size = 0x1000000;
@@ -1616,16 +2492,16 @@ int main(int argc, char *argv[]) {
    }
 
    memory_set_roms_dir(arguments.roms_dir);
-   memory_init(memory_size, arguments.machine, arguments.bbctube);
+   mem = memory_create(memory_size, arguments.machine, arguments.bbctube);
 
    // Turn on memory write logging if show rom bank option (-r) is selected
    if (arguments.show_romno) {
       arguments.mem_model |= (1 << MEM_DATA) | (1 << MEM_STACK);
    }
 
-   memory_set_modelling(  arguments.mem_model       & 0x0f);
-   memory_set_rd_logging((arguments.mem_model >> 4) & 0x0f);
-   memory_set_wr_logging((arguments.mem_model >> 8) & 0x0f);
+   memory_set_modelling(mem,  arguments.mem_model       & 0x0f);
+   memory_set_rd_logging(mem, (arguments.mem_model >> 4) & 0x0f);
+   memory_set_wr_logging(mem, (arguments.mem_model >> 8) & 0x0f);
 
    // Load the swift format symbol file
    if (arguments.labels_file) {
@@ -1682,6 +2558,117 @@ int main(int argc, char *argv[]) {
       }
    }
 
+   // Validate options compatibility with parallel decoding (these depend
+   // on state carried from the start of the capture)
+   if (arguments.parallel > 1) {
+      if (arguments.profile || arguments.trigger_start != UNSPECIFIED || arguments.trigger_stop != UNSPECIFIED || arguments.trigger_skipint) {
+         fprintf(stderr, "--parallel cannot be used with --profile or --trigger\n");
+         return 1;
+      }
+      if (arguments.bbctube || arguments.show_romno || arguments.show_bbcfwa) {
+         fprintf(stderr, "--parallel cannot be used with --bbctube, --showromno or --bbcfwa\n");
+         return 1;
+      }
+      if (arguments.stats) {
+         fprintf(stderr, "--parallel cannot be used with --stats\n");
+         return 1;
+      }
+   }
+
+   // Validate options compatibility with binary instruction traces (these
+   // depend on the memory model, which is not part of the trace)
+   if (arguments.output_format == OUTPUT_BIN || arguments.render) {
+      if (arguments.show_romno || arguments.show_bbcfwa) {
+         fprintf(stderr, "--showromno and --bbcfwa cannot be used with binary instruction traces\n");
+         return 1;
+      }
+   }
+   if (arguments.output_format == OUTPUT_BIN) {
+      if (!arguments.output_file) {
+         fprintf(stderr, "--output-format=bin requires --output=FILE\n");
+         return 1;
+      }
+      if (arguments.parallel > 1) {
+         fprintf(stderr, "--parallel cannot be used with --output-format=bin\n");
+         return 1;
+      }
+   } else if (arguments.output_file) {
+      fprintf(stderr, "--output is only applicable to --output-format=bin\n");
+      return 1;
+   }
+
+   // Validate options compatibility with emitting a cycle file (which
+   // replaces the decoding)
+   if (arguments.emit_cycles) {
+      if (arguments.parallel > 1 || arguments.render || arguments.profile || arguments.output_format == OUTPUT_BIN) {
+         fprintf(stderr, "--emit-cycles cannot be used with --parallel, --render, --profile or --output-format=bin\n");
+         return 1;
+      }
+   }
+
+   // Validate options compatibility with the binary memory access log
+   // (which is written by one decoder)
+   if (arguments.mem_log) {
+      if (!(arguments.mem_model & 0xff0)) {
+         fprintf(stderr, "--mem-log requires memory access logging to be enabled with --mem\n");
+         return 1;
+      }
+      if (arguments.parallel > 1 || arguments.render || arguments.emit_cycles) {
+         fprintf(stderr, "--mem-log cannot be used with --parallel, --render or --emit-cycles\n");
+         return 1;
+      }
+   }
+
+   // Validate options compatibility with --fast (only the PC is followed,
+   // so nothing that depends on the registers or memory is available)
+   if (arguments.fast) {
+      if (arguments.cpu_type == CPU_6800) {
+         fprintf(stderr, "--fast is not supported on the 6800\n");
+         return 1;
+      }
+      if (arguments.show_state || arguments.show_bbcfwa || arguments.show_romno || arguments.bbctube || arguments.mem_model) {
+         fprintf(stderr, "--fast cannot be used with --state, --bbcfwa, --showromno, --bbctube or --mem\n");
+         return 1;
+      }
+      fprintf(stderr, "--fast: only the PC is followed; the registers, flags, stack and memory are not validated, nor are the cycle counts\n");
+   }
+
+   // Validate options compatibility with checkpoints (which are per
+   // capture file, and do not include the state of the tube decoding)
+   if (arguments.checkpoint_every || arguments.seek >= 0) {
+      if (arguments.checkpoint_every && arguments.seek >= 0) {
+         fprintf(stderr, "--checkpoint-every and --seek cannot be used together\n");
+         return 1;
+      }
+      if (!arguments.filename || !strcmp(arguments.filename, "-")) {
+         fprintf(stderr, "--checkpoint-every and --seek require a capture file\n");
+         return 1;
+      }
+      if (arguments.parallel > 1 || arguments.input_format == INPUT_CYCLES || arguments.emit_cycles || arguments.render || arguments.bbctube) {
+         fprintf(stderr, "--checkpoint-every and --seek cannot be used with --parallel, --input-format=cycles, --emit-cycles, --render or --bbctube\n");
+         return 1;
+      }
+   }
+
+   // Validate options compatibility with --follow (which saves the state
+   // to resume from, in the same way as a checkpoint)
+   if (arguments.follow) {
+      if (!arguments.filename || !strcmp(arguments.filename, "-") || capture_is_compressed(arguments.filename)) {
+         fprintf(stderr, "--follow requires an uncompressed capture file\n");
+         return 1;
+      }
+      if (!resume_options_ok()) {
+         fprintf(stderr, "--follow cannot be used with --checkpoint-every, --seek, --parallel, --input-format=cycles, --emit-cycles, --render, --bbctube or --output-format=bin\n");
+         return 1;
+      }
+      if (capture_follow(follow_idle) < 0) {
+         fprintf(stderr, "--follow is not supported on this platform\n");
+         return 1;
+      }
+      signal(SIGINT, stop_following);
+      signal(SIGTERM, stop_following);
+   }
+
    // Implement default pins mapping for unspecified pins
    if (arguments.idx_data == UNSPECIFIED) {
       arguments.idx_data = 0;
@@ -1707,6 +2694,12 @@ int main(int argc, char *argv[]) {
    if (arguments.idx_rst == UNSPECIFIED) {
       arguments.idx_rst = 14;
    }
+   // The signals in a cycle file have already been extracted, but the
+   // decoder still needs to know which were connected
+   if (arguments.input_format == INPUT_CYCLES) {
+      arguments.idx_rdy  = (cycles_signals & CYCLES_RDY ) ? 0 : UNDEFINED;
+      arguments.idx_user = (cycles_signals & CYCLES_USER) ? 0 : UNDEFINED;
+   }
    // Flag conflicting use of --phi1 and --phi2
    if (arguments.idx_phi1 >= 0 && arguments.idx_phi2 >= 0) {
       fprintf(stderr, "--phi1 and --phi2 cannot both be assigned to pins\n");
@@ -1756,32 +2749,137 @@ int main(int argc, char *argv[]) {
 
    arlet = (arguments.cpu_type == CPU_6502_ARLET || arguments.cpu_type == CPU_65C02_ARLET);
 
-   em->init(&arguments);
+   // When decoding in parallel, each worker initialises its own emulator
+   if (arguments.parallel <= 1) {
+      cpu = em->create(&arguments, mem);
+   }
 
    if (arguments.profile) {
-      profiler_init(em);
+      profiler_init(em, cpu);
+      profile_counters = profiler_memory_counters();
+   }
+
+   // Start from the nearest checkpoint (the capture is opened from there)
+   if (arguments.seek >= 0) {
+      checkpoint_t checkpoint;
+      if (checkpoint_restore(arguments.filename, arguments.cpu_type, arguments.machine, arguments.byte, arguments.skip,
+                             arguments.seek, &checkpoint, em, cpu, mem) < 0) {
+         return 2;
+      }
+      first_sample  = checkpoint.start;
+      resume_sample = checkpoint.sample_count;
+      triggered     = checkpoint.triggered;
    }
 
+   // Carry on from where the previous run stopped (finishing off the
+   // decode if not following, when the options allow resuming)
+   finishing = !arguments.follow && arguments.filename && strcmp(arguments.filename, "-") &&
+      !capture_is_compressed(arguments.filename) && resume_options_ok();
+   if (arguments.follow || finishing) {
+      checkpoint_t checkpoint;
+      int ret = checkpoint_resume(arguments.filename, arguments.cpu_type, arguments.machine, arguments.byte, arguments.skip,
+                                  &checkpoint, em, cpu, mem);
+      if (ret < 0) {
+         fprintf(stderr, "remove %s.resume to decode the capture from the start\n", arguments.filename);
+         return 2;
+      } else if (ret == 0) {
+         fprintf(stderr, "resuming from sample %08" PRIx32 "\n", checkpoint.sample_count);
+         first_sample  = checkpoint.start;
+         resume_sample = checkpoint.sample_count;
+         triggered     = checkpoint.triggered;
+         rst_seen      = checkpoint.reset;
+      } else {
+         finishing = 0;
+      }
+   }
+   checkpointing = arguments.checkpoint_every || arguments.follow;
+
    loadSource();
 
-   FILE *stream;
-   if (!arguments.filename || !strcmp(arguments.filename, "-")) {
-      stream = stdin;
-   } else {
-      stream = fopen(arguments.filename, "rb");
-      if (stream == NULL) {
-         perror("failed to open capture file");
+   if (arguments.render) {
+      return render_trace();
+   }
+
+#ifdef HAVE_FORK
+   if (arguments.parallel > 1) {
+      return decode_parallel();
+   }
+#endif
+
+   // (a cycle file has already been opened)
+   if (arguments.input_format == INPUT_CAPTURE && capture_open(arguments.filename, arguments.byte ? 1 : 2, arguments.skip + first_sample) < 0) {
+      perror("failed to open capture file");
+      return 2;
+   }
+
+   if (arguments.emit_cycles) {
+      int signals = 0;
+      if (!arguments.byte) {
+         signals |= (arguments.idx_rnw  >= 0) ? CYCLES_RNW  : 0;
+         signals |= (arguments.idx_rst  >= 0) ? CYCLES_RST  : 0;
+         signals |= (arguments.idx_rdy  >= 0) ? CYCLES_RDY  : 0;
+         signals |= (arguments.idx_e    >= 0) ? CYCLES_E    : 0;
+         signals |= (arguments.idx_user >= 0) ? CYCLES_USER : 0;
+         signals |= (arguments.idx_verify >= 0 && arguments.verify_mask > 0) ? CYCLES_VERIFY : 0;
+      }
+      if (cycles_create(arguments.emit_cycles, arguments.cpu_type, signals) < 0) {
+         perror("failed to create cycle file");
+         return 2;
+      }
+   }
+
+   if (arguments.output_format == OUTPUT_BIN) {
+      if (trace_create(arguments.output_file, arguments.cpu_type, arguments.undocumented, arguments.idx_user >= 0) < 0) {
+         perror("failed to create binary instruction trace");
+         return 2;
+      }
+   }
+
+   if (arguments.mem_log) {
+      if (memlog_create(arguments.mem_log, memory_get_addr_digits(mem)) < 0) {
+         perror("failed to create memory access log");
          return 2;
       }
+      memory_set_log_binary(mem, 1);
    }
 
-   decode(stream);
-   fclose(stream);
+   if (arguments.checkpoint_every && checkpoint_create(arguments.filename, arguments.cpu_type, arguments.machine, arguments.byte, arguments.skip) < 0) {
+      perror("failed to create checkpoint file");
+      return 2;
+   }
+
+   if (arguments.stats) {
+      stats_init();
+   }
+
+   decode();
+   capture_close();
+
+   if (arguments.checkpoint_every) {
+      checkpoint_close();
+   }
+
+   if (arguments.emit_cycles) {
+      cycles_close();
+   }
+
+   if (arguments.output_format == OUTPUT_BIN) {
+      trace_close();
+   }
+
+   if (arguments.mem_log) {
+      memlog_close();
+   }
+
+   // The profiler writes its report directly to stdout
+   output_flush();
 
    if (arguments.profile) {
       profiler_done();
    }
 
+   stats_report();
+
    return 0;
 }
 
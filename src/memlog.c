@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "memlog.h"
+
+// File format (all values little endian):
+//
+// The log starts with a 16 byte header:
+//    0: "6502MEM" followed by the version number
+//    8: number of hex digits in an address
+//    9: reserved
+//
+// Each access is then a 12 byte record:
+//    0: bus cycle count of the instruction (32 bits)
+//    4: address (24 bits)
+//    7: data (8 bits)
+//    8: flags (8 bits, MEMLOG_WRITE etc)
+//    9: bank id (2 characters)
+//   11: reserved
+
+#define MEMLOG_VERSION 1
+
+#define HEADER_SIZE 16
+#define RECORD_SIZE 12
+
+// Records are written and read in blocks
+#define BLOCK_RECORDS 4096
+
+static FILE *memlog_file = NULL;
+
+static int writing;
+
+static uint8_t block[BLOCK_RECORDS * RECORD_SIZE];
+static int block_used;
+static int block_size;
+
+static void put_le(uint8_t *bp, uint64_t value, int n) {
+   for (int i = 0; i < n; i++) {
+      *bp++ = value & 0xff;
+      value >>= 8;
+   }
+}
+
+static uint64_t get_le(const uint8_t *bp, int n) {
+   uint64_t value = 0;
+   for (int i = n - 1; i >= 0; i--) {
+      value = (value << 8) | bp[i];
+   }
+   return value;
+}
+
+// ==================================================
+// Writing
+// ==================================================
+
+static void flush_block() {
+   fwrite(block, 1, block_used, memlog_file);
+   block_used = 0;
+}
+
+int memlog_create(const char *filename, int addr_digits) {
+   memlog_file = fopen(filename, "wb");
+   if (!memlog_file) {
+      return -1;
+   }
+   uint8_t header[HEADER_SIZE];
+   memset(header, 0, sizeof(header));
+   memcpy(header, "6502MEM", 7);
+   header[7] = MEMLOG_VERSION;
+   header[8] = addr_digits;
+   fwrite(header, 1, sizeof(header), memlog_file);
+   writing = 1;
+   block_used = 0;
+   return 0;
+}
+
+void memlog_write(const memlog_record_t *record) {
+   if (block_used == sizeof(block)) {
+      flush_block();
+   }
+   uint8_t *bp = block + block_used;
+   put_le(bp, record->cycle, 4);
+   put_le(bp + 4, record->ea, 3);
+   bp[7]  = record->data;
+   bp[8]  = record->flags;
+   bp[9]  = record->bank_id[0];
+   bp[10] = record->bank_id[1];
+   bp[11] = 0;
+   block_used += RECORD_SIZE;
+}
+
+// ==================================================
+// Reading
+// ==================================================
+
+int memlog_open(const char *filename, int *addr_digits) {
+   uint8_t header[HEADER_SIZE];
+   memlog_file = fopen(filename, "rb");
+   if (!memlog_file) {
+      return -1;
+   }
+   if (fread(header, 1, sizeof(header), memlog_file) != sizeof(header) ||
+       memcmp(header, "6502MEM", 7) || header[7] != MEMLOG_VERSION) {
+      fclose(memlog_file);
+      memlog_file = NULL;
+      return -1;
+   }
+   *addr_digits = header[8];
+   writing = 0;
+   block_used = 0;
+   block_size = 0;
+   return 0;
+}
+
+int memlog_read(memlog_record_t *record) {
+   if (block_used + RECORD_SIZE > block_size) {
+      // A partial record at the end of the log is ignored
+      block_size = fread(block, 1, sizeof(block), memlog_file) / RECORD_SIZE * RECORD_SIZE;
+      block_used = 0;
+      if (!block_size) {
+         return 0;
+      }
+   }
+   const uint8_t *bp = block + block_used;
+   record->cycle      = get_le(bp, 4);
+   record->ea         = get_le(bp + 4, 3);
+   record->data       = bp[7];
+   record->flags      = bp[8];
+   record->bank_id[0] = bp[9];
+   record->bank_id[1] = bp[10];
+   block_used += RECORD_SIZE;
+   return 1;
+}
+
+void memlog_close() {
+   if (memlog_file) {
+      if (writing) {
+         flush_block();
+      }
+      fclose(memlog_file);
+      memlog_file = NULL;
+   }
+}
@@ -0,0 +1,42 @@
+#ifndef _MEMLOG_H
+#define _MEMLOG_H
+
+#include <inttypes.h>
+
+// A memory access log holds the accesses selected for logging by --mem
+// as fixed size binary records, rather than as Rd:/Wr: lines in the
+// output, so they can be filtered afterwards (by memquery) and only the
+// matches printed.
+
+// Record flags: the access type (mem_access_t) in the bottom two bits
+#define MEMLOG_TYPE_MASK 0x03
+#define MEMLOG_WRITE     0x04
+#define MEMLOG_IGNORED   0x08
+
+typedef struct {
+   uint32_t cycle;      // the bus cycle count of the instruction
+   int      ea;
+   int      data;
+   int      flags;
+   char     bank_id[2]; // as in the memory access log
+} memlog_record_t;
+
+// Create a memory access log, where addr_digits is the number of hex
+// digits of each address when printed.
+//
+// Returns 0 on success, or -1 on failure (with errno set).
+int memlog_create(const char *filename, int addr_digits);
+
+void memlog_write(const memlog_record_t *record);
+
+// Open an existing memory access log, returning its addr_digits.
+//
+// Returns 0 on success, or -1 on failure.
+int memlog_open(const char *filename, int *addr_digits);
+
+// Return 1 if a record was read, or 0 at the end of the log.
+int memlog_read(memlog_record_t *record);
+
+void memlog_close();
+
+#endif
@@ -6,123 +6,330 @@
 #include "defs.h"
 #include "tube_decode.h"
 #include "memory.h"
+#include "memlog.h"
+#include "output.h"
+#include "stats.h"
 
 // Sideways ROM
 
 #define SWROM_SIZE          0x4000
 #define SWROM_NUM_BANKS     16
 
-// Standard sideways ROM (upto 16 banks)
-static int *swrom         = NULL;
-static int rom_latch      = 0;
+// Master shadow/overlay RAM
 
-// Extra Master registers
-static int acccon_latch   = 0;
-static int *lynne;           // 20KB overlaid at 3000-7FFF
-static int *hazel;           //  8KB overlaid at C000-DFFF
-static int *andy;            //  4KB overlaid at 8000-8FFF
-static int vdu_op;           // the last instruction fetch was by the VDU driver
+#define LYNNE_SIZE          20480
+#define HAZEL_SIZE          8192
+#define ANDY_SIZE           4096
 
-// Main Memory
+// Checkpoints save memory in pages, omitting the unknown ones
 
-static int8_t *memory        = NULL;
-static int mem_model      = 0;
-static int mem_rd_logging = 0;
-static int mem_wr_logging = 0;
-static int addr_digits    = 0;
+#define CHECKPOINT_PAGE_SIZE 0x1000
 
-static char* mem_roms_dir = 0;
+// The machines with paging hardware map memory in 256 byte pages, which
+// is the granularity of their IO regions (e.g. FC00-FEFF)
+
+#define MAP_PAGE_SHIFT      8
+#define MAP_PAGE_SIZE       (1 << MAP_PAGE_SHIFT)
+#define MAP_PAGE_MASK       (MAP_PAGE_SIZE - 1)
+#define MAP_NONE            -1
 
-// IO
-static int tube_low       = -1;
-static int tube_high      = -1;
+// Shadow memory is allocated in 64KB banks, when first stored to, so a
+// 65816 decode only uses memory for the banks the program touches
 
-static char buffer[256];
+#define BANK_SHIFT          16
+#define BANK_SIZE           (1 << BANK_SHIFT)
+#define BANK_MASK           (BANK_SIZE - 1)
 
-static void memory_read_default(int data, int ea);
-static int memory_write_default(int data, int ea);
+typedef struct {
+   uint8_t data[BANK_SIZE];
+   uint64_t known[BANK_SIZE / 64];
+} bank_t;
 
-// Machine specific memory rd/wr handlers
-static void (*memory_read_fn)(int data, int ea);
-static int (*memory_write_fn)(int data, int ea);
+static char* mem_roms_dir = 0;
 
-// Pre-calculate a label for each 4K page in memory
-// These are manipulated as the ROM and ACCCON latches are modified
-static char bank_id[32];
+// The state of one memory model, so several can be used at once
+struct memory {
+   // Standard sideways ROM (upto 16 banks)
+   int swrom;
+   int rom_latch;
+
+   // Extra Master registers
+   int acccon_latch;
+   int lynne;            // 20KB overlaid at 3000-7FFF
+   int hazel;            //  8KB overlaid at C000-DFFF
+   int andy;             //  4KB overlaid at 8000-8FFF
+   int vdu_op;           // the last instruction fetch was by the VDU driver
+
+   // Extra Blitter registers
+   int boot_mode;
+
+   // Main Memory
+   int size;
+   int mem_model;
+   int mem_rd_logging;
+   int mem_wr_logging;
+   int addr_digits;
+
+   // Logging to a binary memory access log (see memlog.h), and the bus
+   // cycle count its records are stamped with
+   int log_binary;
+   uint32_t cycle;
+   mem_counters_t *counters;
+
+   // Shadow memory: main memory at offset 0, followed by the sideways ROM
+   // and Master RAM (whose offsets are kept above, or 0 if absent). Each
+   // byte of data has a bit in known, set once its value is known. Banks
+   // that have never been stored to are NULL (all unknown).
+   bank_t **banks;
+   int num_banks;
+   int shadow_size;
+
+   // Comparing memory models (see memory_set_hashing), which is only
+   // done while hashing is set, as it slows down the memory model. hash
+   // covers the bytes that changed since then, and tracked_hash the
+   // bytes marked in the tracked bitmaps (one per bank, or NULL).
+   int hashing;
+   uint64_t hash;
+   uint64_t tracked_hash;
+   uint64_t **tracked;
+   void (*learnt)(int i, int data, int read);
+   // The bits of memory_get_latches written since hashing was set
+   int written_latches;
+
+   // IO
+   int tube_low;
+   int tube_high;
+
+   // Machine specific memory rd/wr handlers
+   void (*memory_read_fn)(memory_t *mem, int data, int ea);
+   int (*memory_write_fn)(memory_t *mem, int data, int ea);
+
+   // Page tables, used instead of the handlers by the machines with
+   // paging hardware, and rebuilt by update_map whenever a latch changes.
+   // Each entry is the offset of the page in the shadow memory; reads of
+   // a MAP_NONE page are not modelled (IO), writes to one are ignored.
+   int *rd_map;
+   int *wr_map;
+   void (*update_map)(memory_t *mem);
+   // Writes to the page holding the latches are passed on to write_latch
+   int latch_page;
+   void (*write_latch)(memory_t *mem, int data, int offset);
+   // The address a failure is reported at, if different from ea
+   int (*remap_fn)(memory_t *mem, int ea);
+
+   // Pre-calculate a label for each 4K page in memory
+   // These are manipulated as the ROM and ACCCON latches are modified
+   char bank_id[32];
+
+   // Set when a read disagrees with the memory model
+   int failflag;
+};
+
+// Longest line of memory access logging
+#define LOG_SIZE 256
+
+static void memory_read_default(memory_t *mem, int data, int ea);
+static int memory_write_default(memory_t *mem, int data, int ea);
 
 #define TO_HEX(value) ((value) + ((value) < 10 ? '0' : 'A' - 10))
 
-int write_bankid(char *bp, int ea) {
+int write_bankid(memory_t *mem, char *bp, int ea) {
   if (ea < 0 || ea >= 0x10000) {
       *bp++ = ' ';
       *bp++ = ' ';
    } else {
-      char *bid = bank_id + ((ea & 0xF000) >> 11);
+      char *bid = mem->bank_id + ((ea & 0xF000) >> 11);
       *bp++ = *bid++;
       *bp++ = *bid++;
    }
   return 2;
 }
 
-static inline int write_addr(char *bp, int ea) {
-   bp += write_bankid(bp, ea);
-   int shift = (addr_digits - 1) << 2; // 6 => 20
-   for (int i = 0; i < addr_digits; i++) {
+static inline int write_addr(memory_t *mem, char *bp, int ea) {
+   bp += write_bankid(mem, bp, ea);
+   int shift = (mem->addr_digits - 1) << 2; // 6 => 20
+   for (int i = 0; i < mem->addr_digits; i++) {
       int value = (ea >> shift) & 0xf;
       *bp++ = TO_HEX(value);
       shift -= 4;
    }
-   return addr_digits + 2;
+   return mem->addr_digits + 2;
 }
 
 
-static inline void log_memory_access(char *msg, int data, int ea, int ignored) {
-   char *bp = buffer;
-   bp += write_s(bp, msg);
-   bp += write_addr(bp, ea);
+// The flags are the access type, MEMLOG_WRITE and MEMLOG_IGNORED
+static inline void log_memory_access(memory_t *mem, int data, int ea, int flags) {
+   if (mem->log_binary) {
+      memlog_record_t record;
+      record.cycle = mem->cycle;
+      record.ea    = ea;
+      record.data  = data;
+      record.flags = flags;
+      write_bankid(mem, record.bank_id, ea);
+      memlog_write(&record);
+      return;
+   }
+   char *bp = output_reserve(LOG_SIZE);
+   bp += write_s(bp, (flags & MEMLOG_WRITE) ? "Wr: " : "Rd: ");
+   bp += write_addr(mem, bp, ea);
    bp += write_s(bp, " = ");
    write_hex2(bp, data);
    bp += 2;
-   if (ignored) {
+   if (flags & MEMLOG_IGNORED) {
    bp += write_s(bp, " (ignored)");
    }
-   *bp++ = 0;
-   puts(buffer);
+   *bp++ = '\n';
+   output_commit(bp);
 }
 
 
-static inline void log_memory_fail(int ea, int expected, int actual) {
-   char *bp = buffer;
+static inline void log_memory_fail(memory_t *mem, int ea, int expected, int actual) {
+   stats_add(STAT_MEMORY_FAIL, 1);
+   char *bp = output_reserve(LOG_SIZE);
    bp += write_s(bp, "memory modelling failed at ");
-   bp += write_addr(bp, ea);
+   bp += write_addr(mem, bp, ea);
    bp += write_s(bp, ": expected ");
    write_hex2(bp, expected);
    bp += 2;
    bp += write_s(bp, " actual ");
    write_hex2(bp, actual);
    bp += 2;
-   *bp++ = 0;
-   puts(buffer);
+   *bp++ = '\n';
+   output_commit(bp);
 }
 
-static void set_tube_window(int low, int high) {
-   tube_low = low;
-   tube_high = high;
+static void set_tube_window(memory_t *mem, int low, int high) {
+   mem->tube_low = low;
+   mem->tube_high = high;
 }
 
-static int *init_ram(int size) {
-   int8_t *ram =  malloc(size);
-   for (int i = 0; i < size; i++) {
-      ram[i] = -1;
+// ==================================================
+// Shadow Memory
+// ==================================================
+
+// Add a region of unknown memory (a multiple of 4KB) to the shadow
+// memory, returning its offset
+static int add_region(memory_t *mem, int size) {
+   int offset = mem->shadow_size;
+   int num_banks = mem->num_banks;
+   mem->shadow_size += size;
+   mem->num_banks = (mem->shadow_size + BANK_MASK) >> BANK_SHIFT;
+   mem->banks = realloc(mem->banks, mem->num_banks * sizeof(bank_t *));
+   for (int i = num_banks; i < mem->num_banks; i++) {
+      mem->banks[i] = NULL;
    }
-   return ram;
+   return offset;
 }
 
+// The bank holding shadow memory byte i, allocating it if necessary
+static inline bank_t *get_bank(memory_t *mem, int i) {
+   bank_t **bank = mem->banks + (i >> BANK_SHIFT);
+   if (!*bank) {
+      *bank = calloc(1, sizeof(bank_t));
+   }
+   return *bank;
+}
+
+static inline int is_known(const memory_t *mem, int i) {
+   const bank_t *bank = mem->banks[i >> BANK_SHIFT];
+   int j = i & BANK_MASK;
+   return bank && ((bank->known[j >> 6] >> (j & 63)) & 1);
+}
 
-static void set_rom_latch(int data) {
-   rom_latch = data;
+// The contribution of shadow memory byte i to a hash (which is the XOR
+// of these, so a byte can be added or removed in any order), with data
+// of HASH_UNKNOWN for an unknown byte
+#define HASH_UNKNOWN 0x100
+
+static inline uint64_t hash_byte(int i, int data) {
+   uint64_t x = ((uint64_t) i << 9 | data) * 0x9E3779B97F4A7C15ULL;
+   x ^= x >> 31;
+   x *= 0xBF58476D1CE4E5B9ULL;
+   return x ^ (x >> 29);
+}
+
+static inline int is_tracked(const memory_t *mem, int i) {
+   const uint64_t *tracked = mem->tracked[i >> BANK_SHIFT];
+   int j = i & BANK_MASK;
+   return tracked && ((tracked[j >> 6] >> (j & 63)) & 1);
+}
+
+// Update the hashes as shadow memory byte i changes from old (or
+// HASH_UNKNOWN) to data
+static void hash_change(memory_t *mem, int i, int old, int data, int read) {
+   uint64_t change = hash_byte(i, old) ^ hash_byte(i, data);
+   if (old == HASH_UNKNOWN) {
+      mem->hash ^= hash_byte(i, data);
+      if (mem->learnt) {
+         mem->learnt(i, data, read);
+      }
+   } else {
+      mem->hash ^= change;
+   }
+   if (is_tracked(mem, i)) {
+      mem->tracked_hash ^= change;
+   }
+}
+
+static inline void model_store(memory_t *mem, int data, int i) {
+   bank_t *bank = get_bank(mem, i);
+   int j = i & BANK_MASK;
+   uint64_t bit = (uint64_t) 1 << (j & 63);
+   int old = HASH_UNKNOWN;
+   if (bank->known[j >> 6] & bit) {
+      if (bank->data[j] == data) {
+         return;
+      }
+      old = bank->data[j];
+   }
+   if (mem->hashing) {
+      hash_change(mem, i, old, data, 0);
+   }
+   bank->data[j] = data;
+   bank->known[j >> 6] |= bit;
+}
+
+// Check a read of shadow memory byte i against the model, then update it
+static inline void model_read(memory_t *mem, int data, int ea, int i) {
+   bank_t *bank = get_bank(mem, i);
+   int j = i & BANK_MASK;
+   uint64_t bit = (uint64_t) 1 << (j & 63);
+   int old = HASH_UNKNOWN;
+   if (bank->known[j >> 6] & bit) {
+      if (bank->data[j] == data) {
+         return;
+      }
+      log_memory_fail(mem, mem->remap_fn ? mem->remap_fn(mem, ea) : ea, bank->data[j], data);
+      mem->failflag |= 1;
+      old = bank->data[j];
+   }
+   if (mem->hashing) {
+      hash_change(mem, i, old, data, 1);
+   }
+   bank->data[j] = data;
+   bank->known[j >> 6] |= bit;
+}
+
+// Mark n bytes from j in a bank as known (e.g. after loading a ROM
+// image), a word of the bitmap at a time where possible
+static void set_known_range(bank_t *bank, int j, int n) {
+   for (; n > 0 && (j & 63); j++, n--) {
+      bank->known[j >> 6] |= (uint64_t) 1 << (j & 63);
+   }
+   for (; n >= 64; j += 64, n -= 64) {
+      bank->known[j >> 6] = UINT64_MAX;
+   }
+   for (; n > 0; j++, n--) {
+      bank->known[j >> 6] |= (uint64_t) 1 << (j & 63);
+   }
+}
+
+
+static void set_rom_latch(memory_t *mem, int data) {
+   mem->rom_latch = data;
+   mem->written_latches |= LATCHES_ROM;
    // Update the bank id string
-   char *bid = bank_id + 16; // 8xxx
+   char *bid = mem->bank_id + 16; // 8xxx
    char c = TO_HEX(data & 0xf);
    if (data & 0x80) {
       // Andy RAM is paged in to &8000-&8FFF
@@ -137,14 +344,16 @@ static void set_rom_latch(int data) {
    *bid++ = ':';
    *bid++ = c;
    *bid++ = ':';
+   mem->update_map(mem);
 }
 
-static void set_acccon_latch(int data) {
+static void set_acccon_latch(memory_t *mem, int data) {
    char *bid;
-   acccon_latch = data;
+   mem->acccon_latch = data;
+   mem->written_latches |= LATCHES_ACCCON;
    // Update the bank id string for Lynnn (Shadow RAM) based on bit 2
    // TODO: this is not sufficient; needs to take account of vdu_op which changes each instruction
-   bid = bank_id + 6; // 3xxx
+   bid = mem->bank_id + 6; // 3xxx
    for (int i = 0; i < 5; i++) {
       if (data & 0x04) {
          // Shadow RAM is paged into &3000-7FFF
@@ -157,7 +366,7 @@ static void set_acccon_latch(int data) {
       }
    }
    // Update the bank id string Hazel (MOS Overlay) based on bit 3
-   bid = bank_id + 24; // Cxxx
+   bid = mem->bank_id + 24; // Cxxx
    for (int i = 0; i < 2; i++) {
       if (data & 0x08) {
          // Hazel RAM is paged into &C000-&DFFF
@@ -169,47 +378,75 @@ static void set_acccon_latch(int data) {
          *bid++ = ' ';
       }
    }
-
+   mem->update_map(mem);
 }
 
 // ==================================================
-// Beeb Memory Handlers
+// Page Tables
 // ==================================================
 
-static inline int *get_memptr_beeb(int ea) {
-   if (ea >= 0x8000 && ea < 0xC000) {
-      return swrom + (rom_latch << 14) + (ea & 0x3FFF);
-   } else {
-      return memory + ea;
+// Point the pages from start to end at the shadow memory from base (or
+// MAP_NONE)
+static void map_pages(int *map, int start, int end, int base) {
+   for (int ea = start; ea < end; ea += MAP_PAGE_SIZE) {
+      map[ea >> MAP_PAGE_SHIFT] = base == MAP_NONE ? MAP_NONE : base + (ea - start);
    }
 }
 
-static void memory_read_beeb(int data, int ea) {
-   if (ea < 0xfc00 || ea >= 0xff00) {
-      int *memptr = get_memptr_beeb(ea);
-      if (*memptr >=0 && *memptr != data) {
-         log_memory_fail(ea, *memptr, data);
-         failflag |= 1;
-      }
-      *memptr = data;
+// Initially all of main memory is read and written directly
+static void create_map(memory_t *mem) {
+   int num_pages = mem->size >> MAP_PAGE_SHIFT;
+   mem->rd_map = malloc(num_pages * sizeof(int));
+   mem->wr_map = malloc(num_pages * sizeof(int));
+   map_pages(mem->rd_map, 0, mem->size, 0);
+   map_pages(mem->wr_map, 0, mem->size, 0);
+}
+
+static inline void memory_read_mapped(memory_t *mem, int data, int ea) {
+   int page = mem->rd_map[ea >> MAP_PAGE_SHIFT];
+   if (page != MAP_NONE) {
+      model_read(mem, data, ea, page + (ea & MAP_PAGE_MASK));
    }
 }
 
-static int memory_write_beeb(int data, int ea) {
-   if (ea == 0xfe30) {
-      set_rom_latch(data & 0xf);
+static inline int memory_write_mapped(memory_t *mem, int data, int ea) {
+   int page = mem->wr_map[ea >> MAP_PAGE_SHIFT];
+   if (page == MAP_NONE) {
+      return 1;
+   }
+   model_store(mem, data, page + (ea & MAP_PAGE_MASK));
+   if (page == mem->latch_page) {
+      mem->write_latch(mem, data, ea & MAP_PAGE_MASK);
    }
-   int *memptr = get_memptr_beeb(ea);
-   *memptr = data;
    return 0;
 }
 
-static void init_beeb(int logtube) {
-   swrom = init_ram(SWROM_NUM_BANKS * SWROM_SIZE);
-   memory_read_fn  = memory_read_beeb;
-   memory_write_fn = memory_write_beeb;
+// ==================================================
+// Beeb Memory Handlers
+// ==================================================
+
+static void update_map_beeb(memory_t *mem) {
+   int rom = mem->swrom + (mem->rom_latch << 14);
+   map_pages(mem->rd_map, 0x8000, 0xC000, rom);
+   map_pages(mem->wr_map, 0x8000, 0xC000, rom);
+}
+
+static void write_latch_beeb(memory_t *mem, int data, int offset) {
+   if (offset == 0x30) {
+      set_rom_latch(mem, data & 0xf);
+   }
+}
+
+static void init_beeb(memory_t *mem, int logtube) {
+   mem->swrom = add_region(mem, SWROM_NUM_BANKS * SWROM_SIZE);
+   create_map(mem);
+   map_pages(mem->rd_map, 0xFC00, 0xFF00, MAP_NONE);
+   mem->update_map  = update_map_beeb;
+   mem->latch_page  = 0xFE00;
+   mem->write_latch = write_latch_beeb;
+   update_map_beeb(mem);
    if (logtube) {
-      set_tube_window(0xfee0, 0xfee8);
+      set_tube_window(mem, 0xfee0, 0xfee8);
    }
 }
 
@@ -217,61 +454,58 @@ static void init_beeb(int logtube) {
 // Master Memory Handlers
 // ==================================================
 
-static inline int *get_memptr_master(int ea) {
-   if ((acccon_latch & 0x08) && ea >= 0xc000 && ea < 0xe000) {
-      return hazel + (ea & 0x1FFF);
-   } else if ((rom_latch & 0x80) && ea >= 0x8000 && ea < 0x9000) {
-      return andy + (ea & 0x0FFF);
-   } else if (ea >= 0x3000 && ea < 0x8000 && (acccon_latch & (vdu_op ? 0x02 : 0x04))) {
-      return lynne + (ea - 0x3000);
-   } else if (ea >= 0x8000 && ea < 0xC000) {
-      return swrom + ((rom_latch & 0xf) << 14) + (ea & 0x3FFF);
-   } else {
-      return memory + ea;
-   }
+// Lynne is seen by the VDU driver according to bit 1 of ACCCON, and by
+// everything else according to bit 2, so this also follows vdu_op
+static void map_lynne(memory_t *mem) {
+   int ram = (mem->acccon_latch & (mem->vdu_op ? 0x02 : 0x04)) ? mem->lynne : 0x3000;
+   map_pages(mem->rd_map, 0x3000, 0x8000, ram);
+   map_pages(mem->wr_map, 0x3000, 0x8000, ram);
 }
 
-static void memory_read_master(int data, int ea) {
-   if (ea < 0xfc00 || ea >= 0xff00) {
-      int *memptr = get_memptr_master(ea);
-      if (*memptr >=0 && *memptr != data) {
-         log_memory_fail(ea, *memptr, data);
-         failflag |= 1;
-      }
-      *memptr = data;
+static void update_map_master(memory_t *mem) {
+   map_lynne(mem);
+   int rom = mem->swrom + ((mem->rom_latch & 0xf) << 14);
+   map_pages(mem->rd_map, 0x8000, 0xC000, rom);
+   // Only banks 4-7 are sideways RAM
+   map_pages(mem->wr_map, 0x8000, 0xC000, (mem->rom_latch & 0x0c) == 0x04 ? rom : MAP_NONE);
+   if (mem->rom_latch & 0x80) {
+      map_pages(mem->rd_map, 0x8000, 0x9000, mem->andy);
+      map_pages(mem->wr_map, 0x8000, 0x9000, mem->andy);
+   }
+   if (mem->acccon_latch & 0x08) {
+      map_pages(mem->rd_map, 0xC000, 0xE000, mem->hazel);
+      map_pages(mem->wr_map, 0xC000, 0xE000, mem->hazel);
+   } else {
+      map_pages(mem->rd_map, 0xC000, 0xE000, 0xC000);
+      map_pages(mem->wr_map, 0xC000, 0xE000, MAP_NONE);
    }
 }
 
-static int memory_write_master(int data, int ea) {
-   if (ea == 0xfe30) {
-      set_rom_latch(data & 0x8f);
+static void write_latch_master(memory_t *mem, int data, int offset) {
+   if (offset == 0x30) {
+      set_rom_latch(mem, data & 0x8f);
    }
-   if (ea == 0xfe34) {
-      set_acccon_latch(data & 0xff);
-   }
-   // Determine if the access is writeable
-   if ((ea < 0x8000) ||
-       (ea < 0x9000 && (rom_latch & 0x80)) ||
-       (ea < 0xc000 && ((rom_latch & 0x0c) == 0x04)) ||
-       (ea >= 0xc000 && ea < 0xe000 && (acccon_latch & 0x08)) ||
-       (ea >= 0xfc00 && ea < 0xff00)) {
-      int *memptr = get_memptr_master(ea);
-      *memptr = data;
-      return 0;
-   } else {
-      return 1;
+   if (offset == 0x34) {
+      set_acccon_latch(mem, data & 0xff);
    }
 }
 
-static void init_master(int logtube) {
-   swrom = init_ram(SWROM_NUM_BANKS * SWROM_SIZE);
-   lynne = init_ram(20480); // 20KB overlaid at 3000-7FFF
-   hazel = init_ram(8192);  //  8KB overlaid at C000-DFFF
-   andy  = init_ram(4096);  //  4KB overlaid at 8000-8FFF
-   memory_read_fn  = memory_read_master;
-   memory_write_fn = memory_write_master;
+static void init_master(memory_t *mem, int logtube) {
+   mem->swrom = add_region(mem, SWROM_NUM_BANKS * SWROM_SIZE);
+   mem->lynne = add_region(mem, LYNNE_SIZE); // 20KB overlaid at 3000-7FFF
+   mem->hazel = add_region(mem, HAZEL_SIZE); //  8KB overlaid at C000-DFFF
+   mem->andy  = add_region(mem, ANDY_SIZE);  //  4KB overlaid at 8000-8FFF
+   create_map(mem);
+   map_pages(mem->rd_map, 0xFC00, 0xFF00, MAP_NONE);
+   // Above C000 only the IO region is writeable
+   map_pages(mem->wr_map, 0xC000, mem->size, MAP_NONE);
+   map_pages(mem->wr_map, 0xFC00, 0xFF00, 0xFC00);
+   mem->update_map  = update_map_master;
+   mem->latch_page  = 0xFE00;
+   mem->write_latch = write_latch_master;
+   update_map_master(mem);
    if (logtube) {
-      set_tube_window(0xfee0, 0xfee8);
+      set_tube_window(mem, 0xfee0, 0xfee8);
    }
 }
 
@@ -279,40 +513,28 @@ static void init_master(int logtube) {
 // Elk Memory Handlers
 // ==================================================
 
-static inline int *get_memptr_elk(int ea) {
-   if (ea >= 0x8000 && ea < 0xC000) {
-      return swrom + (rom_latch << 14) + (ea & 0x3FFF);
-   } else {
-      return memory + ea;
-   }
-}
-
-static void memory_read_elk(int data, int ea) {
-   if (ea < 0xfc00 || ea >= 0xff00) {
-      int *memptr = get_memptr_elk(ea);
-      if (*memptr >=0 && *memptr != data) {
-         log_memory_fail(ea, *memptr, data);
-         failflag |= 1;
-      }
-      *memptr = data;
-   }
+// The Elk has no sideways RAM, so writes to the paged ROM are ignored
+static void update_map_elk(memory_t *mem) {
+   map_pages(mem->rd_map, 0x8000, 0xC000, mem->swrom + (mem->rom_latch << 14));
+   map_pages(mem->wr_map, 0x8000, 0xC000, MAP_NONE);
 }
 
-static int memory_write_elk(int data, int ea) {
-   if (ea == 0xfe05) {
-      set_rom_latch(data & 0xf);
+static void write_latch_elk(memory_t *mem, int data, int offset) {
+   if (offset == 0x05) {
+      set_rom_latch(mem, data & 0xf);
    }
-   int *memptr = get_memptr_elk(ea);
-   *memptr = data;
-   return 0;
 }
 
-static void init_elk(int logtube) {
-   swrom = init_ram(SWROM_NUM_BANKS * SWROM_SIZE);
-   memory_read_fn  = memory_read_elk;
-   memory_write_fn = memory_write_elk;
+static void init_elk(memory_t *mem, int logtube) {
+   mem->swrom = add_region(mem, SWROM_NUM_BANKS * SWROM_SIZE);
+   create_map(mem);
+   map_pages(mem->rd_map, 0xFC00, 0xFF00, MAP_NONE);
+   mem->update_map  = update_map_elk;
+   mem->latch_page  = 0xFE00;
+   mem->write_latch = write_latch_elk;
+   update_map_elk(mem);
    if (logtube) {
-      set_tube_window(0xfce0, 0xfce8);
+      set_tube_window(mem, 0xfce0, 0xfce8);
    }
 }
 
@@ -327,103 +549,99 @@ static void init_elk(int logtube) {
 //
 // TODO: correctly handle aliasing
 
-static void memory_read_mek6800d2(int data, int ea) {
+static void memory_read_mek6800d2(memory_t *mem, int data, int ea) {
    if (ea < 0x2000 || (ea >= 0xA000 && ea <= 0xAFFF)) {
-      if (memory[ea] >= 0 && memory[ea] != data) {
-         log_memory_fail(ea,memory[ea], data);
-         failflag |= 1;
-      }
+      model_read(mem, data, ea, ea);
+   } else {
+      model_store(mem, data, ea);
    }
-   memory[ea] = data;
 }
 
-static int memory_write_mek6800d2(int data, int ea) {
-   memory[ea] = data;
+static int memory_write_mek6800d2(memory_t *mem, int data, int ea) {
+   model_store(mem, data, ea);
    return 0;
 }
 
-static void init_mek6800d2(int logtube) {
-   memory_read_fn  = memory_read_mek6800d2;
-   memory_write_fn = memory_write_mek6800d2;
+static void init_mek6800d2(memory_t *mem, int logtube) {
+   mem->memory_read_fn  = memory_read_mek6800d2;
+   mem->memory_write_fn = memory_write_mek6800d2;
 }
 
 // ==================================================
 // Atom Memory Handlers
 // ==================================================
 
-static void memory_read_atom(int data, int ea) {
+static void memory_read_atom(memory_t *mem, int data, int ea) {
    if (ea < 0xA000) {
-      if (memory[ea] >= 0 && memory[ea] != data) {
-         log_memory_fail(ea,memory[ea], data);
-         failflag |= 1;
-      }
+      model_read(mem, data, ea, ea);
+   } else {
+      model_store(mem, data, ea);
    }
-   memory[ea] = data;
 }
 
-static int memory_write_atom(int data, int ea) {
-   memory[ea] = data;
+static int memory_write_atom(memory_t *mem, int data, int ea) {
+   model_store(mem, data, ea);
    return 0;
 }
 
-static void init_atom(int logtube) {
-   memory_read_fn  = memory_read_atom;
-   memory_write_fn = memory_write_atom;
+static void init_atom(memory_t *mem, int logtube) {
+   mem->memory_read_fn  = memory_read_atom;
+   mem->memory_write_fn = memory_write_atom;
 }
 
 // ==================================================
 // Blitter (65816) Memory Handlers
 // ==================================================
 
-static int boot_mode = 0x20;
-
-static inline int remap_address_blitter(int ea) {
-   if (boot_mode && ((ea & 0xff0000) == 0)) {
+static int remap_address_blitter(memory_t *mem, int ea) {
+   if (mem->boot_mode && ((ea & 0xff0000) == 0)) {
       ea |= 0xff0000;
    }
    return ea;
 }
 
-static inline int *get_memptr_blitter(int ea) {
-   if (ea >= 0xff8000 && ea < 0xffC000) {
-      return swrom + (rom_latch << 14) + (ea & 0x3FFF);
-   } else {
-      return memory + ea;
-   }
-}
-
-static void memory_read_blitter(int data, int ea) {
-   ea = remap_address_blitter(ea);
-   if (ea < 0xfffc00 || ea >= 0xffff00) {
-      int *memptr = get_memptr_blitter(ea);
-      if (*memptr >=0 && *memptr != data) {
-         log_memory_fail(ea, *memptr, data);
-         failflag |= 1;
-      }
-      *memptr = data;
+static void update_map_blitter(memory_t *mem) {
+   int rom = mem->swrom + (mem->rom_latch << 14);
+   map_pages(mem->rd_map, 0xff8000, 0xffc000, rom);
+   map_pages(mem->wr_map, 0xff8000, 0xffc000, rom);
+   // In boot mode bank 00 is an alias of bank FF
+   for (int ea = 0; ea < 0x10000; ea += MAP_PAGE_SIZE) {
+      int page = ea >> MAP_PAGE_SHIFT;
+      int alias = remap_address_blitter(mem, ea) >> MAP_PAGE_SHIFT;
+      mem->rd_map[page] = alias == page ? ea : mem->rd_map[alias];
+      mem->wr_map[page] = alias == page ? ea : mem->wr_map[alias];
    }
 }
 
-static int memory_write_blitter(int data, int ea) {
-   ea = remap_address_blitter(ea);
-   if (ea == 0xfffe30) {
-      set_rom_latch(data & 0xf);
+static void write_latch_blitter(memory_t *mem, int data, int offset) {
+   if (offset == 0x30) {
+      set_rom_latch(mem, data & 0xf);
    }
-   if (ea == 0xfffe31) {
-      boot_mode = data & 0x20;
+   if (offset == 0x31) {
+      mem->boot_mode = data & 0x20;
+      mem->written_latches |= LATCHES_BOOT_MODE;
+      update_map_blitter(mem);
    }
-   int *memptr = get_memptr_blitter(ea);
-   *memptr = data;
-   return 0;
 }
 
-static void init_blitter(int logtube) {
-   swrom = init_ram(SWROM_NUM_BANKS * SWROM_SIZE);
-   memory_read_fn  = memory_read_blitter;
-   memory_write_fn = memory_write_blitter;
+static void init_blitter(memory_t *mem, int logtube) {
+   mem->swrom = add_region(mem, SWROM_NUM_BANKS * SWROM_SIZE);
    if (logtube) {
-      set_tube_window(0xfee0, 0xfee8);
+      set_tube_window(mem, 0xfee0, 0xfee8);
+   }
+   if (mem->size <= 0xffffff) {
+      // Only the 65816 sees the 24-bit address map
+      mem->memory_read_fn  = memory_read_default;
+      mem->memory_write_fn = memory_write_default;
+      return;
    }
+   create_map(mem);
+   map_pages(mem->rd_map, 0xfffc00, 0xffff00, MAP_NONE);
+   mem->update_map  = update_map_blitter;
+   mem->latch_page  = 0xfffe00;
+   mem->write_latch = write_latch_blitter;
+   mem->remap_fn    = remap_address_blitter;
+   update_map_blitter(mem);
 }
 
 
@@ -432,40 +650,28 @@ static void init_blitter(int logtube) {
 // ==================================================
 
 
-static void memory_read_pet(int data, int ea) {
+static void memory_read_pet(memory_t *mem, int data, int ea) {
     if (ea >= 0xe810 && ea <= 0xe82f ||
         ea >= 0xe840 && ea <= 0xe84f ||
         ea >= 0xe880 && ea <= 0xe88f)
             return;
 
-    if (memory[ea] >= 0 && memory[ea] != data) {
-        log_memory_fail(ea, memory[ea], data);
-        failflag |= 1;
-    }
-    memory[ea] = data;
+    model_read(mem, data, ea, ea);
 }
 
-static void memory_read_x040(int data, int ea) {
+static void memory_read_x040(memory_t *mem, int data, int ea) {
    if (ea >= 0x0200 && ea <= 0x0fff) return;
 
-   if (memory[ea] >= 0 && memory[ea] != data) {
-      log_memory_fail(ea, memory[ea], data);
-      failflag |= 1;
-   }
-   memory[ea] = data;
+   model_read(mem, data, ea, ea);
 }
 
-static void memory_read_x040_6504(int data, int ea) {
+static void memory_read_x040_6504(memory_t *mem, int data, int ea) {
    // TODO: 6504 IO regions: if (ea >= 0x080 && ea <= 0x0fff) return;
 
-   if (memory[ea] >= 0 && memory[ea] != data) {
-      log_memory_fail(ea, memory[ea], data);
-      failflag |= 1;
-   }
-   memory[ea] = data;
+   model_read(mem, data, ea, ea);
 }
 
-static void load_rom_image(uint16_t address) {
+static void load_rom_image(memory_t *mem, uint16_t address) {
     char romImageFileName[9];
     sprintf(romImageFileName, "%04" PRIx16 ".bin", address);
 
@@ -477,206 +683,457 @@ static void load_rom_image(uint16_t address) {
 
     struct stat romFileStat;
     if (stat(romFilePathName, &romFileStat) < 0) {
-       printf("Warning: Failed to get rom file size: %s\n", romFilePathName);
+       output_printf("Warning: Failed to get rom file size: %s\n", romFilePathName);
        return;
     }
 
     FILE* romsFile = fopen(romFilePathName, "rb");
     if (!romsFile) {
-        printf("Warning: Failed to open rom: %s\n", romFilePathName);
+        output_printf("Warning: Failed to open rom: %s\n", romFilePathName);
         return;
     }
 
+    // The image must fit in the rest of the bank
     long romSize = romFileStat.st_size;
-    if (fread(&memory[address], sizeof(uint8_t), romSize, romsFile) != romSize)
-        printf("Warning, failed to read all %s ROM bytes.\n", romImageFileName);
+    long romSpace = BANK_SIZE - (address & BANK_MASK);
+    bank_t *bank = get_bank(mem, address);
+    size_t romRead = fread(bank->data + (address & BANK_MASK), sizeof(uint8_t), romSize < romSpace ? romSize : romSpace, romsFile);
+    if ((long) romRead != romSize)
+        output_printf("Warning, failed to read all %s ROM bytes.\n", romImageFileName);
+    set_known_range(bank, address & BANK_MASK, romRead);
 
     fclose(romsFile);
 }
 
 
-static void load_rom_images() {
+static void load_rom_images(memory_t *mem) {
     if (!mem_roms_dir) return;
     
-    load_rom_image(0xb000);
-    load_rom_image(0xc000);
-    load_rom_image(0xd000);
+    load_rom_image(mem, 0xb000);
+    load_rom_image(mem, 0xc000);
+    load_rom_image(mem, 0xd000);
     // TODO: Load edit rom (0xe000);
-    load_rom_image(0xf000);
+    load_rom_image(mem, 0xf000);
 }
 
-static void load_x040_rom_images() {
+static void load_x040_rom_images(memory_t *mem) {
    if (!mem_roms_dir) return;
 
-   load_rom_image(0xe000);
-   load_rom_image(0xf000);
+   load_rom_image(mem, 0xe000);
+   load_rom_image(mem, 0xf000);
 }
 
-static void load_x040_6504_rom_images() {
+static void load_x040_6504_rom_images(memory_t *mem) {
    if (!mem_roms_dir) return;
 
-   load_rom_image(0xfc00);
+   load_rom_image(mem, 0xfc00);
 }
 
-static void init_pet(int logtube) {
-    load_rom_images();
-    memory_read_fn = memory_read_pet;
-    memory_write_fn = memory_write_default;
+static void init_pet(memory_t *mem, int logtube) {
+    load_rom_images(mem);
+    mem->memory_read_fn = memory_read_pet;
+    mem->memory_write_fn = memory_write_default;
 }
 
-static void init_pet_x040(int logtube) {
-   load_x040_rom_images();
-   memory_read_fn = memory_read_x040;
-   memory_write_fn = memory_write_default;
+static void init_pet_x040(memory_t *mem, int logtube) {
+   load_x040_rom_images(mem);
+   mem->memory_read_fn = memory_read_x040;
+   mem->memory_write_fn = memory_write_default;
 }
 
-static void init_pet_x040_6504(int logtube) {
-   load_x040_6504_rom_images();
-   memory_read_fn = memory_read_x040_6504;
-   memory_write_fn = memory_write_default;
+static void init_pet_x040_6504(memory_t *mem, int logtube) {
+   load_x040_6504_rom_images(mem);
+   mem->memory_read_fn = memory_read_x040_6504;
+   mem->memory_write_fn = memory_write_default;
 }
 
 // ==================================================
 // Default Memory Handlers
 // ==================================================
 
-static void memory_read_default(int data, int ea) {
-   if (memory[ea] >= 0 && memory[ea] != data) {
-      log_memory_fail(ea,memory[ea], data);
-      failflag |= 1;
-   }
-   memory[ea] = data;
+static void memory_read_default(memory_t *mem, int data, int ea) {
+   model_read(mem, data, ea, ea);
 }
 
-static int memory_write_default(int data, int ea) {
-   memory[ea] = data;
+static int memory_write_default(memory_t *mem, int data, int ea) {
+   model_store(mem, data, ea);
    return 0;
 }
 
-static void init_default(int logtube) {
-   memory_read_fn  = memory_read_default;
-   memory_write_fn = memory_write_default;
+static void init_default(memory_t *mem, int logtube) {
+   mem->memory_read_fn  = memory_read_default;
+   mem->memory_write_fn = memory_write_default;
 }
 
 // ==================================================
 // Public Methods
 // ==================================================
 
-void memory_init(int size, machine_t machine, int logtube) {
-
-    memory = init_ram(size);
+memory_t *memory_create(int size, machine_t machine, int logtube) {
+   memory_t *mem = calloc(1, sizeof(memory_t));
+   add_region(mem, size);
+   mem->size = size;
+   mem->tube_low = -1;
+   mem->tube_high = -1;
+   mem->boot_mode = 0x20;
    // Setup the machine specific memory read/write handler
    switch (machine) {
    case MACHINE_BEEB:
-      init_beeb(logtube);
+      init_beeb(mem, logtube);
       break;
    case MACHINE_MASTER:
-      init_master(logtube);
+      init_master(mem, logtube);
       break;
    case MACHINE_ELK:
-      init_elk(logtube);
+      init_elk(mem, logtube);
       break;
    case MACHINE_ATOM:
-      init_atom(logtube);
+      init_atom(mem, logtube);
       break;
    case MACHINE_MEK6800D2:
-      init_mek6800d2(logtube);
+      init_mek6800d2(mem, logtube);
       break;
    case MACHINE_BLITTER:
-      init_blitter(logtube);
+      init_blitter(mem, logtube);
       break;
    case MACHINE_PET:
-       init_pet(logtube);
+       init_pet(mem, logtube);
        break;
    case MACHINE_PET_X040:
-      init_pet_x040(logtube);
+      init_pet_x040(mem, logtube);
       break;
    case MACHINE_PET_X040_6504:
-      init_pet_x040_6504(logtube);
+      init_pet_x040_6504(mem, logtube);
       break;
    default:
-      init_default(logtube);
+      init_default(mem, logtube);
       break;
    }
    // Calculate the number of digits to represent an address
-   addr_digits = 0;
+   mem->addr_digits = 0;
    size--;
    while (size) {
       size >>= 1;
-      addr_digits++;
+      mem->addr_digits++;
    }
-   addr_digits = (addr_digits + 3) >> 2;
+   mem->addr_digits = (mem->addr_digits + 3) >> 2;
    // Initialize bank labels (2 chars per 4K page)
    for (int i = 0; i < 32; i++) {
-      bank_id[i] = ' ';
+      mem->bank_id[i] = ' ';
    }
+   return mem;
 }
 
-void memory_destroy() {
-   if (swrom) {
-      free(swrom);
-   }
-   if (memory) {
-      free(memory);
+void memory_destroy(memory_t *mem) {
+   for (int i = 0; i < mem->num_banks; i++) {
+      free(mem->banks[i]);
    }
+   free(mem->banks);
+   free(mem->rd_map);
+   free(mem->wr_map);
+   free(mem);
 }
 
-void memory_set_modelling(int bitmask) {
-   mem_model = bitmask;
+void memory_set_modelling(memory_t *mem, int bitmask) {
+   mem->mem_model = bitmask;
 }
 
-void memory_set_rd_logging(int bitmask) {
-   mem_rd_logging = bitmask;
+void memory_set_rd_logging(memory_t *mem, int bitmask) {
+   mem->mem_rd_logging = bitmask;
 }
 
-void memory_set_wr_logging(int bitmask) {
-   mem_wr_logging = bitmask;
+void memory_set_wr_logging(memory_t *mem, int bitmask) {
+   mem->mem_wr_logging = bitmask;
+}
+
+void memory_set_log_binary(memory_t *mem, int enable) {
+   mem->log_binary = enable;
+}
+
+void memory_set_cycle(memory_t *mem, uint32_t cycle) {
+   mem->cycle = cycle;
+}
+
+void memory_set_profiling(memory_t *mem, mem_counters_t *counters) {
+   mem->counters = counters;
+}
+
+void memory_set_hashing(memory_t *mem, int enable) {
+   mem->hashing = enable;
+   mem->hash = 0;
+   mem->written_latches = 0;
+   if (!mem->tracked) {
+      mem->tracked = calloc(mem->num_banks, sizeof(uint64_t *));
+   }
+   memory_untrack_all(mem);
+}
+
+void memory_set_learnt_callback(memory_t *mem, void (*learnt)(int i, int data, int read)) {
+   mem->learnt = learnt;
+}
+
+int memory_get_addr_digits(memory_t *mem) {
+   return mem->addr_digits;
 }
 
 void memory_set_roms_dir(char* roms_dir) {
     mem_roms_dir = roms_dir;
 }
 
-void memory_read(int data, int ea, mem_access_t type) {
+static inline int counter_slot(const mem_counters_t *counters, int ea) {
+   return (ea >= counters->min && ea <= counters->max) ? (ea & 0xffff) : MEM_COUNTER_SLOTS - 1;
+}
+
+void memory_read(memory_t *mem, int data, int ea, mem_access_t type) {
    assert(ea >= 0);
    assert(data >= 0);
+   uint64_t t = stats_start();
+   // Count the access (before a fetch becomes an instruction access)
+   if (mem->counters) {
+      mem->counters->reads[type][counter_slot(mem->counters, ea)]++;
+   }
    // Update the vdu_op state every fetch (used by the master only)
    if (type == MEM_FETCH) {
-      vdu_op = ((acccon_latch & 0x08) == 0x00) && ((ea & 0xffe000) == 0xc000);
+      int vdu_op = ((mem->acccon_latch & 0x08) == 0x00) && ((ea & 0xffe000) == 0xc000);
+      if (vdu_op != mem->vdu_op) {
+         mem->vdu_op = vdu_op;
+         if (mem->lynne) {
+            map_lynne(mem);
+         }
+      }
       type = MEM_INSTR;
    }
    // Log memory read
-   if (mem_rd_logging & (1 << type)) {
-      log_memory_access("Rd: ", data, ea, 0);
+   if (mem->mem_rd_logging & (1 << type)) {
+      log_memory_access(mem, data, ea, type);
    }
-   // Delegate memory read to machine specific handler
-   if (mem_model & (1 << type)) {
-      (*memory_read_fn)(data, ea);
+   // Delegate memory read to the page tables or machine specific handler
+   if (mem->mem_model & (1 << type)) {
+      if (mem->rd_map) {
+         memory_read_mapped(mem, data, ea);
+      } else {
+         (*mem->memory_read_fn)(mem, data, ea);
+      }
    }
    // Pass on to tube decoding
-   if (ea >= tube_low && ea <= tube_high) {
+   if (ea >= mem->tube_low && ea <= mem->tube_high) {
       tube_read(ea & 7, data);
    }
+   stats_stop(TIMER_MEMORY, t);
 }
 
-void memory_write(int data, int ea, mem_access_t type) {
+void memory_write(memory_t *mem, int data, int ea, mem_access_t type) {
    assert(ea >= 0);
    assert(data >= 0);
-   // Delegate memory write to machine specific handler
+   uint64_t t = stats_start();
+   if (mem->counters) {
+      mem->counters->writes[type][counter_slot(mem->counters, ea)]++;
+   }
+   // Delegate memory write to the page tables or machine specific handler
    int ignored = 0;
-   if (mem_model & (1 << type)) {
-      ignored = (*memory_write_fn)(data, ea);
+   if (mem->mem_model & (1 << type)) {
+      if (mem->wr_map) {
+         ignored = memory_write_mapped(mem, data, ea);
+      } else {
+         ignored = (*mem->memory_write_fn)(mem, data, ea);
+      }
    }
    // Log memory write
-   if (mem_wr_logging & (1 << type)) {
-      log_memory_access("Wr: ", data, ea, ignored);
+   if (mem->mem_wr_logging & (1 << type)) {
+      log_memory_access(mem, data, ea, type | MEMLOG_WRITE | (ignored ? MEMLOG_IGNORED : 0));
    }
    // Pass on to tube decoding
-   if (ea >= tube_low && ea <= tube_high) {
+   if (ea >= mem->tube_low && ea <= mem->tube_high) {
       tube_write(ea & 7, data);
    }
+   stats_stop(TIMER_MEMORY, t);
+}
+
+int memory_read_raw(memory_t *mem, int ea) {
+   return is_known(mem, ea) ? mem->banks[ea >> BANK_SHIFT]->data[ea & BANK_MASK] : -1;
+}
+
+int memory_get_latches(memory_t *mem) {
+   return mem->rom_latch | (mem->acccon_latch << 8) | (mem->vdu_op << 16) | (mem->boot_mode << 17);
+}
+
+void memory_set_latches(memory_t *mem, int latches) {
+   int written = mem->written_latches;
+   mem->vdu_op    = (latches >> 16) & 1;
+   mem->boot_mode = latches >> 17;
+   if (mem->update_map) {
+      set_acccon_latch(mem, (latches >> 8) & 0xff);
+      set_rom_latch(mem, latches & 0xff);
+   }
+   mem->written_latches = written;
+}
+
+int memory_get_written_latches(memory_t *mem) {
+   return mem->written_latches;
+}
+
+uint64_t memory_get_hash(memory_t *mem) {
+   return mem->hash;
+}
+
+void memory_track(memory_t *mem, int i) {
+   uint64_t **tracked = mem->tracked + (i >> BANK_SHIFT);
+   if (!*tracked) {
+      *tracked = calloc(BANK_SIZE / 64, sizeof(uint64_t));
+   }
+   int j = i & BANK_MASK;
+   uint64_t bit = (uint64_t) 1 << (j & 63);
+   if (!((*tracked)[j >> 6] & bit)) {
+      (*tracked)[j >> 6] |= bit;
+      int data = memory_get_shadow(mem, i);
+      mem->tracked_hash ^= hash_byte(i, data < 0 ? HASH_UNKNOWN : data);
+   }
+}
+
+void memory_untrack_all(memory_t *mem) {
+   for (int i = 0; i < mem->num_banks; i++) {
+      if (mem->tracked[i]) {
+         memset(mem->tracked[i], 0, BANK_SIZE / 8);
+      }
+   }
+   mem->tracked_hash = 0;
+}
+
+uint64_t memory_get_tracked_hash(memory_t *mem) {
+   return mem->tracked_hash;
+}
+
+int memory_get_shadow(memory_t *mem, int i) {
+   return (i < mem->shadow_size && is_known(mem, i)) ? mem->banks[i >> BANK_SHIFT]->data[i & BANK_MASK] : -1;
+}
+
+int memory_get_and_clear_fail(memory_t *mem) {
+   int ret = mem->failflag;
+   mem->failflag = 0;
+   return ret;
+}
+
+// ==================================================
+// Checkpoints
+// ==================================================
+
+// Each page of the shadow memory is preceded by a byte saying how much
+// of it is known. Unknown pages are omitted, known pages are just the
+// data, and partly known pages are the bitmap followed by the data.
+
+#define PAGE_UNKNOWN 0
+#define PAGE_KNOWN   1
+#define PAGE_PARTLY  2
+
+#define PAGE_WORDS (CHECKPOINT_PAGE_SIZE / 64)
+
+static int page_state(const uint64_t *known) {
+   uint64_t any = 0;
+   uint64_t all = UINT64_MAX;
+   for (int i = 0; i < PAGE_WORDS; i++) {
+      any |= known[i];
+      all &= known[i];
+   }
+   return !any ? PAGE_UNKNOWN : all == UINT64_MAX ? PAGE_KNOWN : PAGE_PARTLY;
 }
 
-int memory_read_raw(int ea) {
-   return memory[ea];
+static void save_shadow(memory_t *mem, FILE *fp) {
+   for (int i = 0; i < mem->shadow_size; i += CHECKPOINT_PAGE_SIZE) {
+      const bank_t *bank = mem->banks[i >> BANK_SHIFT];
+      int j = i & BANK_MASK;
+      const uint64_t *known = bank ? bank->known + j / 64 : NULL;
+      int state = known ? page_state(known) : PAGE_UNKNOWN;
+      fputc(state, fp);
+      if (state == PAGE_PARTLY) {
+         fwrite(known, 1, CHECKPOINT_PAGE_SIZE / 8, fp);
+      }
+      if (state != PAGE_UNKNOWN) {
+         fwrite(bank->data + j, 1, CHECKPOINT_PAGE_SIZE, fp);
+      }
+   }
+}
+
+// With merge, only the known bytes of the checkpoint are restored, on
+// top of the memory model's own
+static int restore_shadow(memory_t *mem, FILE *fp, int merge) {
+   uint64_t page_known[PAGE_WORDS];
+   uint8_t page_data[CHECKPOINT_PAGE_SIZE];
+   for (int i = 0; i < mem->shadow_size; i += CHECKPOINT_PAGE_SIZE) {
+      int j = i & BANK_MASK;
+      int state = fgetc(fp);
+      if (merge) {
+         if (state == PAGE_UNKNOWN) {
+            continue;
+         }
+         if (state == PAGE_KNOWN) {
+            memset(page_known, 0xff, sizeof(page_known));
+         } else if (state != PAGE_PARTLY || fread(page_known, 1, sizeof(page_known), fp) != sizeof(page_known)) {
+            return -1;
+         }
+         if (fread(page_data, 1, sizeof(page_data), fp) != sizeof(page_data)) {
+            return -1;
+         }
+         bank_t *bank = get_bank(mem, i);
+         for (int k = 0; k < CHECKPOINT_PAGE_SIZE; k++) {
+            if ((page_known[k >> 6] >> (k & 63)) & 1) {
+               bank->data[j + k] = page_data[k];
+            }
+         }
+         for (int k = 0; k < PAGE_WORDS; k++) {
+            bank->known[j / 64 + k] |= page_known[k];
+         }
+         continue;
+      }
+      if (state == PAGE_UNKNOWN) {
+         // Leave unallocated banks alone
+         bank_t *bank = mem->banks[i >> BANK_SHIFT];
+         if (bank) {
+            memset(bank->known + j / 64, 0, CHECKPOINT_PAGE_SIZE / 8);
+            memset(bank->data + j, 0, CHECKPOINT_PAGE_SIZE);
+         }
+         continue;
+      }
+      bank_t *bank = get_bank(mem, i);
+      uint64_t *known = bank->known + j / 64;
+      if (state == PAGE_KNOWN) {
+         memset(known, 0xff, CHECKPOINT_PAGE_SIZE / 8);
+      } else if (state != PAGE_PARTLY || fread(known, 1, CHECKPOINT_PAGE_SIZE / 8, fp) != CHECKPOINT_PAGE_SIZE / 8) {
+         return -1;
+      }
+      if (fread(bank->data + j, 1, CHECKPOINT_PAGE_SIZE, fp) != CHECKPOINT_PAGE_SIZE) {
+         return -1;
+      }
+   }
+   return 0;
+}
+
+void memory_save(memory_t *mem, FILE *fp) {
+   uint8_t latches[4] = { mem->rom_latch, mem->acccon_latch, mem->vdu_op, mem->boot_mode };
+   fwrite(latches, 1, sizeof(latches), fp);
+   fwrite(mem->bank_id, 1, sizeof(mem->bank_id), fp);
+   save_shadow(mem, fp);
+}
+
+int memory_restore(memory_t *mem, FILE *fp) {
+   uint8_t latches[4];
+   if (fread(latches, 1, sizeof(latches), fp) != sizeof(latches) ||
+       fread(mem->bank_id, 1, sizeof(mem->bank_id), fp) != sizeof(mem->bank_id)) {
+      return -1;
+   }
+   mem->rom_latch    = latches[0];
+   mem->acccon_latch = latches[1];
+   mem->vdu_op       = latches[2];
+   mem->boot_mode    = latches[3];
+   if (mem->update_map) {
+      mem->update_map(mem);
+   }
+   return restore_shadow(mem, fp, 0);
+}
+
+int memory_merge(memory_t *mem, FILE *fp) {
+   uint8_t header[4 + sizeof(mem->bank_id)];
+   if (fread(header, 1, sizeof(header), fp) != sizeof(header)) {
+      return -1;
+   }
+   return restore_shadow(mem, fp, 1);
 }
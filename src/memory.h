@@ -1,6 +1,8 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
+#include <stdio.h>
+
 #include "defs.h"
 
 typedef enum {
@@ -11,24 +13,116 @@ typedef enum {
    MEM_FETCH    = 4,
 } mem_access_t;
 
-void memory_init(int size, machine_t machine, int logtube);
+#define MEM_NUM_TYPES (MEM_FETCH + 1)
+
+// The counts of the accesses to each address by type, as kept by the mem
+// profiler (see profiler_mem.c). These are updated directly by the memory
+// model, as this is on the path of every access. An address between min
+// and max is counted in the slot of its low 16 bits, and any other in
+// the last slot (OTHER_CONTEXT in profiler.h).
+#define MEM_COUNTER_SLOTS 0x10001
+
+typedef struct {
+   int min;
+   int max;
+   uint32_t reads[MEM_NUM_TYPES][MEM_COUNTER_SLOTS];
+   uint32_t writes[MEM_NUM_TYPES][MEM_COUNTER_SLOTS];
+} mem_counters_t;
+
+// Each memory model is an independent context, so several decodes can
+// run at once (on different threads)
+memory_t *memory_create(int size, machine_t machine, int logtube);
+
+void memory_set_roms_dir(char *roms_dir);
+
+void memory_set_modelling(memory_t *mem, int bitmask);
+
+void memory_set_rd_logging(memory_t *mem, int bitmask);
+
+void memory_set_wr_logging(memory_t *mem, int bitmask);
+
+// Send the logged accesses to the binary memory access log (which must
+// already be created, see memlog.h) rather than the output, stamped with
+// the bus cycle count of the current instruction
+void memory_set_log_binary(memory_t *mem, int enable);
+
+void memory_set_cycle(memory_t *mem, uint32_t cycle);
+
+// Count each access in counters (or none if NULL), which is set only for
+// the instructions being profiled
+void memory_set_profiling(memory_t *mem, mem_counters_t *counters);
+
+// The number of hex digits in an address in the memory access log
+int memory_get_addr_digits(memory_t *mem);
+
+void memory_read(memory_t *mem, int data, int ea, mem_access_t type);
+
+void memory_write(memory_t *mem, int data, int ea, mem_access_t type);
+
+int memory_read_raw(memory_t *mem, int ea);
+
+// The state of the paging latches, which affects both the memory model
+// and the bank ids in the memory access log
+int memory_get_latches(memory_t *mem);
+
+// The fields of memory_get_latches
+#define LATCHES_ROM       0x000ff
+#define LATCHES_ACCCON    0x1ff00   // including vdu_op, which follows ACCCON
+#define LATCHES_BOOT_MODE 0x1fe0000
+
+// Set all the latches (as returned by memory_get_latches), e.g. to
+// start decoding part way through a capture
+void memory_set_latches(memory_t *mem, int latches);
+
+// The fields of memory_get_latches written by the program since hashing
+// was last set (see below)
+int memory_get_written_latches(memory_t *mem);
+
+// Comparing memory models, as done by the parallel decode (see
+// parallel.c). The hashes are only maintained while hashing is enabled,
+// as this slows down the memory model. Bytes are identified by their
+// index in the shadow memory, so the paging latches must agree too.
+//
+// memory_get_hash is a hash of the bytes that changed since hashing was
+// enabled, and the learnt callback is called whenever a byte becomes
+// known (read is set if by a read). memory_get_tracked_hash is a hash
+// of the bytes passed to memory_track (whether known or not). So if the
+// bytes learnt by one model are tracked in another, the hashes are
+// equal if the two models agree on those bytes.
+void memory_set_hashing(memory_t *mem, int enable);
+
+void memory_set_learnt_callback(memory_t *mem, void (*learnt)(int i, int data, int read));
+
+uint64_t memory_get_hash(memory_t *mem);
+
+void memory_track(memory_t *mem, int i);
 
-void memory_set_modelling(int bitmask);
+void memory_untrack_all(memory_t *mem);
 
-void memory_set_rd_logging(int bitmask);
+uint64_t memory_get_tracked_hash(memory_t *mem);
 
-void memory_set_wr_logging(int bitmask);
+// The value of byte i of the shadow memory, or -1 if unknown
+int memory_get_shadow(memory_t *mem, int i);
 
-void memory_read(int data, int ea, mem_access_t type);
+// Returns whether a read has disagreed with the memory model since the
+// last call
+int memory_get_and_clear_fail(memory_t *mem);
 
-void memory_write(int data, int ea, mem_access_t type);
+void memory_destroy(memory_t *mem);
 
-int memory_read_raw(int ea);
+int write_bankid(memory_t *mem, char *buffer, int ea);
 
-int memory_read_raw(int ea);
+// Write the whole state of a memory model (the contents of memory and the
+// paging latches) to a checkpoint, and read it back into a memory model
+// for the same machine.
+//
+// memory_restore returns 0 on success, or -1 if the checkpoint is truncated.
+void memory_save(memory_t *mem, FILE *fp);
 
-void memory_destroy();
+int memory_restore(memory_t *mem, FILE *fp);
 
-int write_bankid(char *buffer, int ea);
+// Read the known bytes of a checkpoint into a memory model, on top of
+// those it already knows (the paging latches are left alone)
+int memory_merge(memory_t *mem, FILE *fp);
 
 #endif
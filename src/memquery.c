@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <argp.h>
+
+#include "memlog.h"
+
+// ====================================================================
+// Memory access log query tool
+// ====================================================================
+
+// Filters a binary memory access log (written by decode6502 --mem-log)
+// and prints the matching accesses in the same Rd:/Wr: format as the
+// decoder's own memory access logging.
+
+const char *argp_program_version = "memquery 0.1";
+
+static char doc[] = "\n\
+Prints the accesses in a binary memory access log (written by decode6502\n\
+--mem-log=FILE) that match all of the given filters.\n\
+\n\
+The --type= value is a hex nibble with the same semantics as those of the\n\
+decode6502 --mem= option:\n\
+ - bit 3 selects stack accesses\n\
+ - bit 2 selects data accesses\n\
+ - bit 1 selects pointer accesses\n\
+ - bit 0 selects instruction accesses\n\
+\n\
+Each access is stamped with the bus cycle count of its instruction, which\n\
+--cycles= selects on. Add --show-cycle to prefix each access with it.\n\
+\n\
+Examples:\n\
+ memquery --range=FE30 --writes mem.log     (paged ROM selection)\n\
+ memquery --range=0100,01FF --type=8 mem.log (stack accesses)\n";
+
+static char args_doc[] = "FILENAME";
+
+enum {
+   KEY_RANGE = 'a',
+   KEY_TYPE = 't',
+   KEY_CYCLES = 'y',
+   KEY_READS = 'r',
+   KEY_WRITES = 'w',
+   KEY_SHOW_CYCLE = 'c'
+};
+
+static struct argp_option options[] = {
+   { "range",      KEY_RANGE,      "LOW,HIGH",    0, "Select addresses from LOW to HIGH (hex, inclusive)"},
+   { "type",       KEY_TYPE,       "HEX",         0, "Select access types (see above, default F)"},
+   { "cycles",     KEY_CYCLES,     "FIRST,LAST",  0, "Select bus cycles from FIRST to LAST (inclusive)"},
+   { "reads",      KEY_READS,      0,             0, "Select reads only"},
+   { "writes",     KEY_WRITES,     0,             0, "Select writes only"},
+   { "show-cycle", KEY_SHOW_CYCLE, 0,             0, "Prefix each access with its bus cycle count"},
+   { 0 }
+};
+
+typedef struct {
+   int low;
+   int high;
+   int types;
+   int64_t first;
+   int64_t last;
+   int reads;
+   int writes;
+   int show_cycle;
+   char *filename;
+} query_arguments_t;
+
+// Parse a whole number, returning -1 if there is anything else in the string
+static int parse_number(const char *arg, const char *end_char, int base, int64_t *value) {
+   char *end;
+   *value = strtoll(arg, &end, base);
+   if (end == arg || (*end && end != end_char)) {
+      return -1;
+   }
+   return 0;
+}
+
+// Parse "LOW[,HIGH]", where a missing HIGH is the same as LOW
+static int parse_range(char *arg, int base, int64_t *low, int64_t *high) {
+   char *comma = strchr(arg, ',');
+   if (parse_number(arg, comma, base, low) < 0) {
+      return -1;
+   }
+   if (!comma) {
+      *high = *low;
+      return 0;
+   }
+   return parse_number(comma + 1, NULL, base, high);
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+   query_arguments_t *arguments = state->input;
+   int64_t low;
+   int64_t high;
+   switch (key) {
+   case KEY_RANGE:
+      if (parse_range(arg, 16, &low, &high) < 0) {
+         argp_error(state, "invalid address range: %s", arg);
+      }
+      arguments->low = low;
+      arguments->high = high;
+      break;
+   case KEY_TYPE:
+      if (parse_number(arg, NULL, 16, &low) < 0) {
+         argp_error(state, "invalid access type mask: %s", arg);
+      }
+      arguments->types = low & 0x0f;
+      break;
+   case KEY_CYCLES:
+      if (parse_range(arg, 10, &arguments->first, &arguments->last) < 0) {
+         argp_error(state, "invalid cycle range: %s", arg);
+      }
+      break;
+   case KEY_READS:
+      arguments->writes = 0;
+      break;
+   case KEY_WRITES:
+      arguments->reads = 0;
+      break;
+   case KEY_SHOW_CYCLE:
+      arguments->show_cycle = 1;
+      break;
+   case ARGP_KEY_ARG:
+      if (state->arg_num > 0) {
+         argp_usage(state);
+      }
+      arguments->filename = arg;
+      break;
+   case ARGP_KEY_END:
+      if (!arguments->filename) {
+         argp_usage(state);
+      }
+      break;
+   default:
+      return ARGP_ERR_UNKNOWN;
+   }
+   return 0;
+}
+
+static struct argp argp = {options, parse_opt, args_doc, doc, 0, 0, 0};
+
+static query_arguments_t arguments;
+
+static int matches(const memlog_record_t *record) {
+   int write = (record->flags & MEMLOG_WRITE) != 0;
+   return record->ea >= arguments.low && record->ea <= arguments.high &&
+      (arguments.types & (1 << (record->flags & MEMLOG_TYPE_MASK))) &&
+      record->cycle >= arguments.first && record->cycle <= arguments.last &&
+      (write ? arguments.writes : arguments.reads);
+}
+
+int main(int argc, char *argv[]) {
+   arguments.low        = 0;
+   arguments.high       = 0xffffff;
+   arguments.types      = 0x0f;
+   arguments.first      = 0;
+   arguments.last       = UINT32_MAX;
+   arguments.reads      = 1;
+   arguments.writes     = 1;
+   arguments.show_cycle = 0;
+   arguments.filename   = NULL;
+
+   argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+   int addr_digits;
+   if (memlog_open(arguments.filename, &addr_digits) < 0) {
+      fprintf(stderr, "%s is not a memory access log\n", arguments.filename);
+      return 1;
+   }
+
+   memlog_record_t record;
+   while (memlog_read(&record)) {
+      if (!matches(&record)) {
+         continue;
+      }
+      if (arguments.show_cycle) {
+         printf("%10" PRIu32 " ", record.cycle);
+      }
+      printf("%s%c%c%0*X = %02X%s\n",
+             (record.flags & MEMLOG_WRITE) ? "Wr: " : "Rd: ",
+             record.bank_id[0], record.bank_id[1],
+             addr_digits, record.ea, record.data,
+             (record.flags & MEMLOG_IGNORED) ? " (ignored)" : "");
+   }
+
+   memlog_close();
+   return 0;
+}
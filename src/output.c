@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "output.h"
+#include "spsc_queue.h"
+#include "stats.h"
+
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif
+
+#define OUTPUT_BUFFER_SIZE (4 << 20)
+
+// Longest line written by output_printf()
+#define MAX_LINE 4096
+
+// Alignment of the buffers, and of the writes when using O_DIRECT
+#define ALIGNMENT 4096
+
+typedef struct {
+   char  *data;
+   size_t num;
+} output_buffer_t;
+
+static output_buffer_t *current = NULL;
+
+// Number of bytes in the buffers already handed to write()
+static int64_t written = 0;
+
+static int direct = 0;
+
+static char *alloc_data() {
+   void *data;
+#ifdef _WIN32
+   data = malloc(OUTPUT_BUFFER_SIZE);
+#else
+   if (posix_memalign(&data, ALIGNMENT, OUTPUT_BUFFER_SIZE)) {
+      data = NULL;
+   }
+#endif
+   if (!data) {
+      fprintf(stderr, "failed to allocate output buffer\n");
+      exit(2);
+   }
+   return (char *) data;
+}
+
+static void set_direct(int on) {
+#ifdef O_DIRECT
+   int flags = fcntl(STDOUT_FILENO, F_GETFL);
+   fcntl(STDOUT_FILENO, F_SETFL, on ? (flags | O_DIRECT) : (flags & ~O_DIRECT));
+#endif
+   direct = on;
+}
+
+static void count_lines(const char *data, size_t n) {
+   const char *end = data + n;
+   uint64_t lines = 0;
+   while ((data = memchr(data, '\n', end - data)) != NULL) {
+      data++;
+      lines++;
+   }
+   stats_add(STAT_LINES, lines);
+}
+
+static void write_all(const char *data, size_t n) {
+   uint64_t t = stats_start();
+   if (stats_enabled) {
+      count_lines(data, n);
+   }
+#ifdef _WIN32
+   fwrite(data, 1, n, stdout);
+   fflush(stdout);
+#else
+   while (n > 0) {
+      ssize_t ret = write(STDOUT_FILENO, data, n);
+      if (ret < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         if (errno == EINVAL && direct) {
+            // O_DIRECT is not supported by this file system
+            set_direct(0);
+            continue;
+         }
+         perror("failed to write output");
+         exit(2);
+      }
+      data += ret;
+      n -= ret;
+   }
+#endif
+   stats_stop(TIMER_WRITE, t);
+}
+
+#ifdef HAVE_THREADS
+
+// ==================================================
+// Writer thread
+// ==================================================
+
+// A pool of buffers circulates between the decoder and the writer
+// thread, as for the reader thread in capture.c.
+
+#define NUM_OUTPUT_BUFFERS 4
+
+static output_buffer_t *write_pool = NULL;
+static spsc_queue_t *full_q;
+static spsc_queue_t *free_q;
+static pthread_t writer;
+
+static void *writer_thread(void *arg) {
+   output_buffer_t *ob;
+   while ((ob = spsc_queue_pop(full_q)) != NULL) {
+      write_all(ob->data, ob->num);
+      spsc_queue_push(free_q, ob);
+   }
+   return NULL;
+}
+
+// Wait for the writer thread to finish with all the buffers
+static void drain_thread() {
+   output_buffer_t *ob[NUM_OUTPUT_BUFFERS];
+   for (int i = 0; i < NUM_OUTPUT_BUFFERS - 1; i++) {
+      ob[i] = spsc_queue_pop(free_q);
+   }
+   for (int i = 0; i < NUM_OUTPUT_BUFFERS - 1; i++) {
+      spsc_queue_push(free_q, ob[i]);
+   }
+}
+
+int output_start_thread() {
+   if (write_pool) {
+      return 0;
+   }
+   output_reserve(0);
+   write_pool = (output_buffer_t *)malloc(NUM_OUTPUT_BUFFERS * sizeof(output_buffer_t));
+   full_q = spsc_queue_create();
+   free_q = spsc_queue_create();
+   // The current buffer becomes the first of the pool
+   write_pool[0] = *current;
+   for (int i = 1; i < NUM_OUTPUT_BUFFERS; i++) {
+      write_pool[i].data = alloc_data();
+      write_pool[i].num = 0;
+      spsc_queue_push(free_q, write_pool + i);
+   }
+   free(current);
+   current = write_pool;
+   if (pthread_create(&writer, NULL, writer_thread, NULL)) {
+      // Carry on with just the current buffer
+      output_buffer_t *ob = (output_buffer_t *)malloc(sizeof(output_buffer_t));
+      *ob = *current;
+      current = ob;
+      for (int i = 1; i < NUM_OUTPUT_BUFFERS; i++) {
+         free(write_pool[i].data);
+      }
+      free(write_pool);
+      write_pool = NULL;
+      spsc_queue_destroy(full_q);
+      spsc_queue_destroy(free_q);
+      return -1;
+   }
+   return 0;
+}
+
+static void stop_thread() {
+   spsc_queue_push(full_q, NULL);
+   pthread_join(writer, NULL);
+   // Keep the current buffer for any further output
+   output_buffer_t *ob = (output_buffer_t *)malloc(sizeof(output_buffer_t));
+   *ob = *current;
+   for (int i = 0; i < NUM_OUTPUT_BUFFERS; i++) {
+      if (write_pool + i != current) {
+         free(write_pool[i].data);
+      }
+   }
+   free(write_pool);
+   write_pool = NULL;
+   current = ob;
+   spsc_queue_destroy(full_q);
+   spsc_queue_destroy(free_q);
+}
+
+#else
+
+int output_start_thread() {
+   return -1;
+}
+
+#endif
+
+// ==================================================
+// Buffering
+// ==================================================
+
+// Hand the current buffer over to be written. With O_DIRECT only whole
+// blocks are written, and the remainder is carried over into the next
+// buffer, unless this is the final write.
+static void handoff(int final) {
+   size_t n = current->num;
+   size_t keep = 0;
+   if (direct) {
+      if (final) {
+         set_direct(0);
+      } else {
+         keep = n & (ALIGNMENT - 1);
+      }
+   }
+   output_buffer_t *next = current;
+#ifdef HAVE_THREADS
+   if (write_pool) {
+      current->num = n - keep;
+      spsc_queue_push(full_q, current);
+      next = spsc_queue_pop(free_q);
+      if (keep) {
+         memcpy(next->data, current->data + n - keep, keep);
+      }
+   } else
+#endif
+   {
+      write_all(current->data, n - keep);
+      if (keep) {
+         memmove(current->data, current->data + n - keep, keep);
+      }
+   }
+   written += n - keep;
+   current = next;
+   current->num = keep;
+}
+
+char *output_reserve(int n) {
+   if (!current) {
+      current = (output_buffer_t *)malloc(sizeof(output_buffer_t));
+      current->data = alloc_data();
+      current->num = 0;
+   }
+   if (current->num + n > OUTPUT_BUFFER_SIZE) {
+      handoff(0);
+   }
+   return current->data + current->num;
+}
+
+void output_commit(char *end) {
+   current->num = end - current->data;
+}
+
+void output_puts(const char *s) {
+   output_write(s, strlen(s));
+   char *bp = output_reserve(1);
+   *bp++ = '\n';
+   output_commit(bp);
+}
+
+void output_printf(const char *fmt, ...) {
+   va_list ap;
+   char *bp = output_reserve(MAX_LINE);
+   va_start(ap, fmt);
+   int n = vsnprintf(bp, MAX_LINE, fmt, ap);
+   va_end(ap);
+   if (n < 0) {
+      n = 0;
+   } else if (n >= MAX_LINE) {
+      n = MAX_LINE - 1;
+   }
+   output_commit(bp + n);
+}
+
+void output_write(const void *data, size_t n) {
+   const char *p = (const char *) data;
+   while (n > 0) {
+      char *bp = output_reserve(0);
+      size_t space = OUTPUT_BUFFER_SIZE - current->num;
+      if (space == 0) {
+         handoff(0);
+         continue;
+      }
+      size_t len = n < space ? n : space;
+      memcpy(bp, p, len);
+      output_commit(bp + len);
+      p += len;
+      n -= len;
+   }
+}
+
+void output_flush() {
+   if (!current) {
+      return;
+   }
+   handoff(1);
+#ifdef HAVE_THREADS
+   if (write_pool) {
+      drain_thread();
+   }
+#endif
+}
+
+int64_t output_tell() {
+   return written + (current ? current->num : 0);
+}
+
+int output_set_direct() {
+#ifdef O_DIRECT
+   struct stat st;
+   if (fstat(STDOUT_FILENO, &st) < 0 || !S_ISREG(st.st_mode)) {
+      return -1;
+   }
+   // The writes must start on a block boundary
+   if (lseek(STDOUT_FILENO, 0, SEEK_CUR) & (ALIGNMENT - 1)) {
+      return -1;
+   }
+   set_direct(1);
+   return 0;
+#else
+   return -1;
+#endif
+}
+
+void output_close() {
+   output_flush();
+#ifdef HAVE_THREADS
+   if (write_pool) {
+      stop_thread();
+   }
+#endif
+}
@@ -0,0 +1,44 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+// All the text output to stdout goes through a single large buffer, so
+// that it is written with a few big write() calls rather than one stdio
+// call per line, and everything stays in order.
+
+// Return a pointer to at least n bytes of free space in the buffer. Any
+// text written there is output once output_commit() is called with the
+// end of the text.
+char *output_reserve(int n);
+
+void output_commit(char *end);
+
+// Output a string, followed by a newline (like puts)
+void output_puts(const char *s);
+
+void output_printf(const char *fmt, ...);
+
+void output_write(const void *data, size_t n);
+
+// Write out everything buffered so far
+void output_flush();
+
+// Return the number of bytes output so far (including any still buffered)
+int64_t output_tell();
+
+// Bypass the page cache when stdout is a file (where O_DIRECT is available).
+//
+// Returns 0 on success, or -1 if not supported.
+int output_set_direct();
+
+// Move writing onto a separate thread, so it overlaps with decoding.
+//
+// Returns 0 on success, or -1 if threads are not available.
+int output_start_thread();
+
+// Flush, and stop any writer thread
+void output_close();
+
+#endif
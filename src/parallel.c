@@ -0,0 +1,637 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "parallel.h"
+#include "memory.h"
+#include "output.h"
+
+#ifdef HAVE_FORK
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Each worker starts decoding at the beginning of its chunk with an
+// unknown register state (as if after a reset), and records its state
+// at the start of its first MAX_SYNC_POINTS instructions. When a worker
+// reaches the end of its chunk it carries on decoding, comparing its
+// own state with the state recorded by the next worker at the same
+// sample. Once these are identical the two decodes produce the same
+// output from then on, so the worker stops, and the output is stitched
+// together at that point.
+//
+// The next worker built its memory model from scratch, so it knows
+// less than this worker, and it may have learnt the wrong value of a
+// byte (e.g. while the paging latches were unknown). So as well as the
+// registers, the bytes the next worker has learnt (which it publishes
+// along with its sync points) must have the same values in this
+// worker's memory model. That leaves the bytes that this worker knows
+// and the next one doesn't: a read of one of those with a different
+// value would be a failure in the serial decode, but not in the next
+// worker. So the workers also log the bytes they learn by reading, and
+// once they have all finished these are checked against the memory
+// model at each join. If any would have failed, the parallel decode is
+// abandoned and the capture is decoded serially.
+//
+// If there is no match amongst the sync points of the next worker, the
+// output of that worker is discarded and the one after is tried. A
+// worker whose output is discarded by all the workers before it stops,
+// so in the worst case (e.g. no sync signal) this takes about as long
+// as a serial decode.
+//
+// The stack pointer is a problem, because the emulators only learn it
+// from instructions like TXS, which may never be seen after the start
+// of a capture. So the decode is preceded by a probe, where each chunk
+// (other than the first) is emulated without output starting from an
+// arbitrary stack pointer, and the joins are made on the rest of the
+// state. The stack pointer offsets at the joins then give the correct
+// initial stack pointer of each chunk for the real decode. The paging
+// latches are similar, as a chunk may never write them, so the probe
+// only compares the latches the next worker has written, and the rest
+// give its initial latches. The probe ignores the memory models, which
+// are wrong until the latches are known.
+
+#define MAX_SYNC_POINTS 65536
+
+#define MAX_LEARNT (1 << 20)
+
+#define STATE_SIZE 128
+
+#define COPY_SIZE 65536
+
+// How often (in instructions) a worker checks if its output is discarded
+#define DISCARD_CHECK_INTERVAL 1024
+
+// Initial stack pointer of the chunks while probing
+#define PROBE_SP 0x1FF
+
+typedef struct {
+   int64_t  sample;
+   int      pc;
+   int      pb;
+   int      hidden;
+   int      latches;
+   int      written;        // the latches written since the start of the chunk
+   uint64_t mem_hash;
+   off_t    offset;         // offset of the instruction in the worker's output
+   char     state[STATE_SIZE];
+} sync_point_t;
+
+// A byte of the memory model that a worker learnt, during the
+// instruction at sample
+typedef struct {
+   int64_t sample;
+   int     index;
+} learnt_t;
+
+// A byte that a worker learnt by reading it, as logged for the check
+// once the workers have finished
+typedef struct {
+   int64_t sample;
+   int32_t index;
+   int32_t data;
+} learnt_read_t;
+
+typedef struct {
+   int64_t    start;        // sample count of the first sample of the chunk
+   int        sp;           // initial stack pointer, or -1 if unknown
+   int        latches;      // initial paging latches, or -1 if unknown
+   pid_t      pid;
+   FILE      *output;
+   FILE      *model;        // the memory model at the join
+   FILE      *reads;        // the bytes learnt by reading (learnt_read_t)
+   atomic_int num_points;   // number of sync points published so far
+   atomic_int num_learnt;   // number of learnt bytes published so far
+   atomic_int done;         // set when no more sync points will be published
+   atomic_int target;       // the worker whose sync points are being compared
+   atomic_int finished;     // set when the worker has stopped
+   int        join;         // the worker that this one joined, or -1 if none
+   int64_t    join_sample;  // sample count of the join
+   off_t      cut;          // offset of the join in this worker's output
+   off_t      resume;       // offset of the join in the joined worker's output
+   int        sp_offset;    // stack pointer of this worker less that of the joined worker
+   int        sp_mask;
+   int        join_latches; // paging latches at the join
+   int        join_written; // the latches this worker had written by the join
+   sync_point_t point[MAX_SYNC_POINTS];
+   learnt_t   learnt[MAX_LEARNT];
+} worker_t;
+
+// Shared between all the processes
+static worker_t *workers;
+static int num_workers;
+static int probing;
+static int serial;          // set when decoding the whole capture in the first worker
+
+static cpu_emulator_t *em;
+static memory_t *mem;
+
+// State of the current worker process
+static worker_t *self;
+static int recording;
+static int target;          // the worker whose sync points are being compared
+static int cursor;          // the next of the target's sync points to compare
+static int learnt_cursor;   // the next of the target's learnt bytes to track
+static int64_t last_sample; // the (64-bit) sample count of the last sync point
+static int64_t output_base; // the output position at the start of the worker
+static int discard_check;
+
+// ==================================================
+// Worker
+// ==================================================
+
+static void get_sync_point(sync_point_t *sp, void *cpu, int64_t sample) {
+   sp->sample   = sample;
+   sp->pc       = em->get_PC(cpu);
+   sp->pb       = em->get_PB(cpu);
+   sp->hidden   = em->get_hidden_state ? em->get_hidden_state(cpu) : 0;
+   sp->latches  = memory_get_latches(mem);
+   sp->written  = memory_get_written_latches(mem);
+   sp->mem_hash = memory_get_hash(mem);
+   sp->offset   = self->output ? output_tell() - output_base : 0;
+   *em->get_state(cpu, sp->state) = 0;
+}
+
+// Locate the stack pointer field of a state, returning its value (or
+// -1 if unknown)
+static int parse_sp(const char *state, int *pos, int *len) {
+   const char *p = strstr(state, "SP=");
+   if (!p) {
+      *pos = strlen(state);
+      *len = 0;
+      return -1;
+   }
+   p += 3;
+   *pos = p - state;
+   *len = strspn(p, "0123456789ABCDEF?");
+   if (memchr(p, '?', *len)) {
+      return -1;
+   }
+   return strtol(p, NULL, 16);
+}
+
+// Compare two states, ignoring the stack pointer
+static int match_except_sp(const char *a, const char *b, int *offset, int *mask) {
+   int pos_a, len_a, pos_b, len_b;
+   int sp_a = parse_sp(a, &pos_a, &len_a);
+   int sp_b = parse_sp(b, &pos_b, &len_b);
+   if (pos_a != pos_b || len_a != len_b || strncmp(a, b, pos_a) || strcmp(a + pos_a + len_a, b + pos_b + len_b)) {
+      return 0;
+   }
+   if (sp_a >= 0 && sp_b < 0) {
+      // The target has lost its stack pointer
+      return 0;
+   }
+   *mask = (1 << (4 * len_a)) - 1;
+   *offset = (sp_a < 0) ? -1 : ((sp_a - sp_b) & *mask);
+   return 1;
+}
+
+static void finish_worker() {
+   output_flush();
+   if (self->reads) {
+      fflush(self->reads);
+   }
+   atomic_store(&self->done, 1);
+   atomic_store(&self->finished, 1);
+   _exit(0);
+}
+
+static void stop_recording() {
+   recording = 0;
+   atomic_store(&self->done, 1);
+}
+
+// Called by the memory model when a byte becomes known
+static void learnt(int i, int data, int read) {
+   if (recording) {
+      int num = atomic_load_explicit(&self->num_learnt, memory_order_relaxed);
+      if (num == MAX_LEARNT) {
+         stop_recording();
+      } else {
+         self->learnt[num].sample = last_sample;
+         self->learnt[num].index  = i;
+         atomic_store_explicit(&self->num_learnt, num + 1, memory_order_release);
+      }
+   }
+   if (read && self->reads) {
+      learnt_read_t record = { last_sample, i, data };
+      fwrite(&record, sizeof(record), 1, self->reads);
+   }
+}
+
+// Returns 1 if no worker before this one can still join it, so its
+// output will not be used
+static int is_discarded() {
+   int index = self - workers;
+   for (int i = 0; i < index; i++) {
+      worker_t *w = workers + i;
+      if (atomic_load(&w->finished)) {
+         if (w->join == index) {
+            return 0;
+         }
+      } else if (atomic_load(&w->target) <= index) {
+         return 0;
+      }
+   }
+   return index > 0;
+}
+
+static void set_target(int index) {
+   target = index;
+   cursor = 0;
+   learnt_cursor = 0;
+   atomic_store(&self->target, target);
+   memory_untrack_all(mem);
+}
+
+// Returns the first of the target's sync points at or after sample, or
+// NULL if it has none
+static sync_point_t *next_sync_point(worker_t *w, int64_t sample) {
+   while (1) {
+      int num = atomic_load_explicit(&w->num_points, memory_order_acquire);
+      while (cursor < num) {
+         if (w->point[cursor].sample >= sample) {
+            return w->point + cursor;
+         }
+         cursor++;
+      }
+      if (atomic_load_explicit(&w->done, memory_order_acquire)) {
+         // Check again, in case a sync point was published just before done
+         if (cursor >= atomic_load_explicit(&w->num_points, memory_order_acquire)) {
+            return NULL;
+         }
+      } else {
+         // The target is still working through the start of its chunk
+         sched_yield();
+      }
+   }
+}
+
+// Track the bytes the target had learnt before the instruction at sample
+// (which were all published before its sync point at sample)
+static void track_learnt(worker_t *w, int64_t sample) {
+   int num = atomic_load_explicit(&w->num_learnt, memory_order_acquire);
+   while (learnt_cursor < num && w->learnt[learnt_cursor].sample < sample) {
+      memory_track(mem, w->learnt[learnt_cursor].index);
+      learnt_cursor++;
+   }
+}
+
+void parallel_sync_point(void *cpu, memory_t *m, uint32_t sample_count) {
+   // Extend the sample count to 64 bits (it only ever increases)
+   int64_t sample = last_sample + (uint32_t)(sample_count - (uint32_t)last_sample);
+   last_sample = sample;
+
+   // Publish the sync points at the start of this chunk
+   if (recording) {
+      int num = atomic_load_explicit(&self->num_points, memory_order_relaxed);
+      get_sync_point(self->point + num, cpu, sample);
+      atomic_store_explicit(&self->num_points, num + 1, memory_order_release);
+      if (num + 1 == MAX_SYNC_POINTS) {
+         stop_recording();
+      }
+   }
+
+   if (++discard_check == DISCARD_CHECK_INTERVAL) {
+      discard_check = 0;
+      if (is_discarded()) {
+         finish_worker();
+      }
+   }
+
+   // Once into a later chunk, look for a matching sync point
+   while (target < num_workers && sample >= workers[target].start) {
+      worker_t *w = workers + target;
+      sync_point_t *sp = next_sync_point(w, sample);
+      if (!sp) {
+         // No match in this chunk, so try the next one
+         set_target(target + 1);
+         continue;
+      }
+      if (sp->sample == sample) {
+         sync_point_t own;
+         track_learnt(w, sample);
+         get_sync_point(&own, cpu, sample);
+         own.mem_hash = memory_get_tracked_hash(mem);
+         if (own.pc == sp->pc && own.pb == sp->pb && own.hidden == sp->hidden) {
+            int match;
+            if (probing) {
+               match = !((own.latches ^ sp->latches) & sp->written) &&
+                  match_except_sp(own.state, sp->state, &self->sp_offset, &self->sp_mask);
+            } else {
+               match = own.latches == sp->latches && own.mem_hash == sp->mem_hash && !strcmp(own.state, sp->state);
+            }
+            if (match) {
+               self->join         = target;
+               self->join_sample  = sample;
+               self->join_latches = own.latches;
+               self->join_written = own.written;
+               self->cut          = own.offset;
+               self->resume       = sp->offset;
+               if (self->model) {
+                  memory_save(mem, self->model);
+                  fflush(self->model);
+               }
+               finish_worker();
+            }
+         }
+      }
+      return;
+   }
+}
+
+static void run_worker(int index, void (*decode_chunk)(int64_t first, int sp, int quiet)) {
+   self          = workers + index;
+   recording     = index > 0;
+   last_sample   = self->start;
+   discard_check = 0;
+   memory_set_hashing(mem, !serial && !probing);
+   memory_set_learnt_callback(mem, (serial || probing) ? NULL : learnt);
+   if (self->latches >= 0) {
+      memory_set_latches(mem, self->latches);
+   }
+   set_target(serial ? num_workers : index + 1);
+   if (!recording) {
+      // Nobody joins the first chunk
+      atomic_store(&self->done, 1);
+   }
+
+   // Redirect stdout to this worker's output file
+   int fd = self->output ? fileno(self->output) : open("/dev/null", O_WRONLY);
+   if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0) {
+      perror("failed to redirect worker output");
+      _exit(2);
+   }
+   output_base = output_tell();
+
+   decode_chunk(self->start - 1, self->sp, probing);
+
+   // Reached the end of the capture
+   finish_worker();
+}
+
+// ==================================================
+// Parent
+// ==================================================
+
+static int wait_for_workers(int num) {
+   int ret = 0;
+   for (int remaining = num; remaining > 0; remaining--) {
+      int status;
+      pid_t pid = wait(&status);
+      if (pid < 0) {
+         return -1;
+      }
+      for (int i = 0; i < num_workers; i++) {
+         if (workers[i].pid == pid) {
+            // Release anyone waiting for this worker, in case it crashed
+            atomic_store(&workers[i].done, 1);
+            atomic_store(&workers[i].finished, 1);
+         }
+      }
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+         ret = -1;
+      }
+   }
+   return ret;
+}
+
+// Run the first num of the workers
+static int run_workers(int num, void (*decode_chunk)(int64_t first, int sp, int quiet)) {
+   for (int i = 0; i < num_workers; i++) {
+      worker_t *w = workers + i;
+      w->join = -1;
+      atomic_store(&w->num_points, 0);
+      atomic_store(&w->num_learnt, 0);
+      atomic_store(&w->done, 0);
+      atomic_store(&w->target, i + 1);
+      atomic_store(&w->finished, i >= num);
+   }
+
+   // Don't let the workers inherit anything still buffered
+   output_flush();
+
+   for (int i = 0; i < num; i++) {
+      pid_t pid = fork();
+      if (pid == 0) {
+         run_worker(i, decode_chunk);
+      } else if (pid < 0) {
+         perror("failed to start worker");
+         for (int j = 0; j < i; j++) {
+            kill(workers[j].pid, SIGKILL);
+         }
+         wait_for_workers(i);
+         return -1;
+      }
+      workers[i].pid = pid;
+   }
+
+   if (wait_for_workers(num) < 0) {
+      fprintf(stderr, "parallel decode worker failed\n");
+      return -1;
+   }
+   return 0;
+}
+
+// Follow the chain of joins from the first chunk, working out the
+// initial stack pointer and paging latches of each chunk from the
+// probe. Any wrong guesses here just mean the joins of the decode are
+// found later.
+static void propagate_state() {
+   for (int i = 1; i < num_workers; i++) {
+      workers[i].sp = -1;
+      workers[i].latches = -1;
+   }
+   // The latches the first chunk starts with
+   int latches = memory_get_latches(mem);
+   // The correction to the stack pointer of the current worker's probe
+   int offset = 0;
+   int i = 0;
+   while (workers[i].join >= 0) {
+      worker_t *w = workers + i;
+      worker_t *next = workers + w->join;
+      // The latches not written in this chunk before the join are those
+      // it started with
+      latches = (w->join_latches & w->join_written) | (latches & ~w->join_written);
+      next->latches = latches;
+      if (w->sp_offset < 0) {
+         // The stack pointer was not known at the join, so the next chunk
+         // starts without it (and will hopefully load it before its join)
+         offset = 0;
+      } else {
+         offset = (offset + w->sp_offset) & w->sp_mask;
+         next->sp = (PROBE_SP + offset) & 0xffff;
+      }
+      i = w->join;
+   }
+}
+
+// Check that none of the bytes learnt by reading after each join would
+// have failed against the memory model of the serial decode. At each
+// join that is the model of the worker that joined, merged over the
+// model at the previous join (for the bytes it never saw).
+static int check_joins() {
+   int i = 0;
+   while (workers[i].join >= 0) {
+      worker_t *w = workers + i;
+      worker_t *next = workers + w->join;
+      rewind(w->model);
+      if (memory_merge(mem, w->model) < 0) {
+         return -1;
+      }
+      int64_t end = next->join >= 0 ? next->join_sample : INT64_MAX;
+      learnt_read_t record;
+      rewind(next->reads);
+      while (fread(&record, sizeof(record), 1, next->reads) == 1) {
+         if (record.sample >= w->join_sample && record.sample < end) {
+            int data = memory_get_shadow(mem, record.index);
+            if (data >= 0 && data != record.data) {
+               return -1;
+            }
+         }
+      }
+      i = w->join;
+   }
+   return 0;
+}
+
+// The check changes the memory model, so it is done in a child process
+static int check_joins_in_child() {
+   pid_t pid = fork();
+   if (pid == 0) {
+      _exit(check_joins() < 0 ? 1 : 0);
+   } else if (pid < 0) {
+      return -1;
+   }
+   int status;
+   if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+      return -1;
+   }
+   return WEXITSTATUS(status) ? -1 : 0;
+}
+
+static void copy_output(FILE *f, off_t from, off_t to) {
+   char buffer[COPY_SIZE];
+   fseeko(f, from, SEEK_SET);
+   while (to < 0 || from < to) {
+      size_t n = COPY_SIZE;
+      if (to >= 0 && to - from < (off_t) n) {
+         n = to - from;
+      }
+      n = fread(buffer, 1, n, f);
+      if (n == 0) {
+         break;
+      }
+      output_write(buffer, n);
+      from += n;
+   }
+}
+
+static int open_files(worker_t *w) {
+   w->output = tmpfile();
+   w->model  = tmpfile();
+   w->reads  = tmpfile();
+   if (!w->output || !w->model || !w->reads) {
+      perror("failed to create worker output file");
+      return -1;
+   }
+   return 0;
+}
+
+static void close_files(worker_t *w) {
+   FILE **files[] = { &w->output, &w->model, &w->reads };
+   for (int i = 0; i < 3; i++) {
+      if (*files[i]) {
+         fclose(*files[i]);
+         *files[i] = NULL;
+      }
+   }
+}
+
+int parallel_decode(int n, int64_t num_samples, int sp, cpu_emulator_t *emulator, memory_t *memory, void (*decode_chunk)(int64_t first, int sp, int quiet)) {
+   em = emulator;
+   mem = memory;
+   num_workers = n;
+   size_t size = num_workers * sizeof(worker_t);
+   void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (base == MAP_FAILED) {
+      perror("failed to allocate shared memory");
+      return -1;
+   }
+   workers = (worker_t *) base;
+
+   for (int i = 0; i < num_workers; i++) {
+      worker_t *w = workers + i;
+      w->start = 1 + num_samples * i / num_workers;
+      w->sp = (i == 0) ? sp : PROBE_SP;
+      w->latches = -1;
+      w->output = NULL;
+      w->model = NULL;
+      w->reads = NULL;
+      atomic_init(&w->num_points, 0);
+      atomic_init(&w->num_learnt, 0);
+      atomic_init(&w->done, 0);
+      atomic_init(&w->target, 0);
+      atomic_init(&w->finished, 0);
+   }
+
+   // Probe for the initial stack pointer of each chunk
+   probing = 1;
+   serial = 0;
+   int ret = run_workers(num_workers, decode_chunk);
+
+   if (ret == 0) {
+      propagate_state();
+      for (int i = 0; i < num_workers && ret == 0; i++) {
+         ret = open_files(workers + i);
+      }
+   }
+
+   // Decode each chunk for real
+   if (ret == 0) {
+      probing = 0;
+      ret = run_workers(num_workers, decode_chunk);
+   }
+
+   // Otherwise decode the whole capture in the first worker
+   if (ret == 0 && check_joins_in_child() < 0) {
+      serial = 1;
+      close_files(workers);
+      ret = open_files(workers);
+      if (ret == 0) {
+         ret = run_workers(1, decode_chunk);
+      }
+   }
+
+   // Stitch together the output of the workers
+   if (ret == 0) {
+      int i = 0;
+      off_t from = 0;
+      while (1) {
+         worker_t *w = workers + i;
+         if (w->join < 0) {
+            copy_output(w->output, from, -1);
+            break;
+         }
+         copy_output(w->output, from, w->cut);
+         from = w->resume;
+         i = w->join;
+      }
+   }
+
+   for (int i = 0; i < num_workers; i++) {
+      close_files(workers + i);
+   }
+   munmap(base, size);
+   return ret;
+}
+
+#endif
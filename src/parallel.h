@@ -0,0 +1,35 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <inttypes.h>
+
+#include "defs.h"
+
+// Worker processes (fork and shared memory) are not available in the MSVC build
+#ifndef _WIN32
+#define HAVE_FORK
+#endif
+
+#ifdef HAVE_FORK
+
+// Split the num_samples samples of the capture into num_workers chunks,
+// and decode each chunk in a separate process by calling decode_chunk()
+// with the offset of its first sample and its initial stack pointer
+// (sp for the first chunk). When quiet is set only the emulation is
+// needed. The output of the workers is then stitched together and
+// written to stdout. The workers compare their memory models (mem) at
+// the joins, and if that cannot be done exactly the capture is decoded
+// serially in a single worker instead.
+//
+// Returns 0 on success, or -1 on failure.
+int parallel_decode(int num_workers, int64_t num_samples, int sp, cpu_emulator_t *em, memory_t *mem, void (*decode_chunk)(int64_t first, int sp, int quiet));
+
+// Called by the decoder in a worker at the start of each instruction,
+// where the decoder has no state other than that of the emulator (cpu)
+// and its memory model. This does not return if the worker has caught
+// up with the next chunk.
+void parallel_sync_point(void *cpu, memory_t *mem, uint32_t sample_count);
+
+#endif
+
+#endif
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
 
@@ -7,11 +8,16 @@
 extern profiler_t *profiler_instr_create(char *arg);
 extern profiler_t *profiler_block_create(char *arg);
 extern profiler_t *profiler_call_create(char *arg);
+extern profiler_t *profiler_mem_create(char *arg);
 
 #define MAX_PROFILERS 10
 
 static profiler_t *active_list[MAX_PROFILERS] = { NULL } ;
 
+// The counters of the active profiler that counts memory accesses (only
+// one, as the memory model updates them directly)
+static mem_counters_t *memory_counters = NULL;
+
 void profiler_parse_opt(int key, char *arg, struct argp_state *state) {
 static int active_count = 0;
    switch (key) {
@@ -27,6 +33,14 @@ static int active_count = 0;
             instance = profiler_block_create(rest);
          } else if (stricmp(type, "call") == 0) {
             instance = profiler_call_create(rest);
+         } else if (stricmp(type, "mem") == 0) {
+            instance = profiler_mem_create(rest);
+         }
+         if (instance && instance->counters) {
+            if (memory_counters) {
+               argp_error(state, "only one memory profiler can be used");
+            }
+            memory_counters = instance->counters;
          }
          if (instance) {
             active_list[active_count++] = instance;
@@ -39,10 +53,10 @@ static int active_count = 0;
    }
 }
 
-void profiler_init(cpu_emulator_t *em) {
+void profiler_init(cpu_emulator_t *em, void *cpu) {
    profiler_t **pp = active_list;
    while (*pp) {
-      (*pp)->init(*pp, em);
+      (*pp)->init(*pp, em, cpu);
       pp++;
    }
 }
@@ -55,6 +69,10 @@ void profiler_profile_instruction(int pc, int opcode, int op1, int op2, int num_
    }
 }
 
+mem_counters_t *profiler_memory_counters() {
+   return memory_counters;
+}
+
 void profiler_done() {
    profiler_t **pp = active_list;
    while (*pp) {
@@ -66,7 +84,46 @@ void profiler_done() {
    }
 }
 
-void profiler_output_helper(address_t *profile_counts, int show_bars, int show_other, cpu_emulator_t *em) {
+// Each profiler's state is preceded by its name and arguments, so a
+// different set of profilers is detected
+void profiler_save(FILE *fp) {
+   profiler_t **pp = active_list;
+   while (*pp) {
+      fprintf(fp, "%s,%s", (*pp)->name, (*pp)->arg);
+      fputc(0, fp);
+      (*pp)->save(*pp, fp);
+      pp++;
+   }
+   fputc(0, fp);
+}
+
+int profiler_restore(FILE *fp) {
+   profiler_t **pp = active_list;
+   char saved[256];
+   char expected[256];
+   do {
+      int i = 0;
+      int c;
+      while ((c = fgetc(fp)) > 0 && i < (int) sizeof(saved) - 1) {
+         saved[i++] = c;
+      }
+      saved[i] = 0;
+      if (c == EOF) {
+         return -1;
+      }
+      if (!*pp) {
+         // The list of profilers ends with an empty name
+         return i ? -1 : 0;
+      }
+      snprintf(expected, sizeof(expected), "%s,%s", (*pp)->name, (*pp)->arg);
+      if (strcmp(saved, expected) || (*pp)->restore(*pp, fp) < 0) {
+         return -1;
+      }
+      pp++;
+   } while (1);
+}
+
+void profiler_output_helper(address_t *profile_counts, int show_bars, int show_other, cpu_emulator_t *em, void *cpu) {
    address_t      *ptr;
 
    uint32_t   max_cycles = 0;
@@ -87,10 +144,10 @@ void profiler_output_helper(address_t *profile_counts, int show_bars, int show_o
       total_cycles += ptr->cycles;
       total_instr += ptr->instructions;
       if (em && ptr->cycles) {
-         int opcode = em->read_memory(addr);
+         int opcode = em->read_memory(cpu, addr);
          // TODO: BRA (0x80) should only be counted on the C02/C816
          if (((opcode & 0x1f) == 0x10) || (opcode == 0x80)) {
-            int offset = em->read_memory(addr + 1);
+            int offset = em->read_memory(cpu, addr + 1);
             // Is the target in a different page?
             if (((addr + 2) & 0xff00) != ((addr + 2 + (int8_t)offset) & 0xff00)) {
                // A small amount of maths gives us the cycles that could be saved if the branch were in the same page
@@ -119,10 +176,10 @@ void profiler_output_helper(address_t *profile_counts, int show_bars, int show_o
             if (em) {
                instruction_t instruction;
                instruction.pc     = addr;
-               instruction.opcode = em->read_memory(addr);
-               instruction.op1    = em->read_memory(addr + 1);
-               instruction.op2    = em->read_memory(addr + 2);
-               int n = em->disassemble(buffer, &instruction);
+               instruction.opcode = em->read_memory(cpu, addr);
+               instruction.op1    = em->read_memory(cpu, addr + 1);
+               instruction.op2    = em->read_memory(cpu, addr + 2);
+               int n = em->disassemble(cpu, buffer, &instruction);
                printf(" %s", buffer);
                for (int i = n; i < 12; i++) {
                   putchar(' ');
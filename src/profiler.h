@@ -2,9 +2,11 @@
 #define _INCLUDE_PROFILER_H
 
 #include <argp.h>
+#include <stdio.h>
 #include <inttypes.h>
 
 #include "defs.h"
+#include "memory.h"
 
 // Slot for instructions that fall outside the region of interest
 // (don't change this or lots of things will break!)
@@ -37,20 +39,37 @@ typedef struct {
 typedef struct {
    const char *name;
    const char *arg;
-   void                (*init)(void *ptr, cpu_emulator_t *em);
+   void                (*init)(void *ptr, cpu_emulator_t *em, void *cpu);
    void (*profile_instruction)(void *ptr, int pc, int opcode, int op1, int op2, int num_cycles);
+   // Optional, counted directly by the memory model
+   mem_counters_t     *counters;
    void                (*done)(void *ptr);
+   // Save and restore the counters, when resuming a decode (the state is
+   // in the host's byte order, as it is only read back on the same host)
+   void                (*save)(void *ptr, FILE *fp);
+   int              (*restore)(void *ptr, FILE *fp);
 } profiler_t;
 
 // Public methods, called from main program
 
 void profiler_parse_opt(int key, char *arg, struct argp_state *state);
-void profiler_init(cpu_emulator_t *em);
+void profiler_init(cpu_emulator_t *em, void *cpu);
 void profiler_profile_instruction(int pc, int opcode, int op1, int op2, int num_cycles);
 void profiler_done();
 
+// Returns the counters of the active profiler that counts memory
+// accesses (to pass to memory_set_profiling), or NULL if there isn't one
+mem_counters_t *profiler_memory_counters();
+
+// Save the state of all the active profilers, and restore it into the
+// same set of profilers (created with the same options).
+//
+// profiler_restore returns 0 on success, or -1 if the profilers differ.
+void profiler_save(FILE *fp);
+int profiler_restore(FILE *fp);
+
 // Helper methods, for use by profiler implementations
 
-void profiler_output_helper(address_t *profile_counts, int show_bars, int show_other, cpu_emulator_t *em);
+void profiler_output_helper(address_t *profile_counts, int show_bars, int show_other, cpu_emulator_t *em, void *cpu);
 
 #endif
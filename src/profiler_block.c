@@ -12,13 +12,15 @@ typedef struct {
    address_t profile_counts[OTHER_CONTEXT + 1];
    int last_opcode;
    cpu_emulator_t *em;
+   void *cpu;
 } profiler_block_t;
 
-static void p_init(void *ptr, cpu_emulator_t *em) {
+static void p_init(void *ptr, cpu_emulator_t *em, void *cpu) {
    profiler_block_t *instance = (profiler_block_t *)ptr;
    memset((void *)instance->profile_counts, 0, sizeof(instance->profile_counts));
    instance->profile_counts[OTHER_CONTEXT].flags = 1;
    instance->em = em;
+   instance->cpu = cpu;
 }
 
 static void p_profile_instruction(void *ptr, int pc, int opcode, int op1, int op2, int num_cycles) {
@@ -70,7 +72,22 @@ static void p_done(void *ptr) {
       block_counts[current_block].cycles += instance->profile_counts[addr].cycles;
       block_counts[current_block].instructions += instance->profile_counts[addr].instructions;
    }
-   profiler_output_helper(block_counts, 0, 1, instance->em);
+   profiler_output_helper(block_counts, 0, 1, instance->em, instance->cpu);
+}
+
+static void p_save(void *ptr, FILE *fp) {
+   profiler_block_t *instance = (profiler_block_t *)ptr;
+   fwrite(instance->profile_counts, sizeof(instance->profile_counts), 1, fp);
+   fwrite(&instance->last_opcode, sizeof(instance->last_opcode), 1, fp);
+}
+
+static int p_restore(void *ptr, FILE *fp) {
+   profiler_block_t *instance = (profiler_block_t *)ptr;
+   if (fread(instance->profile_counts, sizeof(instance->profile_counts), 1, fp) != 1 ||
+       fread(&instance->last_opcode, sizeof(instance->last_opcode), 1, fp) != 1) {
+      return -1;
+   }
+   return 0;
 }
 
 void *profiler_block_create(char *arg) {
@@ -82,6 +99,8 @@ void *profiler_block_create(char *arg) {
    instance->profiler.init                = p_init;
    instance->profiler.profile_instruction = p_profile_instruction;
    instance->profiler.done                = p_done;
+   instance->profiler.save                = p_save;
+   instance->profiler.restore             = p_restore;
    instance->profile_min                  = 0x0000;
    instance->profile_max                  = 0xffff;
 
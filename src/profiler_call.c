@@ -4,6 +4,7 @@
 #include <inttypes.h>
 
 #include "musl_tsearch.h"
+#include "output.h"
 #include "profiler.h"
 #include "symbols.h"
 
@@ -30,6 +31,7 @@ typedef struct {
    call_stack_t *current;
    int profile_enabled;
    cpu_emulator_t *em;
+   void *cpu;
 } profiler_call_t;
 
 
@@ -60,7 +62,7 @@ static int compare_nodes(const void *av, const void *bv) {
    return ret;
 }
 
-static void p_init(void *ptr, cpu_emulator_t *em) {
+static void p_init(void *ptr, cpu_emulator_t *em, void *cpu) {
    profiler_call_t *instance = (profiler_call_t *)ptr;
    call_stack_t *root_context = (call_stack_t *)malloc(sizeof(call_stack_t));
    root_context->index = 0;
@@ -74,6 +76,7 @@ static void p_init(void *ptr, cpu_emulator_t *em) {
    instance->current = *(call_stack_t **)ttsearch(root_context, &instance->root, compare_nodes);
    instance->profile_enabled = 1;
    instance->em = em;
+   instance->cpu = cpu;
    my_em = em;
 }
 
@@ -88,7 +91,7 @@ static void p_profile_instruction(void *ptr, int pc, int opcode, int op1, int op
       if (instance->current->index < CALL_STACK_SIZE) {
          int addr = (op2 << 8 | op1) & 0xffff;
 #if DEBUG
-         printf("*** pushing %04x to %d\n", addr, current->index);
+         output_printf("*** pushing %04x to %d\n", addr, current->index);
 #endif
          // Create a new child node, in case it's not already in the tree
          call_stack_t *child = (call_stack_t *) malloc(sizeof(call_stack_t));
@@ -105,9 +108,9 @@ static void p_profile_instruction(void *ptr, int pc, int opcode, int op1, int op
          }
          instance->current->call_count++;
       } else {
-         printf("warning: call stack overflowed, disabling further profiling\n");
+         output_printf("warning: call stack overflowed, disabling further profiling\n");
          for (int i = 0; i < instance->current->index; i++) {
-            printf("warning: stack[%3d] = %04x\n", i, instance->current->stack[i]);
+            output_printf("warning: stack[%3d] = %04x\n", i, instance->current->stack[i]);
          }
          instance->profile_enabled = 0;
       }
@@ -115,12 +118,12 @@ static void p_profile_instruction(void *ptr, int pc, int opcode, int op1, int op
    if (opcode == 0x60) {
       if (instance->current->parent) {
 #if DEBUG
-         printf("*** popping %d\n", current->index);
+         output_printf("*** popping %d\n", current->index);
 #endif
          instance->current = instance->current->parent;
       } else {
-         printf("warning: call stack underflowed, re-initialize call graph\n");
-         p_init(ptr, instance->em);
+         output_printf("warning: call stack underflowed, re-initialize call graph\n");
+         p_init(ptr, instance->em, instance->cpu);
       }
    }
 }
@@ -167,6 +170,90 @@ static void p_done(void *ptr) {
    printf("%8" PRIu64 " cycles (%10.6f%%)\n", total_cycles, total_percent);
 }
 
+// The tree is saved in order, so each node's parent (its call stack
+// without the last entry) is restored before the node itself
+static FILE *save_file;
+static int num_nodes;
+
+static void save_node(const call_stack_t *node) {
+   fwrite(&node->index, sizeof(node->index), 1, save_file);
+   fwrite(node->stack, sizeof(node->stack[0]), node->index, save_file);
+   fwrite(&node->call_count, sizeof(node->call_count), 1, save_file);
+   fwrite(&node->cycle_count, sizeof(node->cycle_count), 1, save_file);
+}
+
+static int restore_node(call_stack_t *node, FILE *fp) {
+   if (fread(&node->index, sizeof(node->index), 1, fp) != 1 || node->index < 0 || node->index > CALL_STACK_SIZE ||
+       fread(node->stack, sizeof(node->stack[0]), node->index, fp) != (size_t) node->index ||
+       fread(&node->call_count, sizeof(node->call_count), 1, fp) != 1 ||
+       fread(&node->cycle_count, sizeof(node->cycle_count), 1, fp) != 1) {
+      return -1;
+   }
+   return 0;
+}
+
+static void count_node_walker(const void *nodep, const TVISIT which, const int depth) {
+   if (which == tpostorder || which == tleaf) {
+      num_nodes++;
+   }
+}
+
+static void save_node_walker(const void *nodep, const TVISIT which, const int depth) {
+   if (which == tpostorder || which == tleaf) {
+      save_node(*(call_stack_t **)nodep);
+   }
+}
+
+static void p_save(void *ptr, FILE *fp) {
+   profiler_call_t *instance = (profiler_call_t *)ptr;
+   save_file = fp;
+   num_nodes = 0;
+   ttwalk(instance->root, count_node_walker);
+   fwrite(&num_nodes, sizeof(num_nodes), 1, fp);
+   ttwalk(instance->root, save_node_walker);
+   fwrite(&instance->profile_enabled, sizeof(instance->profile_enabled), 1, fp);
+   save_node(instance->current);
+}
+
+static int p_restore(void *ptr, FILE *fp) {
+   profiler_call_t *instance = (profiler_call_t *)ptr;
+   if (instance->root) {
+      ttdestroy(instance->root, free);
+   }
+   instance->root = NULL;
+   instance->current = NULL;
+   if (fread(&num_nodes, sizeof(num_nodes), 1, fp) != 1) {
+      return -1;
+   }
+   call_stack_t key;
+   for (int i = 0; i < num_nodes; i++) {
+      call_stack_t *node = (call_stack_t *)malloc(sizeof(call_stack_t));
+      if (restore_node(node, fp) < 0) {
+         free(node);
+         return -1;
+      }
+      node->parent = NULL;
+      if (node->index > 0) {
+         memcpy((void *)&key, (void *)node, sizeof(call_stack_t));
+         key.index--;
+         void *parent = ttfind(&key, &instance->root, compare_nodes);
+         if (parent) {
+            node->parent = *(call_stack_t **)parent;
+         }
+      }
+      ttsearch(node, &instance->root, compare_nodes);
+   }
+   if (fread(&instance->profile_enabled, sizeof(instance->profile_enabled), 1, fp) != 1 || restore_node(&key, fp) < 0) {
+      return -1;
+   }
+   void *current = ttfind(&key, &instance->root, compare_nodes);
+   if (!current) {
+      return -1;
+   }
+   instance->current = *(call_stack_t **)current;
+   return 0;
+}
+
 void *profiler_call_create(char *arg) {
    profiler_call_t *instance = (profiler_call_t *)calloc(1, sizeof(profiler_call_t));
 
@@ -175,6 +262,8 @@ void *profiler_call_create(char *arg) {
    instance->profiler.init                = p_init;
    instance->profiler.profile_instruction = p_profile_instruction;
    instance->profiler.done                = p_done;
+   instance->profiler.save                = p_save;
+   instance->profiler.restore             = p_restore;
 
    return instance;
 }
@@ -12,12 +12,14 @@ typedef struct {
    int profile_bucket;
    address_t profile_counts[OTHER_CONTEXT + 1];
    cpu_emulator_t *em;
+   void *cpu;
 } profiler_instr_t;
 
-static void p_init(void *ptr, cpu_emulator_t *em) {
+static void p_init(void *ptr, cpu_emulator_t *em, void *cpu) {
    profiler_instr_t *instance = (profiler_instr_t *)ptr;
    memset((void *)instance->profile_counts, 0, sizeof(instance->profile_counts));
    instance->em = em;
+   instance->cpu = cpu;
 }
 
 static void p_profile_instruction(void *ptr, int pc, int opcode, int op1, int op2, int num_cycles) {
@@ -36,7 +38,17 @@ static void p_profile_instruction(void *ptr, int pc, int opcode, int op1, int op
 
 static void p_done(void *ptr) {
    profiler_instr_t *instance = (profiler_instr_t *)ptr;
-   profiler_output_helper(instance->profile_counts, 1, 0, instance->em);
+   profiler_output_helper(instance->profile_counts, 1, 0, instance->em, instance->cpu);
+}
+
+static void p_save(void *ptr, FILE *fp) {
+   profiler_instr_t *instance = (profiler_instr_t *)ptr;
+   fwrite(instance->profile_counts, sizeof(instance->profile_counts), 1, fp);
+}
+
+static int p_restore(void *ptr, FILE *fp) {
+   profiler_instr_t *instance = (profiler_instr_t *)ptr;
+   return fread(instance->profile_counts, sizeof(instance->profile_counts), 1, fp) == 1 ? 0 : -1;
 }
 
 void *profiler_instr_create(char *arg) {
@@ -48,6 +60,8 @@ void *profiler_instr_create(char *arg) {
    instance->profiler.init                = p_init;
    instance->profiler.profile_instruction = p_profile_instruction;
    instance->profiler.done                = p_done;
+   instance->profiler.save                = p_save;
+   instance->profiler.restore             = p_restore;
    instance->profile_min                  = 0x0000;
    instance->profile_max                  = 0xffff;
    instance->profile_bucket               = 1;
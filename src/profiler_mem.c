@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "profiler.h"
+#include "memory.h"
+#include "symbols.h"
+
+// Counts the reads and writes of each address by access type, and reports
+// the hottest addresses and pages, the use of zero page, and the hottest
+// data outside of zero page (which would be cheaper to access in zero page)
+
+// Default number of addresses/pages shown in each table
+#define DEFAULT_TOP 20
+
+typedef struct {
+   profiler_t profiler;
+   int profile_top;
+   // Including the range profiled (min and max)
+   mem_counters_t counters;
+} profiler_mem_t;
+
+// An address (or page) and its count, for sorting
+typedef struct {
+   int addr;
+   uint64_t count;
+} hot_t;
+
+static const char *type_names[MEM_NUM_TYPES] = { "Instr", "Pointer", "Data", "Stack", "Fetch" };
+
+static void p_init(void *ptr, cpu_emulator_t *em, void *cpu) {
+   profiler_mem_t *instance = (profiler_mem_t *)ptr;
+   memset((void *)instance->counters.reads, 0, sizeof(instance->counters.reads));
+   memset((void *)instance->counters.writes, 0, sizeof(instance->counters.writes));
+}
+
+static void p_profile_instruction(void *ptr, int pc, int opcode, int op1, int op2, int num_cycles) {
+}
+
+static uint64_t total_reads(profiler_mem_t *instance, int addr) {
+   uint64_t total = 0;
+   for (int type = 0; type < MEM_NUM_TYPES; type++) {
+      total += instance->counters.reads[type][addr];
+   }
+   return total;
+}
+
+static uint64_t total_writes(profiler_mem_t *instance, int addr) {
+   uint64_t total = 0;
+   for (int type = 0; type < MEM_NUM_TYPES; type++) {
+      total += instance->counters.writes[type][addr];
+   }
+   return total;
+}
+
+// Hottest first, then in address order
+static int compare_hot(const void *av, const void *bv) {
+   const hot_t *a = (const hot_t *)av;
+   const hot_t *b = (const hot_t *)bv;
+   if (a->count != b->count) {
+      return a->count < b->count ? 1 : -1;
+   }
+   return a->addr - b->addr;
+}
+
+// Sort the entries with a non-zero count, returning how many there are
+static int sort_hot(hot_t *hot, int n) {
+   int used = 0;
+   for (int i = 0; i < n; i++) {
+      if (hot[i].count) {
+         hot[used++] = hot[i];
+      }
+   }
+   qsort(hot, used, sizeof(hot_t), compare_hot);
+   return used;
+}
+
+static void print_header(const char *title, const char *first) {
+   printf("\n%s:\n\n", title);
+   printf("%-5s", first);
+   for (int type = 0; type < MEM_NUM_TYPES; type++) {
+      printf(" %10s", type_names[type]);
+   }
+   printf(" %10s %10s\n", "Writes", "Total");
+}
+
+// Print the counts of an address, or the sum over a range of addresses
+static void print_counts(profiler_mem_t *instance, int first, int last) {
+   uint64_t writes = 0;
+   uint64_t total = 0;
+   for (int type = 0; type < MEM_NUM_TYPES; type++) {
+      uint64_t reads = 0;
+      for (int addr = first; addr <= last; addr++) {
+         reads += instance->counters.reads[type][addr];
+         writes += instance->counters.writes[type][addr];
+      }
+      total += reads;
+      printf(" %10" PRIu64, reads);
+   }
+   printf(" %10" PRIu64 " %10" PRIu64, writes, total + writes);
+}
+
+static void print_address(profiler_mem_t *instance, int addr) {
+   char *name = symbol_lookup(addr);
+   printf("%04x ", addr);
+   print_counts(instance, addr, addr);
+   if (name) {
+      printf(" %s", name);
+   }
+   printf("\n");
+}
+
+static void p_done(void *ptr) {
+   profiler_mem_t *instance = (profiler_mem_t *)ptr;
+   hot_t *hot = (hot_t *)malloc(OTHER_CONTEXT * sizeof(hot_t));
+   int top = instance->profile_top;
+   int n;
+
+   // Hottest addresses, by all accesses
+   for (int addr = 0; addr < OTHER_CONTEXT; addr++) {
+      hot[addr].addr = addr;
+      hot[addr].count = total_reads(instance, addr) + total_writes(instance, addr);
+   }
+   n = sort_hot(hot, OTHER_CONTEXT);
+   print_header("Hottest addresses", "Addr");
+   for (int i = 0; i < n && i < top; i++) {
+      print_address(instance, hot[i].addr);
+   }
+
+   // Hottest pages, by all accesses
+   for (int page = 0; page < 0x100; page++) {
+      hot[page].addr = page << 8;
+      hot[page].count = 0;
+      for (int addr = page << 8; addr <= (page << 8) + 0xff; addr++) {
+         hot[page].count += total_reads(instance, addr) + total_writes(instance, addr);
+      }
+   }
+   n = sort_hot(hot, 0x100);
+   print_header("Hottest pages", "Page");
+   for (int i = 0; i < n && i < top; i++) {
+      printf("%02xxx ", hot[i].addr >> 8);
+      print_counts(instance, hot[i].addr, hot[i].addr + 0xff);
+      printf("\n");
+   }
+
+   // Every zero page location that is used, and how many are not
+   for (int addr = 0; addr < 0x100; addr++) {
+      hot[addr].addr = addr;
+      hot[addr].count = total_reads(instance, addr) + total_writes(instance, addr);
+   }
+   n = sort_hot(hot, 0x100);
+   print_header("Zero page", "Addr");
+   for (int i = 0; i < n; i++) {
+      print_address(instance, hot[i].addr);
+   }
+   printf("\n%d zero page locations are unused\n", 0x100 - n);
+
+   // The hottest data outside of zero page (excluding the stack page)
+   // would save a cycle per absolute or absolute indexed access if it
+   // were moved into zero page
+   for (int addr = 0; addr < OTHER_CONTEXT; addr++) {
+      hot[addr].addr = addr;
+      hot[addr].count = (addr < 0x200) ? 0 : instance->counters.reads[MEM_DATA][addr] + instance->counters.writes[MEM_DATA][addr];
+   }
+   n = sort_hot(hot, OTHER_CONTEXT);
+   printf("\nZero page candidates:\n\n");
+   printf("%-5s %10s %10s %10s\n", "Addr", "Reads", "Writes", "Total");
+   for (int i = 0; i < n && i < top; i++) {
+      char *name = symbol_lookup(hot[i].addr);
+      printf("%04x  %10" PRIu32 " %10" PRIu32 " %10" PRIu64, hot[i].addr,
+             instance->counters.reads[MEM_DATA][hot[i].addr], instance->counters.writes[MEM_DATA][hot[i].addr], hot[i].count);
+      if (name) {
+         printf(" %s", name);
+      }
+      printf("\n");
+   }
+
+   // Totals, including the accesses outside of the range profiled
+   print_header("Total", "");
+   printf("     ");
+   print_counts(instance, 0, OTHER_CONTEXT);
+   printf("\n");
+   printf("\n%" PRIu64 " accesses were outside the range profiled\n",
+          total_reads(instance, OTHER_CONTEXT) + total_writes(instance, OTHER_CONTEXT));
+
+   free(hot);
+}
+
+static void p_save(void *ptr, FILE *fp) {
+   profiler_mem_t *instance = (profiler_mem_t *)ptr;
+   fwrite(instance->counters.reads, sizeof(instance->counters.reads), 1, fp);
+   fwrite(instance->counters.writes, sizeof(instance->counters.writes), 1, fp);
+}
+
+static int p_restore(void *ptr, FILE *fp) {
+   profiler_mem_t *instance = (profiler_mem_t *)ptr;
+   if (fread(instance->counters.reads, sizeof(instance->counters.reads), 1, fp) != 1) {
+      return -1;
+   }
+   return fread(instance->counters.writes, sizeof(instance->counters.writes), 1, fp) == 1 ? 0 : -1;
+}
+
+void *profiler_mem_create(char *arg) {
+
+   profiler_mem_t *instance = (profiler_mem_t *)calloc(1, sizeof(profiler_mem_t));
+
+   instance->profiler.name                = "mem";
+   instance->profiler.arg                 = arg ? strdup(arg) : "";
+   instance->profiler.init                = p_init;
+   instance->profiler.profile_instruction = p_profile_instruction;
+   instance->profiler.counters            = &instance->counters;
+   instance->profiler.done                = p_done;
+   instance->profiler.save                = p_save;
+   instance->profiler.restore             = p_restore;
+   instance->counters.min                 = 0x0000;
+   instance->counters.max                 = 0xffff;
+   instance->profile_top                  = DEFAULT_TOP;
+
+   if (arg && strlen(arg) > 0) {
+      char *min = strtok(arg, ",");
+      char *max = strtok(NULL, ",");
+      char *top = strtok(NULL, ",");
+      if (min && strlen(min) > 0) {
+         instance->counters.min = strtol(min, (char **)NULL, 16);
+      }
+      if (max && strlen(max) > 0) {
+         instance->counters.max = strtol(max, (char **)NULL, 16);
+      }
+      if (top && strlen(top) > 0) {
+         instance->profile_top = strtol(top, (char **)NULL, 10);
+      }
+   }
+
+   return instance;
+}
@@ -0,0 +1,62 @@
+#include <stdlib.h>
+
+#include "spsc_queue.h"
+
+#ifdef HAVE_THREADS
+
+#include <sched.h>
+#include <stdatomic.h>
+
+// Must be a power of 2, and at least the number of buffers in circulation
+#define QUEUE_SIZE 64
+
+// Number of times to spin before yielding the CPU
+#define SPIN_COUNT 256
+
+struct spsc_queue {
+   void *slot[QUEUE_SIZE];
+   // Only written by the producer
+   _Alignas(64) atomic_uint tail;
+   // Only written by the consumer
+   _Alignas(64) atomic_uint head;
+};
+
+spsc_queue_t *spsc_queue_create() {
+   spsc_queue_t *q = (spsc_queue_t *)calloc(1, sizeof(spsc_queue_t));
+   atomic_init(&q->head, 0);
+   atomic_init(&q->tail, 0);
+   return q;
+}
+
+static void backoff(int *spins) {
+   if (++*spins > SPIN_COUNT) {
+      sched_yield();
+   }
+}
+
+void spsc_queue_push(spsc_queue_t *q, void *item) {
+   unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+   int spins = 0;
+   while (tail - atomic_load_explicit(&q->head, memory_order_acquire) >= QUEUE_SIZE) {
+      backoff(&spins);
+   }
+   q->slot[tail & (QUEUE_SIZE - 1)] = item;
+   atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+void *spsc_queue_pop(spsc_queue_t *q) {
+   unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+   int spins = 0;
+   while (atomic_load_explicit(&q->tail, memory_order_acquire) == head) {
+      backoff(&spins);
+   }
+   void *item = q->slot[head & (QUEUE_SIZE - 1)];
+   atomic_store_explicit(&q->head, head + 1, memory_order_release);
+   return item;
+}
+
+void spsc_queue_destroy(spsc_queue_t *q) {
+   free(q);
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+// Threading (pthreads and C11 atomics) is not available in the MSVC build
+#ifndef _WIN32
+#define HAVE_THREADS
+#endif
+
+#ifdef HAVE_THREADS
+
+// A lock-free single producer, single consumer queue of pointers, used
+// to pass buffers between the stages of the threaded decoder.
+
+typedef struct spsc_queue spsc_queue_t;
+
+spsc_queue_t *spsc_queue_create();
+
+// Blocks while the queue is full
+void spsc_queue_push(spsc_queue_t *q, void *item);
+
+// Blocks while the queue is empty
+void *spsc_queue_pop(spsc_queue_t *q);
+
+void spsc_queue_destroy(spsc_queue_t *q);
+
+#endif
+
+#endif
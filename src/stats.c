@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "stats.h"
+
+int stats_enabled = 0;
+
+uint64_t stats_counters[NUM_STATS];
+
+uint64_t stats_ticks[NUM_TIMERS];
+
+static const char *stat_names[NUM_STATS] = {
+   "bytes read",
+   "raw samples",
+   "phi2 edges",
+   "rdy dropped cycles",
+   "bus cycles",
+   "instructions",
+   "interrupts",
+   "resets",
+   "prediction failed",
+   "pc/pb prediction failed",
+   "cycle prediction fail",
+   "memory modelling failed",
+   "lines emitted"
+};
+
+// Indented to show how the stages are nested
+static const char *timer_names[NUM_TIMERS] = {
+   "read",
+   "extract",
+   "  decode",
+   "    emulate",
+   "      memory",
+   "    output",
+   "write"
+};
+
+// For converting ticks to seconds
+static uint64_t start_ns;
+static uint64_t start_ticks;
+
+uint64_t stats_time_ns() {
+   struct timespec ts;
+   timespec_get(&ts, TIME_UTC);
+   return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void stats_init() {
+   stats_enabled = 1;
+   start_ns = stats_time_ns();
+   start_ticks = stats_now();
+}
+
+void stats_report() {
+   if (!stats_enabled) {
+      return;
+   }
+   uint64_t elapsed_ns = stats_time_ns() - start_ns;
+   uint64_t elapsed_ticks = stats_now() - start_ticks;
+   double seconds_per_tick = elapsed_ticks ? (double) elapsed_ns / 1e9 / elapsed_ticks : 0.0;
+   double elapsed = (double) elapsed_ns / 1e9;
+
+   fprintf(stderr, "\n");
+   fprintf(stderr, "%-24s %16s\n", "counter", "count");
+   for (int i = 0; i < NUM_STATS; i++) {
+      fprintf(stderr, "%-24s %16" PRIu64 "\n", stat_names[i], stats_counters[i]);
+   }
+   fprintf(stderr, "\n");
+   fprintf(stderr, "%-24s %16s %8s\n", "stage", "seconds", "%");
+   for (int i = 0; i < NUM_TIMERS; i++) {
+      double t = stats_ticks[i] * seconds_per_tick;
+      fprintf(stderr, "%-24s %16.3f %8.1f\n", timer_names[i], t, elapsed > 0 ? 100.0 * t / elapsed : 0.0);
+   }
+   fprintf(stderr, "%-24s %16.3f\n", "total", elapsed);
+   if (elapsed > 0) {
+      fprintf(stderr, "\n");
+      fprintf(stderr, "%.1f MB/s, %.1f Mcycles/s, %.0f instructions/s\n",
+              stats_counters[STAT_BYTES_READ] / elapsed / 1e6,
+              stats_counters[STAT_CYCLES] / elapsed / 1e6,
+              stats_counters[STAT_INSTRUCTIONS] / elapsed);
+   }
+}
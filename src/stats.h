@@ -0,0 +1,87 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <inttypes.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HAVE_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+// Counters and timers for the --stats report.
+//
+// These are only updated when stats_enabled is set, so they cost just a
+// (well predicted) branch otherwise. Each counter and timer is only
+// updated by one thread.
+
+typedef enum {
+   STAT_BYTES_READ,
+   STAT_SAMPLES,
+   STAT_EDGES,
+   STAT_RDY_DROPPED,
+   STAT_CYCLES,
+   STAT_INSTRUCTIONS,
+   STAT_INTERRUPTS,
+   STAT_RESETS,
+   STAT_PREDICTION_FAIL,
+   STAT_PC_PREDICTION_FAIL,
+   STAT_CYCLE_PREDICTION_FAIL,
+   STAT_MEMORY_FAIL,
+   STAT_LINES,
+   NUM_STATS
+} stat_t;
+
+// The timers include the time of any stages nested within them, e.g.
+// memory within emulate, and (without --threads) decode within extract
+typedef enum {
+   TIMER_READ,      // reading the capture
+   TIMER_EXTRACT,   // extracting bus cycles from the samples
+   TIMER_DECODE,    // decoding batches of bus cycles into instructions
+   TIMER_EMULATE,   // em->emulate (and reset/interrupt)
+   TIMER_MEMORY,    // memory_read / memory_write
+   TIMER_OUTPUT,    // formatting the instruction output
+   TIMER_WRITE,     // writing the output
+   NUM_TIMERS
+} stats_timer_t;
+
+extern int stats_enabled;
+
+extern uint64_t stats_counters[NUM_STATS];
+
+extern uint64_t stats_ticks[NUM_TIMERS];
+
+// Wall clock time in nanoseconds
+uint64_t stats_time_ns();
+
+// A cheap timestamp: the TSC where available, otherwise nanoseconds
+#ifdef HAVE_TSC
+#define stats_now() __rdtsc()
+#else
+#define stats_now() stats_time_ns()
+#endif
+
+static inline void stats_add(stat_t stat, uint64_t n) {
+   if (stats_enabled) {
+      stats_counters[stat] += n;
+   }
+}
+
+static inline uint64_t stats_start() {
+   return stats_enabled ? stats_now() : 0;
+}
+
+static inline void stats_stop(stats_timer_t timer, uint64_t start) {
+   if (stats_enabled) {
+      stats_ticks[timer] += stats_now() - start;
+   }
+}
+
+void stats_init();
+
+// Write the report to stderr
+void stats_report();
+
+#endif
@@ -17,24 +17,31 @@ typedef enum {
    SWS_AWAIT_COMMA
 } swstate;
 
-// Being very lazy here using an array!
-static char **symbol_table = NULL;
+// Being very lazy here using an array per 64KB bank, each allocated when
+// the first symbol is added to it
+#define BANK_SHIFT 16
+#define BANK_SIZE  (1 << BANK_SHIFT)
+#define BANK_MASK  (BANK_SIZE - 1)
+
+static char ***symbol_table = NULL;
 
 static int max_address = -1;
 
 void symbol_init(int size) {
-   symbol_table = (char **)malloc(size * sizeof(char *));
-   for (int i = 0; i < size;i++) {
-      symbol_table[i] = NULL;
-   }
+   int num_banks = (size + BANK_MASK) >> BANK_SHIFT;
+   symbol_table = (char ***)calloc(num_banks, sizeof(char **));
    max_address = size - 1;
 }
 
 void symbol_add(char *name, int address) {
    if (address >= 0 && address <= max_address) {
+      char ***bank = symbol_table + (address >> BANK_SHIFT);
+      if (!*bank) {
+         *bank = (char **)calloc(BANK_SIZE, sizeof(char *));
+      }
       char *copy = (char *)malloc(strlen(name)+1);
       strcpy(copy, name);
-      symbol_table[address] = copy;
+      (*bank)[address & BANK_MASK] = copy;
    } else {
       // This case should never happen
       fprintf(stderr, "symbol %s:%04x out of range\r\n", name, address);
@@ -44,7 +51,8 @@ void symbol_add(char *name, int address) {
 
 char *symbol_lookup(int address) {
    if (address >= 0 && address <= max_address) {
-      return symbol_table[address];
+      char **bank = symbol_table[address >> BANK_SHIFT];
+      return bank ? bank[address & BANK_MASK] : NULL;
    } else {
       return NULL;
    }
@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "trace.h"
+
+#ifdef _MSC_VER
+#define fseeko _fseeki64
+#endif
+
+// File format (all values little endian):
+//
+// The trace starts with a 16 byte header:
+//    0: "6502TRC" followed by the version number
+//    8: cpu type
+//    9: options (bit 0 = undocumented opcodes, bit 1 = user signal present)
+//   10: reserved
+//   12: index interval (32 bits)
+//
+// Each record is then:
+//    flags (8 bits, see below)
+//    sample count (varint), relative to the previous record except in key records
+//    cycles (varint)
+//    pc (16 bits), unless REC_NO_PC
+//    pb (8 bits), 65C816 only, unless REC_NO_PB
+//    opcount, opcode, op1..op<opcount>, unless a reset or interrupt
+//    number of state runs (8 bits), followed by each run of characters
+//    of the state string that differ from the previous record, as
+//    offset (8 bits), length (8 bits), characters
+//
+// Every TRACE_INDEX_INTERVAL'th record is a key record, which does not
+// depend on the previous record. The index has a similar 16 byte header
+// ("6502IDX", version, index interval), followed by an entry for each
+// key record of file offset (64 bits), sample count (32 bits) and 32
+// reserved bits.
+
+#define TRACE_VERSION 1
+
+#define HEADER_SIZE 16
+#define ENTRY_SIZE  16
+
+// Record flags, in addition to TRACE_RESET, TRACE_INTERRUPT and TRACE_FAIL
+#define REC_KEY     0x08
+#define REC_NO_PC   0x10
+#define REC_NO_PB   0x20
+#define REC_USER    0x40
+#define REC_NO_USER 0x80
+
+#define OPT_UNDOCUMENTED 0x01
+#define OPT_USER         0x02
+
+// Unchanged characters between two changes of the state string that
+// are still sent as part of one run (cheaper than starting another)
+#define RUN_GAP 2
+
+#define IO_BUFFER_SIZE (1 << 20)
+
+static FILE *trace_file = NULL;
+static FILE *index_file = NULL;
+
+static int c816;
+static int interval;
+
+// Reference state for the delta encoding
+static int64_t  num_records;
+static uint64_t offset;
+static uint32_t last_sample;
+static char     last_state[TRACE_STATE_SIZE];
+
+static void put_le(uint8_t *bp, uint64_t value, int n) {
+   for (int i = 0; i < n; i++) {
+      *bp++ = value & 0xff;
+      value >>= 8;
+   }
+}
+
+static uint64_t get_le(const uint8_t *bp, int n) {
+   uint64_t value = 0;
+   for (int i = n - 1; i >= 0; i--) {
+      value = (value << 8) | bp[i];
+   }
+   return value;
+}
+
+static char *index_filename(const char *filename) {
+   char *name = malloc(strlen(filename) + 5);
+   strcpy(name, filename);
+   strcat(name, ".idx");
+   return name;
+}
+
+static void write_header(FILE *f, const char *magic, int cpu_type, int options) {
+   uint8_t header[HEADER_SIZE];
+   memset(header, 0, sizeof(header));
+   memcpy(header, magic, 7);
+   header[7] = TRACE_VERSION;
+   header[8] = cpu_type;
+   header[9] = options;
+   put_le(header + 12, interval, 4);
+   fwrite(header, 1, sizeof(header), f);
+}
+
+static int read_header(FILE *f, const char *magic, uint8_t *header) {
+   if (fread(header, 1, HEADER_SIZE, f) != HEADER_SIZE || memcmp(header, magic, 7) || header[7] != TRACE_VERSION) {
+      return -1;
+   }
+   return 0;
+}
+
+// ==================================================
+// Writing
+// ==================================================
+
+static uint8_t *put_varint(uint8_t *bp, uint32_t value) {
+   while (value >= 0x80) {
+      *bp++ = (value & 0x7f) | 0x80;
+      value >>= 7;
+   }
+   *bp++ = value;
+   return bp;
+}
+
+int trace_create(const char *filename, cpu_t cpu_type, int undocumented, int user) {
+   char *name = index_filename(filename);
+   trace_file = fopen(filename, "wb");
+   index_file = fopen(name, "wb");
+   free(name);
+   if (!trace_file || !index_file) {
+      return -1;
+   }
+   setvbuf(trace_file, NULL, _IOFBF, IO_BUFFER_SIZE);
+   c816        = (cpu_type == CPU_65C816);
+   interval    = TRACE_INDEX_INTERVAL;
+   num_records = 0;
+   offset      = HEADER_SIZE;
+   int options = (undocumented ? OPT_UNDOCUMENTED : 0) | (user ? OPT_USER : 0);
+   write_header(trace_file, "6502TRC", cpu_type, options);
+   write_header(index_file, "6502IDX", cpu_type, options);
+   return 0;
+}
+
+void trace_write(trace_record_t *record) {
+   uint8_t buffer[32 + 3 * TRACE_STATE_SIZE];
+   uint8_t *bp = buffer;
+   instruction_t *instruction = &record->instruction;
+
+   int key = (num_records % interval) == 0;
+   if (key) {
+      uint8_t entry[ENTRY_SIZE];
+      memset(entry, 0, sizeof(entry));
+      put_le(entry, offset, 8);
+      put_le(entry + 8, record->sample_count, 4);
+      fwrite(entry, 1, sizeof(entry), index_file);
+      // Force the whole of the state to be sent
+      memset(last_state, 0xff, sizeof(last_state));
+      last_sample = 0;
+   }
+
+   int flags = record->flags | (key ? REC_KEY : 0);
+   if (instruction->pc < 0) {
+      flags |= REC_NO_PC;
+   }
+   if (instruction->pb < 0) {
+      flags |= REC_NO_PB;
+   }
+   if (record->user < 0) {
+      flags |= REC_NO_USER;
+   } else if (record->user) {
+      flags |= REC_USER;
+   }
+   *bp++ = flags;
+   bp = put_varint(bp, record->sample_count - last_sample);
+   bp = put_varint(bp, record->cycles);
+   if (instruction->pc >= 0) {
+      put_le(bp, instruction->pc, 2);
+      bp += 2;
+   }
+   if (c816 && instruction->pb >= 0) {
+      *bp++ = instruction->pb;
+   }
+   if (!(record->flags & (TRACE_RESET | TRACE_INTERRUPT))) {
+      int opcount = instruction->opcount & 3;
+      *bp++ = opcount;
+      *bp++ = instruction->opcode;
+      if (opcount > 0) {
+         *bp++ = instruction->op1;
+      }
+      if (opcount > 1) {
+         *bp++ = instruction->op2;
+      }
+      if (opcount > 2) {
+         *bp++ = instruction->op3;
+      }
+   }
+
+   // Send the runs of the state string (including the terminator) that
+   // have changed since the last record
+   uint8_t *num_runs = bp++;
+   *num_runs = 0;
+   int len = strlen(record->state) + 1;
+   int i = 0;
+   while (i < len) {
+      if (record->state[i] == last_state[i]) {
+         i++;
+         continue;
+      }
+      int start = i;
+      int end = i + 1;
+      for (i = end; i < len && i < end + RUN_GAP + 1; i++) {
+         if (record->state[i] != last_state[i]) {
+            end = i + 1;
+         }
+      }
+      i = end;
+      *bp++ = start;
+      *bp++ = end - start;
+      memcpy(bp, record->state + start, end - start);
+      bp += end - start;
+      (*num_runs)++;
+   }
+   memcpy(last_state, record->state, len);
+
+   fwrite(buffer, 1, bp - buffer, trace_file);
+   offset += bp - buffer;
+   last_sample = record->sample_count;
+   num_records++;
+}
+
+// ==================================================
+// Reading
+// ==================================================
+
+// Set when the trace ends part way through a record
+static int truncated;
+
+static int get_byte() {
+   int c = getc(trace_file);
+   if (c == EOF) {
+      truncated = 1;
+      return 0;
+   }
+   return c;
+}
+
+static uint32_t get_varint() {
+   uint32_t value = 0;
+   int shift = 0;
+   int c;
+   do {
+      c = get_byte();
+      value |= (uint32_t) (c & 0x7f) << shift;
+      shift += 7;
+   } while ((c & 0x80) && shift < 35);
+   return value;
+}
+
+int trace_open(const char *filename, cpu_t *cpu_type, int *undocumented, int *user) {
+   uint8_t header[HEADER_SIZE];
+   trace_file = fopen(filename, "rb");
+   if (!trace_file) {
+      perror("failed to open trace file");
+      return -1;
+   }
+   if (read_header(trace_file, "6502TRC", header) < 0) {
+      fprintf(stderr, "%s is not a binary instruction trace\n", filename);
+      return -1;
+   }
+   setvbuf(trace_file, NULL, _IOFBF, IO_BUFFER_SIZE);
+   *cpu_type     = header[8];
+   *undocumented = (header[9] & OPT_UNDOCUMENTED) != 0;
+   *user         = (header[9] & OPT_USER) != 0;
+   c816          = (*cpu_type == CPU_65C816);
+   interval      = get_le(header + 12, 4);
+   num_records   = 0;
+   // The index is optional, without it rendering starts from the beginning
+   char *name = index_filename(filename);
+   index_file = fopen(name, "rb");
+   free(name);
+   if (index_file && read_header(index_file, "6502IDX", header) < 0) {
+      fclose(index_file);
+      index_file = NULL;
+   }
+   return 0;
+}
+
+int trace_seek(int64_t first) {
+   trace_record_t record;
+   if (index_file && interval > 0 && first >= interval) {
+      uint8_t entry[ENTRY_SIZE];
+      int64_t key = first / interval;
+      if (fseeko(index_file, HEADER_SIZE + key * ENTRY_SIZE, SEEK_SET) < 0 || fread(entry, 1, sizeof(entry), index_file) != sizeof(entry)) {
+         return -1;
+      }
+      if (fseeko(trace_file, get_le(entry, 8), SEEK_SET) < 0) {
+         return -1;
+      }
+      num_records = key * interval;
+   }
+   // Then step through the records up to the first
+   while (num_records < first) {
+      if (!trace_read(&record)) {
+         return -1;
+      }
+   }
+   return 0;
+}
+
+int trace_read(trace_record_t *record) {
+   instruction_t *instruction = &record->instruction;
+
+   int flags = getc(trace_file);
+   if (flags == EOF) {
+      return 0;
+   }
+   truncated = 0;
+   if (flags & REC_KEY) {
+      last_sample = 0;
+   }
+   record->flags = flags & (TRACE_RESET | TRACE_INTERRUPT | TRACE_FAIL);
+   record->sample_count = last_sample + get_varint();
+   record->cycles = get_varint();
+   if (flags & REC_NO_USER) {
+      record->user = -1;
+   } else {
+      record->user = (flags & REC_USER) ? 1 : 0;
+   }
+   instruction->pc = -1;
+   instruction->pb = -1;
+   if (!(flags & REC_NO_PC)) {
+      instruction->pc  = get_byte();
+      instruction->pc |= get_byte() << 8;
+   }
+   if (c816 && !(flags & REC_NO_PB)) {
+      instruction->pb = get_byte();
+   }
+   instruction->opcount = 0;
+   if (!(flags & (TRACE_RESET | TRACE_INTERRUPT))) {
+      instruction->opcount = get_byte();
+      instruction->opcode  = get_byte();
+      if (instruction->opcount > 0) {
+         instruction->op1 = get_byte();
+      }
+      if (instruction->opcount > 1) {
+         instruction->op2 = get_byte();
+      }
+      if (instruction->opcount > 2) {
+         instruction->op3 = get_byte();
+      }
+   }
+   int num_runs = get_byte();
+   for (int i = 0; i < num_runs; i++) {
+      int start = get_byte();
+      int len   = get_byte();
+      if (truncated || start + len > TRACE_STATE_SIZE || fread(last_state + start, 1, len, trace_file) != (size_t) len) {
+         fprintf(stderr, "corrupt binary instruction trace\n");
+         return 0;
+      }
+   }
+   if (truncated) {
+      fprintf(stderr, "corrupt binary instruction trace\n");
+      return 0;
+   }
+   last_state[TRACE_STATE_SIZE - 1] = 0;
+   strcpy(record->state, last_state);
+
+   last_sample = record->sample_count;
+   num_records++;
+   return 1;
+}
+
+void trace_close() {
+   if (trace_file) {
+      fclose(trace_file);
+      trace_file = NULL;
+   }
+   if (index_file) {
+      fclose(index_file);
+      index_file = NULL;
+   }
+}
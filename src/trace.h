@@ -0,0 +1,56 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <inttypes.h>
+
+#include "defs.h"
+
+// A binary instruction trace holds one record per decoded instruction,
+// with everything needed to render the usual text output without
+// repeating the emulation. An index of every TRACE_INDEX_INTERVAL'th
+// record is written alongside, in <filename>.idx, so any range of the
+// trace can be rendered quickly.
+
+#define TRACE_INDEX_INTERVAL 4096
+
+// The longest register state string of any of the emulators
+#define TRACE_STATE_SIZE 128
+
+// Record flags
+#define TRACE_RESET     0x01
+#define TRACE_INTERRUPT 0x02
+#define TRACE_FAIL      0x04
+
+typedef struct {
+   uint32_t      sample_count;
+   int           cycles;
+   int           flags;
+   int           user;      // -1 indicates unknown
+   instruction_t instruction;
+   char          state[TRACE_STATE_SIZE];
+} trace_record_t;
+
+// Create a trace (and its index) for the given cpu, where user indicates
+// the user defined signal is present.
+//
+// Returns 0 on success, or -1 on failure (with errno set).
+int trace_create(const char *filename, cpu_t cpu_type, int undocumented, int user);
+
+void trace_write(trace_record_t *record);
+
+// Open an existing trace, returning its cpu and options.
+//
+// Returns 0 on success, or -1 on failure.
+int trace_open(const char *filename, cpu_t *cpu_type, int *undocumented, int *user);
+
+// Position the trace so the next record read is record number first.
+//
+// Returns 0 on success, or -1 if the trace has fewer records.
+int trace_seek(int64_t first);
+
+// Return 1 if a record was read, or 0 at the end of the trace.
+int trace_read(trace_record_t *record);
+
+void trace_close();
+
+#endif
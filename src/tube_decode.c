@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <inttypes.h>
+#include "output.h"
 
 // #define DEBUG
 
@@ -101,7 +102,7 @@ static unsigned int resp_length = 0;
 
 static void expect_response(int state, int length) {
    if (resp_state != RESP_IDLE) {
-      printf("Warning response state conflict: current=%d next=%d\n", resp_state, state);
+      output_printf("Warning response state conflict: current=%d next=%d\n", resp_state, state);
    }
    resp_state = state;
    resp_length = length;
@@ -109,29 +110,29 @@ static void expect_response(int state, int length) {
 
 static void print_call(char *call, int cy, int a, int x, int y, uint8_t *name, uint8_t *block, int block_len) {
    int i;
-   printf("%s: ", call);
+   output_printf("%s: ", call);
    if (cy >= 0) {
-      printf("Cy=%02x ", cy);
+      output_printf("Cy=%02x ", cy);
    }
    if (a >= 0) {
-      printf("A=%02x ", a);
+      output_printf("A=%02x ", a);
    }
    if (x >= 0) {
-      printf("X=%02x ", x);
+      output_printf("X=%02x ", x);
    }
    if (y >= 0) {
-      printf("Y=%02x ", y);
+      output_printf("Y=%02x ", y);
    }
    if (name) {
-      printf("STRING=%s ", name);
+      output_printf("STRING=%s ", name);
    }
    if (block && block_len > 0) {
-      printf("BLOCK=");
+      output_printf("BLOCK=");
       for (i = 0; i < block_len; i++) {
-         printf("%02x ", block[i]);
+         output_printf("%02x ", block[i]);
       }
    }
-   printf("\n");
+   output_printf("\n");
 }
 
 
@@ -142,13 +143,13 @@ void r1_h2p_state_machine(uint8_t data) {
    static unsigned int state = R1_IDLE;
 
 #ifdef DEBUG
-   printf("tube write: R1 = %02x\n", data);
+   output_printf("tube write: R1 = %02x\n", data);
 #endif
 
    switch (state) {
    case R1_IDLE:
       if (data & 0x80) {
-         printf("R1: Escape: flag=%02x\n", data);
+         output_printf("R1: Escape: flag=%02x\n", data);
       } else {
          state = R1_EVENT_0;
       }
@@ -163,7 +164,7 @@ void r1_h2p_state_machine(uint8_t data) {
       break;
    case R1_EVENT_2:
       a = data;
-      printf("R1: Event: A=%02x X=%02x Y=%02x\n", a, x, y);
+      output_printf("R1: Event: A=%02x X=%02x Y=%02x\n", a, x, y);
       state = R1_IDLE;
       break;
    }
@@ -178,19 +179,19 @@ void r2_h2p_state_machine(uint8_t data) {
    static uint8_t buffer[512];
    static unsigned int index = 0;
 #ifdef DEBUG
-   printf("tube write: R2 = %02x\n", data);
+   output_printf("tube write: R2 = %02x\n", data);
 #endif
 
    buffer[index] = data;
    if (index < sizeof(buffer) - 1) {
       index++;
    } else {
-      printf("Response buffer overflow!, state = %d\n", resp_state);
+      output_printf("Response buffer overflow!, state = %d\n", resp_state);
    }
 
    switch (resp_state) {
    case RESP_IDLE:
-      printf("Unexpected data recived in IDLE response state: %02x\n", data);
+      output_printf("Unexpected data recived in IDLE response state: %02x\n", data);
       break;
    case RESP_OSRDCH_0:
       cy = data;
@@ -202,7 +203,7 @@ void r2_h2p_state_machine(uint8_t data) {
       resp_state = RESP_IDLE;
       break;
    case RESP_OSCLI_0:
-      printf("R2: OSCLI response: %02x\n",  data);
+      output_printf("R2: OSCLI response: %02x\n",  data);
       resp_state = RESP_IDLE;
       break;
    case RESP_OSBYTELO_0:
@@ -231,7 +232,7 @@ void r2_h2p_state_machine(uint8_t data) {
       break;
    case RESP_OSWORD0_0:
       if (data & 0x80) {
-         printf("R2: OSWORD0 response: %02x (escape)\n", data);
+         output_printf("R2: OSWORD0 response: %02x (escape)\n", data);
          resp_state = RESP_IDLE;
       } else {
          resp_state = RESP_IDLE;
@@ -264,11 +265,11 @@ void r2_h2p_state_machine(uint8_t data) {
       resp_state = RESP_IDLE;
       break;
    case RESP_OSBPUT_0:
-      printf("R2: OSBPUT response: %02x\n",  data);
+      output_printf("R2: OSBPUT response: %02x\n",  data);
       resp_state = RESP_IDLE;
       break;
    case RESP_OSFIND_0:
-      printf("R2: OSFIND response: %02x\n",  data);
+      output_printf("R2: OSFIND response: %02x\n",  data);
       resp_state = RESP_IDLE;
       break;
    case RESP_OSFILE_0:
@@ -307,7 +308,7 @@ void r2_h2p_state_machine(uint8_t data) {
       break;
    case RESP_ERROR_2:
       if (data == 0x00) {
-         printf("R2: Error response: errno=%d message=%s\n", errno, buffer + 2);
+         output_printf("R2: Error response: errno=%d message=%s\n", errno, buffer + 2);
          resp_state = RESP_IDLE;
       }
       break;
@@ -325,7 +326,7 @@ void r4_h2p_state_machine(uint8_t data) {
    static unsigned int     state = R4_IDLE;
 
 #ifdef DEBUG
-   printf("tube write: R4 = %02x\n", data);
+   output_printf("tube write: R4 = %02x\n", data);
 #endif
 
    switch (state) {
@@ -337,13 +338,13 @@ void r4_h2p_state_machine(uint8_t data) {
          action = data;
          state = R4_XFER_0;
       } else {
-         printf("R4: illegal transfer type: %02x\n", data);
+         output_printf("R4: illegal transfer type: %02x\n", data);
       }
       break;
    case R4_XFER_0:
       id = data;
       if (action == 5) {
-      printf("R4: Transfer: Action=%02x ID=%02x\n", action, id);
+      output_printf("R4: Transfer: Action=%02x ID=%02x\n", action, id);
          state = R4_IDLE;
       } else {
          state = R4_XFER_1;
@@ -370,7 +371,7 @@ void r4_h2p_state_machine(uint8_t data) {
       break;
    case R4_XFER_5:
       sync = data;
-      printf("R4: Transfer: Action=%02x ID=%02x Addr=%08x Sync=%02x\n", action, id, addr, sync);
+      output_printf("R4: Transfer: Action=%02x ID=%02x Addr=%08x Sync=%02x\n", action, id, addr, sync);
       state = R4_IDLE;
       break;
    }
@@ -387,7 +388,7 @@ void r2_p2h_state_machine(uint8_t data) {
    static unsigned int index = 0;
 
 #ifdef DEBUG
-   printf("tube read:  R2 = %02x\n", data);
+   output_printf("tube read:  R2 = %02x\n", data);
 #endif
 
    // There seems to be a spurious read of R2 by the host
@@ -401,7 +402,7 @@ void r2_p2h_state_machine(uint8_t data) {
    if (index < sizeof(buffer) - 1) {
       index++;
    } else {
-      printf("Request buffer overflow!, state = %d\n", state);
+      output_printf("Request buffer overflow!, state = %d\n", state);
    }
    switch (state) {
    case R2_IDLE:
@@ -444,7 +445,7 @@ void r2_p2h_state_machine(uint8_t data) {
          state = R2_OSGBPB_0;
          break;
       default:
-         printf("Illegal R2 tube command %02x\n", data);
+         output_printf("Illegal R2 tube command %02x\n", data);
       }
       break;
 
@@ -575,11 +576,11 @@ void r2_p2h_state_machine(uint8_t data) {
          break;
       case 3:
          // 3 indicates claim tube
-         printf("R2: OSWORD: A=fb: tube claim\n");
+         output_printf("R2: OSWORD: A=fb: tube claim\n");
          break;
       case 4:
          // 4 indicates release tube
-         printf("R2: OSWORD: A=fb: tube release\n");
+         output_printf("R2: OSWORD: A=fb: tube release\n");
          break;
       default:
          // anything else indicates &FExx write
@@ -593,67 +594,67 @@ void r2_p2h_state_machine(uint8_t data) {
 
    case R2_OSWORD_FB_FDC:
       if (index == 9) {
-         printf("R2: OSWORD: A=fb: fdc disk command: ");
+         output_printf("R2: OSWORD: A=fb: fdc disk command: ");
          for (i = 8; i >= 0; i--) {
-            printf("%02x ", buffer[i]);
+            output_printf("%02x ", buffer[i]);
          }
-         printf("(");
+         output_printf("(");
          switch (data >> 4) {
          case 0:
-            printf("Restore");
+            output_printf("Restore");
             break;
          case 1:
-            printf("Seek");
+            output_printf("Seek");
             break;
          case 2:
          case 3:
-            printf("Step");
+            output_printf("Step");
             break;
          case 4:
          case 5:
-            printf("Step in");
+            output_printf("Step in");
             break;
          case 6:
          case 7:
-            printf("Step out");
+            output_printf("Step out");
             break;
          case 8:
          case 9:
-            printf("Read sector");
+            output_printf("Read sector");
             break;
          case 10:
          case 11:
-            printf("Write sector");
+            output_printf("Write sector");
             break;
          case 12:
-            printf("Read address");
+            output_printf("Read address");
             break;
          case 13:
-            printf("Read track");
+            output_printf("Read track");
             break;
          case 14:
-            printf("Write track");
+            output_printf("Write track");
             break;
          case 15:
-            printf("Force interrupt");
+            output_printf("Force interrupt");
             break;
          }
-         printf(")\n");
+         output_printf(")\n");
          state = R2_OSWORD_FB_1;
       }
       break;
 
    case R2_OSWORD_FB_IO:
       if (x == 0x24) {
-         printf("R2: OSWORD: A=fb: fdc disk control %02x\n", data);
+         output_printf("R2: OSWORD: A=fb: fdc disk control %02x\n", data);
       } else if (x == 0x29) {
-         printf("R2: OSWORD: A=fb: fdc set track %d\n", data);
+         output_printf("R2: OSWORD: A=fb: fdc set track %d\n", data);
       } else if (x == 0x2a) {
-         printf("R2: OSWORD: A=fb: fdc set sector %d\n", data);
+         output_printf("R2: OSWORD: A=fb: fdc set sector %d\n", data);
       } else if (x == 0x2b) {
-         printf("R2: OSWORD: A=fb: fdc set data %d\n", data);
+         output_printf("R2: OSWORD: A=fb: fdc set data %d\n", data);
       } else {
-         printf("R2: OSWORD: A=fb: io write FE%02X=%02X\n", x, data);
+         output_printf("R2: OSWORD: A=fb: io write FE%02X=%02X\n", x, data);
       }
       state = R2_OSWORD_FB_1;
       break;
@@ -692,7 +693,7 @@ void r2_p2h_state_machine(uint8_t data) {
          index = 3;
          state = R2_OSWORD_FF_1;
       } else {
-         printf("Osword FF protocol violation\n");
+         output_printf("Osword FF protocol violation\n");
          state = R2_IDLE;
       }
       break;
@@ -788,7 +789,7 @@ void r2_p2h_state_machine(uint8_t data) {
          state = R2_OSGBPB_1;
       }
       break;
-      printf("R2: OSGBPB not yet implemented\n");
+      output_printf("R2: OSGBPB not yet implemented\n");
       expect_response(RESP_OSGBPB_0, 16);
       state = R2_IDLE;
       break;
@@ -805,20 +806,20 @@ void r2_p2h_state_machine(uint8_t data) {
 // Parasite Initiated Requests
 void tube_read(int reg, uint8_t data) {
    if (reg == 1) {
-      printf("R1: OSWRCH: %c <%02x>\n", (data >= 32 && data < 127) ? data : '.', data);
+      output_printf("R1: OSWRCH: %c <%02x>\n", (data >= 32 && data < 127) ? data : '.', data);
    }
    if (reg == 3) {
       r2_p2h_state_machine(data);
    }
    if (reg == 5) {
-      printf("R3: P2H: %c <%02x>\n", (data >= 32 && data < 127) ? data : '.', data);
+      output_printf("R3: P2H: %c <%02x>\n", (data >= 32 && data < 127) ? data : '.', data);
    }
 }
 
 // Host Initiated Requests
 void tube_write(int reg, uint8_t data) {
    if (reg == 0) {
-      printf("Ctrl: <%02x>\n", data);
+      output_printf("Ctrl: <%02x>\n", data);
    }
    if (reg == 1) {
       r1_h2p_state_machine(data);
@@ -827,7 +828,7 @@ void tube_write(int reg, uint8_t data) {
       r2_h2p_state_machine(data);
    }
    if (reg == 5) {
-      printf("R3: H2P: %c <%02x>\n", (data >= 32 && data < 127) ? data : '.', data);
+      output_printf("R3: H2P: %c <%02x>\n", (data >= 32 && data < 127) ? data : '.', data);
    }
    if (reg == 7) {
       r4_h2p_state_machine(data);
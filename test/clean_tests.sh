@@ -13,4 +13,8 @@ for machine in "${machine_names[@]}"
 do
    rm -f ${machine}/*.tmp
    rm -f ${machine}/*.log
+   rm -f ${machine}/*.cycles
+   rm -f ${machine}/*.trace
+   rm -f ${machine}/*.trace.idx
+   rm -f ${machine}/*.ckpt
 done
@@ -0,0 +1,133 @@
+#!/bin/bash
+
+# Decoder throughput benchmark, using synthetic captures from gencapture
+#
+# Usage: ./run_bench.sh [-c|--cycles CYCLES] [-s|--samples-per-cycle SAMPLES]
+
+DECODE=../decode6502
+GENCAPTURE=../gencapture
+
+CYCLES=20000000
+SAMPLES_PER_CYCLE=4
+
+cpu_names=(
+    6502
+    65c816
+    6800
+)
+
+declare -A cpu_options
+
+cpu_options[6502]="--cpu=6502"
+cpu_options[65c816]="--cpu=65c816"
+cpu_options[6800]="--cpu=6800"
+
+# Pins to disconnect in the word sampling modes (the 6800 has no sync,
+# and BA is not in the synthetic captures)
+declare -A cpu_word_options
+
+cpu_word_options[6800]="--sync= --rdy="
+
+declare -A cpu_vecrst
+
+cpu_vecrst[6502]="A20400"
+cpu_vecrst[65c816]="A20400"
+cpu_vecrst[6800]="CE0004"
+
+mode_names=(
+    byte
+    sync
+    async
+)
+
+declare -A mode_options
+
+mode_options[byte]="--byte"
+mode_options[sync]="--phi2="
+mode_options[async]=""
+
+# Each stage adds to the work done by the previous one
+stage_names=(
+    decode
+    memory
+    output
+)
+
+declare -A stage_options
+
+stage_options[decode]="--quiet"
+stage_options[memory]="--quiet --mem=00F"
+stage_options[output]="-h -s"
+
+# Parse the command line options
+while [[ $# -gt 0 ]]
+do
+    key="$1"
+
+    case $key in
+        -c|--cycles)
+            CYCLES="$2"
+            shift # past argument
+            shift # past value
+            ;;
+        -s|--samples-per-cycle)
+            SAMPLES_PER_CYCLE="$2"
+            shift # past argument
+            shift # past value
+            ;;
+        *)    # unknown option
+            echo "unknown option: $1"
+            exit 1
+            ;;
+    esac
+done
+
+if [[ `uname` = Darwin ]]; then
+  STATARGS=-f%z
+else
+  STATARGS=-c%s
+fi
+
+# Time in nanoseconds
+now() {
+    date +%s%N
+}
+
+echo "Running benchmark: ${CYCLES} cycles, ${SAMPLES_PER_CYCLE} samples per cycle in async mode"
+echo
+printf "%-8s %-6s %-7s %9s %10s %10s %12s\n" cpu mode stage seconds MB/s Mcycles/s instr/s
+
+for cpu in "${cpu_names[@]}"
+do
+    for mode in "${mode_names[@]}"
+    do
+        capture=bench_${cpu}_${mode}.tmp
+        options="${cpu_options[${cpu}]} ${mode_options[${mode}]}"
+        if [ "${mode}" == "byte" ]; then
+            options="${options} --vecrst=${cpu_vecrst[${cpu}]}"
+        else
+            options="${options} ${cpu_word_options[${cpu}]}"
+        fi
+        # Generate the capture, and get the number of cycles and instructions in it
+        counts=`${GENCAPTURE} --cpu=${cpu} --mode=${mode} --cycles=${CYCLES} --samples-per-cycle=${SAMPLES_PER_CYCLE} ${capture} 2>&1`
+        cycles=`echo ${counts} | cut -d' ' -f1`
+        instructions=`echo ${counts} | cut -d' ' -f3`
+        size=$(stat ${STATARGS} "${capture}")
+        # Check the capture decodes without any prediction failures
+        fail_count=`${DECODE} ${options} --quiet --mem=00F ${capture} | grep fail | wc -l`
+        if [ "${fail_count}" != "0" ]; then
+            echo -e "\e[31mFAIL\e[97m: ${cpu} ${mode}: prediction fail count: ${fail_count}"
+        fi
+        for stage in "${stage_names[@]}"
+        do
+            start=`now`
+            ${DECODE} ${options} ${stage_options[${stage}]} ${capture} > /dev/null
+            end=`now`
+            awk -v cpu=${cpu} -v mode=${mode} -v stage=${stage} -v ns=$((end - start)) -v size=${size} -v cycles=${cycles} -v instructions=${instructions} 'BEGIN {
+                t = ns / 1e9;
+                printf "%-8s %-6s %-7s %9.3f %10.1f %10.1f %12.0f\n", cpu, mode, stage, t, size / t / 1e6, cycles / t / 1e6, instructions / t;
+            }'
+        done
+        rm -f ${capture}
+    done
+done